@@ -0,0 +1,163 @@
+// ******************************************************************************
+//
+// Filename:	RenderQueue.cpp
+// Project:		Game
+// Author:		Steven Ball
+//
+// Purpose:
+//   Draw packets collected over a frame and executed together. Every packet
+//   carries a 64 bit sort key, built from its pass, transparency, material,
+//   texture, static buffer and view depth, so that after a radix sort the
+//   opaque draws come out grouped by state and front to back, followed by
+//   the transparent draws back to front.
+//
+// Revision History:
+//   Initial Revision - 18/10/26
+//
+// Copyright (c) 2005-2015, Steven Ball
+//
+// ******************************************************************************
+
+#include "RenderQueue.h"
+
+#include <string.h>
+
+
+RenderPacket::RenderPacket()
+{
+	m_sortKey = 0;
+	m_pass = 0;
+	m_transparent = false;
+	m_materialID = -1;
+	m_textureID = -1;
+	m_renderMode = RM_SOLID;
+	m_cullMode = CM_NOCULL;
+	m_lineWidth = 0.0f;
+	m_tint = Colour(1.0f, 1.0f, 1.0f, 1.0f);
+	m_tintReplacesColour = false;
+	m_applyTextureMatrix = false;
+	m_staticBufferID = -1;
+	m_firstIndex = 0;
+	m_numIndices = -1;
+}
+
+
+RenderQueue::RenderQueue()
+{
+}
+
+RenderQueue::~RenderQueue()
+{
+	Clear();
+}
+
+void RenderQueue::Clear()
+{
+	// Keeps the capacity, so a steady frame doesn't allocate
+	m_vPackets.clear();
+	m_vSortedIndices.clear();
+}
+
+void RenderQueue::AddPacket(const RenderPacket& packet)
+{
+	m_vPackets.push_back(packet);
+}
+
+void RenderQueue::Sort()
+{
+	unsigned int numPackets = (unsigned int)m_vPackets.size();
+
+	m_vSortedIndices.resize(numPackets);
+	m_vSortScratch.resize(numPackets);
+	for(unsigned int i = 0; i < numPackets; i++)
+	{
+		m_vSortedIndices[i] = i;
+	}
+
+	// Least significant digit first radix sort, a byte at a time. Each pass is stable, so equal keys keep their submission order.
+	for(int shift = 0; shift < 64; shift += 8)
+	{
+		unsigned int counts[256];
+		memset(counts, 0, sizeof(counts));
+
+		for(unsigned int i = 0; i < numPackets; i++)
+		{
+			counts[(m_vPackets[i].m_sortKey >> shift) & 0xFF]++;
+		}
+
+		// Nothing to do if every key has the same byte here, which is common for the unused high bits
+		if(numPackets == 0 || counts[(m_vPackets[0].m_sortKey >> shift) & 0xFF] == numPackets)
+		{
+			continue;
+		}
+
+		unsigned int offset = 0;
+		for(int i = 0; i < 256; i++)
+		{
+			unsigned int count = counts[i];
+			counts[i] = offset;
+			offset += count;
+		}
+
+		for(unsigned int i = 0; i < numPackets; i++)
+		{
+			unsigned int packetIndex = m_vSortedIndices[i];
+			m_vSortScratch[counts[(m_vPackets[packetIndex].m_sortKey >> shift) & 0xFF]++] = packetIndex;
+		}
+
+		m_vSortedIndices.swap(m_vSortScratch);
+	}
+}
+
+int RenderQueue::GetNumPackets()
+{
+	return (int)m_vPackets.size();
+}
+
+RenderPacket* RenderQueue::GetSortedPacket(int index)
+{
+	return &m_vPackets[m_vSortedIndices[index]];
+}
+
+unsigned long long RenderQueue::CreateSortKey(const RenderPacket& packet, float viewDepth)
+{
+	// The ids are offset by one so that -1 sorts first, ids too big for their field share a bucket with some other id.
+	// Each range of a static buffer sorts as a buffer of its own, so the draws of the same range stay next to each other.
+	unsigned long long pass = packet.m_pass & ((1ULL << PASS_BITS) - 1);
+	unsigned long long material = (unsigned long long)(packet.m_materialID + 1) & ((1ULL << MATERIAL_BITS) - 1);
+	unsigned long long texture = (unsigned long long)(packet.m_textureID + 1) & ((1ULL << TEXTURE_BITS) - 1);
+	unsigned long long staticBuffer = ((unsigned long long)(packet.m_staticBufferID + 1) + (unsigned long long)packet.m_firstIndex * 31) & ((1ULL << STATIC_BUFFER_BITS) - 1);
+
+	// The bits of a positive float sort in the same order as its value, the top ones are plenty to order draws by
+	if(!(viewDepth > 0.0f))
+	{
+		viewDepth = 0.0f;
+	}
+	unsigned int depthBits;
+	memcpy(&depthBits, &viewDepth, sizeof(depthBits));
+	unsigned long long depth = (unsigned long long)(depthBits >> (31 - DEPTH_BITS));
+
+	unsigned long long key = pass << (64 - PASS_BITS);
+
+	if(packet.m_transparent)
+	{
+		// Back to front before anything else, blending is only right in that order
+		depth = ((1ULL << DEPTH_BITS) - 1) - depth;
+
+		key |= 1ULL << (63 - PASS_BITS);
+		key |= depth << (63 - PASS_BITS - DEPTH_BITS);
+		key |= material << (63 - PASS_BITS - DEPTH_BITS - MATERIAL_BITS);
+		key |= texture << (63 - PASS_BITS - DEPTH_BITS - MATERIAL_BITS - TEXTURE_BITS);
+		key |= staticBuffer << (63 - PASS_BITS - DEPTH_BITS - MATERIAL_BITS - TEXTURE_BITS - STATIC_BUFFER_BITS);
+	}
+	else
+	{
+		// Grouped by state to keep the state changes down, then front to back so the depth test rejects what's hidden early
+		key |= material << (63 - PASS_BITS - MATERIAL_BITS);
+		key |= texture << (63 - PASS_BITS - MATERIAL_BITS - TEXTURE_BITS);
+		key |= staticBuffer << (63 - PASS_BITS - MATERIAL_BITS - TEXTURE_BITS - STATIC_BUFFER_BITS);
+		key |= depth;
+	}
+
+	return key;
+}
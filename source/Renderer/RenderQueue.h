@@ -0,0 +1,117 @@
+// ******************************************************************************
+//
+// Filename:	RenderQueue.h
+// Project:		Game
+// Author:		Steven Ball
+//
+// Purpose:
+//   Draw packets collected over a frame and executed together. Every packet
+//   carries a 64 bit sort key, built from its pass, transparency, material,
+//   texture, static buffer and view depth, so that after a radix sort the
+//   opaque draws come out grouped by state and front to back, followed by
+//   the transparent draws back to front.
+//
+// Revision History:
+//   Initial Revision - 18/10/26
+//
+// Copyright (c) 2005-2015, Steven Ball
+//
+// ******************************************************************************
+
+#pragma once
+
+#include "Renderer.h"
+
+#include <vector>
+#include <functional>
+
+using namespace std;
+
+typedef std::function<void()> RenderPacketCallback;
+
+
+class RenderPacket
+{
+public:
+	/* Public methods */
+	RenderPacket();
+
+public:
+	/* Public members */
+	// Filled in by the renderer when the packet is submitted
+	unsigned long long m_sortKey;
+	Matrix4x4 m_modelMatrix;
+	Matrix4x4 m_modelViewMatrix;
+
+	// Packets in a lower pass are always drawn first
+	unsigned int m_pass;
+
+	// Drawn with alpha blending, after all of the opaque packets in the same pass
+	bool m_transparent;
+
+	// State to draw with, -1 for no material or texture
+	int m_materialID;
+	int m_textureID;
+	RenderMode m_renderMode;
+	CullMode m_cullMode;
+	float m_lineWidth;  // 0 to leave the line width alone
+
+	// Mesh tint for the draw, see Renderer::SetMeshTint()
+	Colour m_tint;
+	bool m_tintReplacesColour;
+
+	// Load the model matrix onto the texture matrix for the draw, for shadow rendering
+	bool m_applyTextureMatrix;
+
+	// What to draw, either a static buffer or, when that is -1, the callback
+	int m_staticBufferID;
+	int m_firstIndex;
+	int m_numIndices;  // -1 for the whole static buffer
+	RenderPacketCallback m_drawCallback;
+};
+
+
+class RenderQueue
+{
+public:
+	/* Public methods */
+	RenderQueue();
+	~RenderQueue();
+
+	void Clear();
+
+	void AddPacket(const RenderPacket& packet);
+
+	// Orders the packets by their sort keys, packets with equal keys stay in submission order
+	void Sort();
+
+	int GetNumPackets();
+	RenderPacket* GetSortedPacket(int index);
+
+	static unsigned long long CreateSortKey(const RenderPacket& packet, float viewDepth);
+
+protected:
+	/* Protected methods */
+
+private:
+	/* Private methods */
+
+public:
+	/* Public members */
+	static const int PASS_BITS = 4;
+	static const int MATERIAL_BITS = 8;
+	static const int TEXTURE_BITS = 10;
+	static const int STATIC_BUFFER_BITS = 16;
+	static const int DEPTH_BITS = 24;
+
+protected:
+	/* Protected members */
+
+private:
+	/* Private members */
+	vector<RenderPacket> m_vPackets;
+
+	// Packet indices in sorted order, and the scratch space for the radix sort
+	vector<unsigned int> m_vSortedIndices;
+	vector<unsigned int> m_vSortScratch;
+};
@@ -16,8 +16,16 @@
 #include "../glew/include/GL/glew.h"
 
 #include "Renderer.h"
+#include "RenderQueue.h"
+
+#include <cstddef>
+
+const float Renderer::PACKED_POSITION_OFFSET = 0.5f;
 
 bool useGLSL = false;
+bool useBufferObjects = false;
+bool useVertexArrayObjects = false;
+bool useInstancing = false;
 bool extensions_init = false;
 bool bGeometryShader = false;
 bool bGPUShader4 = false;
@@ -61,61 +69,141 @@ Renderer::Renderer(int width, int height, int depthBits, int stencilBits)
 	m_cullMode = CM_NOCULL;
 	m_primativeMode = PM_TRIANGLES;
 	m_activeViewport = -1;
+	m_frustumCulling = false;
+	m_numFrustumCulled = 0;
+	m_numFrustumVisible = 0;
+
+	// Nothing has been loaded into GL's model view yet
+	m_loadedModelViewValid = false;
+	m_editTextureMatrix = false;
+	m_numMatrixCalls = 0;
+	m_numDrawCalls = 0;
+
+	// The GL state set up above isn't tracked, so start off with nothing known
+	InvalidateStateCache();
+	m_numStateChanges = 0;
+	m_numFilteredStateChanges = 0;
+
+	// Static buffers only keep a client side copy of their data on request
+	m_keepStaticBufferShadowCopies = false;
+
+	// Draws go straight to GL until a render queue is started
+	m_pRenderQueue = new RenderQueue();
+	m_recordingRenderQueue = false;
+	m_numRenderPackets = 0;
 
 	InitOpenGLExtensions();
+
+	// Meshes draw with their own vertex colours until a tint is set
+	m_meshTint = Colour(1.0f, 1.0f, 1.0f, 1.0f);
+	m_meshTintReplacesColour = false;
+
+	m_tintTextureID = 0;
+	unsigned char white[4] = { 255, 255, 255, 255 };
+	glGenTextures(1, &m_tintTextureID);
+	glBindTexture(GL_TEXTURE_2D, m_tintTextureID);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Falls back to a draw per packet without it
+	m_instancingProgram = 0;
+	m_instancingTintReplacesColourLocation = -1;
+	m_instanceBufferID = 0;
+	if (useInstancing)
+	{
+		CreateInstancingShader();
+	}
+
+	// Falls back to a draw per mesh without it
+	m_pRangesVertexArray = NULL;
+
+	m_skinningProgram = 0;
+	m_boneMatricesLocation = -1;
+	m_skinningTintLocation = -1;
+	m_skinningTintReplacesColourLocation = -1;
+	if (useGLSL && useBufferObjects)
+	{
+		CreateSkinningShader();
+	}
 }
 
 Renderer::~Renderer()
 {
-	unsigned int i;
+	int i;
 
 	// Delete the vertex arrays
-	for (i = 0; i < m_vertexArrays.size(); i++)
+	for (i = 0; i < m_vertexArrays.GetNumSlots(); i++)
 	{
-		delete m_vertexArrays[i];
-		m_vertexArrays[i] = 0;
+		if (m_vertexArrays.GetSlot(i))
+		{
+			ReleaseStaticBufferObjects(m_vertexArrays.GetSlot(i));
+		}
+		delete m_vertexArrays.GetSlot(i);
 	}
 
 	// Delete the viewports
-	for (i = 0; i < m_viewports.size(); i++)
+	for (i = 0; i < m_viewports.GetNumSlots(); i++)
 	{
-		delete m_viewports[i];
-		m_viewports[i] = 0;
+		delete m_viewports.GetSlot(i);
 	}
 
 	// Delete the frustums
-	for (i = 0; i < m_frustums.size(); i++)
+	for (i = 0; i < m_frustums.GetNumSlots(); i++)
 	{
-		delete m_frustums[i];
-		m_frustums[i] = 0;
+		delete m_frustums.GetSlot(i);
 	}
 
 	// Delete the materials
-	for (i = 0; i < m_materials.size(); i++)
+	for (i = 0; i < m_materials.GetNumSlots(); i++)
 	{
-		delete m_materials[i];
-		m_materials[i] = 0;
+		delete m_materials.GetSlot(i);
 	}
 
 	// Delete the textures
-	for (i = 0; i < m_textures.size(); i++)
+	for (i = 0; i < m_textures.GetNumSlots(); i++)
 	{
-		delete m_textures[i];
-		m_textures[i] = 0;
+		delete m_textures.GetSlot(i);
 	}
 
 	// Delete the lights
-	for (i = 0; i < m_lights.size(); i++)
+	for (i = 0; i < m_lights.GetNumSlots(); i++)
 	{
-		delete m_lights[i];
-		m_lights[i] = 0;
+		delete m_lights.GetSlot(i);
 	}
 
 	// Delete the FreeType fonts
-	for (i = 0; i < m_freetypeFonts.size(); i++)
+	for (i = 0; i < m_freetypeFonts.GetNumSlots(); i++)
+	{
+		delete m_freetypeFonts.GetSlot(i);
+	}
+
+	delete m_pRenderQueue;
+	m_pRenderQueue = 0;
+
+	if (m_instancingProgram != 0)
+	{
+		glDeleteProgram(m_instancingProgram);
+		m_instancingProgram = 0;
+	}
+
+	if (m_instanceBufferID != 0)
+	{
+		glDeleteBuffers(1, &m_instanceBufferID);
+		m_instanceBufferID = 0;
+	}
+
+	if (m_skinningProgram != 0)
+	{
+		glDeleteProgram(m_skinningProgram);
+		m_skinningProgram = 0;
+	}
+
+	if (m_tintTextureID != 0)
 	{
-		delete m_freetypeFonts[i];
-		m_freetypeFonts[i] = 0;
+		glDeleteTextures(1, &m_tintTextureID);
+		m_tintTextureID = 0;
 	}
 }
 
@@ -151,8 +239,8 @@ bool Renderer::CreateViewport(int bottom, int left, int width, int height, float
 	// Setup the frustum for this viewport
 	pFrustum->SetFrustum(fov, pViewport->Aspect, m_clipNear, m_clipFar);
 
-	// Push this frustum onto the list
-	m_frustums.push_back(pFrustum);
+	// Add this frustum to the pool, it is always added alongside its viewport so the two get the same handle
+	m_frustums.Add(pFrustum);
 
 	// Create the orthographic projection matrix for the viewport
 	float coordright = 1.0f;
@@ -184,11 +272,8 @@ bool Renderer::CreateViewport(int bottom, int left, int width, int height, float
 	pViewport->Projection2d.m[14] = -(m_clipFar + m_clipNear) / (m_clipFar - m_clipNear);
 	pViewport->Projection2d.m[15] = 1.0f;
 
-	// Push this viewport onto the list
-	m_viewports.push_back(pViewport);
-
-	// Return the viewport id
-	*pID = (int)m_viewports.size() - 1;
+	// Add this viewport to the pool and return its handle
+	*pID = m_viewports.Add(pViewport);
 
 	return true;
 }
@@ -196,8 +281,8 @@ bool Renderer::CreateViewport(int bottom, int left, int width, int height, float
 
 bool Renderer::ResizeViewport(unsigned int viewportid, int bottom, int left, int width, int height, float fov)
 {
-	Viewport* pViewport = m_viewports[viewportid];
-	Frustum* pFrustum = m_frustums[viewportid];
+	Viewport* pViewport = m_viewports.Get(viewportid);
+	Frustum* pFrustum = m_frustums.Get(viewportid);
 
 	pViewport->Bottom = bottom;
 	pViewport->Left = left;
@@ -263,36 +348,33 @@ void Renderer::SetRenderMode(RenderMode mode)
 	switch (mode)
 	{
 	case RM_WIREFRAME:
-		glDisable(GL_TEXTURE_2D);
-		glDisable(GL_LIGHTING);
-		glPolygonMode(GL_FRONT, GL_LINE);
-		glPolygonMode(GL_BACK, GL_LINE);
+		SetCapability(GL_TEXTURE_2D, &m_textureEnabled, false);
+		SetCapability(GL_LIGHTING, &m_lightingEnabled, false);
 		break;
 	case RM_SOLID:
-		glDisable(GL_TEXTURE_2D);
-		glDisable(GL_LIGHTING);
-		glPolygonMode(GL_FRONT, GL_FILL);
-		glPolygonMode(GL_BACK, GL_FILL);
+		SetCapability(GL_TEXTURE_2D, &m_textureEnabled, false);
+		SetCapability(GL_LIGHTING, &m_lightingEnabled, false);
 		break;
 	case RM_SHADED:
-		glDisable(GL_TEXTURE_2D);
-		glEnable(GL_LIGHTING);
-		glPolygonMode(GL_FRONT, GL_FILL);
-		glPolygonMode(GL_BACK, GL_FILL);
+		SetCapability(GL_TEXTURE_2D, &m_textureEnabled, false);
+		SetCapability(GL_LIGHTING, &m_lightingEnabled, true);
 		break;
 	case RM_TEXTURED:
-		glEnable(GL_TEXTURE_2D);
-		glDisable(GL_LIGHTING);
-		glPolygonMode(GL_FRONT, GL_FILL);
-		glPolygonMode(GL_BACK, GL_FILL);
+		SetCapability(GL_TEXTURE_2D, &m_textureEnabled, true);
+		SetCapability(GL_LIGHTING, &m_lightingEnabled, false);
 		break;
 	case RM_TEXTURED_LIGHTING:
-		glEnable(GL_TEXTURE_2D);
-		glEnable(GL_LIGHTING);
-		glPolygonMode(GL_FRONT, GL_FILL);
-		glPolygonMode(GL_BACK, GL_FILL);
+		SetCapability(GL_TEXTURE_2D, &m_textureEnabled, true);
+		SetCapability(GL_LIGHTING, &m_lightingEnabled, true);
 		break;
 	};
+
+	GLenum polygonMode = (mode == RM_WIREFRAME) ? GL_LINE : GL_FILL;
+	if (CheckStateChange(&m_polygonMode, polygonMode))
+	{
+		glPolygonMode(GL_FRONT, polygonMode);
+		glPolygonMode(GL_BACK, polygonMode);
+	}
 }
 
 void Renderer::SetPrimativeMode(PrimativeMode mode)
@@ -330,15 +412,21 @@ void Renderer::SetCullMode(CullMode mode)
 	switch (mode)
 	{
 	case CM_NOCULL:
-		glDisable(GL_CULL_FACE);
+		SetCapability(GL_CULL_FACE, &m_cullFaceEnabled, false);
 		break;
 	case CM_FRONT:
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_FRONT);
+		SetCapability(GL_CULL_FACE, &m_cullFaceEnabled, true);
+		if (CheckStateChange(&m_cullFace, GL_FRONT))
+		{
+			glCullFace(GL_FRONT);
+		}
 		break;
 	case CM_BACK:
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_BACK);
+		SetCapability(GL_CULL_FACE, &m_cullFaceEnabled, true);
+		if (CheckStateChange(&m_cullFace, GL_BACK))
+		{
+			glCullFace(GL_BACK);
+		}
 		break;
 	}
 }
@@ -361,7 +449,7 @@ void Renderer::SetPointSize(float width)
 // Projection
 bool Renderer::SetProjectionMode(ProjectionMode mode, int viewPort)
 {
-	Viewport* pVeiwport = m_viewports[viewPort];
+	Viewport* pVeiwport = m_viewports.Get(viewPort);
 	glViewport(pVeiwport->Left, pVeiwport->Bottom, pVeiwport->Width, pVeiwport->Height);
 
 	m_activeViewport = viewPort;
@@ -386,9 +474,14 @@ bool Renderer::SetProjectionMode(ProjectionMode mode, int viewPort)
 
 void Renderer::SetViewProjection()
 {
+	m_projectionMatrix = m_view * (*m_projection);
+
+	float m[16];
+	m_projectionMatrix.GetMatrix(m);
 	glMatrixMode(GL_PROJECTION);
-	MultViewProjection();
+	glLoadMatrixf(m);
 	glMatrixMode(GL_MODELVIEW);
+	m_numMatrixCalls += 3;
 }
 
 void Renderer::MultViewProjection()
@@ -417,17 +510,29 @@ bool Renderer::BeginScene(bool pixel, bool depth, bool stencil)
 {
 	ClearScene(pixel, depth, stencil);
 
+	m_numMatrixCalls = 0;
+	m_numDrawCalls = 0;
+	m_numStateChanges = 0;
+	m_numFilteredStateChanges = 0;
+	m_numRenderPackets = 0;
+	m_numFrustumCulled = 0;
+	m_numFrustumVisible = 0;
+
 	// Reset the projection and modelview matrices to be identity
 	glMatrixMode(GL_PROJECTION);
 	glLoadIdentity();
 	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
+	m_numMatrixCalls += 3;
+	m_projectionMatrix.LoadIdentity();
+
+	// Don't trust whatever was left in GL's model view last frame
+	m_loadedModelViewValid = false;
 
 	IdentityWorldMatrix();
 
 	// Start off with lighting and texturing disabled. If these are required, they need to be set explicitly
-	glDisable(GL_LIGHTING);
-	glDisable(GL_TEXTURE_2D);
+	SetCapability(GL_LIGHTING, &m_lightingEnabled, false);
+	SetCapability(GL_TEXTURE_2D, &m_textureEnabled, false);
 
 	return true;
 }
@@ -440,32 +545,50 @@ void Renderer::EndScene()
 // Push / Pop matrix stack
 void Renderer::PushMatrix()
 {
-	glPushMatrix();
+	if (m_editTextureMatrix)
+	{
+		glPushMatrix();
+		m_numMatrixCalls++;
+		return;
+	}
 
 	m_modelStack.push_back(m_model);
+	m_modelViewStack.push_back(m_modelView);
 }
 
 void Renderer::PopMatrix()
 {
-	glPopMatrix();
+	if (m_editTextureMatrix)
+	{
+		glPopMatrix();
+		m_numMatrixCalls++;
+		return;
+	}
 
 	m_model = m_modelStack.back();
 	m_modelStack.pop_back();
+	m_modelView = m_modelViewStack.back();
+	m_modelViewStack.pop_back();
 }
 
 // Matrix manipulations
 void Renderer::SetWorldMatrix(const Matrix4x4& mat)
 {
-	float m[16];
-	mat.GetMatrix(m);
-	glLoadMatrixf(m);
+	if (m_editTextureMatrix)
+	{
+		float m[16];
+		mat.GetMatrix(m);
+		glLoadMatrixf(m);
+		m_numMatrixCalls++;
+		return;
+	}
+
+	m_modelView = mat;
 }
 
 void Renderer::GetModelViewMatrix(Matrix4x4 *pMat)
 {
-	float mat[16];
-	glGetFloatv(GL_MODELVIEW_MATRIX, mat);
-	memcpy(pMat->m, mat, 16 * sizeof(float));
+	memcpy(pMat->m, m_modelView.m, 16 * sizeof(float));
 }
 
 void Renderer::GetModelMatrix(Matrix4x4 *pMat)
@@ -480,45 +603,37 @@ void Renderer::GetViewMatrix(Matrix4x4 *pMat)
 
 void Renderer::GetProjectionMatrix(Matrix4x4 *pMat)
 {
-	float mat[16];
-	glGetFloatv(GL_PROJECTION_MATRIX, mat);
-	memcpy(pMat->m, mat, 16 * sizeof(float));
-	//memcpy(pMat->m, m_projection->m, 16 * sizeof(float));
+	memcpy(pMat->m, m_projectionMatrix.m, 16 * sizeof(float));
 }
 
 void Renderer::IdentityWorldMatrix()
 {
-	glLoadIdentity();
+	if (m_editTextureMatrix)
+	{
+		glLoadIdentity();
+		m_numMatrixCalls++;
+		return;
+	}
 
 	m_model.LoadIdentity();
+	m_modelView.LoadIdentity();
 }
 
 void Renderer::MultiplyWorldMatrix(const Matrix4x4 &mat)
 {
-	float m[16];
-	mat.GetMatrix(m);
-	glMultMatrixf(m);
-
-	Matrix4x4 world(mat);
-	m_model = world * m_model;
+	MultiplyEditMatrix(mat);
 }
 
 void Renderer::TranslateWorldMatrix(float x, float y, float z)
 {
-	glTranslatef(x, y, z);
-
 	Matrix4x4 translate;
 	translate.SetTranslation(Vector3d(x, y, z));
-	m_model = translate * m_model;
+	MultiplyEditMatrix(translate);
 }
 
 void Renderer::RotateWorldMatrix(float x, float y, float z)
 {
 	// Posible gimbal lock?
-	glRotatef(z, 0.0f, 0.0f, 1.0f);
-	glRotatef(y, 0.0f, 1.0f, 0.0f);
-	glRotatef(x, 1.0f, 0.0f, 0.0f);
-
 	Matrix4x4 rotX;
 	Matrix4x4 rotY;
 	Matrix4x4 rotZ;
@@ -526,85 +641,174 @@ void Renderer::RotateWorldMatrix(float x, float y, float z)
 	rotY.SetYRotation(DegToRad(y));
 	rotZ.SetZRotation(DegToRad(z));
 
-	m_model = rotZ * rotY * rotX * m_model;
+	MultiplyEditMatrix(rotZ * rotY * rotX);
 }
 
 void Renderer::ScaleWorldMatrix(float x, float y, float z)
 {
-	glScalef(x, y, z);
-
 	Matrix4x4 scale;
 	scale.SetScale(Vector3d(x, y, z));
-	m_model = scale * m_model;
+	MultiplyEditMatrix(scale);
+}
+
+void Renderer::MultiplyEditMatrix(const Matrix4x4 &mat)
+{
+	if (m_editTextureMatrix)
+	{
+		float m[16];
+		mat.GetMatrix(m);
+		glMultMatrixf(m);
+		m_numMatrixCalls++;
+		return;
+	}
+
+	Matrix4x4 transform(mat);
+	m_model = transform * m_model;
+	m_modelView = transform * m_modelView;
+}
+
+void Renderer::ApplyModelViewMatrix()
+{
+	LoadModelViewMatrix(m_modelView);
+}
+
+void Renderer::LoadModelViewMatrix(const Matrix4x4 &modelView)
+{
+	if (m_loadedModelViewValid && memcmp(m_loadedModelView.m, modelView.m, 16 * sizeof(float)) == 0)
+	{
+		return;
+	}
+
+	float m[16];
+	modelView.GetMatrix(m);
+
+	if (m_editTextureMatrix)
+	{
+		glMatrixMode(GL_MODELVIEW);
+		glLoadMatrixf(m);
+		glMatrixMode(GL_TEXTURE);
+		m_numMatrixCalls += 3;
+	}
+	else
+	{
+		glLoadMatrixf(m);
+		m_numMatrixCalls++;
+	}
+
+	m_loadedModelView = modelView;
+	m_loadedModelViewValid = true;
+}
+
+int Renderer::GetNumMatrixCalls()
+{
+	return m_numMatrixCalls;
+}
+
+int Renderer::GetNumDrawCalls()
+{
+	return m_numDrawCalls;
 }
 
 // Texture matrix manipulations
 void Renderer::SetTextureMatrix()
 {
-	static double modelView[16];
-	static double projection[16];
-
 	// This is matrix transform every coordinate x,y,z
 	// x = x* 0.5 + 0.5 
 	// y = y* 0.5 + 0.5 
 	// z = z* 0.5 + 0.5 
 	// Moving from unit cube [-1,1] to [0,1]  
-	const GLdouble bias[16] = {
-		0.5, 0.0, 0.0, 0.0,
-		0.0, 0.5, 0.0, 0.0,
-		0.0, 0.0, 0.5, 0.0,
-		0.5, 0.5, 0.5, 1.0 };
+	float bias[16] = {
+		0.5f, 0.0f, 0.0f, 0.0f,
+		0.0f, 0.5f, 0.0f, 0.0f,
+		0.0f, 0.0f, 0.5f, 0.0f,
+		0.5f, 0.5f, 0.5f, 1.0f };
 
-	// Grab modelview and transformation matrices
-	glGetDoublev(GL_MODELVIEW_MATRIX, modelView);
-	glGetDoublev(GL_PROJECTION_MATRIX, projection);
+	// concatating all matrice into one, from our own copies of the modelview and projection matrices
+	Matrix4x4 biasMatrix(bias);
+	Matrix4x4 textureMatrix = m_modelView * m_projectionMatrix * biasMatrix;
 
+	float m[16];
+	textureMatrix.GetMatrix(m);
 
 	glMatrixMode(GL_TEXTURE);
-	glActiveTextureARB(GL_TEXTURE7);
-
-	glLoadIdentity();
-	glLoadMatrixd(bias);
-
-	// concatating all matrice into one.
-	glMultMatrixd(projection);
-	glMultMatrixd(modelView);
+	SetActiveTexture(GL_TEXTURE7);
+	glLoadMatrixf(m);
 
 	// Go back to normal matrix mode
 	glMatrixMode(GL_MODELVIEW);
+	m_numMatrixCalls += 3;
 }
 
 void Renderer::PushTextureMatrix()
 {
 	glMatrixMode(GL_TEXTURE);
-	glActiveTextureARB(GL_TEXTURE7);
+	SetActiveTexture(GL_TEXTURE7);
 	glPushMatrix();
+	m_numMatrixCalls += 2;
+
+	m_editTextureMatrix = true;
 }
 
 void Renderer::PopTextureMatrix()
 {
 	glPopMatrix();
 	glMatrixMode(GL_MODELVIEW);
+	m_numMatrixCalls += 2;
+
+	m_editTextureMatrix = false;
 }
 
 // Camera functionality
 void Renderer::SetLookAtCamera(Vector3d pos, Vector3d target, Vector3d up)
 {
-	gluLookAt(pos.x, pos.y, pos.z, target.x, target.y, target.z, up.x, up.y, up.z);
+	// The same matrix as gluLookAt(), the camera only goes on the model view and not the model matrix
+	Vector3d forward = (target - pos).GetUnit();
+	Vector3d side = Vector3d::CrossProduct(forward, up).GetUnit();
+	Vector3d cameraUp = Vector3d::CrossProduct(side, forward);
+
+	float lookAt[16] = {
+		side.x, cameraUp.x, -forward.x, 0.0f,
+		side.y, cameraUp.y, -forward.y, 0.0f,
+		side.z, cameraUp.z, -forward.z, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f };
+
+	Matrix4x4 rotation(lookAt);
+	Matrix4x4 translation;
+	translation.SetTranslation(Vector3d(-pos.x, -pos.y, -pos.z));
+	Matrix4x4 camera = translation * rotation;
+
+	if (m_editTextureMatrix)
+	{
+		MultiplyEditMatrix(camera);
+		return;
+	}
+
+	m_modelView = camera * m_modelView;
 }
 
 // Transparency
 void Renderer::EnableTransparency(BlendFunction source, BlendFunction destination)
 {
-	glDisable(GL_DEPTH_WRITEMASK);
-	glEnable(GL_BLEND);
-	glBlendFunc(GetBlendEnum(source), GetBlendEnum(destination));
+	SetCapability(GL_BLEND, &m_blendEnabled, true);
+
+	GLenum glSource = GetBlendEnum(source);
+	GLenum glDestination = GetBlendEnum(destination);
+	if (m_blendSource == (int)glSource && m_blendDestination == (int)glDestination)
+	{
+		m_numFilteredStateChanges++;
+	}
+	else
+	{
+		glBlendFunc(glSource, glDestination);
+		m_blendSource = glSource;
+		m_blendDestination = glDestination;
+		m_numStateChanges++;
+	}
 }
 
 void Renderer::DisableTransparency()
 {
-	glDisable(GL_BLEND);
-	glEnable(GL_DEPTH_WRITEMASK);
+	SetCapability(GL_BLEND, &m_blendEnabled, false);
 }
 
 GLenum Renderer::GetBlendEnum(BlendFunction flag)
@@ -632,14 +836,18 @@ GLenum Renderer::GetBlendEnum(BlendFunction flag)
 // Depth testing
 void Renderer::EnableDepthTest(DepthTest lTestFunction)
 {
-	glEnable(GL_DEPTH_TEST);
+	SetCapability(GL_DEPTH_TEST, &m_depthTestEnabled, true);
 
-	glDepthFunc(GetDepthTest(lTestFunction));
+	GLenum depthFunction = GetDepthTest(lTestFunction);
+	if (CheckStateChange(&m_depthFunction, depthFunction))
+	{
+		glDepthFunc(depthFunction);
+	}
 }
 
 void Renderer::DisableDepthTest()
 {
-	glDisable(GL_DEPTH_TEST);
+	SetCapability(GL_DEPTH_TEST, &m_depthTestEnabled, false);
 }
 
 GLenum Renderer::GetDepthTest(DepthTest lTest)
@@ -678,12 +886,18 @@ GLenum Renderer::GetDepthTest(DepthTest lTest)
 
 void Renderer::EnableDepthWrite()
 {
-	glDepthMask(GL_TRUE);
+	if (CheckStateChange(&m_depthMask, GL_TRUE))
+	{
+		glDepthMask(GL_TRUE);
+	}
 }
 
 void Renderer::DisableDepthWrite()
 {
-	glDepthMask(GL_FALSE);
+	if (CheckStateChange(&m_depthMask, GL_FALSE))
+	{
+		glDepthMask(GL_FALSE);
+	}
 }
 
 // Immediate mode
@@ -724,7 +938,10 @@ void Renderer::EnableImmediateMode(ImmediateModePrimitive mode)
 		break;
 	}
 
+	ApplyModelViewMatrix();
+
 	glBegin(glMode);
+	m_numDrawCalls++;
 }
 
 void Renderer::ImmediateVertex(float x, float y, float z)
@@ -770,9 +987,11 @@ bool Renderer::CreateFreeTypeFont(char *fontName, int fontSize, unsigned int *pI
 	// Build the new freetype font
 	font->BuildFont(fontName, fontSize);
 
-	// Push this font onto the list of fonts and return the id
-	m_freetypeFonts.push_back(font);
-	*pID = (unsigned int)m_freetypeFonts.size() - 1;
+	// Building the glyph textures binds them
+	InvalidateStateCache();
+
+	// Add this font to the pool and return its handle
+	*pID = m_freetypeFonts.Add(font);
 
 	return true;
 }
@@ -798,10 +1017,16 @@ bool Renderer::RenderFreeTypeText(unsigned int fontID, float x, float y, float z
 	// HACK : The descent has rounding errors and is usually off by about 1 pixel
 	y -= 1;
 
+	// The font moves GL's model view along as it draws each glyph, so it still uses GL's stack
+	ApplyModelViewMatrix();
 	glPushMatrix();
 		glTranslatef(x, y, 0);
-		m_freetypeFonts[fontID]->DrawString(outText, scale);
+		m_freetypeFonts.Get(fontID)->DrawString(outText, scale);
 	glPopMatrix();
+	m_numMatrixCalls += 3;
+
+	// The font sets its own blend function and binds its glyph textures
+	InvalidateStateCache();
 
 	glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
 
@@ -821,22 +1046,27 @@ int Renderer::GetFreeTypeTextWidth(unsigned int fontID, char *inText, ...)
 		vsprintf_s(outText, inText, ap);
 	va_end(ap);
 
-	return m_freetypeFonts[fontID]->GetTextWidth(outText);
+	int width = m_freetypeFonts.Get(fontID)->GetTextWidth(outText);
+
+	// Measuring draws the glyphs, which binds their textures
+	InvalidateStateCache();
+
+	return width;
 }
 
 int Renderer::GetFreeTypeTextHeight(unsigned int fontID, char *inText, ...)
 {
-	return m_freetypeFonts[fontID]->GetCharHeight('a');
+	return m_freetypeFonts.Get(fontID)->GetCharHeight('a');
 }
 
 int Renderer::GetFreeTypeTextAscent(unsigned int fontID)
 {
-	return m_freetypeFonts[fontID]->GetAscent();
+	return m_freetypeFonts.Get(fontID)->GetAscent();
 }
 
 int Renderer::GetFreeTypeTextDescent(unsigned int fontID)
 {
-	return m_freetypeFonts[fontID]->GetDescent();
+	return m_freetypeFonts.Get(fontID)->GetDescent();
 }
 
 // Lighting
@@ -857,18 +1087,15 @@ bool Renderer::CreateLight(const Colour &ambient, const Colour &diffuse, const C
 	pLight->Point(point);
 	pLight->Spotlight(spot);
 
-	// Push the light onto the list
-	m_lights.push_back(pLight);
-
-	// Return the light id
-	*pID = (int)m_lights.size() - 1;
+	// Add the light to the pool and return its handle
+	*pID = m_lights.Add(pLight);
 
 	return true;
 }
 
 bool Renderer::EditLight(unsigned int id, const Colour &ambient, const Colour &diffuse, const Colour &specular, Vector3d &position, Vector3d &direction, float exponent, float cutoff, float cAtten, float lAtten, float qAtten, bool point, bool spot)
 {
-	Light *pLight = m_lights[id];
+	Light *pLight = m_lights.Get(id);
 
 	pLight->Ambient(ambient);
 	pLight->Diffuse(diffuse);
@@ -883,77 +1110,124 @@ bool Renderer::EditLight(unsigned int id, const Colour &ambient, const Colour &d
 	pLight->Point(point);
 	pLight->Spotlight(spot);
 
+	InvalidateLight(id);
+
 	return true;
 }
 
 bool Renderer::EditLightPosition(unsigned int id, Vector3d &position)
 {
-	Light *pLight = m_lights[id];
+	Light *pLight = m_lights.Get(id);
 
 	pLight->Position(position);
 
+	InvalidateLight(id);
+
 	return true;
 }
 
 void Renderer::DeleteLight(unsigned int id)
 {
-	if (m_lights[id]) {
-		delete m_lights[id];
-		m_lights[id] = 0;
-	}
+	delete m_lights.Remove(id);
+
+	InvalidateLight(id);
 }
 
 void Renderer::EnableLight(unsigned int id, unsigned int lightNumber)
 {
-	if (m_lights[id])
+	if (m_lights.Get(id))
 	{
-		m_lights[id]->Apply(lightNumber);
+		// The light position is transformed by the current model view
+		ApplyModelViewMatrix();
+
+		if (lightNumber < MAX_CACHED_LIGHTS)
+		{
+			if (m_appliedLights[lightNumber] == (int)id && memcmp(m_appliedLightModelViews[lightNumber].m, m_loadedModelView.m, 16 * sizeof(float)) == 0)
+			{
+				m_numFilteredStateChanges++;
+				return;
+			}
+
+			m_appliedLights[lightNumber] = id;
+			m_appliedLightModelViews[lightNumber] = m_loadedModelView;
+		}
+
+		m_lights.Get(id)->Apply(lightNumber);
+		m_numStateChanges++;
 	}
 }
 
 void Renderer::DisableLight(unsigned int lightNumber)
 {
+	if (lightNumber < MAX_CACHED_LIGHTS)
+	{
+		if (CheckStateChange(&m_appliedLights[lightNumber], -2) == false)
+		{
+			return;
+		}
+	}
+	else
+	{
+		m_numStateChanges++;
+	}
+
 	glDisable(GL_LIGHT0 + lightNumber);
 }
 
+void Renderer::InvalidateLight(unsigned int id)
+{
+	// The light has to be applied again the next time it is enabled
+	for (int i = 0; i < MAX_CACHED_LIGHTS; i++)
+	{
+		if (m_appliedLights[i] == (int)id)
+		{
+			m_appliedLights[i] = -1;
+		}
+	}
+}
+
 void Renderer::RenderLight(unsigned int id)
 {
-	m_lights[id]->Render();
+	ApplyModelViewMatrix();
+	m_lights.Get(id)->Render();
+
+	// Drawing the light turns lighting off
+	InvalidateStateCache();
 }
 
 Colour Renderer::GetLightAmbient(unsigned int id)
 {
-	return m_lights[id]->Ambient();
+	return m_lights.Get(id)->Ambient();
 }
 
 Colour Renderer::GetLightDiffuse(unsigned int id)
 {
-	return m_lights[id]->Diffuse();
+	return m_lights.Get(id)->Diffuse();
 }
 
 Colour Renderer::GetLightSpecular(unsigned int id)
 {
-	return m_lights[id]->Specular();
+	return m_lights.Get(id)->Specular();
 }
 
 Vector3d Renderer::GetLightPosition(unsigned int id)
 {
-	return m_lights[id]->Position();
+	return m_lights.Get(id)->Position();
 }
 
 float Renderer::GetConstantAttenuation(unsigned int id)
 {
-	return m_lights[id]->ConstantAttenuation();
+	return m_lights.Get(id)->ConstantAttenuation();
 }
 
 float Renderer::GetLinearAttenuation(unsigned int id)
 {
-	return m_lights[id]->LinearAttenuation();
+	return m_lights.Get(id)->LinearAttenuation();
 }
 
 float Renderer::GetQuadraticAttenuation(unsigned int id)
 {
-	return m_lights[id]->QuadraticAttenuation();
+	return m_lights.Get(id)->QuadraticAttenuation();
 }
 
 // Materials
@@ -967,18 +1241,15 @@ bool Renderer::CreateMaterial(const Colour &ambient, const Colour &diffuse, cons
 	pMaterial->Emission(emmisive);
 	pMaterial->Shininess(specularPower);
 
-	// Push the material onto the list
-	m_materials.push_back(pMaterial);
-
-	// Return the material id
-	*pID = (int)m_materials.size() - 1;
+	// Add the material to the pool and return its handle
+	*pID = m_materials.Add(pMaterial);
 
 	return true;
 }
 
 bool Renderer::EditMaterial(unsigned int id, const Colour &ambient, const Colour &diffuse, const Colour &specular, const Colour &emmisive, float specularPower)
 {
-	Material *pMaterial = m_materials[id];
+	Material *pMaterial = m_materials.Get(id);
 
 	pMaterial->Ambient(ambient);
 	pMaterial->Diffuse(diffuse);
@@ -986,20 +1257,37 @@ bool Renderer::EditMaterial(unsigned int id, const Colour &ambient, const Colour
 	pMaterial->Emission(emmisive);
 	pMaterial->Shininess(specularPower);
 
+	// The material has to be applied again the next time it is enabled
+	if (m_appliedMaterial == (int)id)
+	{
+		m_appliedMaterial = -1;
+	}
+
 	return true;
 }
 
 void Renderer::EnableMaterial(unsigned int id)
 {
-	m_materials[id]->Apply();
+	Material *pMaterial = m_materials.Get(id);
+
+	if (pMaterial == NULL)
+	{
+		return;  // We have supplied an invalid id
+	}
+
+	if (CheckStateChange(&m_appliedMaterial, id))
+	{
+		pMaterial->Apply();
+	}
 }
 
 void Renderer::DeleteMaterial(unsigned int id)
 {
-	if (m_materials[id])
+	delete m_materials.Remove(id);
+
+	if (m_appliedMaterial == (int)id)
 	{
-		delete m_materials[id];
-		m_materials[id] = 0;
+		m_appliedMaterial = -1;
 	}
 }
 
@@ -1007,15 +1295,16 @@ void Renderer::DeleteMaterial(unsigned int id)
 bool Renderer::LoadTexture(string fileName, int *width, int *height, int *width_power2, int *height_power2, unsigned int *pID)
 {
 	// Check that this texture hasn't already been loaded
-	for (unsigned int i = 0; i < m_textures.size(); i++)
+	for (int i = 0; i < m_textures.GetNumSlots(); i++)
 	{
-		if (m_textures[i]->GetFileName() == fileName)
+		Texture *pLoadedTexture = m_textures.GetSlot(i);
+		if (pLoadedTexture != NULL && pLoadedTexture->GetFileName() == fileName)
 		{
-			*width = m_textures[i]->GetWidth();
-			*height = m_textures[i]->GetHeight();
-			*width_power2 = m_textures[i]->GetWidthPower2();
-			*height_power2 = m_textures[i]->GetHeightPower2();
-			*pID = i;
+			*width = pLoadedTexture->GetWidth();
+			*height = pLoadedTexture->GetHeight();
+			*width_power2 = pLoadedTexture->GetWidthPower2();
+			*height_power2 = pLoadedTexture->GetHeightPower2();
+			*pID = m_textures.GetSlotHandle(i);
 
 			return true;
 		}
@@ -1024,36 +1313,40 @@ bool Renderer::LoadTexture(string fileName, int *width, int *height, int *width_
 	// Texture hasn't already been loaded, create and load it!
 	Texture *pTexture = new Texture();
 	pTexture->Load(fileName, width, height, width_power2, height_power2, false);
+	m_boundTexture = -1;  // Loading binds the texture
 
-	// Push the vertex array onto the list
-	m_textures.push_back(pTexture);
-
-	// Return the vertex array id
-	*pID = (int)m_textures.size() - 1;
+	// Add the texture to the pool and return its handle
+	*pID = m_textures.Add(pTexture);
 
 	return true;
 }
 
 bool Renderer::RefreshTexture(unsigned int id)
 {
-	Texture *pTexture = m_textures[id];
+	Texture *pTexture = m_textures.Get(id);
+
+	if (pTexture == NULL)
+	{
+		return false;  // We have supplied an invalid id
+	}
 
 	int width;
 	int height;
 	int width_power2;
 	int height_power2;
 	pTexture->Load(pTexture->GetFileName(), &width, &height, &width_power2, &height_power2, true);
+	m_boundTexture = -1;  // Loading binds the texture
 
 	return true;
 }
 
 bool Renderer::RefreshTexture(string filename)
 {
-	for (unsigned int i = 0; i < m_textures.size(); i++)
+	for (int i = 0; i < m_textures.GetNumSlots(); i++)
 	{
-		if (m_textures[i]->GetFileName() == filename)
+		if (m_textures.GetSlot(i) != NULL && m_textures.GetSlot(i)->GetFileName() == filename)
 		{
-			return RefreshTexture(i);
+			return RefreshTexture(m_textures.GetSlotHandle(i));
 		}
 	}
 
@@ -1062,24 +1355,31 @@ bool Renderer::RefreshTexture(string filename)
 
 void Renderer::BindTexture(unsigned int id)
 {
-	glEnable(GL_TEXTURE_2D);
-	m_textures[id]->Bind();
+	Texture *pTexture = m_textures.Get(id);
+
+	if (pTexture == NULL)
+	{
+		return;  // We have supplied an invalid id
+	}
+
+	SetCapability(GL_TEXTURE_2D, &m_textureEnabled, true);
+	SetBoundTexture(pTexture->GetId());
 }
 
 void Renderer::DisableTexture()
 {
-	glDisable(GL_TEXTURE_2D);
+	SetCapability(GL_TEXTURE_2D, &m_textureEnabled, false);
 }
 
 Texture* Renderer::GetTexture(unsigned int id)
 {
-	return m_textures[id];
+	return m_textures.Get(id);
 }
 
 void Renderer::BindRawTextureId(unsigned int textureId)
 {
-	glEnable(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, textureId);
+	SetCapability(GL_TEXTURE_2D, &m_textureEnabled, true);
+	SetBoundTexture(textureId);
 }
 
 void Renderer::GenerateEmptyTexture(unsigned int *pID)
@@ -1087,21 +1387,18 @@ void Renderer::GenerateEmptyTexture(unsigned int *pID)
 	Texture *pTexture = new Texture();
 	pTexture->GenerateEmptyTexture();
 
-	// Push the vertex array onto the list
-	m_textures.push_back(pTexture);
-
-	// Return the vertex array id
-	*pID = (int)m_textures.size() - 1;
+	// Add the texture to the pool and return its handle
+	*pID = m_textures.Add(pTexture);
 }
 
 void Renderer::SetTextureData(unsigned int id, int width, int height, unsigned char *texdata)
 {
-	glEnable(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, m_textures[id]->GetId());
+	SetCapability(GL_TEXTURE_2D, &m_textureEnabled, true);
+	SetBoundTexture(m_textures.Get(id)->GetId());
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, texdata);
-	glDisable(GL_TEXTURE_2D);
+	SetCapability(GL_TEXTURE_2D, &m_textureEnabled, false);
 }
 
 // Vertex buffers
@@ -1109,170 +1406,96 @@ bool Renderer::CreateStaticBuffer(VertexType type, unsigned int materialID, unsi
 {
 	VertexArray *pVertexArray = new VertexArray();
 
-	pVertexArray->nIndices = nIndices;
-	pVertexArray->nVerts = nVerts;
-	pVertexArray->nTextureCoordinates = nTextureCoordinates;
-	pVertexArray->materialID = materialID;
-	pVertexArray->textureID = textureID;
-	pVertexArray->type = type;
+	SetupStaticBuffer(pVertexArray, type, materialID, textureID, nVerts, nTextureCoordinates, nIndices, pVerts, pTextureCoordinates, pIndices);
 
-	// Get the correct vertex size and construct the vertex array to hold the vertices
-	if (nVerts)
-	{
-		switch (type)
-		{
-		case VT_POSITION:
-			pVertexArray->vertexSize = sizeof(OGLPositionVertex);
-			pVertexArray->pVA = new float[nVerts * 3];
-			break;
-		case VT_POSITION_DIFFUSE:
-			pVertexArray->vertexSize = sizeof(OGLPositionDiffuseVertex);
-			pVertexArray->pVA = new float[nVerts * 6];
-			break;
-		case VT_POSITION_DIFFUSE_ALPHA:
-			pVertexArray->vertexSize = sizeof(OGLPositionDiffuseAlphaVertex);
-			pVertexArray->pVA = new float[nVerts * 7];
-			break;
-		case VT_POSITION_NORMAL:
-			pVertexArray->vertexSize = sizeof(OGLPositionNormalVertex);
-			pVertexArray->pVA = new float[nVerts * 6];
-			break;
-		case VT_POSITION_NORMAL_COLOUR:
-			pVertexArray->vertexSize = sizeof(OGLPositionNormalColourVertex);
-			pVertexArray->pVA = new float[nVerts * 10];
-			break;
-		case VT_POSITION_NORMAL_UV:
-			pVertexArray->vertexSize = sizeof(OGLPositionNormalVertex);
-			pVertexArray->pVA = new float[nVerts * 6];
-			pVertexArray->textureCoordinateSize = sizeof(OGLUVCoordinate);
-			pVertexArray->pTextureCoordinates = new float[nTextureCoordinates * 2];
-			break;
-		case VT_POSITION_NORMAL_UV_COLOUR:
-			pVertexArray->vertexSize = sizeof(OGLPositionNormalColourVertex);
-			pVertexArray->pVA = new float[nVerts * 10];
-			pVertexArray->textureCoordinateSize = sizeof(OGLUVCoordinate);
-			pVertexArray->pTextureCoordinates = new float[nTextureCoordinates * 2];
-			break;
-		}
-	}
+	// Add the vertex array to the pool and return its handle
+	*pID = m_vertexArrays.Add(pVertexArray);
 
+	return true;
+}
 
-	// If we have indices, create the indices array to hold the information
-	if (nIndices)
+bool Renderer::RecreateStaticBuffer(unsigned int ID, VertexType type, unsigned int materialID, unsigned int textureID, int nVerts, int nTextureCoordinates, int nIndices, const void *pVerts, const void *pTextureCoordinates, const unsigned int *pIndices)
+{
+	if (m_vertexArrays.IsValid(ID) == false)
 	{
-		pVertexArray->pIndices = new unsigned int[nIndices];
+		return false;  // We have supplied an invalid id
 	}
 
-	// Copy the vertices into the vertex array
-	memcpy(pVertexArray->pVA, pVerts, pVertexArray->vertexSize*nVerts);
-
-	// Copt the texture coordinates into the texture array
-	memcpy(pVertexArray->pTextureCoordinates, pTextureCoordinates, pVertexArray->textureCoordinateSize*nTextureCoordinates);
+	// Swap a new vertex array into the same slot, so the handle stays the same
+	VertexArray *pVertexArray = new VertexArray();
+	VertexArray *pOldVertexArray = m_vertexArrays.Replace(ID, pVertexArray);
 
-	// Copy the indices into the vertex array
-	memcpy(pVertexArray->pIndices, pIndices, sizeof(unsigned int)*nIndices);
+	// Hand the buffer objects over to the new array, they are simply refilled rather than being recreated
+	pVertexArray->vertexBufferID = pOldVertexArray->vertexBufferID;
+	pVertexArray->textureCoordinateBufferID = pOldVertexArray->textureCoordinateBufferID;
+	pVertexArray->indexBufferID = pOldVertexArray->indexBufferID;
+	pVertexArray->vertexArrayID = pOldVertexArray->vertexArrayID;
 
-	// Push the vertex array onto the list
-	m_vertexArrays.push_back(pVertexArray);
+	delete pOldVertexArray;
 
-	// Return the vertex array id
-	*pID = (int)m_vertexArrays.size() - 1;
+	SetupStaticBuffer(pVertexArray, type, materialID, textureID, nVerts, nTextureCoordinates, nIndices, pVerts, pTextureCoordinates, pIndices);
 
 	return true;
 }
 
-bool Renderer::RecreateStaticBuffer(unsigned int ID, VertexType type, unsigned int materialID, unsigned int textureID, int nVerts, int nTextureCoordinates, int nIndices, const void *pVerts, const void *pTextureCoordinates, const unsigned int *pIndices)
+bool Renderer::UpdateStaticBuffer(unsigned int id, int firstVertex, int nVerts, const void *pVerts)
 {
-	// Create a new vertex array
-	m_vertexArrays[ID] = new VertexArray();
-
-	// Get this already existing array pointer from the list
-	VertexArray *pVertexArray = m_vertexArrays[ID];
-
-	pVertexArray->nIndices = nIndices;
-	pVertexArray->nVerts = nVerts;
-	pVertexArray->nTextureCoordinates = nTextureCoordinates;
-	pVertexArray->materialID = materialID;
-	pVertexArray->textureID = textureID;
-	pVertexArray->type = type;
+	VertexArray *pVertexArray = m_vertexArrays.Get(id);
 
-	// Get the correct vertex size and construct the vertex array to hold the vertices
-	if (nVerts)
+	if (pVertexArray == NULL)
 	{
-		switch (type)
-		{
-		case VT_POSITION:
-			pVertexArray->vertexSize = sizeof(OGLPositionVertex);
-			pVertexArray->pVA = new float[nVerts * 3];
-			break;
-		case VT_POSITION_DIFFUSE:
-			pVertexArray->vertexSize = sizeof(OGLPositionDiffuseVertex);
-			pVertexArray->pVA = new float[nVerts * 6];
-			break;
-		case VT_POSITION_DIFFUSE_ALPHA:
-			pVertexArray->vertexSize = sizeof(OGLPositionDiffuseAlphaVertex);
-			pVertexArray->pVA = new float[nVerts * 7];
-			break;
-		case VT_POSITION_NORMAL:
-			pVertexArray->vertexSize = sizeof(OGLPositionNormalVertex);
-			pVertexArray->pVA = new float[nVerts * 6];
-			break;
-		case VT_POSITION_NORMAL_COLOUR:
-			pVertexArray->vertexSize = sizeof(OGLPositionNormalColourVertex);
-			pVertexArray->pVA = new float[nVerts * 10];
-			break;
-		case VT_POSITION_NORMAL_UV:
-			pVertexArray->vertexSize = sizeof(OGLPositionNormalVertex);
-			pVertexArray->pVA = new float[nVerts * 6];
-			pVertexArray->textureCoordinateSize = sizeof(OGLUVCoordinate);
-			pVertexArray->pTextureCoordinates = new float[nTextureCoordinates * 2];
-			break;
-		case VT_POSITION_NORMAL_UV_COLOUR:
-			pVertexArray->vertexSize = sizeof(OGLPositionNormalColourVertex);
-			pVertexArray->pVA = new float[nVerts * 10];
-			pVertexArray->textureCoordinateSize = sizeof(OGLUVCoordinate);
-			pVertexArray->pTextureCoordinates = new float[nTextureCoordinates * 2];
-			break;
-		}
+		return false;  // We have supplied an invalid id
 	}
 
-
-	// If we have indices, create the indices array to hold the information
-	if (nIndices)
+	if (firstVertex < 0 || nVerts < 0 || firstVertex + nVerts > pVertexArray->nVerts)
 	{
-		pVertexArray->pIndices = new unsigned int[nIndices];
+		return false;
 	}
 
-	// Copy the vertices into the vertex array
-	memcpy(pVertexArray->pVA, pVerts, pVertexArray->vertexSize*nVerts);
+	int offset = pVertexArray->vertexSize*firstVertex;
+	int size = pVertexArray->vertexSize*nVerts;
 
-	// Copt the texture coordinates into the texture array
-	memcpy(pVertexArray->pTextureCoordinates, pTextureCoordinates, pVertexArray->textureCoordinateSize*nTextureCoordinates);
+	if (pVertexArray->pVA != NULL)
+	{
+		memcpy((char*)pVertexArray->pVA + offset, pVerts, size);
+	}
 
-	// Copy the indices into the vertex array
-	memcpy(pVertexArray->pIndices, pIndices, sizeof(unsigned int)*nIndices);
+	if (pVertexArray->vertexBufferID != 0)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, pVertexArray->vertexBufferID);
+		glBufferSubData(GL_ARRAY_BUFFER, offset, size, pVerts);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
 
 	return true;
 }
 
 void Renderer::DeleteStaticBuffer(unsigned int id)
 {
-	if (m_vertexArrays[id])
+	VertexArray *pVertexArray = m_vertexArrays.Remove(id);
+
+	if (pVertexArray != NULL)
 	{
-		delete m_vertexArrays[id];
-		m_vertexArrays[id] = 0;
+		ReleaseStaticBufferObjects(pVertexArray);
+
+		delete pVertexArray;
 	}
 }
 
-bool Renderer::RenderStaticBuffer(unsigned int id)
+void Renderer::SetKeepStaticBufferShadowCopies(bool keep)
 {
-	if (id >= m_vertexArrays.size())
-	{
-		return false;  // We have supplied an invalid id
-	}
+	m_keepStaticBufferShadowCopies = keep;
+}
 
-	// Find the vertex array from the list
-	VertexArray *pVertexArray = m_vertexArrays[id];
+bool Renderer::GetKeepStaticBufferShadowCopies()
+{
+	return m_keepStaticBufferShadowCopies;
+}
+
+bool Renderer::RenderStaticBuffer(unsigned int id, int firstIndex, int numIndices)
+{
+	// Find the vertex array from the pool, NULL for an invalid id
+	VertexArray *pVertexArray = m_vertexArrays.Get(id);
 
 	if (pVertexArray != NULL)
 	{
@@ -1280,7 +1503,7 @@ bool Renderer::RenderStaticBuffer(unsigned int id)
 		{
 			if (pVertexArray->materialID != -1)
 			{
-				m_materials[pVertexArray->materialID]->Apply();
+				EnableMaterial(pVertexArray->materialID);
 			}
 		}
 
@@ -1292,50 +1515,9 @@ bool Renderer::RenderStaticBuffer(unsigned int id)
 			}
 		}
 
-		// Calculate the stride
-		GLsizei totalStride = GetStride(pVertexArray->type);
-
-		glEnableClientState(GL_VERTEX_ARRAY);
-		glVertexPointer(3, GL_FLOAT, totalStride, pVertexArray->pVA);
-
-		if (pVertexArray->type == VT_POSITION_NORMAL || pVertexArray->type == VT_POSITION_NORMAL_UV || pVertexArray->type == VT_POSITION_NORMAL_UV_COLOUR || pVertexArray->type == VT_POSITION_NORMAL_COLOUR)
-		{
-			glEnableClientState(GL_NORMAL_ARRAY);
-			glNormalPointer(GL_FLOAT, totalStride, &pVertexArray->pVA[3]);
-		}
-
-		if (pVertexArray->type == VT_POSITION_NORMAL_UV || pVertexArray->type == VT_POSITION_NORMAL_UV_COLOUR)
-		{
-			glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-			glTexCoordPointer(2, GL_FLOAT, 0, pVertexArray->pTextureCoordinates);
-		}
-
-		if (pVertexArray->type == VT_POSITION_DIFFUSE_ALPHA)
-		{
-			glEnableClientState(GL_COLOR_ARRAY);
-			glColorPointer(4, GL_FLOAT, totalStride, &pVertexArray->pVA[3]);
-		}
-
-		if (pVertexArray->type == VT_POSITION_DIFFUSE)
-		{
-			glEnableClientState(GL_COLOR_ARRAY);
-			glColorPointer(3, GL_FLOAT, totalStride, &pVertexArray->pVA[3]);
-		}
-
-		if (pVertexArray->type == VT_POSITION_NORMAL_UV_COLOUR || pVertexArray->type == VT_POSITION_NORMAL_COLOUR)
-		{
-			glEnableClientState(GL_COLOR_ARRAY);
-			glColorPointer(4, GL_FLOAT, totalStride, &pVertexArray->pVA[6]);
-		}
-
-		if (pVertexArray->nIndices != 0)
-		{
-			glDrawElements(m_primativeMode, pVertexArray->nIndices, GL_UNSIGNED_INT, pVertexArray->pIndices);
-		}
-		else
-		{
-			glDrawArrays(m_primativeMode, 0, pVertexArray->nVerts);
-		}
+		BindStaticBuffer(pVertexArray, true, true);
+		DrawStaticBuffer(pVertexArray, firstIndex, numIndices);
+		UnbindStaticBuffer(pVertexArray, true);
 
 		glDisableClientState(GL_VERTEX_ARRAY);
 		glDisableClientState(GL_NORMAL_ARRAY);
@@ -1348,15 +1530,10 @@ bool Renderer::RenderStaticBuffer(unsigned int id)
 	return false;
 }
 
-bool Renderer::RenderStaticBuffer_NoColour(unsigned int id)
+bool Renderer::RenderStaticBuffer_NoColour(unsigned int id, int firstIndex, int numIndices)
 {
-	if (id >= m_vertexArrays.size())
-	{
-		return false;  // We have supplied an invalid id
-	}
-
-	// Find the vertex array from the list
-	VertexArray *pVertexArray = m_vertexArrays[id];
+	// Find the vertex array from the pool, NULL for an invalid id
+	VertexArray *pVertexArray = m_vertexArrays.Get(id);
 
 	if (pVertexArray != NULL)
 	{
@@ -1364,7 +1541,7 @@ bool Renderer::RenderStaticBuffer_NoColour(unsigned int id)
 		{
 			if (pVertexArray->materialID != -1)
 			{
-				m_materials[pVertexArray->materialID]->Apply();
+				EnableMaterial(pVertexArray->materialID);
 			}
 		}
 
@@ -1376,50 +1553,9 @@ bool Renderer::RenderStaticBuffer_NoColour(unsigned int id)
 			}
 		}
 
-		// Calculate the stride
-		GLsizei totalStride = GetStride(pVertexArray->type);
-
-		glEnableClientState(GL_VERTEX_ARRAY);
-		glVertexPointer(3, GL_FLOAT, totalStride, pVertexArray->pVA);
-
-		if (pVertexArray->type == VT_POSITION_NORMAL || pVertexArray->type == VT_POSITION_NORMAL_UV || pVertexArray->type == VT_POSITION_NORMAL_UV_COLOUR || pVertexArray->type == VT_POSITION_NORMAL_COLOUR)
-		{
-			glEnableClientState(GL_NORMAL_ARRAY);
-			glNormalPointer(GL_FLOAT, totalStride, &pVertexArray->pVA[3]);
-		}
-
-		if (pVertexArray->type == VT_POSITION_NORMAL_UV || pVertexArray->type == VT_POSITION_NORMAL_UV_COLOUR)
-		{
-			glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-			glTexCoordPointer(2, GL_FLOAT, 0, pVertexArray->pTextureCoordinates);
-		}
-
-		if (pVertexArray->type == VT_POSITION_DIFFUSE_ALPHA)
-		{
-			//glEnableClientState(GL_COLOR_ARRAY);
-			//glColorPointer(4, GL_FLOAT, totalStride, &pVertexArray->pVA[3]);
-		}
-
-		if (pVertexArray->type == VT_POSITION_DIFFUSE)
-		{
-			//glEnableClientState(GL_COLOR_ARRAY);
-			//glColorPointer(3, GL_FLOAT, totalStride, &pVertexArray->pVA[3]);
-		}
-
-		if (pVertexArray->type == VT_POSITION_NORMAL_UV_COLOUR || pVertexArray->type == VT_POSITION_NORMAL_COLOUR)
-		{
-			//glEnableClientState(GL_COLOR_ARRAY);
-			//glColorPointer(4, GL_FLOAT, totalStride, &pVertexArray->pVA[6]);
-		}
-
-		if (pVertexArray->nIndices != 0)
-		{
-			glDrawElements(m_primativeMode, pVertexArray->nIndices, GL_UNSIGNED_INT, pVertexArray->pIndices);
-		}
-		else
-		{
-			glDrawArrays(m_primativeMode, 0, pVertexArray->nVerts);
-		}
+		BindStaticBuffer(pVertexArray, false, true);
+		DrawStaticBuffer(pVertexArray, firstIndex, numIndices);
+		UnbindStaticBuffer(pVertexArray, false);
 
 		glDisableClientState(GL_VERTEX_ARRAY);
 		glDisableClientState(GL_NORMAL_ARRAY);
@@ -1438,7 +1574,7 @@ bool Renderer::RenderFromArray(VertexType type, unsigned int materialID, unsigne
 	{
 		if (materialID != -1)
 		{
-			m_materials[materialID]->Apply();
+			EnableMaterial(materialID);
 		}
 	}
 
@@ -1489,6 +1625,8 @@ bool Renderer::RenderFromArray(VertexType type, unsigned int materialID, unsigne
 		glColorPointer(4, GL_FLOAT, totalStride, &pVertsf[6]);
 	}
 
+	ApplyModelViewMatrix();
+
 	if (nIndices != 0)
 	{
 		glDrawElements(m_primativeMode, nIndices, GL_UNSIGNED_INT, pIndices);
@@ -1497,6 +1635,7 @@ bool Renderer::RenderFromArray(VertexType type, unsigned int materialID, unsigne
 	{
 		glDrawArrays(m_primativeMode, 0, nVerts);
 	}
+	m_numDrawCalls++;
 
 	glDisableClientState(GL_VERTEX_ARRAY);
 	glDisableClientState(GL_NORMAL_ARRAY);
@@ -1506,24 +1645,363 @@ bool Renderer::RenderFromArray(VertexType type, unsigned int materialID, unsigne
 	return true;
 }
 
+// The layout of each vertex type as compile time constants. The stride and the static buffer pointer setup are instantiated
+// once per type from these, so none of the per attribute choices are left to run time.
+template <VertexType type>
+struct VertexFormat
+{
+	static const bool Packed = (type == VT_PACKED_POSITION_NORMAL_COLOUR);
+	static const bool HasNormal = (type == VT_POSITION_NORMAL || type == VT_POSITION_NORMAL_COLOUR || type == VT_POSITION_NORMAL_UV || type == VT_POSITION_NORMAL_UV_COLOUR || Packed);
+	static const bool HasTextureCoordinates = (type == VT_POSITION_NORMAL_UV || type == VT_POSITION_NORMAL_UV_COLOUR);
+	static const int ColourComponents = (type == VT_POSITION_DIFFUSE) ? 3 : ((type == VT_POSITION_DIFFUSE_ALPHA || type == VT_POSITION_NORMAL_COLOUR || type == VT_POSITION_NORMAL_UV_COLOUR || Packed) ? 4 : 0);
+
+	static const unsigned int Stride = Packed ? sizeof(OGLPackedPositionNormalColourVertex) : sizeof(float) * (3 + (HasNormal ? 3 : 0) + ColourComponents);
+	static const unsigned int NormalOffset = Packed ? offsetof(OGLPackedPositionNormalColourVertex, nx) : sizeof(float) * 3;
+	static const unsigned int ColourOffset = Packed ? offsetof(OGLPackedPositionNormalColourVertex, r) : sizeof(float) * (HasNormal ? 6 : 3);
+
+	static const GLenum PositionType = Packed ? GL_SHORT : GL_FLOAT;
+	static const GLenum NormalType = Packed ? GL_BYTE : GL_FLOAT;
+	static const GLenum ColourType = Packed ? GL_UNSIGNED_BYTE : GL_FLOAT;
+};
+
 unsigned int Renderer::GetStride(VertexType type)
 {
-	// Add xyz stride
-	unsigned int totalStride = sizeof(float) * 3;
+	switch (type)
+	{
+	case VT_POSITION: return VertexFormat<VT_POSITION>::Stride;
+	case VT_POSITION_DIFFUSE: return VertexFormat<VT_POSITION_DIFFUSE>::Stride;
+	case VT_POSITION_DIFFUSE_ALPHA: return VertexFormat<VT_POSITION_DIFFUSE_ALPHA>::Stride;
+	case VT_POSITION_NORMAL: return VertexFormat<VT_POSITION_NORMAL>::Stride;
+	case VT_POSITION_NORMAL_COLOUR: return VertexFormat<VT_POSITION_NORMAL_COLOUR>::Stride;
+	case VT_POSITION_NORMAL_UV: return VertexFormat<VT_POSITION_NORMAL_UV>::Stride;
+	case VT_POSITION_NORMAL_UV_COLOUR: return VertexFormat<VT_POSITION_NORMAL_UV_COLOUR>::Stride;
+	case VT_PACKED_POSITION_NORMAL_COLOUR: return VertexFormat<VT_PACKED_POSITION_NORMAL_COLOUR>::Stride;
+	}
 
-	// Add normals stride
-	if (type == VT_POSITION_NORMAL || type == VT_POSITION_NORMAL_UV || type == VT_POSITION_NORMAL_UV_COLOUR || type == VT_POSITION_NORMAL_COLOUR)
-		totalStride += sizeof(float) * 3;
+	return 0;
+}
 
-	// Add colour  stride
-	if (type == VT_POSITION_DIFFUSE)
-		totalStride += sizeof(float) * 3;
+// Static buffer internals
+void Renderer::SetupStaticBuffer(VertexArray *pVertexArray, VertexType type, unsigned int materialID, unsigned int textureID, int nVerts, int nTextureCoordinates, int nIndices, const void *pVerts, const void *pTextureCoordinates, const unsigned int *pIndices)
+{
+	pVertexArray->nIndices = nIndices;
+	pVertexArray->nVerts = nVerts;
+	pVertexArray->nTextureCoordinates = nTextureCoordinates;
+	pVertexArray->materialID = materialID;
+	pVertexArray->textureID = textureID;
+	pVertexArray->type = type;
+
+	pVertexArray->vertexSize = GetStride(type);
+	if (type == VT_POSITION_NORMAL_UV || type == VT_POSITION_NORMAL_UV_COLOUR)
+	{
+		pVertexArray->textureCoordinateSize = sizeof(OGLUVCoordinate);
+	}
+
+	int verticesSize = pVertexArray->vertexSize*nVerts;
+	int textureCoordinatesSize = pVertexArray->textureCoordinateSize*nTextureCoordinates;
+	int indicesSize = sizeof(unsigned int)*nIndices;
+
+	// Once the data is in buffer objects we only hold on to a client side copy if it has been asked for
+	if (useBufferObjects == false || m_keepStaticBufferShadowCopies)
+	{
+		if (verticesSize)
+		{
+			pVertexArray->pVA = new float[verticesSize / sizeof(float)];
+			memcpy(pVertexArray->pVA, pVerts, verticesSize);
+		}
+
+		if (textureCoordinatesSize)
+		{
+			pVertexArray->pTextureCoordinates = new float[textureCoordinatesSize / sizeof(float)];
+			memcpy(pVertexArray->pTextureCoordinates, pTextureCoordinates, textureCoordinatesSize);
+		}
+
+		if (indicesSize)
+		{
+			pVertexArray->pIndices = new unsigned int[nIndices];
+			memcpy(pVertexArray->pIndices, pIndices, indicesSize);
+		}
+	}
+
+	if (useBufferObjects == false)
+	{
+		return;
+	}
+
+	// Upload everything once, draws then just source from the buffer objects
+	if (verticesSize)
+	{
+		if (pVertexArray->vertexBufferID == 0)
+		{
+			glGenBuffers(1, &pVertexArray->vertexBufferID);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, pVertexArray->vertexBufferID);
+		glBufferData(GL_ARRAY_BUFFER, verticesSize, pVerts, GL_STATIC_DRAW);
+	}
+
+	if (textureCoordinatesSize)
+	{
+		if (pVertexArray->textureCoordinateBufferID == 0)
+		{
+			glGenBuffers(1, &pVertexArray->textureCoordinateBufferID);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, pVertexArray->textureCoordinateBufferID);
+		glBufferData(GL_ARRAY_BUFFER, textureCoordinatesSize, pTextureCoordinates, GL_STATIC_DRAW);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (indicesSize)
+	{
+		if (pVertexArray->indexBufferID == 0)
+		{
+			glGenBuffers(1, &pVertexArray->indexBufferID);
+		}
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pVertexArray->indexBufferID);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indicesSize, pIndices, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+
+	// Record the full colour array setup in a vertex array object, so drawing is a single bind
+	if (useVertexArrayObjects && verticesSize)
+	{
+		if (pVertexArray->vertexArrayID == 0)
+		{
+			glGenVertexArrays(1, &pVertexArray->vertexArrayID);
+		}
+		glBindVertexArray(pVertexArray->vertexArrayID);
+
+		// A recycled vertex array object may still have arrays enabled for a different vertex type
+		glDisableClientState(GL_NORMAL_ARRAY);
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		glDisableClientState(GL_COLOR_ARRAY);
+
+		SetStaticBufferPointers(pVertexArray, true, true);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, nIndices ? pVertexArray->indexBufferID : 0);
+
+		glBindVertexArray(0);
+	}
+}
+
+void Renderer::ReleaseStaticBufferObjects(VertexArray *pVertexArray)
+{
+	if (pVertexArray->vertexArrayID != 0)
+	{
+		glDeleteVertexArrays(1, &pVertexArray->vertexArrayID);
+		pVertexArray->vertexArrayID = 0;
+	}
+
+	if (pVertexArray->vertexBufferID != 0)
+	{
+		glDeleteBuffers(1, &pVertexArray->vertexBufferID);
+		pVertexArray->vertexBufferID = 0;
+	}
+
+	if (pVertexArray->textureCoordinateBufferID != 0)
+	{
+		glDeleteBuffers(1, &pVertexArray->textureCoordinateBufferID);
+		pVertexArray->textureCoordinateBufferID = 0;
+	}
+
+	if (pVertexArray->indexBufferID != 0)
+	{
+		glDeleteBuffers(1, &pVertexArray->indexBufferID);
+		pVertexArray->indexBufferID = 0;
+	}
+}
+
+// Points the client arrays for one vertex type at pVertexData, which is an offset into the bound vertex buffer or the shadow copy
+template <VertexType type>
+static void SetVertexFormatPointers(const char *pVertexData, bool colour, bool enableArrays)
+{
+	typedef VertexFormat<type> Format;
+
+	glVertexPointer(3, Format::PositionType, Format::Stride, pVertexData);
+
+	if (Format::HasNormal)
+	{
+		if (enableArrays)
+		{
+			glEnableClientState(GL_NORMAL_ARRAY);
+		}
+		glNormalPointer(Format::NormalType, Format::Stride, pVertexData + Format::NormalOffset);
+	}
+
+	if (colour && Format::ColourComponents != 0)
+	{
+		if (enableArrays)
+		{
+			glEnableClientState(GL_COLOR_ARRAY);
+		}
+		glColorPointer(Format::ColourComponents, Format::ColourType, Format::Stride, pVertexData + Format::ColourOffset);
+	}
+}
+
+// Points the client arrays at the static buffer, either as offsets into its buffer objects or straight at the shadow copy
+void Renderer::SetStaticBufferPointers(VertexArray *pVertexArray, bool colour, bool enableArrays)
+{
+	VertexType type = pVertexArray->type;
+
+	const char *pVertexData = (const char*)pVertexArray->pVA;
+	const char *pTextureCoordinateData = (const char*)pVertexArray->pTextureCoordinates;
+
+	if (pVertexArray->vertexBufferID != 0)
+	{
+		pVertexData = NULL;
+		glBindBuffer(GL_ARRAY_BUFFER, pVertexArray->vertexBufferID);
+	}
+
+	if (enableArrays)
+	{
+		glEnableClientState(GL_VERTEX_ARRAY);
+	}
+
+	switch (type)
+	{
+	case VT_POSITION: SetVertexFormatPointers<VT_POSITION>(pVertexData, colour, enableArrays); break;
+	case VT_POSITION_DIFFUSE: SetVertexFormatPointers<VT_POSITION_DIFFUSE>(pVertexData, colour, enableArrays); break;
+	case VT_POSITION_DIFFUSE_ALPHA: SetVertexFormatPointers<VT_POSITION_DIFFUSE_ALPHA>(pVertexData, colour, enableArrays); break;
+	case VT_POSITION_NORMAL: SetVertexFormatPointers<VT_POSITION_NORMAL>(pVertexData, colour, enableArrays); break;
+	case VT_POSITION_NORMAL_COLOUR: SetVertexFormatPointers<VT_POSITION_NORMAL_COLOUR>(pVertexData, colour, enableArrays); break;
+	case VT_POSITION_NORMAL_UV: SetVertexFormatPointers<VT_POSITION_NORMAL_UV>(pVertexData, colour, enableArrays); break;
+	case VT_POSITION_NORMAL_UV_COLOUR: SetVertexFormatPointers<VT_POSITION_NORMAL_UV_COLOUR>(pVertexData, colour, enableArrays); break;
+	case VT_PACKED_POSITION_NORMAL_COLOUR: SetVertexFormatPointers<VT_PACKED_POSITION_NORMAL_COLOUR>(pVertexData, colour, enableArrays); break;
+	}
+
+	if (type == VT_POSITION_NORMAL_UV || type == VT_POSITION_NORMAL_UV_COLOUR)
+	{
+		if (pVertexArray->textureCoordinateBufferID != 0)
+		{
+			pTextureCoordinateData = NULL;
+			glBindBuffer(GL_ARRAY_BUFFER, pVertexArray->textureCoordinateBufferID);
+		}
+
+		if (enableArrays)
+		{
+			glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		}
+		glTexCoordPointer(2, GL_FLOAT, 0, pTextureCoordinateData);
+	}
+
+	// Leave the array buffer unbound so that client side arrays elsewhere carry on working
+	if (useBufferObjects)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+}
+
+void Renderer::BindStaticBuffer(VertexArray *pVertexArray, bool colour, bool enableArrays)
+{
+	// The vertex array object only records the full colour setup
+	if (colour && pVertexArray->vertexArrayID != 0)
+	{
+		glBindVertexArray(pVertexArray->vertexArrayID);
+		return;
+	}
+
+	SetStaticBufferPointers(pVertexArray, colour, enableArrays);
+
+	if (pVertexArray->indexBufferID != 0)
+	{
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pVertexArray->indexBufferID);
+	}
+}
+
+void Renderer::UnbindStaticBuffer(VertexArray *pVertexArray, bool colour)
+{
+	if (colour && pVertexArray->vertexArrayID != 0)
+	{
+		glBindVertexArray(0);
+		return;
+	}
+
+	if (pVertexArray->indexBufferID != 0)
+	{
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+}
+
+void Renderer::ApplyStaticBufferModelView(VertexArray *pVertexArray)
+{
+	if (pVertexArray->type == VT_PACKED_POSITION_NORMAL_COLOUR)
+	{
+		Matrix4x4 packedOffset;
+		packedOffset.SetTranslation(Vector3d(-PACKED_POSITION_OFFSET, -PACKED_POSITION_OFFSET, -PACKED_POSITION_OFFSET));
+		LoadModelViewMatrix(packedOffset * m_modelView);
+	}
+	else
+	{
+		ApplyModelViewMatrix();
+	}
+}
+
+// Where glDrawElements() starts reading, an offset into the index buffer or a pointer into the shadow copy
+static const GLvoid* GetStaticBufferIndices(VertexArray *pVertexArray, int firstIndex)
+{
+	return (pVertexArray->indexBufferID != 0) ? (const GLvoid*)(firstIndex * sizeof(unsigned int)) : (const GLvoid*)(pVertexArray->pIndices + firstIndex);
+}
+
+void Renderer::DrawStaticBuffer(VertexArray *pVertexArray, int firstIndex, int numIndices)
+{
+	ApplyStaticBufferModelView(pVertexArray);
+
+	if (numIndices != -1)
+	{
+		glDrawElements(m_primativeMode, numIndices, GL_UNSIGNED_INT, GetStaticBufferIndices(pVertexArray, firstIndex));
+	}
+	else if (pVertexArray->nIndices != 0)
+	{
+		glDrawElements(m_primativeMode, pVertexArray->nIndices, GL_UNSIGNED_INT, (pVertexArray->indexBufferID != 0) ? NULL : pVertexArray->pIndices);
+	}
+	else
+	{
+		glDrawArrays(m_primativeMode, 0, pVertexArray->nVerts);
+	}
+	m_numDrawCalls++;
+}
+
+// Gives write access to the vertices, through the shadow copy if there is one or by mapping the vertex buffer
+void* Renderer::LockStaticBufferVertices(VertexArray *pVertexArray)
+{
+	if (pVertexArray == NULL)
+	{
+		return NULL;
+	}
+
+	if (pVertexArray->pVA != NULL)
+	{
+		return pVertexArray->pVA;
+	}
+
+	if (pVertexArray->vertexBufferID == 0 || pVertexArray->nVerts == 0)
+	{
+		return NULL;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, pVertexArray->vertexBufferID);
+	void *pVertices = glMapBuffer(GL_ARRAY_BUFFER, GL_READ_WRITE);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	return pVertices;
+}
 
-	// Add colour and alpha stride
-	if (type == VT_POSITION_DIFFUSE_ALPHA || type == VT_POSITION_NORMAL_UV_COLOUR || type == VT_POSITION_NORMAL_COLOUR)
-		totalStride += sizeof(float) * 4;
+void Renderer::UnlockStaticBufferVertices(VertexArray *pVertexArray)
+{
+	if (pVertexArray->vertexBufferID == 0)
+	{
+		return;
+	}
 
-	return totalStride;
+	glBindBuffer(GL_ARRAY_BUFFER, pVertexArray->vertexBufferID);
+	if (pVertexArray->pVA != NULL)
+	{
+		glBufferSubData(GL_ARRAY_BUFFER, 0, pVertexArray->vertexSize*pVertexArray->nVerts, pVertexArray->pVA);
+	}
+	else
+	{
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 // Mesh
@@ -1543,32 +2021,11 @@ void Renderer::ClearMesh(OpenGLTriangleMesh* pMesh)
 	pMesh->m_materialId = -1;
 	//pMesh->m_staticMeshId = -1; // DON'T reset this! Else we end up create more and more and more static buffers and data
 
-	// Delete the vertices
-	for (unsigned int i = 0; i < pMesh->m_vertices.size(); i++)
-	{
-		delete pMesh->m_vertices[i];
-		pMesh->m_vertices[i] = 0;
-	}
-
-	// Delete the texture coordinates
-	for (unsigned int i = 0; i < pMesh->m_textureCoordinates.size(); i++)
-	{
-		delete pMesh->m_textureCoordinates[i];
-		pMesh->m_textureCoordinates[i] = 0;
-	}
-
-	// Delete the triangles
-	for (unsigned int i = 0; i < pMesh->m_triangles.size(); i++)
-	{
-		delete pMesh->m_triangles[i];
-		pMesh->m_triangles[i] = 0;
-	}
-
 	pMesh->m_vertices.clear();
 	pMesh->m_textureCoordinates.clear();
 	pMesh->m_triangles.clear();
 
-	if (pMesh->m_staticMeshId != -1)
+	if (pMesh->m_staticMeshId != -1 && pMesh->m_sharedStaticBuffer == false)
 	{
 		DeleteStaticBuffer(pMesh->m_staticMeshId);
 	}
@@ -1578,25 +2035,36 @@ void Renderer::ClearMesh(OpenGLTriangleMesh* pMesh)
 	pMesh = NULL;
 }
 
+void Renderer::ReserveMesh(unsigned int numVertices, unsigned int numTriangles, OpenGLTriangleMesh* pMesh)
+{
+	pMesh->m_vertices.reserve(numVertices);
+	pMesh->m_triangles.reserve(numTriangles);
+
+	if (pMesh->m_meshType == OGLMeshType_Textured)
+	{
+		pMesh->m_textureCoordinates.reserve(numVertices);
+	}
+}
+
 unsigned int Renderer::AddVertexToMesh(Vector3d p, Vector3d n, float r, float g, float b, float a, OpenGLTriangleMesh* pMesh)
 {
-	OpenGLMesh_Vertex* pNewVertex = new OpenGLMesh_Vertex();
-	pNewVertex->vertexPosition[0] = p.x;
-	pNewVertex->vertexPosition[1] = p.y;
-	pNewVertex->vertexPosition[2] = p.z;
+	OpenGLMesh_Vertex newVertex;
+	newVertex.vertexPosition[0] = p.x;
+	newVertex.vertexPosition[1] = p.y;
+	newVertex.vertexPosition[2] = p.z;
 
-	pNewVertex->vertexNormals[0] = n.x;
-	pNewVertex->vertexNormals[1] = n.y;
-	pNewVertex->vertexNormals[2] = n.z;
+	newVertex.vertexNormals[0] = n.x;
+	newVertex.vertexNormals[1] = n.y;
+	newVertex.vertexNormals[2] = n.z;
 
-	pNewVertex->vertexColour[0] = r;
-	pNewVertex->vertexColour[1] = g;
-	pNewVertex->vertexColour[2] = b;
-	pNewVertex->vertexColour[3] = a;
+	newVertex.vertexColour[0] = r;
+	newVertex.vertexColour[1] = g;
+	newVertex.vertexColour[2] = b;
+	newVertex.vertexColour[3] = a;
 
 	if (pMesh != NULL)
 	{
-		pMesh->m_vertices.push_back(pNewVertex);
+		pMesh->m_vertices.push_back(newVertex);
 
 		unsigned int vertex_id = (int)pMesh->m_vertices.size() - 1;
 
@@ -1610,13 +2078,13 @@ unsigned int Renderer::AddVertexToMesh(Vector3d p, Vector3d n, float r, float g,
 
 unsigned int Renderer::AddTextureCoordinatesToMesh(float s, float t, OpenGLTriangleMesh* pMesh)
 {
-	OpenGLMesh_TextureCoordinate* pNewTextureCoordinate = new OpenGLMesh_TextureCoordinate();
-	pNewTextureCoordinate->s = s;
-	pNewTextureCoordinate->t = t;
+	OpenGLMesh_TextureCoordinate newTextureCoordinate;
+	newTextureCoordinate.s = s;
+	newTextureCoordinate.t = t;
 
-	if (pMesh != NULL)
+	if (pMesh != NULL && pMesh->m_meshType == OGLMeshType_Textured)
 	{
-		pMesh->m_textureCoordinates.push_back(pNewTextureCoordinate);
+		pMesh->m_textureCoordinates.push_back(newTextureCoordinate);
 
 		unsigned int textureCoordinate_id = (int)pMesh->m_textureCoordinates.size() - 1;
 
@@ -1631,14 +2099,14 @@ unsigned int Renderer::AddTextureCoordinatesToMesh(float s, float t, OpenGLTrian
 unsigned int Renderer::AddTriangleToMesh(unsigned int vertexId1, unsigned int vertexId2, unsigned int vertexId3, OpenGLTriangleMesh* pMesh)
 {
 	// Create the triangle
-	OpenGLMesh_Triangle* pTri = new OpenGLMesh_Triangle();
-	pTri->vertexIndices[0] = vertexId1;
-	pTri->vertexIndices[1] = vertexId2;
-	pTri->vertexIndices[2] = vertexId3;
+	OpenGLMesh_Triangle tri;
+	tri.vertexIndices[0] = vertexId1;
+	tri.vertexIndices[1] = vertexId2;
+	tri.vertexIndices[2] = vertexId3;
 
 	if (pMesh != NULL)
 	{
-		pMesh->m_triangles.push_back(pTri);
+		pMesh->m_triangles.push_back(tri);
 
 		unsigned int tri_id = (int)pMesh->m_triangles.size() - 1;
 
@@ -1650,45 +2118,149 @@ unsigned int Renderer::AddTriangleToMesh(unsigned int vertexId1, unsigned int ve
 	}
 }
 
+static unsigned char PackColourComponent(float value)
+{
+	value = (value < 0.0f) ? 0.0f : ((value > 1.0f) ? 1.0f : value);
+	return (unsigned char)(value * 255.0f + 0.5f);
+}
+
+static signed char PackNormalComponent(float value)
+{
+	value = (value < -1.0f) ? -1.0f : ((value > 1.0f) ? 1.0f : value);
+	return (signed char)((value < 0.0f) ? (value * 127.0f - 0.5f) : (value * 127.0f + 0.5f));
+}
+
 void Renderer::ModifyMeshAlpha(float alpha, OpenGLTriangleMesh* pMesh)
 {
-	VertexArray* pArray = m_vertexArrays[pMesh->m_staticMeshId];
+	VertexArray* pArray = m_vertexArrays.Get(pMesh->m_staticMeshId);
+
+	void* pVertices = LockStaticBufferVertices(pArray);
+	if (pVertices == NULL)
+	{
+		return;
+	}
 
-	GLsizei totalStride = GetStride(pArray->type) / 4;
-	int alphaIndex = totalStride - 1;
+	int firstVertex = pMesh->m_firstVertex;
+	int endVertex = (pMesh->m_numVertices == -1) ? pArray->nVerts : firstVertex + pMesh->m_numVertices;
 
-	for (int i = 0; i < pArray->nVerts; i++)
+	if (pArray->type == VT_PACKED_POSITION_NORMAL_COLOUR)
+	{
+		OGLPackedPositionNormalColourVertex* pPackedVertices = (OGLPackedPositionNormalColourVertex*)pVertices;
+		for (int i = firstVertex; i < endVertex; i++)
+		{
+			pPackedVertices[i].a = PackColourComponent(alpha);
+		}
+	}
+	else
 	{
-		pArray->pVA[alphaIndex] = alpha;
+		float* pFloatVertices = (float*)pVertices;
+		GLsizei totalStride = GetStride(pArray->type) / 4;
+		int alphaIndex = firstVertex*totalStride + totalStride - 1;
+
+		for (int i = firstVertex; i < endVertex; i++)
+		{
+			pFloatVertices[alphaIndex] = alpha;
 
-		alphaIndex += totalStride;
+			alphaIndex += totalStride;
+		}
 	}
+
+	UnlockStaticBufferVertices(pArray);
 }
 
 void Renderer::ModifyMeshColour(float r, float g, float b, OpenGLTriangleMesh* pMesh)
 {
-	VertexArray* pArray = m_vertexArrays[pMesh->m_staticMeshId];
+	VertexArray* pArray = m_vertexArrays.Get(pMesh->m_staticMeshId);
+
+	void* pVertices = LockStaticBufferVertices(pArray);
+	if (pVertices == NULL)
+	{
+		return;
+	}
 
-	GLsizei totalStride = GetStride(pArray->type) / 4;
-	int rIndex = totalStride - 4;
-	int gIndex = totalStride - 3;
-	int bIndex = totalStride - 2;
+	int firstVertex = pMesh->m_firstVertex;
+	int endVertex = (pMesh->m_numVertices == -1) ? pArray->nVerts : firstVertex + pMesh->m_numVertices;
 
-	for (int i = 0; i < pArray->nVerts; i++)
+	if (pArray->type == VT_PACKED_POSITION_NORMAL_COLOUR)
+	{
+		OGLPackedPositionNormalColourVertex* pPackedVertices = (OGLPackedPositionNormalColourVertex*)pVertices;
+		for (int i = firstVertex; i < endVertex; i++)
+		{
+			pPackedVertices[i].r = PackColourComponent(r);
+			pPackedVertices[i].g = PackColourComponent(g);
+			pPackedVertices[i].b = PackColourComponent(b);
+		}
+	}
+	else
 	{
-		pArray->pVA[rIndex] = r;
-		pArray->pVA[gIndex] = g;
-		pArray->pVA[bIndex] = b;
+		float* pFloatVertices = (float*)pVertices;
+		GLsizei totalStride = GetStride(pArray->type) / 4;
+		int rIndex = firstVertex*totalStride + totalStride - 4;
+		int gIndex = firstVertex*totalStride + totalStride - 3;
+		int bIndex = firstVertex*totalStride + totalStride - 2;
+
+		for (int i = firstVertex; i < endVertex; i++)
+		{
+			pFloatVertices[rIndex] = r;
+			pFloatVertices[gIndex] = g;
+			pFloatVertices[bIndex] = b;
 
-		rIndex += totalStride;
-		gIndex += totalStride;
-		bIndex += totalStride;
+			rIndex += totalStride;
+			gIndex += totalStride;
+			bIndex += totalStride;
+		}
 	}
+
+	UnlockStaticBufferVertices(pArray);
 }
 
-void Renderer::FinishMesh(unsigned int textureID, unsigned int materialID, OpenGLTriangleMesh* pMesh)
+// The mesh arrays are already in static buffer layout, so they are handed over without any intermediate copies
+static_assert(sizeof(OpenGLMesh_Vertex) == sizeof(OGLPositionNormalColourVertex), "Mesh vertices must match the static buffer vertex layout");
+static_assert(sizeof(OpenGLMesh_TextureCoordinate) == sizeof(OGLUVCoordinate), "Mesh texture coordinates must match the static buffer layout");
+static_assert(sizeof(OpenGLMesh_Triangle) == sizeof(unsigned int) * 3, "Mesh triangles must be tightly packed indices");
+
+static_assert(sizeof(OGLPackedPositionNormalColourVertex) == 16, "Packed vertices should be 16 bytes");
+
+// The offset is removed again with a translate when drawing, which unlike a scale leaves the normals alone
+bool Renderer::PackMeshVertices(OpenGLTriangleMesh* pMesh, OGLPackedPositionNormalColourVertex* pPackedVertices)
+{
+	for (unsigned int i = 0; i < pMesh->m_vertices.size(); i++)
+	{
+		const OpenGLMesh_Vertex& vertex = pMesh->m_vertices[i];
+		short position[3];
+
+		for (int j = 0; j < 3; j++)
+		{
+			float offsetPosition = vertex.vertexPosition[j] + PACKED_POSITION_OFFSET;
+			if (offsetPosition != floorf(offsetPosition) || offsetPosition < -32768.0f || offsetPosition > 32767.0f)
+			{
+				return false;
+			}
+
+			position[j] = (short)offsetPosition;
+		}
+
+		pPackedVertices[i].x = position[0];
+		pPackedVertices[i].y = position[1];
+		pPackedVertices[i].z = position[2];
+		pPackedVertices[i].pad = 0;
+
+		pPackedVertices[i].nx = PackNormalComponent(vertex.vertexNormals[0]);
+		pPackedVertices[i].ny = PackNormalComponent(vertex.vertexNormals[1]);
+		pPackedVertices[i].nz = PackNormalComponent(vertex.vertexNormals[2]);
+		pPackedVertices[i].nw = 0;
+
+		pPackedVertices[i].r = PackColourComponent(vertex.vertexColour[0]);
+		pPackedVertices[i].g = PackColourComponent(vertex.vertexColour[1]);
+		pPackedVertices[i].b = PackColourComponent(vertex.vertexColour[2]);
+		pPackedVertices[i].a = PackColourComponent(vertex.vertexColour[3]);
+	}
+
+	return true;
+}
+
+void Renderer::FinishMesh(unsigned int textureID, unsigned int materialID, OpenGLTriangleMesh* pMesh)
 {
-	unsigned int numTriangles = (int)pMesh->m_triangles.size();
 	unsigned int numVertices = (int)pMesh->m_vertices.size();
 	unsigned int numTextureCoordinates = (int)pMesh->m_textureCoordinates.size();
 	unsigned int numIndices = (int)pMesh->m_triangles.size() * 3;
@@ -1696,46 +2268,20 @@ void Renderer::FinishMesh(unsigned int textureID, unsigned int materialID, OpenG
 	pMesh->m_materialId = materialID;
 	pMesh->m_textureId = textureID;
 
-	// Vertices
-	OGLPositionNormalColourVertex* meshBuffer;
-	meshBuffer = new OGLPositionNormalColourVertex[numVertices];
-	for (unsigned int i = 0; i < numVertices; i++)
-	{
-		meshBuffer[i].x = pMesh->m_vertices[i]->vertexPosition[0];
-		meshBuffer[i].y = pMesh->m_vertices[i]->vertexPosition[1];
-		meshBuffer[i].z = pMesh->m_vertices[i]->vertexPosition[2];
-
-		meshBuffer[i].nx = pMesh->m_vertices[i]->vertexNormals[0];
-		meshBuffer[i].ny = pMesh->m_vertices[i]->vertexNormals[1];
-		meshBuffer[i].nz = pMesh->m_vertices[i]->vertexNormals[2];
-
-		meshBuffer[i].r = pMesh->m_vertices[i]->vertexColour[0];
-		meshBuffer[i].g = pMesh->m_vertices[i]->vertexColour[1];
-		meshBuffer[i].b = pMesh->m_vertices[i]->vertexColour[2];
-		meshBuffer[i].a = pMesh->m_vertices[i]->vertexColour[3];
-	}
-
-	// Texture coordinates
-	OGLUVCoordinate* textureCoordinatesBuffer;
-	textureCoordinatesBuffer = new OGLUVCoordinate[numTextureCoordinates];
-	for (unsigned int i = 0; i < numTextureCoordinates; i++)
+	// A mesh that was merged into a shared buffer gets a buffer of its own back, the shared one isn't the mesh's to refill
+	if (pMesh->m_sharedStaticBuffer)
 	{
-		textureCoordinatesBuffer[i].u = pMesh->m_textureCoordinates[i]->s;
-		textureCoordinatesBuffer[i].v = pMesh->m_textureCoordinates[i]->t;
+		pMesh->m_staticMeshId = -1;
 	}
+	pMesh->m_sharedStaticBuffer = false;
+	pMesh->m_firstVertex = 0;
+	pMesh->m_numVertices = -1;
+	pMesh->m_firstIndex = 0;
+	pMesh->m_numIndices = -1;
 
-	// Indices
-	unsigned int* indicesBuffer;
-	indicesBuffer = new unsigned int[numIndices];
-	int lIndexCounter = 0;
-	for (unsigned int i = 0; i < numTriangles; i++)
-	{
-		indicesBuffer[lIndexCounter] = pMesh->m_triangles[i]->vertexIndices[0];
-		indicesBuffer[lIndexCounter + 1] = pMesh->m_triangles[i]->vertexIndices[1];
-		indicesBuffer[lIndexCounter + 2] = pMesh->m_triangles[i]->vertexIndices[2];
-
-		lIndexCounter += 3;
-	}
+	const void* meshBuffer = pMesh->m_vertices.empty() ? NULL : &pMesh->m_vertices[0];
+	const void* textureCoordinatesBuffer = pMesh->m_textureCoordinates.empty() ? NULL : &pMesh->m_textureCoordinates[0];
+	const unsigned int* indicesBuffer = pMesh->m_triangles.empty() ? NULL : pMesh->m_triangles[0].vertexIndices;
 
 	if (pMesh->m_meshType == OGLMeshType_Colour)
 	{
@@ -1759,11 +2305,29 @@ void Renderer::FinishMesh(unsigned int textureID, unsigned int materialID, OpenG
 			RecreateStaticBuffer(pMesh->m_staticMeshId, VT_POSITION_NORMAL_UV_COLOUR, pMesh->m_materialId, pMesh->m_textureId, numVertices, numTextureCoordinates, numIndices, meshBuffer, textureCoordinatesBuffer, indicesBuffer);
 		}
 	}
+	else if (pMesh->m_meshType == OGLMeshType_Packed)
+	{
+		// Fall back to the full float format for any mesh that can't be packed without losing precision
+		OGLPackedPositionNormalColourVertex* packedBuffer = new OGLPackedPositionNormalColourVertex[numVertices];
+		VertexType vertexType = VT_PACKED_POSITION_NORMAL_COLOUR;
+		const void* vertexBuffer = packedBuffer;
+		if (PackMeshVertices(pMesh, packedBuffer) == false)
+		{
+			vertexType = VT_POSITION_NORMAL_COLOUR;
+			vertexBuffer = meshBuffer;
+		}
+
+		if (pMesh->m_staticMeshId == (unsigned int)-1)
+		{
+			CreateStaticBuffer(vertexType, pMesh->m_materialId, -1, numVertices, 0, numIndices, vertexBuffer, NULL, indicesBuffer, &pMesh->m_staticMeshId);
+		}
+		else
+		{
+			RecreateStaticBuffer(pMesh->m_staticMeshId, vertexType, pMesh->m_materialId, -1, numVertices, 0, numIndices, vertexBuffer, NULL, indicesBuffer);
+		}
 
-	// Delete temp data
-	delete[] meshBuffer;
-	delete[] textureCoordinatesBuffer;
-	delete[] indicesBuffer;
+		delete[] packedBuffer;
+	}
 }
 
 void Renderer::RenderMesh(OpenGLTriangleMesh* pMesh)
@@ -1774,7 +2338,7 @@ void Renderer::RenderMesh(OpenGLTriangleMesh* pMesh)
 		//SetRenderMode(RM_SOLID);
 		if (pMesh->m_staticMeshId != -1)
 		{
-			RenderStaticBuffer(pMesh->m_staticMeshId);
+			RenderStaticBuffer(pMesh->m_staticMeshId, pMesh->m_firstIndex, pMesh->m_numIndices);
 		}
 	PopMatrix();
 }
@@ -1787,15 +2351,33 @@ void Renderer::RenderMesh_NoColour(OpenGLTriangleMesh* pMesh)
 		//SetRenderMode(RM_SOLID);
 		if (pMesh->m_staticMeshId != -1)
 		{
-			RenderStaticBuffer_NoColour(pMesh->m_staticMeshId);
+			RenderStaticBuffer_NoColour(pMesh->m_staticMeshId, pMesh->m_firstIndex, pMesh->m_numIndices);
 		}
 	PopMatrix();
 }
 
+// The vertex data is only needed until the mesh has been uploaded, the sizes are still known from the static buffer after
+void Renderer::ReleaseMeshData(OpenGLTriangleMesh* pMesh)
+{
+	pMesh->m_vertices.clear();
+	pMesh->m_vertices.shrink_to_fit();
+	pMesh->m_textureCoordinates.clear();
+	pMesh->m_textureCoordinates.shrink_to_fit();
+	pMesh->m_triangles.clear();
+	pMesh->m_triangles.shrink_to_fit();
+}
+
 void Renderer::GetMeshInformation(int *numVerts, int *numTris, OpenGLTriangleMesh* pMesh)
 {
 	*numVerts = (int)pMesh->m_vertices.size();
 	*numTris = (int)pMesh->m_triangles.size();
+
+	VertexArray *pVertexArray = m_vertexArrays.Get(pMesh->m_staticMeshId);
+	if (pMesh->m_vertices.empty() && pVertexArray != NULL)
+	{
+		*numVerts = (pMesh->m_numVertices == -1) ? pVertexArray->nVerts : pMesh->m_numVertices;
+		*numTris = ((pMesh->m_numIndices == -1) ? pVertexArray->nIndices : pMesh->m_numIndices) / 3;
+	}
 }
 
 void Renderer::StartMeshRender()
@@ -1814,14 +2396,20 @@ void Renderer::EndMeshRender()
 
 bool Renderer::MeshStaticBufferRender(OpenGLTriangleMesh* pMesh)
 {
-	SetPrimativeMode(PM_TRIANGLES);
 	//SetRenderMode(RM_SOLID);
 
-	VertexArray *pVertexArray = m_vertexArrays[pMesh->m_staticMeshId];
+	return DrawMeshStaticBuffer(pMesh->m_staticMeshId, pMesh->m_firstIndex, pMesh->m_numIndices);
+}
+
+bool Renderer::DrawMeshStaticBuffer(unsigned int id, int firstIndex, int numIndices)
+{
+	SetPrimativeMode(PM_TRIANGLES);
+
+	VertexArray *pVertexArray = m_vertexArrays.Get(id);
 
 	if (pVertexArray != NULL)
 	{
-		if (pVertexArray->nVerts == 0)
+		if (pVertexArray->nVerts == 0 || numIndices == 0)
 		{
 			return false;
 		}
@@ -1830,7 +2418,7 @@ bool Renderer::MeshStaticBufferRender(OpenGLTriangleMesh* pMesh)
 		{
 			if (pVertexArray->materialID != -1)
 			{
-				m_materials[pVertexArray->materialID]->Apply();
+				EnableMaterial(pVertexArray->materialID);
 			}
 		}
 
@@ -1842,49 +2430,698 @@ bool Renderer::MeshStaticBufferRender(OpenGLTriangleMesh* pMesh)
 			}
 		}
 
-		// Calculate the stride
-		GLsizei totalStride = GetStride(pVertexArray->type);
+		// The texture unit is taken over to apply the tint, so textured buffers are drawn untinted
+		bool tinted = IsMeshTinted() && pVertexArray->type != VT_POSITION_NORMAL_UV && pVertexArray->type != VT_POSITION_NORMAL_UV_COLOUR;
+		if (tinted)
+		{
+			BeginMeshTint();
+		}
 
-		glVertexPointer(3, GL_FLOAT, totalStride, pVertexArray->pVA);
+		// The arrays are enabled once by StartMeshRender(), so only the pointers are set here
+		BindStaticBuffer(pVertexArray, true, false);
+		DrawStaticBuffer(pVertexArray, firstIndex, numIndices);
+		UnbindStaticBuffer(pVertexArray, true);
 
-		if (pVertexArray->type == VT_POSITION_NORMAL || pVertexArray->type == VT_POSITION_NORMAL_UV || pVertexArray->type == VT_POSITION_NORMAL_UV_COLOUR || pVertexArray->type == VT_POSITION_NORMAL_COLOUR)
+		if (tinted)
 		{
-			glNormalPointer(GL_FLOAT, totalStride, &pVertexArray->pVA[3]);
+			EndMeshTint();
 		}
 
-		if (pVertexArray->type == VT_POSITION_NORMAL_UV || pVertexArray->type == VT_POSITION_NORMAL_UV_COLOUR)
+		return true;
+	}
+
+	return false;
+}
+
+// Mesh tint
+void Renderer::SetMeshTint(const Colour& tint, bool replaceColour)
+{
+	m_meshTint = tint;
+	m_meshTintReplacesColour = replaceColour;
+}
+
+void Renderer::ClearMeshTint()
+{
+	m_meshTint = Colour(1.0f, 1.0f, 1.0f, 1.0f);
+	m_meshTintReplacesColour = false;
+}
+
+bool Renderer::IsMeshTinted()
+{
+	return m_meshTintReplacesColour || m_meshTint.GetRed() != 1.0f || m_meshTint.GetGreen() != 1.0f || m_meshTint.GetBlue() != 1.0f || m_meshTint.GetAlpha() != 1.0f;
+}
+
+// The combiner works the tint in as its constant colour, the white texture is only there to enable the texture unit
+void Renderer::BeginMeshTint()
+{
+	SetCapability(GL_TEXTURE_2D, &m_textureEnabled, true);
+	SetBoundTexture(m_tintTextureID);
+
+	float tint[4] = { m_meshTint.GetRed(), m_meshTint.GetGreen(), m_meshTint.GetBlue(), m_meshTint.GetAlpha() };
+	glTexEnvfv(GL_TEXTURE_ENV, GL_TEXTURE_ENV_COLOR, tint);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE);
+	glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_RGB, m_meshTintReplacesColour ? GL_REPLACE : GL_MODULATE);
+	glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE0_RGB, GL_CONSTANT);
+	glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE1_RGB, GL_PRIMARY_COLOR);
+	glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_ALPHA, GL_MODULATE);
+	glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE0_ALPHA, GL_CONSTANT);
+	glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE1_ALPHA, GL_PRIMARY_COLOR);
+}
+
+void Renderer::EndMeshTint()
+{
+	// Everything else that textures expects the default environment
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	SetCapability(GL_TEXTURE_2D, &m_textureEnabled, false);
+}
+
+// Render queue
+void Renderer::BeginRenderQueue()
+{
+	m_pRenderQueue->Clear();
+	m_recordingRenderQueue = true;
+}
+
+bool Renderer::IsRecordingRenderQueue()
+{
+	return m_recordingRenderQueue;
+}
+
+void Renderer::SubmitRenderPacket(RenderPacket* pPacket, const Vector3d& localCentre)
+{
+	pPacket->m_modelMatrix = m_model;
+	pPacket->m_modelViewMatrix = m_modelView;
+
+	// The camera looks down -z in view space
+	Vector3d viewCentre = m_modelView * localCentre;
+	pPacket->m_sortKey = RenderQueue::CreateSortKey(*pPacket, -viewCentre.z);
+
+	m_pRenderQueue->AddPacket(*pPacket);
+}
+
+void Renderer::FlushRenderQueue()
+{
+	m_recordingRenderQueue = false;
+
+	m_pRenderQueue->Sort();
+
+	// Each packet brings its own matrices, put back the ones in use when they're done
+	Matrix4x4 model = m_model;
+	Matrix4x4 modelView = m_modelView;
+	CullMode cullMode = m_cullMode;
+	float lineWidth = 0.0f;
+
+	StartMeshRender();
+
+	int numPackets = m_pRenderQueue->GetNumPackets();
+	for (int i = 0; i < numPackets; i++)
+	{
+		RenderPacket* pPacket = m_pRenderQueue->GetSortedPacket(i);
+
+		// The line width isn't part of the state cache, so only set it when it changes within the queue
+		if (pPacket->m_lineWidth > 0.0f && pPacket->m_lineWidth != lineWidth)
 		{
-			glTexCoordPointer(2, GL_FLOAT, 0, pVertexArray->pTextureCoordinates);
+			SetLineWidth(pPacket->m_lineWidth);
+			lineWidth = pPacket->m_lineWidth;
 		}
 
-		if (pVertexArray->type == VT_POSITION_DIFFUSE_ALPHA)
+		// Gather up the run of packets that can share an instanced draw with this one
+		int numInstances = 1;
+		if (CanInstanceRenderPacket(pPacket))
 		{
-			glColorPointer(4, GL_FLOAT, totalStride, &pVertexArray->pVA[3]);
+			while (i + numInstances < numPackets && CanInstanceRenderPackets(pPacket, m_pRenderQueue->GetSortedPacket(i + numInstances)))
+			{
+				numInstances++;
+			}
 		}
 
-		if (pVertexArray->type == VT_POSITION_DIFFUSE)
+		if (numInstances > 1)
+		{
+			DrawRenderPacketInstances(i, numInstances);
+			i += numInstances - 1;
+		}
+		else
 		{
-			glColorPointer(3, GL_FLOAT, totalStride, &pVertexArray->pVA[3]);
+			DrawRenderPacket(pPacket);
 		}
+	}
+
+	EndMeshRender();
+
+	DisableTransparency();
+	DisableTexture();
+	SetCullMode(cullMode);
+
+	m_model = model;
+	m_modelView = modelView;
+
+	m_numRenderPackets += numPackets;
+	m_pRenderQueue->Clear();
+}
+
+int Renderer::GetNumRenderPackets()
+{
+	return m_numRenderPackets;
+}
 
-		if (pVertexArray->type == VT_POSITION_NORMAL_UV_COLOUR || pVertexArray->type == VT_POSITION_NORMAL_COLOUR)
+void Renderer::DiscardRenderQueue()
+{
+	m_recordingRenderQueue = false;
+
+	m_pRenderQueue->Clear();
+}
+
+int Renderer::GetNumQueuedRenderPackets()
+{
+	return m_pRenderQueue->GetNumPackets();
+}
+
+bool Renderer::IsInstancedRenderingSupported()
+{
+	return m_instancingProgram != 0;
+}
+
+void Renderer::DrawRenderPacket(RenderPacket* pPacket)
+{
+	m_model = pPacket->m_modelMatrix;
+	m_modelView = pPacket->m_modelViewMatrix;
+
+	ApplyRenderPacketState(pPacket);
+
+	if (pPacket->m_applyTextureMatrix)
+	{
+		PushTextureMatrix();
+		MultiplyWorldMatrix(pPacket->m_modelMatrix);
+	}
+
+	SetMeshTint(pPacket->m_tint, pPacket->m_tintReplacesColour);
+
+	if (pPacket->m_staticBufferID != -1)
+	{
+		DrawMeshStaticBuffer(pPacket->m_staticBufferID, pPacket->m_firstIndex, pPacket->m_numIndices);
+	}
+	else if (pPacket->m_drawCallback)
+	{
+		pPacket->m_drawCallback();
+	}
+
+	ClearMeshTint();
+
+	if (pPacket->m_applyTextureMatrix)
+	{
+		PopTextureMatrix();
+	}
+}
+
+void Renderer::ApplyRenderPacketState(RenderPacket* pPacket)
+{
+	// Packets come out sorted by state, so the state cache filters out most of these
+	SetCullMode(pPacket->m_cullMode);
+	SetRenderMode(pPacket->m_renderMode);
+
+	if (pPacket->m_transparent)
+	{
+		EnableTransparency(BF_SRC_ALPHA, BF_ONE_MINUS_SRC_ALPHA);
+	}
+	else
+	{
+		DisableTransparency();
+	}
+
+	if (pPacket->m_textureID != -1)
+	{
+		BindTexture(pPacket->m_textureID);
+	}
+
+	if (pPacket->m_materialID != -1)
+	{
+		EnableMaterial(pPacket->m_materialID);
+	}
+}
+
+bool Renderer::CanInstanceRenderPacket(RenderPacket* pPacket)
+{
+	if (m_instancingProgram == 0 || pPacket->m_staticBufferID == -1 || pPacket->m_numIndices == 0)
+	{
+		return false;
+	}
+
+	// The instancing shader only passes the vertex colours through, so nothing lit or textured
+	if (pPacket->m_textureID != -1 || (pPacket->m_renderMode != RM_SOLID && pPacket->m_renderMode != RM_WIREFRAME))
+	{
+		return false;
+	}
+
+	VertexArray *pVertexArray = m_vertexArrays.Get(pPacket->m_staticBufferID);
+	if (pVertexArray == NULL || pVertexArray->nVerts == 0 || pVertexArray->vertexBufferID == 0)
+	{
+		return false;
+	}
+
+	VertexType type = pVertexArray->type;
+	return (type == VT_PACKED_POSITION_NORMAL_COLOUR || type == VT_POSITION_NORMAL_COLOUR || type == VT_POSITION_DIFFUSE || type == VT_POSITION_DIFFUSE_ALPHA);
+}
+
+bool Renderer::CanInstanceRenderPackets(RenderPacket* pFirstPacket, RenderPacket* pPacket)
+{
+	return (pPacket->m_staticBufferID == pFirstPacket->m_staticBufferID &&
+			pPacket->m_firstIndex == pFirstPacket->m_firstIndex &&
+			pPacket->m_numIndices == pFirstPacket->m_numIndices &&
+			pPacket->m_transparent == pFirstPacket->m_transparent &&
+			pPacket->m_materialID == pFirstPacket->m_materialID &&
+			pPacket->m_textureID == pFirstPacket->m_textureID &&
+			pPacket->m_renderMode == pFirstPacket->m_renderMode &&
+			pPacket->m_cullMode == pFirstPacket->m_cullMode &&
+			pPacket->m_lineWidth == pFirstPacket->m_lineWidth &&
+			pPacket->m_tintReplacesColour == pFirstPacket->m_tintReplacesColour);
+}
+
+void Renderer::DrawRenderPacketInstances(int firstPacket, int numPackets)
+{
+	RenderPacket* pFirstPacket = m_pRenderQueue->GetSortedPacket(firstPacket);
+	VertexArray *pVertexArray = m_vertexArrays.Get(pFirstPacket->m_staticBufferID);
+
+	ApplyRenderPacketState(pFirstPacket);
+	if ((pVertexArray->type != VT_POSITION_DIFFUSE_ALPHA) && (pVertexArray->type != VT_POSITION_DIFFUSE))
+	{
+		if (pVertexArray->materialID != (unsigned int)-1)
+		{
+			EnableMaterial(pVertexArray->materialID);
+		}
+	}
+
+	// The shader doesn't read texture coordinates, so unlike DrawRenderPacket() nothing goes on the texture matrix.
+	// The same packed offset DrawStaticBuffer() puts on the model view goes on each instance instead.
+	Matrix4x4 packedOffset;
+	if (pVertexArray->type == VT_PACKED_POSITION_NORMAL_COLOUR)
+	{
+		packedOffset.SetTranslation(Vector3d(-PACKED_POSITION_OFFSET, -PACKED_POSITION_OFFSET, -PACKED_POSITION_OFFSET));
+	}
+
+	m_vInstanceData.resize(numPackets * INSTANCE_DATA_SIZE);
+	for (int i = 0; i < numPackets; i++)
+	{
+		RenderPacket* pPacket = m_pRenderQueue->GetSortedPacket(firstPacket + i);
+		float* pInstanceData = &m_vInstanceData[i * INSTANCE_DATA_SIZE];
+
+		Matrix4x4 modelView = packedOffset * pPacket->m_modelViewMatrix;
+		modelView.GetMatrix(pInstanceData);
+		pInstanceData[16] = pPacket->m_tint.GetRed();
+		pInstanceData[17] = pPacket->m_tint.GetGreen();
+		pInstanceData[18] = pPacket->m_tint.GetBlue();
+		pInstanceData[19] = pPacket->m_tint.GetAlpha();
+	}
+
+	// Orphan last draw's data rather than wait for the GPU to finish with it
+	glBindBuffer(GL_ARRAY_BUFFER, m_instanceBufferID);
+	glBufferData(GL_ARRAY_BUFFER, m_vInstanceData.size() * sizeof(float), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, m_vInstanceData.size() * sizeof(float), &m_vInstanceData[0]);
+
+	SetPrimativeMode(PM_TRIANGLES);
+	BindStaticBuffer(pVertexArray, true, false);
+
+	// Set up inside the static buffer's vertex array object, and taken back out again after the draw
+	glBindBuffer(GL_ARRAY_BUFFER, m_instanceBufferID);
+	GLsizei instanceStride = INSTANCE_DATA_SIZE * sizeof(float);
+	for (int i = 0; i < 5; i++)
+	{
+		GLuint attribute = (i < 4) ? INSTANCE_MODEL_VIEW_ATTRIBUTE + i : INSTANCE_TINT_ATTRIBUTE;
+		glEnableVertexAttribArray(attribute);
+		glVertexAttribPointer(attribute, 4, GL_FLOAT, GL_FALSE, instanceStride, (const GLvoid*)(i * 4 * sizeof(float)));
+		glVertexAttribDivisor(attribute, 1);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glUseProgram(m_instancingProgram);
+	glUniform1f(m_instancingTintReplacesColourLocation, pFirstPacket->m_tintReplacesColour ? 1.0f : 0.0f);
+
+	if (pFirstPacket->m_numIndices != -1)
+	{
+		glDrawElementsInstanced(m_primativeMode, pFirstPacket->m_numIndices, GL_UNSIGNED_INT, GetStaticBufferIndices(pVertexArray, pFirstPacket->m_firstIndex), numPackets);
+	}
+	else if (pVertexArray->nIndices != 0)
+	{
+		glDrawElementsInstanced(m_primativeMode, pVertexArray->nIndices, GL_UNSIGNED_INT, NULL, numPackets);
+	}
+	else
+	{
+		glDrawArraysInstanced(m_primativeMode, 0, pVertexArray->nVerts, numPackets);
+	}
+	m_numDrawCalls++;
+
+	glUseProgram(0);
+
+	for (int i = 0; i < 5; i++)
+	{
+		GLuint attribute = (i < 4) ? INSTANCE_MODEL_VIEW_ATTRIBUTE + i : INSTANCE_TINT_ATTRIBUTE;
+		glVertexAttribDivisor(attribute, 0);
+		glDisableVertexAttribArray(attribute);
+	}
+
+	UnbindStaticBuffer(pVertexArray, true);
+}
+
+// Merged static buffers
+bool Renderer::CreateMergedStaticBuffer(unsigned int materialID, OpenGLTriangleMesh** ppMeshes, int numMeshes, unsigned int *pID)
+{
+	int numVertices = 0;
+	int numIndices = 0;
+	for (int meshIndex = 0; meshIndex < numMeshes; meshIndex++)
+	{
+		if (ppMeshes[meshIndex] != NULL)
 		{
-			glColorPointer(4, GL_FLOAT, totalStride, &pVertexArray->pVA[6]);
+			numVertices += (int)ppMeshes[meshIndex]->m_vertices.size();
+			numIndices += (int)ppMeshes[meshIndex]->m_triangles.size() * 3;
 		}
+	}
+
+	if (numIndices == 0)
+	{
+		return false;
+	}
+
+	vector<OGLPackedPositionNormalColourVertex> vVertices(numVertices);
+	vector<unsigned int> vIndices(numIndices);
 
-		if (pVertexArray->nIndices != 0)
+	int firstVertex = 0;
+	int firstIndex = 0;
+	for (int meshIndex = 0; meshIndex < numMeshes; meshIndex++)
+	{
+		OpenGLTriangleMesh* pMesh = ppMeshes[meshIndex];
+		if (pMesh == NULL)
 		{
-			glDrawElements(m_primativeMode, pVertexArray->nIndices, GL_UNSIGNED_INT, pVertexArray->pIndices);
+			continue;
 		}
-		else
+
+		int meshVertices = (int)pMesh->m_vertices.size();
+		if (pMesh->m_meshType != OGLMeshType_Packed || (meshVertices != 0 && PackMeshVertices(pMesh, &vVertices[firstVertex]) == false))
 		{
-			glDrawArrays(m_primativeMode, 0, pVertexArray->nVerts);
+			return false;
 		}
 
-		return true;
+		for (int i = firstVertex; i < firstVertex + meshVertices; i++)
+		{
+			vVertices[i].pad = (short)meshIndex;
+		}
+
+		const unsigned int* pMeshIndices = pMesh->m_triangles.empty() ? NULL : pMesh->m_triangles[0].vertexIndices;
+		int meshIndices = (int)pMesh->m_triangles.size() * 3;
+		for (int i = 0; i < meshIndices; i++)
+		{
+			vIndices[firstIndex + i] = pMeshIndices[i] + firstVertex;
+		}
+
+		firstVertex += meshVertices;
+		firstIndex += meshIndices;
 	}
 
-	return false;
+	bool created;
+	if (*pID == (unsigned int)-1)
+	{
+		created = CreateStaticBuffer(VT_PACKED_POSITION_NORMAL_COLOUR, materialID, -1, numVertices, 0, numIndices, &vVertices[0], NULL, &vIndices[0], pID);
+	}
+	else
+	{
+		created = RecreateStaticBuffer(*pID, VT_PACKED_POSITION_NORMAL_COLOUR, materialID, -1, numVertices, 0, numIndices, &vVertices[0], NULL, &vIndices[0]);
+	}
+
+	if (created == false)
+	{
+		return false;
+	}
+
+	// Each mesh is drawn from its range of the merged buffer from now on, so any buffer of its own is let go
+	firstVertex = 0;
+	firstIndex = 0;
+	for (int meshIndex = 0; meshIndex < numMeshes; meshIndex++)
+	{
+		OpenGLTriangleMesh* pMesh = ppMeshes[meshIndex];
+		if (pMesh == NULL)
+		{
+			continue;
+		}
+
+		if (pMesh->m_staticMeshId != (unsigned int)-1 && pMesh->m_sharedStaticBuffer == false)
+		{
+			DeleteStaticBuffer(pMesh->m_staticMeshId);
+		}
+
+		pMesh->m_materialId = materialID;
+		pMesh->m_textureId = -1;
+		pMesh->m_staticMeshId = *pID;
+		pMesh->m_sharedStaticBuffer = true;
+		pMesh->m_firstVertex = firstVertex;
+		pMesh->m_numVertices = (int)pMesh->m_vertices.size();
+		pMesh->m_firstIndex = firstIndex;
+		pMesh->m_numIndices = (int)pMesh->m_triangles.size() * 3;
+
+		firstVertex += pMesh->m_numVertices;
+		firstIndex += pMesh->m_numIndices;
+	}
+
+	return true;
+}
+
+bool Renderer::BeginStaticBufferRanges(unsigned int id)
+{
+	VertexArray *pVertexArray = m_vertexArrays.Get(id);
+
+	if (pVertexArray == NULL || pVertexArray->nIndices == 0)
+	{
+		return false;
+	}
+
+	SetPrimativeMode(PM_TRIANGLES);
+
+	// The arrays are enabled once by StartMeshRender(), so only the pointers are set here
+	BindStaticBuffer(pVertexArray, true, false);
+	m_pRangesVertexArray = pVertexArray;
+
+	return true;
+}
+
+bool Renderer::RenderStaticBufferRange(int firstIndex, int numIndices)
+{
+	VertexArray *pVertexArray = m_pRangesVertexArray;
+
+	if (pVertexArray == NULL || firstIndex < 0 || numIndices <= 0 || firstIndex + numIndices > pVertexArray->nIndices)
+	{
+		return false;
+	}
+
+	bool tinted = IsMeshTinted();
+	if (tinted)
+	{
+		BeginMeshTint();
+	}
+
+	ApplyStaticBufferModelView(pVertexArray);
+
+	glDrawElements(m_primativeMode, numIndices, GL_UNSIGNED_INT, GetStaticBufferIndices(pVertexArray, firstIndex));
+	m_numDrawCalls++;
+
+	if (tinted)
+	{
+		EndMeshTint();
+	}
+
+	return true;
+}
+
+void Renderer::EndStaticBufferRanges()
+{
+	if (m_pRangesVertexArray != NULL)
+	{
+		UnbindStaticBuffer(m_pRangesVertexArray, true);
+		m_pRangesVertexArray = NULL;
+	}
+}
+
+// Skinned rendering
+bool Renderer::IsSkinnedRenderingSupported()
+{
+	return m_skinningProgram != 0;
+}
+
+bool Renderer::RenderSkinnedStaticBuffer(unsigned int id, const Matrix4x4** ppBoneMatrices, int numBones)
+{
+	if (m_skinningProgram == 0 || m_vertexArrays.IsValid(id) == false || numBones > MAX_SKINNING_BONES)
+	{
+		return false;
+	}
+
+	VertexArray *pVertexArray = m_vertexArrays.Get(id);
+	if (pVertexArray->type != VT_PACKED_POSITION_NORMAL_COLOUR || pVertexArray->nIndices == 0 || pVertexArray->vertexBufferID == 0)
+	{
+		return false;
+	}
+
+	// Built exactly as MultiplyWorldMatrix() and DrawStaticBuffer() would for each mesh on its own, so the two paths match
+	Matrix4x4 packedOffset;
+	packedOffset.SetTranslation(Vector3d(-PACKED_POSITION_OFFSET, -PACKED_POSITION_OFFSET, -PACKED_POSITION_OFFSET));
+	for (int i = 0; i < numBones; i++)
+	{
+		if (ppBoneMatrices[i] == NULL)
+		{
+			// Every vertex of a hidden bone collapses onto the same point, leaving nothing to rasterise
+			memset(&m_boneMatrixData[i * 16], 0, 16 * sizeof(float));
+			continue;
+		}
+
+		Matrix4x4 transform(*ppBoneMatrices[i]);
+		Matrix4x4 modelView = transform * m_modelView;
+		Matrix4x4 boneModelView = packedOffset * modelView;
+		Matrix4x4 boneMatrix = boneModelView * m_projectionMatrix;
+		boneMatrix.GetMatrix(&m_boneMatrixData[i * 16]);
+	}
+
+	SetPrimativeMode(PM_TRIANGLES);
+	BindStaticBuffer(pVertexArray, true, false);
+
+	// Set up inside the static buffer's vertex array object, and taken back out again after the draw
+	glBindBuffer(GL_ARRAY_BUFFER, pVertexArray->vertexBufferID);
+	glEnableVertexAttribArray(SKINNING_BONE_INDEX_ATTRIBUTE);
+	glVertexAttribPointer(SKINNING_BONE_INDEX_ATTRIBUTE, 1, GL_SHORT, GL_FALSE, pVertexArray->vertexSize, (const GLvoid*)offsetof(OGLPackedPositionNormalColourVertex, pad));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glUseProgram(m_skinningProgram);
+	glUniformMatrix4fv(m_boneMatricesLocation, numBones, GL_FALSE, m_boneMatrixData);
+	glUniform4f(m_skinningTintLocation, m_meshTint.GetRed(), m_meshTint.GetGreen(), m_meshTint.GetBlue(), m_meshTint.GetAlpha());
+	glUniform1f(m_skinningTintReplacesColourLocation, m_meshTintReplacesColour ? 1.0f : 0.0f);
+
+	glDrawElements(m_primativeMode, pVertexArray->nIndices, GL_UNSIGNED_INT, NULL);
+	m_numDrawCalls++;
+
+	glUseProgram(0);
+
+	glDisableVertexAttribArray(SKINNING_BONE_INDEX_ATTRIBUTE);
+	UnbindStaticBuffer(pVertexArray, true);
+
+	return true;
+}
+
+bool Renderer::CreateInstancingShader()
+{
+	// The vertex arrays come in through the fixed function attributes, only the per instance data is generic
+	const char* vertexSource =
+		"#version 120\n"
+		"attribute vec4 instanceModelView0;\n"
+		"attribute vec4 instanceModelView1;\n"
+		"attribute vec4 instanceModelView2;\n"
+		"attribute vec4 instanceModelView3;\n"
+		"attribute vec4 instanceTint;\n"
+		"uniform float tintReplacesColour;\n"
+		"void main()\n"
+		"{\n"
+		"	mat4 modelView = mat4(instanceModelView0, instanceModelView1, instanceModelView2, instanceModelView3);\n"
+		"	gl_Position = gl_ProjectionMatrix * (modelView * gl_Vertex);\n"
+		"	gl_FrontColor = vec4(mix(gl_Color.rgb, vec3(1.0), tintReplacesColour), gl_Color.a) * instanceTint;\n"
+		"	gl_BackColor = gl_FrontColor;\n"
+		"}\n";
+
+	const char* fragmentSource =
+		"#version 120\n"
+		"void main()\n"
+		"{\n"
+		"	gl_FragColor = gl_Color;\n"
+		"}\n";
+
+	const char* attributeNames[] = { "instanceModelView0", "instanceModelView1", "instanceModelView2", "instanceModelView3", "instanceTint" };
+	const int attributeLocations[] = { INSTANCE_MODEL_VIEW_ATTRIBUTE + 0, INSTANCE_MODEL_VIEW_ATTRIBUTE + 1, INSTANCE_MODEL_VIEW_ATTRIBUTE + 2, INSTANCE_MODEL_VIEW_ATTRIBUTE + 3, INSTANCE_TINT_ATTRIBUTE };
+
+	GLuint program = CreateShaderProgram(vertexSource, fragmentSource, attributeNames, attributeLocations, 5, "Instancing shader failed to link, drawing each instance separately");
+	if (program == 0)
+	{
+		return false;
+	}
+
+	m_instancingProgram = program;
+	m_instancingTintReplacesColourLocation = glGetUniformLocation(program, "tintReplacesColour");
+	glGenBuffers(1, &m_instanceBufferID);
+
+	return true;
+}
+
+bool Renderer::CreateSkinningShader()
+{
+	// The bone matrices are the whole transform, projection included. Fixed function multiplies the vertices by
+	// the combined matrix too, which keeps the two paths rasterising exactly the same pixels.
+	const char* vertexSource =
+		"#version 120\n"
+		"uniform mat4 boneMatrices[24];\n"
+		"uniform vec4 tint;\n"
+		"uniform float tintReplacesColour;\n"
+		"attribute float boneIndex;\n"
+		"void main()\n"
+		"{\n"
+		"	gl_Position = boneMatrices[int(boneIndex)] * gl_Vertex;\n"
+		"	gl_FrontColor = vec4(mix(gl_Color.rgb, vec3(1.0), tintReplacesColour), gl_Color.a) * tint;\n"
+		"	gl_BackColor = gl_FrontColor;\n"
+		"}\n";
+
+	const char* fragmentSource =
+		"#version 120\n"
+		"void main()\n"
+		"{\n"
+		"	gl_FragColor = gl_Color;\n"
+		"}\n";
+
+	static_assert(MAX_SKINNING_BONES == 24, "The skinning shader's bone array must match MAX_SKINNING_BONES");
+
+	const char* attributeNames[] = { "boneIndex" };
+	const int attributeLocations[] = { SKINNING_BONE_INDEX_ATTRIBUTE };
+
+	GLuint program = CreateShaderProgram(vertexSource, fragmentSource, attributeNames, attributeLocations, 1, "Skinning shader failed to link, drawing each mesh separately");
+	if (program == 0)
+	{
+		return false;
+	}
+
+	m_skinningProgram = program;
+	m_boneMatricesLocation = glGetUniformLocation(program, "boneMatrices");
+	m_skinningTintLocation = glGetUniformLocation(program, "tint");
+	m_skinningTintReplacesColourLocation = glGetUniformLocation(program, "tintReplacesColour");
+
+	return true;
+}
+
+// Returns 0 if the program doesn't link, with the message and the link log written out
+unsigned int Renderer::CreateShaderProgram(const char* vertexSource, const char* fragmentSource, const char** attributeNames, const int* attributeLocations, int numAttributes, const char* failureMessage)
+{
+	GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vertexShader, 1, &vertexSource, NULL);
+	glCompileShader(vertexShader);
+
+	GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fragmentShader, 1, &fragmentSource, NULL);
+	glCompileShader(fragmentShader);
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+	for (int i = 0; i < numAttributes; i++)
+	{
+		glBindAttribLocation(program, attributeLocations[i], attributeNames[i]);
+	}
+	glLinkProgram(program);
+
+	// The program keeps hold of the shaders for as long as it needs them
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked != GL_TRUE)
+	{
+		char log[1024];
+		glGetProgramInfoLog(program, sizeof(log), NULL, log);
+		cout << "[WARNING] " << failureMessage << ":\n" << log << "\n";
+
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return program;
 }
 
 // Name rendering and name picking
@@ -1922,8 +3159,13 @@ void Renderer::StartNamePicking(unsigned int lViewportid, int lX, int lY)
 	glGetIntegerv(GL_VIEWPORT, viewportCoords);
 	gluPickMatrix(lX, lY, 3, 3, viewportCoords);
 
+	// Picking is rare enough that reading the pick matrix back is fine
+	float mat[16];
+	glGetFloatv(GL_PROJECTION_MATRIX, mat);
+	m_projectionMatrix = mat;
+
 	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
+	m_numMatrixCalls += 3;
 
 	MultViewProjection();
 }
@@ -1961,35 +3203,229 @@ int Renderer::GetPickedObject()
 	return -1;
 }
 
+// State cache
+void Renderer::InvalidateStateCache()
+{
+	m_textureEnabled = -1;
+	m_lightingEnabled = -1;
+	m_cullFaceEnabled = -1;
+	m_blendEnabled = -1;
+	m_depthTestEnabled = -1;
+	m_polygonMode = -1;
+	m_cullFace = -1;
+	m_blendSource = -1;
+	m_blendDestination = -1;
+	m_depthFunction = -1;
+	m_depthMask = -1;
+	m_activeTexture = -1;
+	m_boundTexture = -1;
+	m_appliedMaterial = -1;
+
+	for (int i = 0; i < MAX_CACHED_LIGHTS; i++)
+	{
+		m_appliedLights[i] = -1;
+	}
+}
+
+int Renderer::GetNumStateChanges()
+{
+	return m_numStateChanges;
+}
+
+int Renderer::GetNumFilteredStateChanges()
+{
+	return m_numFilteredStateChanges;
+}
+
+// Returns false, and counts the change as filtered, when GL already has this value
+bool Renderer::CheckStateChange(int *pCachedValue, int value)
+{
+	if (*pCachedValue == value)
+	{
+		m_numFilteredStateChanges++;
+		return false;
+	}
+
+	*pCachedValue = value;
+	m_numStateChanges++;
+
+	return true;
+}
+
+void Renderer::SetCapability(GLenum capability, int *pEnabled, bool enable)
+{
+	if (CheckStateChange(pEnabled, enable ? 1 : 0))
+	{
+		if (enable)
+		{
+			glEnable(capability);
+		}
+		else
+		{
+			glDisable(capability);
+		}
+	}
+}
+
+void Renderer::SetActiveTexture(GLenum textureUnit)
+{
+	if (CheckStateChange(&m_activeTexture, textureUnit))
+	{
+		glActiveTextureARB(textureUnit);
+
+		// Texture enable and binding belong to the texture unit
+		m_textureEnabled = -1;
+		m_boundTexture = -1;
+	}
+}
+
+void Renderer::SetBoundTexture(GLuint textureId)
+{
+	if (CheckStateChange(&m_boundTexture, textureId))
+	{
+		glBindTexture(GL_TEXTURE_2D, textureId);
+	}
+}
+
+// Resources
+int Renderer::GetNumLiveResources(RendererResource type)
+{
+	switch (type)
+	{
+	case RR_VIEWPORT:
+		return m_viewports.GetNumLive();
+	case RR_MATERIAL:
+		return m_materials.GetNumLive();
+	case RR_TEXTURE:
+		return m_textures.GetNumLive();
+	case RR_LIGHT:
+		return m_lights.GetNumLive();
+	case RR_FONT:
+		return m_freetypeFonts.GetNumLive();
+	case RR_STATIC_BUFFER:
+		return m_vertexArrays.GetNumLive();
+	default:
+		return 0;
+	}
+}
+
+int Renderer::GetPeakResources(RendererResource type)
+{
+	switch (type)
+	{
+	case RR_VIEWPORT:
+		return m_viewports.GetPeakLive();
+	case RR_MATERIAL:
+		return m_materials.GetPeakLive();
+	case RR_TEXTURE:
+		return m_textures.GetPeakLive();
+	case RR_LIGHT:
+		return m_lights.GetPeakLive();
+	case RR_FONT:
+		return m_freetypeFonts.GetPeakLive();
+	case RR_STATIC_BUFFER:
+		return m_vertexArrays.GetPeakLive();
+	default:
+		return 0;
+	}
+}
+
 // Frustum
 Frustum* Renderer::GetFrustum(unsigned int frustumid)
 {
-	Frustum* pFrustum = m_frustums[frustumid];
+	Frustum* pFrustum = m_frustums.Get(frustumid);
 
 	return pFrustum;
 }
 
 int Renderer::PointInFrustum(unsigned int frustumid, const Vector3d &point)
 {
-	Frustum* pFrustum = m_frustums[frustumid];
+	Frustum* pFrustum = m_frustums.Get(frustumid);
 
 	return pFrustum->PointInFrustum(point);
 }
 
 int Renderer::SphereInFrustum(unsigned int frustumid, const Vector3d &point, float radius)
 {
-	Frustum* pFrustum = m_frustums[frustumid];
+	Frustum* pFrustum = m_frustums.Get(frustumid);
 
 	return pFrustum->SphereInFrustum(point, radius);
 }
 
 int Renderer::CubeInFrustum(unsigned int frustumid, const Vector3d &center, float x, float y, float z)
 {
-	Frustum* pFrustum = m_frustums[frustumid];
+	Frustum* pFrustum = m_frustums.Get(frustumid);
 
 	return pFrustum->CubeInFrustum(center, x, y, z);
 }
 
+// Frustum culling
+void Renderer::SetFrustumCullingEnabled(bool enabled)
+{
+	m_frustumCulling = enabled;
+}
+
+bool Renderer::IsFrustumCullingEnabled()
+{
+	return m_frustumCulling;
+}
+
+int Renderer::ModelSphereInFrustum(const Vector3d &centre, float radius)
+{
+	if (m_frustumCulling == false)
+	{
+		return Frustum::FRUSTUM_INSIDE;
+	}
+
+	Viewport* pViewport = m_viewports.Get(m_activeViewport);
+	Frustum* pFrustum = m_frustums.Get(m_activeViewport);
+
+	if (pViewport == NULL || pFrustum == NULL || m_projection != &pViewport->Perspective)
+	{
+		return Frustum::FRUSTUM_INSIDE;
+	}
+
+	// Into world space, with the radius grown by the largest scale of the model matrix
+	Vector3d worldCentre = m_model * centre;
+
+	float scaleX = Vector3d(m_model.m[0], m_model.m[1], m_model.m[2]).GetLength();
+	float scaleY = Vector3d(m_model.m[4], m_model.m[5], m_model.m[6]).GetLength();
+	float scaleZ = Vector3d(m_model.m[8], m_model.m[9], m_model.m[10]).GetLength();
+	float maxScale = scaleX;
+	if (scaleY > maxScale)
+	{
+		maxScale = scaleY;
+	}
+	if (scaleZ > maxScale)
+	{
+		maxScale = scaleZ;
+	}
+	float worldRadius = radius * maxScale;
+
+	int result = pFrustum->SphereInFrustum(worldCentre, worldRadius);
+
+	if (result == Frustum::FRUSTUM_OUTSIDE)
+	{
+		m_numFrustumCulled++;
+	}
+	else
+	{
+		m_numFrustumVisible++;
+	}
+
+	return result;
+}
+
+int Renderer::GetNumFrustumCulled()
+{
+	return m_numFrustumCulled;
+}
+
+int Renderer::GetNumFrustumVisible()
+{
+	return m_numFrustumVisible;
+}
+
 bool InitOpenGLExtensions()
 {
 	if (extensions_init)
@@ -2014,6 +3450,13 @@ bool InitOpenGLExtensions()
 
 	HasGLSLSupport();
 
+	// Static buffers live in buffer objects when they are available, and fall back to client side arrays otherwise
+	useBufferObjects = (GLEW_VERSION_1_5 == GL_TRUE);
+	useVertexArrayObjects = useBufferObjects && (GLEW_VERSION_3_0 == GL_TRUE || GLEW_ARB_vertex_array_object == GL_TRUE);
+
+	// Instanced draws need instanced arrays for the per instance data, and a shader to apply it
+	useInstancing = useGLSL && useVertexArrayObjects && (GLEW_VERSION_3_3 == GL_TRUE);
+
 	return true;
 }
 
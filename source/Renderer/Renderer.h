@@ -36,7 +36,10 @@ using namespace std;
 #include "texture.h"
 #include "material.h"
 #include "light.h"
+#include "ResourcePool.h"
 
+class RenderQueue;
+class RenderPacket;
 
 enum ProjectionMode
 {
@@ -92,6 +95,17 @@ enum DepthTest
 	DT_NOTEQUAL,
 };
 
+enum RendererResource
+{
+	RR_VIEWPORT = 0,
+	RR_MATERIAL,
+	RR_TEXTURE,
+	RR_LIGHT,
+	RR_FONT,
+	RR_STATIC_BUFFER,
+	RR_NUMRESOURCES,
+};
+
 enum ImmediateModePrimitive
 {
 	IM_POINTS = 0,
@@ -143,6 +157,14 @@ struct OGLUVCoordinate
 	float u, v;			// Texture coordinates
 };
 
+// Compact vertex for voxel meshes, positions are stored as integers offset by PACKED_POSITION_OFFSET
+struct OGLPackedPositionNormalColourVertex
+{
+	short x, y, z, pad;				// Position.
+	signed char nx, ny, nz, nw;		// Normal.
+	unsigned char r, g, b, a;		// Colour and alpha
+};
+
 class Renderer
 {
 public:
@@ -191,6 +213,16 @@ public:
 	void RotateWorldMatrix(float x, float y, float z);
 	void ScaleWorldMatrix(float x, float y, float z);
 
+	// The model view is composed on the CPU and only loaded into GL before something is drawn, if it changed.
+	// The renderer's own drawing does this, anything that draws with GL directly must call it first.
+	void ApplyModelViewMatrix();
+
+	// GL matrix calls made since BeginScene()
+	int GetNumMatrixCalls();
+
+	// GL draw calls made since BeginScene(), an instanced draw counts once however many instances it has
+	int GetNumDrawCalls();
+
 	// Texture matrix manipulations
 	void SetTextureMatrix();
 	void PushTextureMatrix();
@@ -265,28 +297,77 @@ public:
 	// Vertex buffers
 	bool CreateStaticBuffer(VertexType type, unsigned int materialID, unsigned int textureID, int nVerts, int nTextureCoordinates, int nIndices, const void *pVerts, const void *pTextureCoordinates, const unsigned int *pIndices, unsigned int *pID);
 	bool RecreateStaticBuffer(unsigned int ID, VertexType type, unsigned int materialID, unsigned int textureID, int nVerts, int nTextureCoordinates, int nIndices, const void *pVerts, const void *pTextureCoordinates, const unsigned int *pIndices);
+	bool UpdateStaticBuffer(unsigned int id, int firstVertex, int nVerts, const void *pVerts);
 	void DeleteStaticBuffer(unsigned int id);
-	bool RenderStaticBuffer(unsigned int id);
-	bool RenderStaticBuffer_NoColour(unsigned int id);
+	void SetKeepStaticBufferShadowCopies(bool keep);
+	bool GetKeepStaticBufferShadowCopies();
+	bool RenderStaticBuffer(unsigned int id, int firstIndex = 0, int numIndices = -1);  // -1 draws every index
+	bool RenderStaticBuffer_NoColour(unsigned int id, int firstIndex = 0, int numIndices = -1);
 	bool RenderFromArray(VertexType type, unsigned int materialID, unsigned int textureID, int nVerts, int nTextureCoordinates, int nIndices, const void *pVerts, const void *pTextureCoordinates, const unsigned int *pIndices);
 	unsigned int GetStride(VertexType type);
 
 	// Mesh
 	OpenGLTriangleMesh* CreateMesh(OGLMeshType meshType);
 	void ClearMesh(OpenGLTriangleMesh* pMesh);
+	void ReserveMesh(unsigned int numVertices, unsigned int numTriangles, OpenGLTriangleMesh* pMesh);
 	unsigned int AddVertexToMesh(Vector3d p, Vector3d n, float r, float g, float b, float a, OpenGLTriangleMesh* pMesh);
 	unsigned int AddTextureCoordinatesToMesh(float s, float t, OpenGLTriangleMesh* pMesh);
 	unsigned int AddTriangleToMesh(unsigned int vertexId1, unsigned int vertexId2, unsigned int vertexId3, OpenGLTriangleMesh* pMesh);
 	void ModifyMeshAlpha(float alpha, OpenGLTriangleMesh* pMesh);
 	void ModifyMeshColour(float r, float g, float b, OpenGLTriangleMesh* pMesh);
 	void FinishMesh(unsigned int textureID, unsigned int materialID, OpenGLTriangleMesh* pMesh);
+	bool PackMeshVertices(OpenGLTriangleMesh* pMesh, OGLPackedPositionNormalColourVertex* pPackedVertices);
 	void RenderMesh(OpenGLTriangleMesh* pMesh);
 	void RenderMesh_NoColour(OpenGLTriangleMesh* pMesh);
+	void ReleaseMeshData(OpenGLTriangleMesh* pMesh);
 	void GetMeshInformation(int *numVerts, int *numTris, OpenGLTriangleMesh* pMesh);
 	void StartMeshRender();
 	void EndMeshRender();
 	bool MeshStaticBufferRender(OpenGLTriangleMesh* pMesh);
 
+	// Mesh tint
+	// Applied to the vertex colours of untextured mesh static buffers as they are drawn, so fades and flashes never touch
+	// the vertex data. The tint multiplies the vertex colours, or with replaceColour its rgb replaces theirs.
+	void SetMeshTint(const Colour& tint, bool replaceColour);
+	void ClearMeshTint();
+
+	// Render queue
+	// While recording, models submit their draws as packets instead of drawing straight away.
+	// FlushRenderQueue() sorts them by state and depth and draws them all. Outlines, silhouettes and
+	// name picking still draw straight away, so anything meant to go over the top belongs after the flush.
+	void BeginRenderQueue();
+	bool IsRecordingRenderQueue();
+	void SubmitRenderPacket(RenderPacket* pPacket, const Vector3d& localCentre);
+	void FlushRenderQueue();
+	int GetNumRenderPackets();
+
+	// Stops recording and throws the packets away without drawing them, for timing the submission on its own
+	void DiscardRenderQueue();
+	int GetNumQueuedRenderPackets();
+
+	// Packets that draw the same static buffer in the same state, one after the other in the sorted queue,
+	// are drawn with a single instanced draw call when the GL context supports it
+	bool IsInstancedRenderingSupported();
+
+	// Merged static buffers
+	// Packed voxel meshes uploaded together into one static buffer, straight from their vertex data, so a whole model only
+	// needs the one buffer bound. The meshes give up any static buffers of their own and are drawn from their ranges of the
+	// merged one, which the caller owns, and every vertex keeps the index of its mesh in pad. Fails, leaving the meshes
+	// alone, if any of them can't be packed. The ranges can also be drawn between BeginStaticBufferRanges() and
+	// EndStaticBufferRanges(), each with the current model view and mesh tint, the buffer staying bound in between.
+	// Nothing else that draws may be called until the ranges are ended.
+	bool CreateMergedStaticBuffer(unsigned int materialID, OpenGLTriangleMesh** ppMeshes, int numMeshes, unsigned int *pID);  // Refills *pID if it isn't -1
+	bool BeginStaticBufferRanges(unsigned int id);
+	bool RenderStaticBufferRange(int firstIndex, int numIndices);
+	void EndStaticBufferRanges();
+
+	// Skinned rendering
+	// Draws a merged static buffer with each mesh's index as its bone. The draw takes a matrix per bone on top of the current
+	// model view, so a whole animated model is a single draw call. A NULL bone matrix hides that bone's vertices. Vertex
+	// colours are drawn unlit, as in RM_SOLID and RM_WIREFRAME, with the mesh tint applied.
+	bool IsSkinnedRenderingSupported();
+	bool RenderSkinnedStaticBuffer(unsigned int id, const Matrix4x4** ppBoneMatrices, int numBones);
+
 	// Name rendering and name picking
 	void InitNameStack();
 	void LoadNameOntoStack(int lName);
@@ -294,20 +375,88 @@ public:
 	void StartNamePicking(unsigned int lViewportid, int lX, int lY);
 	int  GetPickedObject();
 
+	// State cache
+	// The renderer remembers the GL state it has set and skips changes that wouldn't change anything.
+	// Anything that changes GL state directly, rather than through the renderer, must call this afterwards.
+	void InvalidateStateCache();
+	int GetNumStateChanges();
+	int GetNumFilteredStateChanges();
+
+	// Resources
+	// Every resource is referred to by a generational handle. A handle kept after its resource was deleted is stale,
+	// and is ignored rather than reaching whatever resource reuses the slot.
+	int GetNumLiveResources(RendererResource type);
+	int GetPeakResources(RendererResource type);
+
 	// Frustum
 	Frustum* GetFrustum(unsigned int frustumid);
 	int PointInFrustum(unsigned int frustumid, const Vector3d &point);
 	int SphereInFrustum(unsigned int frustumid, const Vector3d &point, float radius);
 	int CubeInFrustum(unsigned int frustumid, const Vector3d &center, float x, float y, float z);
 
+	// Frustum culling
+	// Bounds are tested against the frustum of the active viewport, as set up by Camera::Look(). Culling is off until it is
+	// enabled, since passes that aren't drawn from the camera, like shadows, still need what the camera can't see.
+	void SetFrustumCullingEnabled(bool enabled);
+	bool IsFrustumCullingEnabled();
+
+	// A sphere in the space of the current model matrix, always FRUSTUM_INSIDE unless culling is enabled in a perspective projection
+	int ModelSphereInFrustum(const Vector3d &centre, float radius);
+
+	// Bounds found outside of the frustum and bounds kept since BeginScene()
+	int GetNumFrustumCulled();
+	int GetNumFrustumVisible();
+
 protected:
 	/* Protected methods */
 
 private:
 	/* Private methods */
+	void SetupStaticBuffer(VertexArray *pVertexArray, VertexType type, unsigned int materialID, unsigned int textureID, int nVerts, int nTextureCoordinates, int nIndices, const void *pVerts, const void *pTextureCoordinates, const unsigned int *pIndices);
+	void ReleaseStaticBufferObjects(VertexArray *pVertexArray);
+	void SetStaticBufferPointers(VertexArray *pVertexArray, bool colour, bool enableArrays);
+	void BindStaticBuffer(VertexArray *pVertexArray, bool colour, bool enableArrays);
+	void UnbindStaticBuffer(VertexArray *pVertexArray, bool colour);
+	void ApplyStaticBufferModelView(VertexArray *pVertexArray);
+	void DrawStaticBuffer(VertexArray *pVertexArray, int firstIndex, int numIndices);
+	bool DrawMeshStaticBuffer(unsigned int id, int firstIndex, int numIndices);
+	bool IsMeshTinted();
+	void BeginMeshTint();
+	void EndMeshTint();
+	void DrawRenderPacket(RenderPacket* pPacket);
+	void ApplyRenderPacketState(RenderPacket* pPacket);
+	bool CanInstanceRenderPacket(RenderPacket* pPacket);
+	bool CanInstanceRenderPackets(RenderPacket* pFirstPacket, RenderPacket* pPacket);
+	void DrawRenderPacketInstances(int firstPacket, int numPackets);
+	bool CreateInstancingShader();
+	bool CreateSkinningShader();
+	unsigned int CreateShaderProgram(const char* vertexSource, const char* fragmentSource, const char** attributeNames, const int* attributeLocations, int numAttributes, const char* failureMessage);
+	void MultiplyEditMatrix(const Matrix4x4 &mat);
+	void LoadModelViewMatrix(const Matrix4x4 &modelView);
+	bool CheckStateChange(int *pCachedValue, int value);
+	void SetCapability(GLenum capability, int *pEnabled, bool enable);
+	void SetActiveTexture(GLenum textureUnit);
+	void SetBoundTexture(GLuint textureId);
+	void InvalidateLight(unsigned int id);
+	void* LockStaticBufferVertices(VertexArray *pVertexArray);
+	void UnlockStaticBufferVertices(VertexArray *pVertexArray);
 
 public:
 	/* Public members */
+	// Voxel mesh corners always sit half way between integers, packed positions are stored with this added on
+	static const float PACKED_POSITION_OFFSET;
+
+	// Light numbers that the state cache keeps track of, the fixed function pipeline guarantees this many
+	static const int MAX_CACHED_LIGHTS = 8;
+
+	// Generic vertex attributes the per instance data is fed through, clear of the ones the fixed function arrays alias
+	static const int INSTANCE_MODEL_VIEW_ATTRIBUTE = 10;  // Takes up 4 attributes, one for each column
+	static const int INSTANCE_TINT_ATTRIBUTE = 14;
+	static const int INSTANCE_DATA_SIZE = 20;  // Floats per instance
+
+	// Bones a skinned static buffer can have, their matrices all go in one uniform array
+	static const int MAX_SKINNING_BONES = 24;
+	static const int SKINNING_BONE_INDEX_ATTRIBUTE = 6;
 
 protected:
 	/* Protected members */
@@ -332,34 +481,108 @@ private:
 	CullMode m_cullMode;
 
 	// Viewports
-	vector<Viewport *> m_viewports;
+	ResourcePool<Viewport> m_viewports;
 	unsigned int m_activeViewport;
 
 	// Frustums
-	vector<Frustum *> m_frustums; // Note : We store a frustum for each viewport, therefore viewport and frustum are closely linked (See viewport functions)
+	bool m_frustumCulling;
+	int m_numFrustumCulled;
+	int m_numFrustumVisible;
+	ResourcePool<Frustum> m_frustums; // Note : We store a frustum for each viewport, therefore viewport and frustum are closely linked (See viewport functions)
 
 	// Materials
-	vector<Material *> m_materials;
+	ResourcePool<Material> m_materials;
 
 	// Textures
-	vector<Texture *> m_textures;
+	ResourcePool<Texture> m_textures;
 
 	// Lights
-	vector<Light *> m_lights;
+	ResourcePool<Light> m_lights;
 
 	// Fonts
-	vector<FreeTypeFont *> m_freetypeFonts;
+	ResourcePool<FreeTypeFont> m_freetypeFonts;
 
 	// Vertex arrays, for storing static vertex data
-	vector<VertexArray *> m_vertexArrays;
+	ResourcePool<VertexArray> m_vertexArrays;
+	bool m_keepStaticBufferShadowCopies;
 
 	// Matrices
 	Matrix4x4 *m_projection;
 	Matrix4x4  m_view;
 	Matrix4x4  m_model;
 
+	// The full model view, the model matrix with the camera applied, and what is loaded in GL_PROJECTION.
+	// GL's own model view stack is not used, so neither of these ever need reading back.
+	Matrix4x4  m_modelView;
+	Matrix4x4  m_projectionMatrix;
+
+	// What was last loaded into GL_MODELVIEW
+	Matrix4x4  m_loadedModelView;
+	bool m_loadedModelViewValid;
+
+	// Between PushTextureMatrix() and PopTextureMatrix() the world matrix calls work on GL's texture matrix instead
+	bool m_editTextureMatrix;
+
 	// Model stack
 	vector<Matrix4x4> m_modelStack;
+	vector<Matrix4x4> m_modelViewStack;
+
+	// GL matrix calls made since BeginScene()
+	int m_numMatrixCalls;
+
+	// GL draw calls made since BeginScene()
+	int m_numDrawCalls;
+
+	// GL state as last set by the renderer, -1 when it isn't known. Texture enable and binding are for the active texture unit.
+	int m_textureEnabled;
+	int m_lightingEnabled;
+	int m_cullFaceEnabled;
+	int m_blendEnabled;
+	int m_depthTestEnabled;
+	int m_polygonMode;
+	int m_cullFace;
+	int m_blendSource;
+	int m_blendDestination;
+	int m_depthFunction;
+	int m_depthMask;
+	int m_activeTexture;
+	int m_boundTexture;
+	int m_appliedMaterial;
+
+	// The light applied to each light number, -2 when the light is disabled. The light position is transformed
+	// by the model view when it is applied, so that is kept too.
+	int m_appliedLights[MAX_CACHED_LIGHTS];
+	Matrix4x4 m_appliedLightModelViews[MAX_CACHED_LIGHTS];
+
+	// State changes made and skipped since BeginScene()
+	int m_numStateChanges;
+	int m_numFilteredStateChanges;
+
+	// Mesh tint. Without a shader it is applied by the texture combiner, which needs a texture bound, so a white one is kept for it.
+	Colour m_meshTint;
+	bool m_meshTintReplacesColour;
+	unsigned int m_tintTextureID;
+
+	// Render queue
+	RenderQueue* m_pRenderQueue;
+	bool m_recordingRenderQueue;
+	int m_numRenderPackets;
+
+	// Instanced rendering, 0 when it isn't supported. Per instance model views and tints are streamed through the buffer.
+	unsigned int m_instancingProgram;
+	int m_instancingTintReplacesColourLocation;
+	unsigned int m_instanceBufferID;
+	vector<float> m_vInstanceData;
+
+	// The merged static buffer bound for drawing ranges from, NULL outside of BeginStaticBufferRanges() and EndStaticBufferRanges()
+	VertexArray* m_pRangesVertexArray;
+
+	// Skinned rendering, 0 when it isn't supported. The bone index is read from the otherwise unused pad of the packed vertex.
+	unsigned int m_skinningProgram;
+	int m_boneMatricesLocation;
+	int m_skinningTintLocation;
+	int m_skinningTintReplacesColourLocation;
+	float m_boneMatrixData[MAX_SKINNING_BONES * 16];
 
 	// Name picking
 	static const int NAME_PICKING_BUFFER = 64;
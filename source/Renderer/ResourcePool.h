@@ -0,0 +1,249 @@
+// ******************************************************************************
+//
+// Filename:	ResourcePool.h
+// Project:		Game
+// Author:		Steven Ball
+//
+// Purpose:
+//   Slots for the renderer's resources, handed out as generational handles.
+//   A handle packs the slot index with the slot's generation, which moves on
+//   every time the slot is freed, so a handle kept after its resource was
+//   deleted is caught rather than reaching whatever reuses the slot. Freed
+//   slots go on a free list and are reused oldest first, so the pool only
+//   grows with the most resources that are ever alive at once.
+//
+// Revision History:
+//   Initial Revision - 18/10/26
+//
+// Copyright (c) 2005-2015, Steven Ball
+//
+// ******************************************************************************
+
+#pragma once
+
+#include <vector>
+using namespace std;
+
+
+template <class T>
+class ResourcePool
+{
+public:
+	/* Public methods */
+	ResourcePool();
+
+	// Stores the resource and returns its handle. The pool does not own the resource.
+	unsigned int Add(T* pResource);
+
+	// Takes the resource out of the pool, NULL for a stale or invalid handle. The handle is stale from then on.
+	T* Remove(unsigned int handle);
+
+	// Puts a different resource behind the same handle and returns the one it held, NULL for a stale or invalid handle
+	T* Replace(unsigned int handle, T* pResource);
+
+	// NULL for a stale or invalid handle
+	T* Get(unsigned int handle) const;
+	bool IsValid(unsigned int handle) const;
+
+	// Every slot, for walking the live resources. GetSlot() is NULL for a free slot.
+	int GetNumSlots() const;
+	T* GetSlot(int index) const;
+	unsigned int GetSlotHandle(int index) const;
+
+	// Resources alive now, and the most that were ever alive at once
+	int GetNumLive() const;
+	int GetPeakLive() const;
+
+protected:
+	/* Protected methods */
+
+private:
+	/* Private methods */
+	static unsigned int MakeHandle(unsigned int index, unsigned int generation);
+
+public:
+	/* Public members */
+	// The generation sits above the index. The first handle out of each slot is just its index, and the
+	// generation wraps before all of its bits are set, so a handle can never be -1, which means "none".
+	static const int INDEX_BITS = 20;
+	static const int GENERATION_BITS = 32 - INDEX_BITS;
+	static const unsigned int INDEX_MASK = (1u << INDEX_BITS) - 1;
+	static const unsigned int MAX_GENERATION = (1u << GENERATION_BITS) - 2;
+	static const unsigned int NO_SLOT = 0xFFFFFFFF;
+
+protected:
+	/* Protected members */
+
+private:
+	/* Private members */
+	struct Slot
+	{
+		T* m_pResource;
+		unsigned int m_generation;
+		unsigned int m_nextFreeSlot;
+	};
+
+	vector<Slot> m_vSlots;
+
+	// Free slots are reused oldest first, so a slot's generation wraps as late as possible
+	unsigned int m_firstFreeSlot;
+	unsigned int m_lastFreeSlot;
+
+	int m_numLive;
+	int m_peakLive;
+};
+
+
+template <class T>
+ResourcePool<T>::ResourcePool()
+{
+	m_firstFreeSlot = NO_SLOT;
+	m_lastFreeSlot = NO_SLOT;
+	m_numLive = 0;
+	m_peakLive = 0;
+}
+
+template <class T>
+unsigned int ResourcePool<T>::Add(T* pResource)
+{
+	unsigned int index;
+
+	if (m_firstFreeSlot != NO_SLOT)
+	{
+		index = m_firstFreeSlot;
+		m_firstFreeSlot = m_vSlots[index].m_nextFreeSlot;
+		if (m_firstFreeSlot == NO_SLOT)
+		{
+			m_lastFreeSlot = NO_SLOT;
+		}
+	}
+	else
+	{
+		Slot slot;
+		slot.m_generation = 0;
+		m_vSlots.push_back(slot);
+
+		index = (unsigned int)m_vSlots.size() - 1;
+	}
+
+	m_vSlots[index].m_pResource = pResource;
+	m_vSlots[index].m_nextFreeSlot = NO_SLOT;
+
+	m_numLive++;
+	if (m_numLive > m_peakLive)
+	{
+		m_peakLive = m_numLive;
+	}
+
+	return MakeHandle(index, m_vSlots[index].m_generation);
+}
+
+template <class T>
+T* ResourcePool<T>::Remove(unsigned int handle)
+{
+	if (IsValid(handle) == false)
+	{
+		return NULL;
+	}
+
+	unsigned int index = handle & INDEX_MASK;
+	Slot& slot = m_vSlots[index];
+
+	T* pResource = slot.m_pResource;
+
+	slot.m_pResource = NULL;
+	slot.m_generation = (slot.m_generation < MAX_GENERATION) ? slot.m_generation + 1 : 0;
+	slot.m_nextFreeSlot = NO_SLOT;
+
+	if (m_lastFreeSlot != NO_SLOT)
+	{
+		m_vSlots[m_lastFreeSlot].m_nextFreeSlot = index;
+	}
+	else
+	{
+		m_firstFreeSlot = index;
+	}
+	m_lastFreeSlot = index;
+
+	m_numLive--;
+
+	return pResource;
+}
+
+template <class T>
+T* ResourcePool<T>::Replace(unsigned int handle, T* pResource)
+{
+	if (IsValid(handle) == false || pResource == NULL)
+	{
+		return NULL;
+	}
+
+	Slot& slot = m_vSlots[handle & INDEX_MASK];
+
+	T* pOldResource = slot.m_pResource;
+	slot.m_pResource = pResource;
+
+	return pOldResource;
+}
+
+template <class T>
+T* ResourcePool<T>::Get(unsigned int handle) const
+{
+	if (IsValid(handle) == false)
+	{
+		return NULL;
+	}
+
+	return m_vSlots[handle & INDEX_MASK].m_pResource;
+}
+
+template <class T>
+bool ResourcePool<T>::IsValid(unsigned int handle) const
+{
+	unsigned int index = handle & INDEX_MASK;
+
+	if (index >= m_vSlots.size())
+	{
+		return false;
+	}
+
+	const Slot& slot = m_vSlots[index];
+
+	return slot.m_pResource != NULL && slot.m_generation == (handle >> INDEX_BITS);
+}
+
+template <class T>
+int ResourcePool<T>::GetNumSlots() const
+{
+	return (int)m_vSlots.size();
+}
+
+template <class T>
+T* ResourcePool<T>::GetSlot(int index) const
+{
+	return m_vSlots[index].m_pResource;
+}
+
+template <class T>
+unsigned int ResourcePool<T>::GetSlotHandle(int index) const
+{
+	return MakeHandle((unsigned int)index, m_vSlots[index].m_generation);
+}
+
+template <class T>
+int ResourcePool<T>::GetNumLive() const
+{
+	return m_numLive;
+}
+
+template <class T>
+int ResourcePool<T>::GetPeakLive() const
+{
+	return m_peakLive;
+}
+
+template <class T>
+unsigned int ResourcePool<T>::MakeHandle(unsigned int index, unsigned int generation)
+{
+	return (generation << INDEX_BITS) | index;
+}
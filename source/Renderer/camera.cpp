@@ -83,7 +83,7 @@ void Camera::Rotate(const float xAmount, const float yAmount, const float zAmoun
 // Viewing
 void Camera::Look() const {
 	Vector3d view = m_position + m_facing;
-	gluLookAt(m_position.x, m_position.y, m_position.z, view.x, view.y, view.z, m_up.x, m_up.y, m_up.z);
+	m_pRenderer->SetLookAtCamera(m_position, view, m_up);
     m_pRenderer->GetFrustum(m_pRenderer->GetActiveViewPort())->SetCamera(m_position, view, m_up);
 }
 
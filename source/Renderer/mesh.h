@@ -36,6 +36,7 @@ enum OGLMeshType
 {
 	OGLMeshType_Colour = 0,
 	OGLMeshType_Textured,
+	OGLMeshType_Packed,		// Voxel meshes, uploaded as packed half unit positions, byte normals and RGBA8 colour, with no texture coordinates
 };
 
 class OpenGLTriangleMesh
@@ -45,12 +46,21 @@ public:
 	~OpenGLTriangleMesh();
 
 public:
-    vector<OpenGLMesh_Triangle*> m_triangles;
-	vector<OpenGLMesh_Vertex*> m_vertices;
-	vector<OpenGLMesh_TextureCoordinate*> m_textureCoordinates;
+	// Stored contiguously, in the same layout as the static buffer vertex/uv/index arrays, so they can be uploaded directly
+    vector<OpenGLMesh_Triangle> m_triangles;
+	vector<OpenGLMesh_Vertex> m_vertices;
+	vector<OpenGLMesh_TextureCoordinate> m_textureCoordinates;
 
     unsigned int m_staticMeshId;
 
+	// The part of the static buffer the mesh is drawn from, a count of -1 for the whole buffer. A mesh merged into a static
+	// buffer shared with other meshes only draws its own range of it, and leaves deleting the buffer to whoever merged it.
+	bool m_sharedStaticBuffer;
+	int m_firstVertex;
+	int m_numVertices;
+	int m_firstIndex;
+	int m_numIndices;
+
 	unsigned int m_materialId;
 	unsigned int m_textureId;
 
@@ -15,19 +15,20 @@ enum VertexType {
 	VT_POSITION_NORMAL_COLOUR,
 	VT_POSITION_NORMAL_UV,
 	VT_POSITION_NORMAL_UV_COLOUR,
+	VT_PACKED_POSITION_NORMAL_COLOUR,
 };
 
 class VertexArray {
 public:
 	~VertexArray() {
 		if(nVerts)
-			delete pVA;
+			delete [] pVA;
 
 		if(nIndices)
-			delete pIndices;
+			delete [] pIndices;
 
 		if(nTextureCoordinates)
-			delete pTextureCoordinates;
+			delete [] pTextureCoordinates;
 
 		nVerts = 0;
 		nIndices = 0;
@@ -45,4 +46,11 @@ public:
 	unsigned int *pIndices;
 	int vertexSize;
 	int textureCoordinateSize;
+
+	// GL buffer objects holding the uploaded data, 0 when client side arrays are used instead.
+	// pVA, pTextureCoordinates and pIndices are only kept alongside these if a shadow copy was requested.
+	unsigned int vertexBufferID;
+	unsigned int textureCoordinateBufferID;
+	unsigned int indexBufferID;
+	unsigned int vertexArrayID;
 };
\ No newline at end of file
@@ -0,0 +1,211 @@
+// ******************************************************************************
+//
+// Filename:	BenchmarkMain.cpp
+// Project:		Benchmark
+// Author:		Steven Ball
+//
+// Purpose:
+//   Entry point for the headless character benchmark.
+//
+//   Usage: Benchmark [-characters N] [-frames M] [-warmup W] [-dt seconds]
+//                    [-seed S] [-meshiterations I] [-nomeshing] [-noanimators]
+//                    [-posecachekb K] [-noposecache] [-threads T]
+//                    [-nothreadscaling] [-nofading] [-respawns R]
+//                    [-noculling] [-noimport] [-output file.json]
+//
+// Revision History:
+//   Initial Revision - 18/10/26
+//
+// Copyright (c) 2005-2015, Steven Ball
+//
+// ******************************************************************************
+
+#include "CharacterBenchmark.h"
+#include "../utils/Interpolator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+
+
+int main(int argc, char** argv)
+{
+	int numCharacters = 100;
+	int numFrames = 1000;
+	int numWarmupFrames = 50;
+	float deltaTime = 1.0f / 60.0f;
+	unsigned int randomSeed = 1;
+	int meshingIterations = 10;
+	bool runMeshing = true;
+	bool runAnimators = true;
+	bool usePoseCache = true;
+	unsigned int poseCacheBudget = MS3DPoseCache::DEFAULT_MEMORY_BUDGET;
+	int numThreads = 0;
+	bool runThreadScaling = true;
+	bool runFading = true;
+	int numRespawns = 10;
+	bool runCulling = true;
+	bool runImport = true;
+	const char* outputFilename = "benchmark.json";
+
+	for(int i = 1; i < argc; i++)
+	{
+		bool hasValue = (i + 1 < argc);
+
+		if(strcmp(argv[i], "-characters") == 0 && hasValue)
+		{
+			numCharacters = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "-frames") == 0 && hasValue)
+		{
+			numFrames = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "-warmup") == 0 && hasValue)
+		{
+			numWarmupFrames = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "-dt") == 0 && hasValue)
+		{
+			deltaTime = (float)atof(argv[++i]);
+		}
+		else if(strcmp(argv[i], "-seed") == 0 && hasValue)
+		{
+			randomSeed = (unsigned int)atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "-meshiterations") == 0 && hasValue)
+		{
+			meshingIterations = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "-nomeshing") == 0)
+		{
+			runMeshing = false;
+		}
+		else if(strcmp(argv[i], "-noanimators") == 0)
+		{
+			runAnimators = false;
+		}
+		else if(strcmp(argv[i], "-posecachekb") == 0 && hasValue)
+		{
+			poseCacheBudget = (unsigned int)atoi(argv[++i]) * 1024;
+		}
+		else if(strcmp(argv[i], "-noposecache") == 0)
+		{
+			usePoseCache = false;
+		}
+		else if(strcmp(argv[i], "-threads") == 0 && hasValue)
+		{
+			numThreads = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "-nothreadscaling") == 0)
+		{
+			runThreadScaling = false;
+		}
+		else if(strcmp(argv[i], "-nofading") == 0)
+		{
+			runFading = false;
+		}
+		else if(strcmp(argv[i], "-respawns") == 0 && hasValue)
+		{
+			numRespawns = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "-noculling") == 0)
+		{
+			runCulling = false;
+		}
+		else if(strcmp(argv[i], "-noimport") == 0)
+		{
+			runImport = false;
+		}
+		else if(strcmp(argv[i], "-output") == 0 && hasValue)
+		{
+			outputFilename = argv[++i];
+		}
+		else
+		{
+			cout << "Usage: Benchmark [-characters N] [-frames M] [-warmup W] [-dt seconds] [-seed S] [-meshiterations I] [-nomeshing] [-noanimators] [-posecachekb K] [-noposecache] [-threads T] [-nothreadscaling] [-nofading] [-respawns R] [-noculling] [-noimport] [-output file.json]\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	// No window or GL context is created. GL calls without a current context are ignored and the
+	// renderer falls back to client side arrays for the static buffers, so only the CPU work is measured.
+	Renderer* pRenderer = new Renderer(800, 800, 32, 8);
+	QubicleBinaryManager* pQubicleBinaryManager = new QubicleBinaryManager(pRenderer);
+	MS3DPoseCache* pPoseCache = usePoseCache ? new MS3DPoseCache(poseCacheBudget) : NULL;
+
+	CharacterBenchmark* pBenchmark = new CharacterBenchmark(pRenderer, pQubicleBinaryManager);
+	pBenchmark->SetNumCharacters(numCharacters);
+	pBenchmark->SetNumFrames(numFrames);
+	pBenchmark->SetNumWarmupFrames(numWarmupFrames);
+	pBenchmark->SetDeltaTime(deltaTime);
+	pBenchmark->SetRandomSeed(randomSeed);
+	pBenchmark->SetMeshingIterations(meshingIterations);
+	pBenchmark->SetPoseCache(pPoseCache);
+	pBenchmark->SetNumThreads(numThreads);
+
+	if(pBenchmark->LoadCharacters() == false)
+	{
+		return EXIT_FAILURE;
+	}
+
+	pBenchmark->Run();
+
+	if(runFading)
+	{
+		pBenchmark->RunFading();
+	}
+
+	if(runCulling)
+	{
+		pBenchmark->RunCulling();
+	}
+
+	if(runThreadScaling)
+	{
+		pBenchmark->RunThreadScaling();
+	}
+
+	if(numRespawns > 0)
+	{
+		pBenchmark->RunRespawning(numRespawns);
+	}
+
+	bool importChecksPassed = true;
+	if(runImport)
+	{
+		pBenchmark->RunImport("media/gamedata/models/Human/Steve.qb");
+		pBenchmark->RunImport("media/gamedata/weapons/Sword/Sword.qb");
+		pBenchmark->RunSyntheticImport(128, false);
+		pBenchmark->RunSyntheticImport(128, true);
+		importChecksPassed = pBenchmark->RunMalformedImport();
+		pBenchmark->RunRLEDecoding("long_runs", 128, 1024);
+		pBenchmark->RunRLEDecoding("short_runs", 128, 2);
+	}
+
+	if(runMeshing)
+	{
+		pBenchmark->RunMeshing("media/gamedata/models/Human/Steve.qb");
+		pBenchmark->RunMeshing("media/gamedata/weapons/Sword/Sword.qb");
+	}
+
+	if(runAnimators)
+	{
+		pBenchmark->RunAnimators(1);
+		pBenchmark->RunAnimators(100);
+		pBenchmark->RunAnimators(1000);
+	}
+
+	pBenchmark->PrintResults();
+	bool written = pBenchmark->WriteResults(outputFilename);
+
+	delete pBenchmark;
+	delete pPoseCache;
+	delete pQubicleBinaryManager;
+	delete pRenderer;
+
+	Interpolator::GetInstance()->Destroy();
+
+	// A corrupt file that imports is a failure, not just a number to compare
+	return (written && importChecksPassed) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,1525 @@
+// ******************************************************************************
+//
+// Filename:	CharacterBenchmark.cpp
+// Project:		Benchmark
+// Author:		Steven Ball
+//
+// Purpose:
+//   Headless benchmark of the per-character CPU cost. Loads a crowd of voxel
+//   characters with weapons and steps them with a fixed delta time, timing
+//   each subsystem per frame. Results are written out as JSON so that runs
+//   can be compared against each other.
+//
+// Revision History:
+//   Initial Revision - 18/10/26
+//
+// Copyright (c) 2005-2015, Steven Ball
+//
+// ******************************************************************************
+
+#include "CharacterBenchmark.h"
+
+#include "../utils/Interpolator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+
+// Benchmark samples
+void BenchmarkSamples::Reserve(int numSamples)
+{
+	m_samples.reserve(numSamples);
+}
+
+void BenchmarkSamples::AddSample(double milliseconds)
+{
+	m_samples.push_back(milliseconds);
+}
+
+int BenchmarkSamples::GetNumSamples()
+{
+	return (int)m_samples.size();
+}
+
+double BenchmarkSamples::GetTotal()
+{
+	double total = 0.0;
+	for(unsigned int i = 0; i < m_samples.size(); i++)
+	{
+		total += m_samples[i];
+	}
+
+	return total;
+}
+
+double BenchmarkSamples::GetMean()
+{
+	if(m_samples.empty())
+	{
+		return 0.0;
+	}
+
+	return GetTotal() / m_samples.size();
+}
+
+double BenchmarkSamples::GetMax()
+{
+	if(m_samples.empty())
+	{
+		return 0.0;
+	}
+
+	return *max_element(m_samples.begin(), m_samples.end());
+}
+
+// Nearest rank percentile, percentile is in the range [0, 100]
+double BenchmarkSamples::GetPercentile(double percentile)
+{
+	if(m_samples.empty())
+	{
+		return 0.0;
+	}
+
+	vector<double> sorted = m_samples;
+	sort(sorted.begin(), sorted.end());
+
+	int rank = (int)ceil(percentile / 100.0 * sorted.size()) - 1;
+	rank = max(0, min(rank, (int)sorted.size() - 1));
+
+	return sorted[rank];
+}
+
+
+// Character benchmark
+CharacterBenchmark::CharacterBenchmark(Renderer* pRenderer, QubicleBinaryManager* pQubicleBinaryManager)
+{
+	m_pRenderer = pRenderer;
+	m_pQubicleBinaryManager = pQubicleBinaryManager;
+
+	m_numCharacters = 100;
+	m_numFrames = 1000;
+	m_numWarmupFrames = 50;
+	m_deltaTime = 1.0f / 60.0f;
+	m_randomSeed = 1;
+	m_typeName = "Human";
+	m_modelName = "Steve";
+	m_weaponFilename = "media/gamedata/weapons/Sword/Sword.weapon";
+	m_meshingIterations = 10;
+	m_pPoseCache = NULL;
+	m_numThreads = 0;
+
+	m_loadTime = 0.0;
+
+	m_frameSamples.m_name = "frame";
+	m_interpolatorSamples.m_name = "interpolator";
+	m_characterUpdateSamples.m_name = "character_update";
+	m_weaponTrailSamples.m_name = "weapon_trails";
+	m_fadingSamples.m_name = "fading";
+}
+
+CharacterBenchmark::~CharacterBenchmark()
+{
+	UnloadCharacters();
+}
+
+// Settings
+void CharacterBenchmark::SetNumCharacters(int numCharacters)
+{
+	m_numCharacters = numCharacters;
+}
+
+void CharacterBenchmark::SetNumFrames(int numFrames)
+{
+	m_numFrames = numFrames;
+}
+
+void CharacterBenchmark::SetNumWarmupFrames(int numWarmupFrames)
+{
+	m_numWarmupFrames = numWarmupFrames;
+}
+
+void CharacterBenchmark::SetDeltaTime(float dt)
+{
+	m_deltaTime = dt;
+}
+
+void CharacterBenchmark::SetRandomSeed(unsigned int seed)
+{
+	m_randomSeed = seed;
+}
+
+void CharacterBenchmark::SetCharacter(const char* typeName, const char* modelName)
+{
+	m_typeName = typeName;
+	m_modelName = modelName;
+}
+
+void CharacterBenchmark::SetWeapon(const char* weaponFilename)
+{
+	m_weaponFilename = weaponFilename;
+}
+
+void CharacterBenchmark::SetMeshingIterations(int iterations)
+{
+	m_meshingIterations = iterations;
+}
+
+void CharacterBenchmark::SetPoseCache(MS3DPoseCache* pPoseCache)
+{
+	m_pPoseCache = pPoseCache;
+}
+
+// 0 uses all of the hardware threads
+void CharacterBenchmark::SetNumThreads(int numThreads)
+{
+	m_numThreads = numThreads;
+}
+
+// Loading
+bool CharacterBenchmark::LoadCharacters()
+{
+	UnloadCharacters();
+
+	// Each character seeds its own random number generator from rand(), so seed it for repeatable runs
+	srand(m_randomSeed);
+
+	char characterBaseFolder[128];
+	char qbFilename[128];
+	char ms3dFilename[128];
+	char animListFilename[128];
+	char facesFilename[128];
+	char characterFilename[128];
+	sprintf_s(characterBaseFolder, 128, "media/gamedata/models");
+	sprintf_s(qbFilename, 128, "media/gamedata/models/%s/%s.qb", m_typeName.c_str(), m_modelName.c_str());
+	sprintf_s(ms3dFilename, 128, "media/gamedata/models/%s/%s.ms3d", m_typeName.c_str(), m_typeName.c_str());
+	sprintf_s(animListFilename, 128, "media/gamedata/models/%s/%s.animlist", m_typeName.c_str(), m_typeName.c_str());
+	sprintf_s(facesFilename, 128, "media/gamedata/models/%s/%s.faces", m_typeName.c_str(), m_modelName.c_str());
+	sprintf_s(characterFilename, 128, "media/gamedata/models/%s/%s.character", m_typeName.c_str(), m_modelName.c_str());
+
+	double startTime = GetTimeMilliseconds();
+
+	for(int i = 0; i < m_numCharacters; i++)
+	{
+		VoxelCharacter* pVoxelCharacter = new VoxelCharacter(m_pRenderer, m_pQubicleBinaryManager);
+		pVoxelCharacter->SetPoseCache(m_pPoseCache);
+		pVoxelCharacter->LoadVoxelCharacter(m_typeName.c_str(), qbFilename, ms3dFilename, animListFilename, facesFilename, characterFilename, characterBaseFolder);
+		pVoxelCharacter->SetBreathingAnimationEnabled(true);
+		pVoxelCharacter->SetWinkAnimationEnabled(true);
+		pVoxelCharacter->SetTalkingAnimationEnabled(true);
+		pVoxelCharacter->SetRandomMouthSelection(true);
+		pVoxelCharacter->SetRandomLookDirection(true);
+		pVoxelCharacter->SetCharacterScale(0.08f);
+
+		if(pVoxelCharacter->GetNumAnimations() == 0)
+		{
+			cout << "Benchmark: Failed to load character " << qbFilename << "\n";
+			delete pVoxelCharacter;
+			return false;
+		}
+
+		if(m_weaponFilename.empty() == false)
+		{
+			pVoxelCharacter->LoadRightWeapon(m_weaponFilename.c_str());
+			if(pVoxelCharacter->IsRightWeaponLoaded())
+			{
+				pVoxelCharacter->GetRightWeapon()->StartWeaponTrails();
+			}
+		}
+
+		// Spread the crowd over all of the animations, so we aren't just measuring the cheapest one
+		int animationIndex = i % pVoxelCharacter->GetNumAnimations();
+		pVoxelCharacter->PlayAnimation(AnimationSections_FullBody, false, AnimationSections_FullBody, pVoxelCharacter->GetAnimationName(animationIndex));
+
+		m_vpCharacters.push_back(pVoxelCharacter);
+	}
+
+	m_loadTime = GetTimeMilliseconds() - startTime;
+
+	return true;
+}
+
+void CharacterBenchmark::UnloadCharacters()
+{
+	for(unsigned int i = 0; i < m_vpCharacters.size(); i++)
+	{
+		delete m_vpCharacters[i];
+		m_vpCharacters[i] = 0;
+	}
+	m_vpCharacters.clear();
+
+	Interpolator::GetInstance()->ClearInterpolators();
+}
+
+// Running
+void CharacterBenchmark::Run()
+{
+	m_frameSamples.m_samples.clear();
+	m_interpolatorSamples.m_samples.clear();
+	m_characterUpdateSamples.m_samples.clear();
+	m_weaponTrailSamples.m_samples.clear();
+
+	m_frameSamples.Reserve(m_numFrames);
+	m_interpolatorSamples.Reserve(m_numFrames);
+	m_characterUpdateSamples.Reserve(m_numFrames);
+	m_weaponTrailSamples.Reserve(m_numFrames);
+
+	WorkerPool workerPool(m_numThreads);
+
+	for(int i = 0; i < m_numWarmupFrames; i++)
+	{
+		StepFrame(&workerPool, false);
+	}
+
+	for(int i = 0; i < m_numFrames; i++)
+	{
+		StepFrame(&workerPool, true);
+	}
+}
+
+// Times the same crowd, reloaded each time so every run starts from the same state, over a range of thread counts
+void CharacterBenchmark::RunThreadScaling()
+{
+	m_vThreadScalingRuns.clear();
+
+	vector<int> threadCounts = GetThreadCounts();
+	for(unsigned int i = 0; i < threadCounts.size(); i++)
+	{
+		if(LoadCharacters() == false)
+		{
+			return;
+		}
+
+		ThreadScalingBenchmarkRun run;
+		run.m_numThreads = threadCounts[i];
+		run.m_samples.Reserve(m_numFrames);
+
+		WorkerPool workerPool(run.m_numThreads);
+
+		for(int j = 0; j < m_numWarmupFrames; j++)
+		{
+			StepFrame(&workerPool, false);
+		}
+
+		for(int j = 0; j < m_numFrames; j++)
+		{
+			double updateStart = GetTimeMilliseconds();
+			StepFrame(&workerPool, false);
+			run.m_samples.AddSample(GetTimeMilliseconds() - updateStart);
+		}
+
+		m_vThreadScalingRuns.push_back(run);
+	}
+}
+
+// Times fading the whole crowd in and out together, with every character's alpha changing every frame
+void CharacterBenchmark::RunFading()
+{
+	m_fadingSamples.m_samples.clear();
+	m_fadingSamples.Reserve(m_numFrames);
+
+	for(int i = 0; i < m_numWarmupFrames + m_numFrames; i++)
+	{
+		float alpha = 1.0f - (float)(i % FADE_FRAMES) / (float)FADE_FRAMES;
+
+		double fadeStart = GetTimeMilliseconds();
+
+		for(unsigned int j = 0; j < m_vpCharacters.size(); j++)
+		{
+			m_vpCharacters[j]->SetMeshAlpha(alpha);
+		}
+
+		if(i >= m_numWarmupFrames)
+		{
+			m_fadingSamples.AddSample(GetTimeMilliseconds() - fadeStart);
+		}
+	}
+
+	// Leave the crowd fully visible for anything run afterwards
+	for(unsigned int i = 0; i < m_vpCharacters.size(); i++)
+	{
+		m_vpCharacters[i]->SetMeshAlpha(1.0f);
+	}
+}
+
+// Despawns and respawns the whole crowd, keeping track of the renderer resources left alive after each cycle.
+// The crowd shares its models, so each cycle also loads, remeshes and deletes a model of its own, like a
+// spawned object that doesn't come from the model manager. Nothing should be left behind by anything that
+// was despawned, so the live counts should be the same at the end as at the start.
+void CharacterBenchmark::RunRespawning(int numCycles)
+{
+	RespawnBenchmarkResult result;
+	result.m_numCycles = numCycles;
+	result.m_samples.Reserve(numCycles);
+
+	char qbFilename[128];
+	sprintf_s(qbFilename, 128, "media/gamedata/models/%s/%s.qb", m_typeName.c_str(), m_modelName.c_str());
+
+	for(int i = 0; i < numCycles; i++)
+	{
+		double respawnStart = GetTimeMilliseconds();
+
+		if(LoadCharacters() == false)
+		{
+			return;
+		}
+
+		QubicleBinary* pQubicleBinary = new QubicleBinary(m_pRenderer);
+		if(pQubicleBinary->Import(qbFilename, true))
+		{
+			pQubicleBinary->CreateMesh(true);
+		}
+		delete pQubicleBinary;
+
+		result.m_samples.AddSample(GetTimeMilliseconds() - respawnStart);
+
+		for(int j = 0; j < RR_NUMRESOURCES; j++)
+		{
+			int numLive = m_pRenderer->GetNumLiveResources((RendererResource)j);
+
+			if(i == 0)
+			{
+				result.m_liveAtStart[j] = numLive;
+			}
+			result.m_liveAtEnd[j] = numLive;
+			result.m_peak[j] = m_pRenderer->GetPeakResources((RendererResource)j);
+		}
+	}
+
+	m_vRespawnResults.push_back(result);
+}
+
+// Times drawing the crowd, stood in a grid in front of the camera, with the camera facing the crowd and facing away from it.
+// There is no GL context, so the draws are recorded into the render queue and thrown away, which times the culling
+// and the submission of what survives it. The crowd is updated between frames, untimed, so every frame has new poses.
+void CharacterBenchmark::RunCulling()
+{
+	m_vCullingRuns.clear();
+
+	unsigned int viewport;
+	if(m_pRenderer->CreateViewport(0, 0, 800, 800, 60.0f, &viewport) == false)
+	{
+		return;
+	}
+
+	static const char* runNames[3] = { "unculled_facing_away", "culled_facing_away", "culled_facing_crowd" };
+	static const bool runCulling[3] = { false, true, true };
+	static const bool runFacingCrowd[3] = { false, false, true };
+
+	WorkerPool workerPool(m_numThreads);
+
+	for(int i = 0; i < 3; i++)
+	{
+		CullingBenchmarkRun run;
+		run.m_name = runNames[i];
+		run.m_frustumCulling = runCulling[i];
+		run.m_facingCrowd = runFacingCrowd[i];
+		run.m_samples.Reserve(m_numFrames);
+
+		m_pRenderer->SetFrustumCullingEnabled(run.m_frustumCulling);
+
+		for(int j = 0; j < m_numWarmupFrames + m_numFrames; j++)
+		{
+			StepFrame(&workerPool, false);
+
+			double renderStart = GetTimeMilliseconds();
+			run.m_numRenderPackets = RenderCrowd(viewport, run.m_facingCrowd);
+
+			if(j >= m_numWarmupFrames)
+			{
+				run.m_samples.AddSample(GetTimeMilliseconds() - renderStart);
+			}
+		}
+
+		run.m_numCulled = m_pRenderer->GetNumFrustumCulled();
+		run.m_numVisible = m_pRenderer->GetNumFrustumVisible();
+
+		m_vCullingRuns.push_back(run);
+	}
+
+	m_pRenderer->SetFrustumCullingEnabled(false);
+}
+
+int CharacterBenchmark::RenderCrowd(unsigned int viewport, bool facingCrowd)
+{
+	int numPackets = 0;
+
+	// The crowd stands in rows going away from the camera, down the negative z axis
+	int numColumns = (int)sqrt((double)m_vpCharacters.size()) + 1;
+
+	Vector3d cameraPosition(0.0f, 2.0f, 5.0f);
+	Vector3d cameraTarget = cameraPosition + (facingCrowd ? Vector3d(0.0f, 0.0f, -1.0f) : Vector3d(0.0f, 0.0f, 1.0f));
+	Vector3d cameraUp(0.0f, 1.0f, 0.0f);
+
+	Colour outlineColour(1.0f, 1.0f, 0.0f, 1.0f);
+
+	m_pRenderer->BeginScene(true, true, true);
+
+	m_pRenderer->PushMatrix();
+		m_pRenderer->SetProjectionMode(PM_PERSPECTIVE, viewport);
+		m_pRenderer->SetLookAtCamera(cameraPosition, cameraTarget, cameraUp);
+		m_pRenderer->GetFrustum(viewport)->SetCamera(cameraPosition, cameraTarget, cameraUp);
+
+		// Recorded into the render queue rather than drawn, drawing needs the extension functions of a real GL context
+		m_pRenderer->BeginRenderQueue();
+
+		for(unsigned int i = 0; i < m_vpCharacters.size(); i++)
+		{
+			float x = (float)(((int)i % numColumns) - numColumns / 2) * CROWD_SPACING;
+			float z = -(float)((int)i / numColumns) * CROWD_SPACING;
+
+			m_pRenderer->PushMatrix();
+				m_pRenderer->TranslateWorldMatrix(x, 0.0f, z);
+
+				m_vpCharacters[i]->RenderWeapons(false, false, false, outlineColour);
+				m_vpCharacters[i]->Render(false, false, false, outlineColour, false);
+				m_vpCharacters[i]->RenderFace();
+			m_pRenderer->PopMatrix();
+		}
+
+		numPackets = m_pRenderer->GetNumQueuedRenderPackets();
+		m_pRenderer->DiscardRenderQueue();
+	m_pRenderer->PopMatrix();
+
+	m_pRenderer->EndScene();
+
+	return numPackets;
+}
+
+void CharacterBenchmark::StepFrame(WorkerPool* pWorkerPool, bool recordSamples)
+{
+	float animationSpeeds[AnimationSections_NUMSECTIONS] = { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+	Matrix4x4 worldMatrix;
+
+	double frameStart = GetTimeMilliseconds();
+
+	Interpolator::GetInstance()->Update(m_deltaTime);
+
+	double interpolatorEnd = GetTimeMilliseconds();
+
+	// Characters only touch their own state while updating, so they can go in any order on any thread
+	pWorkerPool->ParallelFor((int)m_vpCharacters.size(), [&](int index)
+	{
+		m_vpCharacters[index]->Update(m_deltaTime, animationSpeeds);
+	}, CHARACTER_BATCH_SIZE);
+
+	double characterUpdateEnd = GetTimeMilliseconds();
+
+	// The weapon trails need the bone matrices from every character's update to be finished
+	pWorkerPool->ParallelFor((int)m_vpCharacters.size(), [&](int index)
+	{
+		m_vpCharacters[index]->UpdateWeaponTrails(m_deltaTime, worldMatrix);
+	}, CHARACTER_BATCH_SIZE);
+
+	double frameEnd = GetTimeMilliseconds();
+
+	if(recordSamples)
+	{
+		m_frameSamples.AddSample(frameEnd - frameStart);
+		m_interpolatorSamples.AddSample(interpolatorEnd - frameStart);
+		m_characterUpdateSamples.AddSample(characterUpdateEnd - interpolatorEnd);
+		m_weaponTrailSamples.AddSample(frameEnd - characterUpdateEnd);
+	}
+}
+
+// The reader Import() used before the bulk reader, one fread per voxel or RLE token, kept here as the baseline.
+// Every matrix is decoded into a colour array of its own, in the same layout as QubicleMatrix::m_pColour.
+static bool ImportQubiclePerElement(const char* fileName, vector<unsigned int*>* pvpColours)
+{
+	FILE* pQBfile = NULL;
+	fopen_s(&pQBfile, fileName, "rb");
+
+	if(pQBfile == NULL)
+	{
+		return false;
+	}
+
+	const unsigned int CODEFLAG = 2;
+	const unsigned int NEXTSLICEFLAG = 6;
+
+	char version[4];
+	unsigned int colourFormat;
+	unsigned int zAxisOrientation;
+	unsigned int compressed;
+	unsigned int visibilityMaskEncoded;
+	unsigned int numMatrices;
+
+	bool ok = fread(&version[0], sizeof(char)*4, 1, pQBfile) == 1;
+	ok = ok && fread(&colourFormat, sizeof(unsigned int), 1, pQBfile) == 1;
+	ok = ok && fread(&zAxisOrientation, sizeof(unsigned int), 1, pQBfile) == 1;
+	ok = ok && fread(&compressed, sizeof(unsigned int), 1, pQBfile) == 1;
+	ok = ok && fread(&visibilityMaskEncoded, sizeof(unsigned int), 1, pQBfile) == 1;
+	ok = ok && fread(&numMatrices, sizeof(unsigned int), 1, pQBfile) == 1;
+
+	for(unsigned int i = 0; ok && i < numMatrices; i++)
+	{
+		unsigned char nameLength = 0;
+		char name[256];
+		unsigned int sizeX = 0;
+		unsigned int sizeY = 0;
+		unsigned int sizeZ = 0;
+		int position[3];
+
+		ok = fread(&nameLength, sizeof(char), 1, pQBfile) == 1;
+		ok = ok && (nameLength == 0 || fread(&name[0], sizeof(char)*nameLength, 1, pQBfile) == 1);
+		ok = ok && fread(&sizeX, sizeof(unsigned int), 1, pQBfile) == 1;
+		ok = ok && fread(&sizeY, sizeof(unsigned int), 1, pQBfile) == 1;
+		ok = ok && fread(&sizeZ, sizeof(unsigned int), 1, pQBfile) == 1;
+		ok = ok && fread(&position[0], sizeof(int)*3, 1, pQBfile) == 1;
+
+		if(ok == false)
+		{
+			break;
+		}
+
+		unsigned int* pColour = new unsigned int[sizeX * sizeY * sizeZ];
+		pvpColours->push_back(pColour);
+
+		if(compressed == 0)
+		{
+			for(unsigned int z = 0; ok && z < sizeZ; z++)
+			{
+				for(unsigned int y = 0; ok && y < sizeY; y++)
+				{
+					for(unsigned int x = 0; ok && x < sizeX; x++)
+					{
+						unsigned int colour = 0;
+						ok = fread(&colour, sizeof(unsigned int), 1, pQBfile) == 1;
+
+						pColour[x + sizeX * (y + sizeY * z)] = colour;
+					}
+				}
+			}
+		}
+		else
+		{
+			for(unsigned int z = 0; ok && z < sizeZ; z++)
+			{
+				unsigned int index = 0;
+
+				while(ok)
+				{
+					unsigned int data = 0;
+					ok = fread(&data, sizeof(unsigned int), 1, pQBfile) == 1;
+
+					if(ok == false || data == NEXTSLICEFLAG)
+					{
+						break;
+					}
+
+					unsigned int count = 1;
+					if(data == CODEFLAG)
+					{
+						ok = fread(&count, sizeof(unsigned int), 1, pQBfile) == 1;
+						ok = ok && fread(&data, sizeof(unsigned int), 1, pQBfile) == 1;
+					}
+
+					for(unsigned int j = 0; ok && j < count; j++)
+					{
+						unsigned int x = index % sizeX;
+						unsigned int y = index / sizeX;
+
+						ok = (y < sizeY);
+						if(ok)
+						{
+							pColour[x + sizeX * (y + sizeY * z)] = data;
+						}
+
+						index++;
+					}
+				}
+
+				// Anything the slice didn't cover is empty space, as the bulk reader leaves it
+				for(; ok && index < sizeX * sizeY; index++)
+				{
+					pColour[index + sizeX * sizeY * z] = 0;
+				}
+			}
+		}
+	}
+
+	fclose(pQBfile);
+
+	return ok;
+}
+
+// Reads the whole file in one go, as Import() does
+static unsigned char* ReadQubicleFile(const char* fileName, unsigned int* pFileSize)
+{
+	FILE* pQBfile = NULL;
+	fopen_s(&pQBfile, fileName, "rb");
+
+	if(pQBfile == NULL)
+	{
+		return NULL;
+	}
+
+	fseek(pQBfile, 0, SEEK_END);
+	long fileSize = ftell(pQBfile);
+	fseek(pQBfile, 0, SEEK_SET);
+
+	unsigned char* pFileData = NULL;
+	if(fileSize > 0)
+	{
+		pFileData = new unsigned char[fileSize];
+		if(fread(pFileData, 1, fileSize, pQBfile) != (size_t)fileSize)
+		{
+			delete [] pFileData;
+			pFileData = NULL;
+		}
+	}
+
+	fclose(pQBfile);
+
+	*pFileSize = (unsigned int)fileSize;
+
+	return pFileData;
+}
+
+static void AppendUnsignedInt(vector<unsigned char>* pData, unsigned int value)
+{
+	unsigned char bytes[4];
+	memcpy(&bytes[0], &value, sizeof(unsigned int));
+	pData->insert(pData->end(), bytes, bytes + 4);
+}
+
+// The voxel data of a size^3 matrix. The voxels come in runs of up to maxRunLength of the same colour, about a third of
+// the runs empty, and runs never carry over from one slice to the next. Compressed runs of one are written as literals.
+static void AppendSyntheticVoxelData(vector<unsigned char>* pData, unsigned int size, bool compressed, unsigned int maxRunLength, unsigned int seed)
+{
+	const unsigned int CODEFLAG = 2;
+	const unsigned int NEXTSLICEFLAG = 6;
+
+	unsigned int sliceSize = size * size;
+	for(unsigned int z = 0; z < size; z++)
+	{
+		unsigned int index = 0;
+		while(index < sliceSize)
+		{
+			seed = seed * 1664525 + 1013904223;
+			unsigned int count = 1 + (seed >> 8) % maxRunLength;
+			if(count > sliceSize - index)
+			{
+				count = sliceSize - index;
+			}
+
+			// Solid colours are fully opaque, so they can never be mistaken for one of the flags
+			seed = seed * 1664525 + 1013904223;
+			unsigned int colour = ((seed >> 8) % 3 == 0) ? 0 : (0xFF000000 | (seed >> 8));
+
+			if(compressed == false)
+			{
+				for(unsigned int i = 0; i < count; i++)
+				{
+					AppendUnsignedInt(pData, colour);
+				}
+			}
+			else if(count == 1)
+			{
+				AppendUnsignedInt(pData, colour);
+			}
+			else
+			{
+				AppendUnsignedInt(pData, CODEFLAG);
+				AppendUnsignedInt(pData, count);
+				AppendUnsignedInt(pData, colour);
+			}
+
+			index += count;
+		}
+
+		if(compressed)
+		{
+			AppendUnsignedInt(pData, NEXTSLICEFLAG);
+		}
+	}
+}
+
+// The file header and matrix header of a .qb file with a single matrix, the voxel data is left to the caller
+static void CreateQubicleHeader(vector<unsigned char>* pData, unsigned int sizeX, unsigned int sizeY, unsigned int sizeZ, bool compressed)
+{
+	pData->clear();
+
+	const char version[4] = { 1, 1, 0, 0 };
+	pData->insert(pData->end(), version, version + 4);
+	AppendUnsignedInt(pData, 0);  // Colour format, RGBA
+	AppendUnsignedInt(pData, 1);  // Z axis orientation, right handed
+	AppendUnsignedInt(pData, compressed ? 1 : 0);
+	AppendUnsignedInt(pData, 0);  // Visibility mask encoded
+	AppendUnsignedInt(pData, 1);  // Number of matrices
+
+	const char* name = "Synthetic";
+	pData->push_back((unsigned char)strlen(name));
+	pData->insert(pData->end(), name, name + strlen(name));
+	AppendUnsignedInt(pData, sizeX);
+	AppendUnsignedInt(pData, sizeY);
+	AppendUnsignedInt(pData, sizeZ);
+	AppendUnsignedInt(pData, 0);
+	AppendUnsignedInt(pData, 0);
+	AppendUnsignedInt(pData, 0);
+}
+
+// A .qb file with a single size^3 matrix of synthetic voxel data
+static void CreateSyntheticQubicleData(vector<unsigned char>* pData, unsigned int size, bool compressed, unsigned int maxRunLength, unsigned int seed)
+{
+	CreateQubicleHeader(pData, size, size, size, compressed);
+	AppendSyntheticVoxelData(pData, size, compressed, maxRunLength, seed);
+}
+
+// A compressed .qb file whose header claims sizeX x sizeY x sizeZ, followed by numSlices empty slices
+static void CreateMalformedQubicleData(vector<unsigned char>* pData, unsigned int sizeX, unsigned int sizeY, unsigned int sizeZ, unsigned int numSlices)
+{
+	const unsigned int NEXTSLICEFLAG = 6;
+
+	CreateQubicleHeader(pData, sizeX, sizeY, sizeZ, true);
+
+	for(unsigned int z = 0; z < numSlices; z++)
+	{
+		AppendUnsignedInt(pData, NEXTSLICEFLAG);
+	}
+}
+
+// The RLE decode Import() used before DecodeQubicleRLEMatrix(), a token at a time and working out x and y for every
+// voxel, kept here as the baseline. It reads out of memory rather than the file, so only the decode itself is timed.
+static bool DecodeQubicleRLEPerVoxel(const unsigned char* pRead, const unsigned char* pEnd, unsigned int* pColour, unsigned int sizeX, unsigned int sizeY, unsigned int sizeZ)
+{
+	const unsigned int CODEFLAG = 2;
+	const unsigned int NEXTSLICEFLAG = 6;
+
+	for(unsigned int z = 0; z < sizeZ; z++)
+	{
+		unsigned int index = 0;
+
+		while(true)
+		{
+			if(pEnd - pRead < 4)
+			{
+				return false;
+			}
+
+			unsigned int data;
+			memcpy(&data, pRead, sizeof(unsigned int));
+			pRead += 4;
+
+			if(data == NEXTSLICEFLAG)
+			{
+				break;
+			}
+
+			unsigned int count = 1;
+			if(data == CODEFLAG)
+			{
+				if(pEnd - pRead < 8)
+				{
+					return false;
+				}
+
+				memcpy(&count, pRead, sizeof(unsigned int));
+				memcpy(&data, pRead + 4, sizeof(unsigned int));
+				pRead += 8;
+			}
+
+			for(unsigned int j = 0; j < count; j++)
+			{
+				unsigned int x = index % sizeX;
+				unsigned int y = index / sizeX;
+
+				if(y >= sizeY)
+				{
+					return false;
+				}
+
+				pColour[x + sizeX * (y + sizeY * z)] = data;
+
+				index++;
+			}
+		}
+
+		for(; index < sizeX * sizeY; index++)
+		{
+			pColour[index + sizeX * sizeY * z] = 0;
+		}
+	}
+
+	return true;
+}
+
+// Times importing a qubicle file with the old per element reader and with the bulk reader, without meshing it. Both
+// decodes are compared the first time through, so the results also show the bulk reader reads the file the same.
+void CharacterBenchmark::RunImport(const char* qbFilename)
+{
+	ImportBenchmarkResult result;
+	result.m_fileName = qbFilename;
+	result.m_compressed = false;
+	result.m_fileSize = 0;
+	result.m_numVoxels = 0;
+	result.m_decodedSame = true;
+	result.m_perElementSamples.Reserve(IMPORT_ITERATIONS);
+	result.m_bulkSamples.Reserve(IMPORT_ITERATIONS);
+
+	for(int i = 0; i < IMPORT_ITERATIONS; i++)
+	{
+		vector<unsigned int*> vpColours;
+
+		double perElementStart = GetTimeMilliseconds();
+		bool perElementOk = ImportQubiclePerElement(qbFilename, &vpColours);
+		result.m_perElementSamples.AddSample(GetTimeMilliseconds() - perElementStart);
+
+		QubicleBinary* pQubicleBinary = new QubicleBinary(m_pRenderer);
+
+		double bulkStart = GetTimeMilliseconds();
+		unsigned int fileSize = 0;
+		unsigned char* pFileData = ReadQubicleFile(qbFilename, &fileSize);
+		bool bulkOk = (pFileData != NULL) && pQubicleBinary->ImportFromMemory(pFileData, fileSize);
+		result.m_bulkSamples.AddSample(GetTimeMilliseconds() - bulkStart);
+
+		if(perElementOk == false || bulkOk == false || (int)vpColours.size() != pQubicleBinary->GetNumMatrices())
+		{
+			cout << "Benchmark: Failed to import " << qbFilename << "\n";
+
+			for(unsigned int j = 0; j < vpColours.size(); j++)
+			{
+				delete [] vpColours[j];
+			}
+			delete [] pFileData;
+			delete pQubicleBinary;
+			return;
+		}
+
+		if(i == 0)
+		{
+			unsigned int compressed;
+			memcpy(&compressed, pFileData + 12, sizeof(unsigned int));
+
+			result.m_compressed = (compressed != 0);
+			result.m_fileSize = (int)fileSize;
+
+			for(int j = 0; j < pQubicleBinary->GetNumMatrices(); j++)
+			{
+				QubicleMatrix* pMatrix = pQubicleBinary->GetQubicleMatrix(j);
+				unsigned int numVoxels = pMatrix->m_matrixSizeX * pMatrix->m_matrixSizeY * pMatrix->m_matrixSizeZ;
+
+				result.m_numVoxels += (int)numVoxels;
+				if(memcmp(vpColours[j], pMatrix->m_pColour, numVoxels * sizeof(unsigned int)) != 0)
+				{
+					result.m_decodedSame = false;
+				}
+			}
+		}
+
+		for(unsigned int j = 0; j < vpColours.size(); j++)
+		{
+			delete [] vpColours[j];
+		}
+		delete [] pFileData;
+		delete pQubicleBinary;
+	}
+
+	m_vImportResults.push_back(result);
+}
+
+// Times importing a synthetic size^3 matrix, written out to a file of its own for the readers to load
+void CharacterBenchmark::RunSyntheticImport(unsigned int size, bool compressed)
+{
+	vector<unsigned char> data;
+	CreateSyntheticQubicleData(&data, size, compressed, 16, m_randomSeed);
+
+	char qbFilename[128];
+	sprintf_s(qbFilename, 128, "synthetic_%u%s.qb", size, compressed ? "_rle" : "");
+
+	FILE* pQBfile = NULL;
+	fopen_s(&pQBfile, qbFilename, "wb");
+
+	if(pQBfile == NULL)
+	{
+		cout << "Benchmark: Failed to open " << qbFilename << " for writing\n";
+		return;
+	}
+
+	bool writeOk = fwrite(&data[0], 1, data.size(), pQBfile) == data.size();
+	writeOk = (fclose(pQBfile) == 0) && writeOk;
+
+	if(writeOk)
+	{
+		RunImport(qbFilename);
+	}
+
+	remove(qbFilename);
+}
+
+// Imports .qb files with corrupt matrix sizes, each of which ImportFromMemory() has to reject before it allocates the
+// colours. A well formed file goes through the same path first, so a reader that rejects everything doesn't pass.
+bool CharacterBenchmark::RunMalformedImport()
+{
+	const char* names[] = { "well_formed", "oversized", "slice_overflow", "zero_size", "short_payload" };
+	const bool expectedOk[] = { true, false, false, false, false };
+	const int numFiles = sizeof(names) / sizeof(names[0]);
+
+	bool allAsExpected = true;
+
+	for(int i = 0; i < numFiles; i++)
+	{
+		vector<unsigned char> data;
+		switch(i)
+		{
+			case 0: CreateSyntheticQubicleData(&data, 16, true, 16, m_randomSeed); break;
+			// 256 x 256 x 65537 voxels, more than 32 bits of them, in an empty payload of under a megabyte
+			case 1: CreateMalformedQubicleData(&data, 256, 256, 65537, 65537); break;
+			// A 65536 x 65536 slice wraps a 32 bit slice size to zero
+			case 2: CreateMalformedQubicleData(&data, 65536, 65536, 1, 1); break;
+			case 3: CreateMalformedQubicleData(&data, 16, 0, 16, 16); break;
+			// Fewer slice flags than the header has slices
+			case 4: CreateMalformedQubicleData(&data, 16, 16, 16, 2); break;
+		}
+
+		QubicleBinary* pQubicleBinary = new QubicleBinary(m_pRenderer);
+
+		MalformedImportResult result;
+		result.m_name = names[i];
+		result.m_expectedOk = expectedOk[i];
+		result.m_importOk = pQubicleBinary->ImportFromMemory(&data[0], (unsigned int)data.size());
+		m_vMalformedImportResults.push_back(result);
+
+		if(result.m_importOk != result.m_expectedOk)
+		{
+			allAsExpected = false;
+		}
+
+		delete pQubicleBinary;
+	}
+
+	return allAsExpected;
+}
+
+// Times decoding a synthetic RLE compressed size^3 matrix, with runs of up to maxRunLength voxels, with the old per voxel
+// decode and with DecodeQubicleRLEMatrix(). Both decode into the same buffer, so only the decoding is timed.
+void CharacterBenchmark::RunRLEDecoding(const char* name, unsigned int size, unsigned int maxRunLength)
+{
+	vector<unsigned char> data;
+	AppendSyntheticVoxelData(&data, size, true, maxRunLength, m_randomSeed);
+
+	RLEDecodingBenchmarkResult result;
+	result.m_name = name;
+	result.m_maxRunLength = (int)maxRunLength;
+	result.m_dataSize = (int)data.size();
+	result.m_numVoxels = (int)(size * size * size);
+	result.m_decodedSame = true;
+	result.m_perVoxelSamples.Reserve(IMPORT_ITERATIONS);
+	result.m_sliceSamples.Reserve(IMPORT_ITERATIONS);
+
+	vector<unsigned int> perVoxelColours(size * size * size);
+	vector<unsigned int> sliceColours(size * size * size);
+
+	const unsigned char* pStart = &data[0];
+	const unsigned char* pEnd = pStart + data.size();
+
+	for(int i = 0; i < IMPORT_ITERATIONS; i++)
+	{
+		double perVoxelStart = GetTimeMilliseconds();
+		bool perVoxelOk = DecodeQubicleRLEPerVoxel(pStart, pEnd, &perVoxelColours[0], size, size, size);
+		result.m_perVoxelSamples.AddSample(GetTimeMilliseconds() - perVoxelStart);
+
+		const unsigned char* pRead = pStart;
+		double sliceStart = GetTimeMilliseconds();
+		bool sliceOk = DecodeQubicleRLEMatrix(&pRead, pEnd, &sliceColours[0], size, size, size);
+		result.m_sliceSamples.AddSample(GetTimeMilliseconds() - sliceStart);
+
+		if(perVoxelOk == false || sliceOk == false)
+		{
+			cout << "Benchmark: Failed to decode the " << name << " RLE data\n";
+			return;
+		}
+	}
+
+	result.m_decodedSame = (perVoxelColours == sliceColours);
+
+	m_vRLEDecodingResults.push_back(result);
+}
+
+// Times importing a qubicle file, then remeshing it with each mesher over a range of thread counts
+void CharacterBenchmark::RunMeshing(const char* qbFilename)
+{
+	MeshingBenchmarkResult result;
+	result.m_fileName = qbFilename;
+	result.m_numMatrices = 0;
+	result.m_numVoxels = 0;
+
+	QubicleBinary* pQubicleBinary = new QubicleBinary(m_pRenderer);
+
+	double importStart = GetTimeMilliseconds();
+	bool imported = pQubicleBinary->Import(qbFilename, false);
+	result.m_importTime = GetTimeMilliseconds() - importStart;
+
+	if(imported == false)
+	{
+		cout << "Benchmark: Failed to import " << qbFilename << "\n";
+		delete pQubicleBinary;
+		return;
+	}
+
+	result.m_numMatrices = pQubicleBinary->GetNumMatrices();
+	for(int i = 0; i < pQubicleBinary->GetNumMatrices(); i++)
+	{
+		QubicleMatrix* pMatrix = pQubicleBinary->GetQubicleMatrix(i);
+		result.m_numVoxels += pMatrix->m_matrixSizeX * pMatrix->m_matrixSizeY * pMatrix->m_matrixSizeZ;
+	}
+
+	vector<int> threadCounts = GetThreadCounts();
+
+	QubicleMeshingMethod meshingMethods[2] = { QubicleMeshingMethod_MergedSide, QubicleMeshingMethod_Bitmask };
+	for(int i = 0; i < 2; i++)
+	{
+		for(unsigned int j = 0; j < threadCounts.size(); j++)
+		{
+			MeshingBenchmarkRun run;
+			run.m_meshingMethod = meshingMethods[i];
+			run.m_numThreads = threadCounts[j];
+			run.m_numTriangles = 0;
+			run.m_samples.Reserve(m_meshingIterations);
+
+			WorkerPool workerPool(run.m_numThreads);
+			pQubicleBinary->SetMeshingMethod(run.m_meshingMethod);
+			pQubicleBinary->SetMeshingWorkerPool(&workerPool);
+
+			for(int k = 0; k < m_meshingIterations; k++)
+			{
+				double meshStart = GetTimeMilliseconds();
+				pQubicleBinary->CreateMesh(false);
+				run.m_samples.AddSample(GetTimeMilliseconds() - meshStart);
+			}
+
+			for(int k = 0; k < pQubicleBinary->GetNumMatrices(); k++)
+			{
+				run.m_numTriangles += (int)pQubicleBinary->GetQubicleMatrix(k)->m_pMesh->m_triangles.size();
+			}
+
+			pQubicleBinary->SetMeshingWorkerPool(NULL);
+
+			result.m_vRuns.push_back(run);
+		}
+	}
+
+	// Remesh in the background the way an edited model would, the rebuilt meshes should match what CreateMesh() made
+	pQubicleBinary->SetMeshingMethod(QubicleMeshingMethod_Bitmask);
+	pQubicleBinary->CreateMesh(true);
+
+	vector<int> vNumTriangles;
+	for(int i = 0; i < pQubicleBinary->GetNumMatrices(); i++)
+	{
+		int numVertices;
+		int numTriangles;
+		m_pRenderer->GetMeshInformation(&numVertices, &numTriangles, pQubicleBinary->GetQubicleMatrix(i)->m_pMesh);
+		vNumTriangles.push_back(numTriangles);
+	}
+
+	result.m_asyncRebuildSame = true;
+	result.m_asyncStartSamples.Reserve(m_meshingIterations);
+	result.m_asyncRebuildSamples.Reserve(m_meshingIterations);
+
+	for(int k = 0; k < m_meshingIterations; k++)
+	{
+		vector<OpenGLTriangleMesh*> vpOldMeshes;
+		for(int i = 0; i < pQubicleBinary->GetNumMatrices(); i++)
+		{
+			vpOldMeshes.push_back(pQubicleBinary->GetQubicleMatrix(i)->m_pMesh);
+		}
+
+		double rebuildStart = GetTimeMilliseconds();
+		pQubicleBinary->RebuildMeshAsync();
+		result.m_asyncStartSamples.AddSample(GetTimeMilliseconds() - rebuildStart);
+
+		while(pQubicleBinary->IsMeshRebuilding())
+		{
+			// The old meshes have to keep rendering until Update() swaps the new ones in
+			for(int i = 0; i < pQubicleBinary->GetNumMatrices(); i++)
+			{
+				if(pQubicleBinary->GetQubicleMatrix(i)->m_pMesh != vpOldMeshes[i])
+				{
+					result.m_asyncRebuildSame = false;
+				}
+			}
+
+			pQubicleBinary->Update(0.0f);
+			std::this_thread::yield();
+		}
+		result.m_asyncRebuildSamples.AddSample(GetTimeMilliseconds() - rebuildStart);
+
+		for(int i = 0; i < pQubicleBinary->GetNumMatrices(); i++)
+		{
+			int numVertices;
+			int numTriangles;
+			m_pRenderer->GetMeshInformation(&numVertices, &numTriangles, pQubicleBinary->GetQubicleMatrix(i)->m_pMesh);
+
+			if(pQubicleBinary->GetQubicleMatrix(i)->m_pMesh == vpOldMeshes[i] || numTriangles != vNumTriangles[i])
+			{
+				result.m_asyncRebuildSame = false;
+			}
+		}
+	}
+
+	delete pQubicleBinary;
+
+	m_vMeshingResults.push_back(result);
+}
+
+// Times the skeletal pose evaluation on its own, with a number of animators sharing the character's ms3d model
+void CharacterBenchmark::RunAnimators(int numAnimators)
+{
+	char ms3dFilename[128];
+	char animListFilename[128];
+	sprintf_s(ms3dFilename, 128, "media/gamedata/models/%s/%s.ms3d", m_typeName.c_str(), m_typeName.c_str());
+	sprintf_s(animListFilename, 128, "media/gamedata/models/%s/%s.animlist", m_typeName.c_str(), m_typeName.c_str());
+
+	MS3DModel* pModel = new MS3DModel(m_pRenderer);
+	if(pModel->LoadModel(ms3dFilename) == false)
+	{
+		cout << "Benchmark: Failed to load " << ms3dFilename << "\n";
+		delete pModel;
+		return;
+	}
+
+	vector<MS3DAnimator*> vpAnimators;
+	for(int i = 0; i < numAnimators; i++)
+	{
+		MS3DAnimator* pAnimator = new MS3DAnimator(m_pRenderer, pModel);
+		pAnimator->LoadAnimations(animListFilename);
+		pAnimator->SetPoseCache(m_pPoseCache);
+
+		// Spread the animators over all of the animations, the same as the character crowd
+		if(pAnimator->GetNumAnimations() > 0)
+		{
+			pAnimator->PlayAnimation(i % pAnimator->GetNumAnimations());
+		}
+
+		vpAnimators.push_back(pAnimator);
+	}
+
+	AnimatorBenchmarkResult result;
+	result.m_numAnimators = numAnimators;
+	result.m_numJoints = pModel->GetNumJoints();
+	result.m_samples.Reserve(m_numFrames);
+
+	for(int i = 0; i < m_numWarmupFrames + m_numFrames; i++)
+	{
+		double updateStart = GetTimeMilliseconds();
+
+		for(unsigned int j = 0; j < vpAnimators.size(); j++)
+		{
+			vpAnimators[j]->Update(m_deltaTime);
+		}
+
+		if(i >= m_numWarmupFrames)
+		{
+			result.m_samples.AddSample(GetTimeMilliseconds() - updateStart);
+		}
+	}
+
+	for(unsigned int i = 0; i < vpAnimators.size(); i++)
+	{
+		delete vpAnimators[i];
+	}
+	delete pModel;
+
+	m_vAnimatorResults.push_back(result);
+}
+
+// Powers of two up to and including the number of hardware threads
+vector<int> CharacterBenchmark::GetThreadCounts()
+{
+	vector<int> threadCounts;
+	int maxThreads = max(1, (int)std::thread::hardware_concurrency());
+	for(int numThreads = 1; numThreads < maxThreads; numThreads *= 2)
+	{
+		threadCounts.push_back(numThreads);
+	}
+	threadCounts.push_back(maxThreads);
+
+	return threadCounts;
+}
+
+// Results
+void CharacterBenchmark::PrintResults()
+{
+	cout << "Characters: " << m_numCharacters << ", frames: " << m_numFrames << ", dt: " << m_deltaTime << "\n";
+	cout << "Load: " << m_loadTime << "ms\n";
+
+	BenchmarkSamples* pSamples[4] = { &m_frameSamples, &m_interpolatorSamples, &m_characterUpdateSamples, &m_weaponTrailSamples };
+	for(int i = 0; i < 4; i++)
+	{
+		cout << pSamples[i]->m_name << ": mean " << pSamples[i]->GetMean() << "ms, p95 " << pSamples[i]->GetPercentile(95.0) << "ms, p99 " << pSamples[i]->GetPercentile(99.0) << "ms\n";
+	}
+
+	if(m_fadingSamples.GetNumSamples() > 0)
+	{
+		cout << m_fadingSamples.m_name << ": mean " << m_fadingSamples.GetMean() << "ms, p95 " << m_fadingSamples.GetPercentile(95.0) << "ms, p99 " << m_fadingSamples.GetPercentile(99.0) << "ms\n";
+	}
+
+	if(m_numCharacters > 0)
+	{
+		cout << "Per character: " << (m_frameSamples.GetMean() * 1000.0 / m_numCharacters) << "us\n";
+	}
+
+	for(unsigned int i = 0; i < m_vImportResults.size(); i++)
+	{
+		ImportBenchmarkResult& result = m_vImportResults[i];
+		double speedup = (result.m_bulkSamples.GetMean() > 0.0) ? result.m_perElementSamples.GetMean() / result.m_bulkSamples.GetMean() : 0.0;
+		cout << "Import " << result.m_fileName << ": per element mean " << result.m_perElementSamples.GetMean() << "ms, bulk mean " << result.m_bulkSamples.GetMean() << "ms, speedup " << speedup << (result.m_decodedSame ? "" : ", DECODED DIFFERENTLY") << "\n";
+	}
+
+	for(unsigned int i = 0; i < m_vMalformedImportResults.size(); i++)
+	{
+		MalformedImportResult& result = m_vMalformedImportResults[i];
+		cout << "Malformed import " << result.m_name << ": " << (result.m_importOk ? "accepted" : "rejected") << ((result.m_importOk == result.m_expectedOk) ? "" : ", UNEXPECTED") << "\n";
+	}
+
+	for(unsigned int i = 0; i < m_vRLEDecodingResults.size(); i++)
+	{
+		RLEDecodingBenchmarkResult& result = m_vRLEDecodingResults[i];
+		double speedup = (result.m_sliceSamples.GetMean() > 0.0) ? result.m_perVoxelSamples.GetMean() / result.m_sliceSamples.GetMean() : 0.0;
+		cout << "RLE decode " << result.m_name << ": per voxel mean " << result.m_perVoxelSamples.GetMean() << "ms, slice mean " << result.m_sliceSamples.GetMean() << "ms, speedup " << speedup << (result.m_decodedSame ? "" : ", DECODED DIFFERENTLY") << "\n";
+	}
+
+	for(unsigned int i = 0; i < m_vMeshingResults.size(); i++)
+	{
+		MeshingBenchmarkResult& result = m_vMeshingResults[i];
+		cout << result.m_fileName << ": import " << result.m_importTime << "ms\n";
+
+		for(unsigned int j = 0; j < result.m_vRuns.size(); j++)
+		{
+			MeshingBenchmarkRun& run = result.m_vRuns[j];
+			const char* methodName = (run.m_meshingMethod == QubicleMeshingMethod_Bitmask) ? "bitmask" : "merged_side";
+			cout << "  " << methodName << " x" << run.m_numThreads << ": mean " << run.m_samples.GetMean() << "ms, " << run.m_numTriangles << " triangles\n";
+		}
+
+		cout << "  async rebuild: start mean " << result.m_asyncStartSamples.GetMean() << "ms, swapped in after mean " << result.m_asyncRebuildSamples.GetMean() << "ms" << (result.m_asyncRebuildSame ? "" : ", DIFFERENT FROM CreateMesh()") << "\n";
+	}
+
+	for(unsigned int i = 0; i < m_vAnimatorResults.size(); i++)
+	{
+		AnimatorBenchmarkResult& result = m_vAnimatorResults[i];
+		cout << "Animators x" << result.m_numAnimators << ": mean " << result.m_samples.GetMean() << "ms, p95 " << result.m_samples.GetPercentile(95.0) << "ms, per animator " << (result.m_samples.GetMean() * 1000.0 / result.m_numAnimators) << "us\n";
+	}
+
+	for(unsigned int i = 0; i < m_vThreadScalingRuns.size(); i++)
+	{
+		ThreadScalingBenchmarkRun& run = m_vThreadScalingRuns[i];
+		double speedup = (run.m_samples.GetMean() > 0.0) ? m_vThreadScalingRuns[0].m_samples.GetMean() / run.m_samples.GetMean() : 0.0;
+		cout << "Update x" << run.m_numThreads << " threads: mean " << run.m_samples.GetMean() << "ms, p95 " << run.m_samples.GetPercentile(95.0) << "ms, speedup " << speedup << "\n";
+	}
+
+	for(unsigned int i = 0; i < m_vRespawnResults.size(); i++)
+	{
+		RespawnBenchmarkResult& result = m_vRespawnResults[i];
+		cout << "Respawn x" << result.m_numCycles << ": mean " << result.m_samples.GetMean() << "ms, static buffers live " << result.m_liveAtStart[RR_STATIC_BUFFER] << " -> " << result.m_liveAtEnd[RR_STATIC_BUFFER] << ", peak " << result.m_peak[RR_STATIC_BUFFER] << "\n";
+	}
+
+	for(unsigned int i = 0; i < m_vCullingRuns.size(); i++)
+	{
+		CullingBenchmarkRun& run = m_vCullingRuns[i];
+		cout << "Render " << run.m_name << ": mean " << run.m_samples.GetMean() << "ms, p95 " << run.m_samples.GetPercentile(95.0) << "ms, culled " << run.m_numCulled << ", visible " << run.m_numVisible << ", render packets " << run.m_numRenderPackets << "\n";
+	}
+
+	if(m_pPoseCache != NULL)
+	{
+		m_pPoseCache->PrintStatistics();
+	}
+}
+
+bool CharacterBenchmark::WriteResults(const char* fileName)
+{
+	FILE* pFile = NULL;
+	fopen_s(&pFile, fileName, "w");
+
+	if(pFile == NULL)
+	{
+		cout << "Benchmark: Failed to open " << fileName << " for writing\n";
+		return false;
+	}
+
+	fprintf(pFile, "{\n");
+	fprintf(pFile, "  \"settings\": {\n");
+	fprintf(pFile, "    \"character\": \"%s/%s\",\n", m_typeName.c_str(), m_modelName.c_str());
+	fprintf(pFile, "    \"weapon\": \"%s\",\n", m_weaponFilename.c_str());
+	fprintf(pFile, "    \"num_characters\": %d,\n", m_numCharacters);
+	fprintf(pFile, "    \"num_frames\": %d,\n", m_numFrames);
+	fprintf(pFile, "    \"num_warmup_frames\": %d,\n", m_numWarmupFrames);
+	fprintf(pFile, "    \"dt\": %f,\n", m_deltaTime);
+	fprintf(pFile, "    \"random_seed\": %u,\n", m_randomSeed);
+	fprintf(pFile, "    \"pose_cache_budget\": %u,\n", (m_pPoseCache != NULL) ? m_pPoseCache->GetMemoryBudget() : 0);
+	fprintf(pFile, "    \"pose_cache_used\": %u,\n", (m_pPoseCache != NULL) ? m_pPoseCache->GetMemoryUsed() : 0);
+	fprintf(pFile, "    \"num_threads\": %d,\n", (m_numThreads > 0) ? m_numThreads : max(1, (int)std::thread::hardware_concurrency()));
+	fprintf(pFile, "    \"hardware_threads\": %u\n", std::thread::hardware_concurrency());
+	fprintf(pFile, "  },\n");
+
+	fprintf(pFile, "  \"load_ms\": %f,\n", m_loadTime);
+	fprintf(pFile, "  \"per_character_us\": %f,\n", (m_numCharacters > 0) ? (m_frameSamples.GetMean() * 1000.0 / m_numCharacters) : 0.0);
+
+	fprintf(pFile, "  \"frame\": ");
+	WriteSamples(pFile, m_frameSamples);
+	fprintf(pFile, ",\n");
+
+	fprintf(pFile, "  \"subsystems\": {\n");
+	BenchmarkSamples* pSubsystems[3] = { &m_interpolatorSamples, &m_characterUpdateSamples, &m_weaponTrailSamples };
+	for(int i = 0; i < 3; i++)
+	{
+		fprintf(pFile, "    \"%s\": ", pSubsystems[i]->m_name.c_str());
+		WriteSamples(pFile, *pSubsystems[i]);
+		fprintf(pFile, (i < 2) ? ",\n" : "\n");
+	}
+	fprintf(pFile, "  },\n");
+
+	fprintf(pFile, "  \"fading\": ");
+	WriteSamples(pFile, m_fadingSamples);
+	fprintf(pFile, ",\n");
+
+	fprintf(pFile, "  \"import\": [");
+	for(unsigned int i = 0; i < m_vImportResults.size(); i++)
+	{
+		ImportBenchmarkResult& result = m_vImportResults[i];
+
+		fprintf(pFile, "%s\n    { \"file\": \"%s\", \"compressed\": %s, \"file_size\": %d, \"num_voxels\": %d, \"decoded_same\": %s,\n", (i > 0) ? "," : "",
+			result.m_fileName.c_str(), result.m_compressed ? "true" : "false", result.m_fileSize, result.m_numVoxels, result.m_decodedSame ? "true" : "false");
+		fprintf(pFile, "      \"per_element\": ");
+		WriteSamples(pFile, result.m_perElementSamples);
+		fprintf(pFile, ",\n      \"bulk\": ");
+		WriteSamples(pFile, result.m_bulkSamples);
+		fprintf(pFile, " }");
+	}
+	fprintf(pFile, "%s],\n", m_vImportResults.empty() ? "" : "\n  ");
+
+	fprintf(pFile, "  \"malformed_import\": [");
+	for(unsigned int i = 0; i < m_vMalformedImportResults.size(); i++)
+	{
+		MalformedImportResult& result = m_vMalformedImportResults[i];
+
+		fprintf(pFile, "%s\n    { \"name\": \"%s\", \"expected_ok\": %s, \"import_ok\": %s }", (i > 0) ? "," : "",
+			result.m_name.c_str(), result.m_expectedOk ? "true" : "false", result.m_importOk ? "true" : "false");
+	}
+	fprintf(pFile, "%s],\n", m_vMalformedImportResults.empty() ? "" : "\n  ");
+
+	fprintf(pFile, "  \"rle_decoding\": [");
+	for(unsigned int i = 0; i < m_vRLEDecodingResults.size(); i++)
+	{
+		RLEDecodingBenchmarkResult& result = m_vRLEDecodingResults[i];
+
+		fprintf(pFile, "%s\n    { \"name\": \"%s\", \"max_run_length\": %d, \"data_size\": %d, \"num_voxels\": %d, \"decoded_same\": %s,\n", (i > 0) ? "," : "",
+			result.m_name.c_str(), result.m_maxRunLength, result.m_dataSize, result.m_numVoxels, result.m_decodedSame ? "true" : "false");
+		fprintf(pFile, "      \"per_voxel\": ");
+		WriteSamples(pFile, result.m_perVoxelSamples);
+		fprintf(pFile, ",\n      \"slice\": ");
+		WriteSamples(pFile, result.m_sliceSamples);
+		fprintf(pFile, " }");
+	}
+	fprintf(pFile, "%s],\n", m_vRLEDecodingResults.empty() ? "" : "\n  ");
+
+	fprintf(pFile, "  \"meshing\": [");
+	for(unsigned int i = 0; i < m_vMeshingResults.size(); i++)
+	{
+		MeshingBenchmarkResult& result = m_vMeshingResults[i];
+
+		fprintf(pFile, "%s\n    {\n", (i > 0) ? "," : "");
+		fprintf(pFile, "      \"file\": \"%s\",\n", result.m_fileName.c_str());
+		fprintf(pFile, "      \"num_matrices\": %d,\n", result.m_numMatrices);
+		fprintf(pFile, "      \"num_voxels\": %d,\n", result.m_numVoxels);
+		fprintf(pFile, "      \"import_ms\": %f,\n", result.m_importTime);
+		fprintf(pFile, "      \"runs\": [");
+
+		for(unsigned int j = 0; j < result.m_vRuns.size(); j++)
+		{
+			MeshingBenchmarkRun& run = result.m_vRuns[j];
+			const char* methodName = (run.m_meshingMethod == QubicleMeshingMethod_Bitmask) ? "bitmask" : "merged_side";
+
+			fprintf(pFile, "%s\n        { \"method\": \"%s\", \"threads\": %d, \"triangles\": %d, \"timing\": ", (j > 0) ? "," : "", methodName, run.m_numThreads, run.m_numTriangles);
+			WriteSamples(pFile, run.m_samples);
+			fprintf(pFile, " }");
+		}
+
+		fprintf(pFile, "\n      ],\n");
+		fprintf(pFile, "      \"async_rebuild\": { \"same\": %s, \"start\": ", result.m_asyncRebuildSame ? "true" : "false");
+		WriteSamples(pFile, result.m_asyncStartSamples);
+		fprintf(pFile, ", \"swapped_in\": ");
+		WriteSamples(pFile, result.m_asyncRebuildSamples);
+		fprintf(pFile, " }\n    }");
+	}
+	fprintf(pFile, "%s],\n", m_vMeshingResults.empty() ? "" : "\n  ");
+
+	fprintf(pFile, "  \"animators\": [");
+	for(unsigned int i = 0; i < m_vAnimatorResults.size(); i++)
+	{
+		AnimatorBenchmarkResult& result = m_vAnimatorResults[i];
+
+		fprintf(pFile, "%s\n    { \"num_animators\": %d, \"num_joints\": %d, \"per_animator_us\": %f, \"timing\": ", (i > 0) ? "," : "", result.m_numAnimators, result.m_numJoints, result.m_samples.GetMean() * 1000.0 / result.m_numAnimators);
+		WriteSamples(pFile, result.m_samples);
+		fprintf(pFile, " }");
+	}
+	fprintf(pFile, "%s],\n", m_vAnimatorResults.empty() ? "" : "\n  ");
+
+	fprintf(pFile, "  \"thread_scaling\": [");
+	for(unsigned int i = 0; i < m_vThreadScalingRuns.size(); i++)
+	{
+		ThreadScalingBenchmarkRun& run = m_vThreadScalingRuns[i];
+		double speedup = (run.m_samples.GetMean() > 0.0) ? m_vThreadScalingRuns[0].m_samples.GetMean() / run.m_samples.GetMean() : 0.0;
+
+		fprintf(pFile, "%s\n    { \"threads\": %d, \"speedup\": %f, \"timing\": ", (i > 0) ? "," : "", run.m_numThreads, speedup);
+		WriteSamples(pFile, run.m_samples);
+		fprintf(pFile, " }");
+	}
+	fprintf(pFile, "%s],\n", m_vThreadScalingRuns.empty() ? "" : "\n  ");
+
+	static const char* resourceNames[RR_NUMRESOURCES] = { "viewport", "material", "texture", "light", "font", "static_buffer" };
+
+	fprintf(pFile, "  \"respawning\": [");
+	for(unsigned int i = 0; i < m_vRespawnResults.size(); i++)
+	{
+		RespawnBenchmarkResult& result = m_vRespawnResults[i];
+
+		fprintf(pFile, "%s\n    { \"cycles\": %d, \"timing\": ", (i > 0) ? "," : "", result.m_numCycles);
+		WriteSamples(pFile, result.m_samples);
+		fprintf(pFile, ", \"resources\": {");
+
+		for(int j = 0; j < RR_NUMRESOURCES; j++)
+		{
+			fprintf(pFile, "%s\n        \"%s\": { \"live_start\": %d, \"live_end\": %d, \"peak\": %d }", (j > 0) ? "," : "", resourceNames[j], result.m_liveAtStart[j], result.m_liveAtEnd[j], result.m_peak[j]);
+		}
+
+		fprintf(pFile, "\n      } }");
+	}
+	fprintf(pFile, "%s],\n", m_vRespawnResults.empty() ? "" : "\n  ");
+
+	fprintf(pFile, "  \"culling\": [");
+	for(unsigned int i = 0; i < m_vCullingRuns.size(); i++)
+	{
+		CullingBenchmarkRun& run = m_vCullingRuns[i];
+
+		fprintf(pFile, "%s\n    { \"name\": \"%s\", \"frustum_culling\": %s, \"facing_crowd\": %s, \"culled\": %d, \"visible\": %d, \"render_packets\": %d, \"timing\": ", (i > 0) ? "," : "",
+			run.m_name.c_str(), run.m_frustumCulling ? "true" : "false", run.m_facingCrowd ? "true" : "false", run.m_numCulled, run.m_numVisible, run.m_numRenderPackets);
+		WriteSamples(pFile, run.m_samples);
+		fprintf(pFile, " }");
+	}
+	fprintf(pFile, "%s]\n", m_vCullingRuns.empty() ? "" : "\n  ");
+
+	fprintf(pFile, "}\n");
+
+	bool writeOk = (ferror(pFile) == 0);
+	writeOk = (fclose(pFile) == 0) && writeOk;
+
+	return writeOk;
+}
+
+// Measured from the first call rather than the clock's epoch, so that the doubles keep sub-microsecond precision
+double CharacterBenchmark::GetTimeMilliseconds()
+{
+	static const chrono::high_resolution_clock::time_point startTime = chrono::high_resolution_clock::now();
+
+	return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - startTime).count();
+}
+
+void CharacterBenchmark::WriteSamples(FILE* pFile, BenchmarkSamples& samples)
+{
+	fprintf(pFile, "{ \"mean_ms\": %f, \"p50_ms\": %f, \"p95_ms\": %f, \"p99_ms\": %f, \"max_ms\": %f, \"total_ms\": %f, \"samples\": %d }",
+		samples.GetMean(), samples.GetPercentile(50.0), samples.GetPercentile(95.0), samples.GetPercentile(99.0), samples.GetMax(), samples.GetTotal(), samples.GetNumSamples());
+}
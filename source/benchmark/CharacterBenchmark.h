@@ -0,0 +1,262 @@
+// ******************************************************************************
+//
+// Filename:	CharacterBenchmark.h
+// Project:		Benchmark
+// Author:		Steven Ball
+//
+// Purpose:
+//   Headless benchmark of the per-character CPU cost. Loads a crowd of voxel
+//   characters with weapons and steps them with a fixed delta time, timing
+//   each subsystem per frame. Results are written out as JSON so that runs
+//   can be compared against each other.
+//
+// Revision History:
+//   Initial Revision - 18/10/26
+//
+// Copyright (c) 2005-2015, Steven Ball
+//
+// ******************************************************************************
+
+#pragma once
+
+#include "../Renderer/Renderer.h"
+#include "../models/VoxelCharacter.h"
+#include "../models/QubicleBinaryManager.h"
+#include "../models/MS3DAnimator.h"
+#include "../models/MS3DPoseCache.h"
+#include "../utils/WorkerPool.h"
+
+#include <vector>
+#include <string>
+
+using namespace std;
+
+
+// Per frame timings for one subsystem, in milliseconds
+class BenchmarkSamples
+{
+public:
+	/* Public methods */
+	void Reserve(int numSamples);
+	void AddSample(double milliseconds);
+
+	int GetNumSamples();
+	double GetTotal();
+	double GetMean();
+	double GetMax();
+	double GetPercentile(double percentile);
+
+public:
+	/* Public members */
+	string m_name;
+	vector<double> m_samples;
+};
+
+// Timing of importing a single qubicle file, with the old per element reader and the bulk reader that Import() uses
+class ImportBenchmarkResult
+{
+public:
+	string m_fileName;
+	bool m_compressed;
+	int m_fileSize;
+	int m_numVoxels;
+	bool m_decodedSame;
+	BenchmarkSamples m_perElementSamples;
+	BenchmarkSamples m_bulkSamples;
+};
+
+// Whether ImportFromMemory() accepted a .qb file with a corrupt or well formed matrix header
+class MalformedImportResult
+{
+public:
+	string m_name;
+	bool m_expectedOk;
+	bool m_importOk;
+};
+
+// Timing of decoding a synthetic RLE compressed matrix, with the old per voxel decode and with DecodeQubicleRLEMatrix()
+class RLEDecodingBenchmarkResult
+{
+public:
+	string m_name;
+	int m_maxRunLength;
+	int m_dataSize;
+	int m_numVoxels;
+	bool m_decodedSame;
+	BenchmarkSamples m_perVoxelSamples;
+	BenchmarkSamples m_sliceSamples;
+};
+
+// Timing of meshing a single qubicle file with one mesher and thread count
+class MeshingBenchmarkRun
+{
+public:
+	QubicleMeshingMethod m_meshingMethod;
+	int m_numThreads;
+	int m_numTriangles;
+	BenchmarkSamples m_samples;
+};
+
+class MeshingBenchmarkResult
+{
+public:
+	string m_fileName;
+	int m_numMatrices;
+	int m_numVoxels;
+	double m_importTime;
+	vector<MeshingBenchmarkRun> m_vRuns;
+
+	// Background rebuilds, how long RebuildMeshAsync() holds up the caller and how long until Update() swaps the meshes in
+	bool m_asyncRebuildSame;
+	BenchmarkSamples m_asyncStartSamples;
+	BenchmarkSamples m_asyncRebuildSamples;
+};
+
+// Timing of updating a number of skeletal animators that share one model
+class AnimatorBenchmarkResult
+{
+public:
+	int m_numAnimators;
+	int m_numJoints;
+	BenchmarkSamples m_samples;
+};
+
+// Timing of the whole crowd's character update and weapon trails, fanned out over a number of threads
+class ThreadScalingBenchmarkRun
+{
+public:
+	int m_numThreads;
+	BenchmarkSamples m_samples;
+};
+
+// Renderer resources alive while the whole crowd is despawned and respawned over and over
+class RespawnBenchmarkResult
+{
+public:
+	int m_numCycles;
+	int m_liveAtStart[RR_NUMRESOURCES];
+	int m_liveAtEnd[RR_NUMRESOURCES];
+	int m_peak[RR_NUMRESOURCES];
+	BenchmarkSamples m_samples;
+};
+
+// Timing of drawing the whole crowd from one camera, the counts are from the last frame drawn
+class CullingBenchmarkRun
+{
+public:
+	string m_name;
+	bool m_frustumCulling;
+	bool m_facingCrowd;
+	int m_numCulled;
+	int m_numVisible;
+	int m_numRenderPackets;
+	BenchmarkSamples m_samples;
+};
+
+
+class CharacterBenchmark
+{
+public:
+	/* Public methods */
+	CharacterBenchmark(Renderer* pRenderer, QubicleBinaryManager* pQubicleBinaryManager);
+	~CharacterBenchmark();
+
+	// Settings
+	void SetNumCharacters(int numCharacters);
+	void SetNumFrames(int numFrames);
+	void SetNumWarmupFrames(int numWarmupFrames);
+	void SetDeltaTime(float dt);
+	void SetRandomSeed(unsigned int seed);
+	void SetCharacter(const char* typeName, const char* modelName);
+	void SetWeapon(const char* weaponFilename);
+	void SetMeshingIterations(int iterations);
+	void SetPoseCache(MS3DPoseCache* pPoseCache);
+	void SetNumThreads(int numThreads);
+
+	// Loading
+	bool LoadCharacters();
+	void UnloadCharacters();
+
+	// Running
+	void Run();
+	void RunImport(const char* qbFilename);
+	void RunSyntheticImport(unsigned int size, bool compressed);
+	bool RunMalformedImport();
+	void RunRLEDecoding(const char* name, unsigned int size, unsigned int maxRunLength);
+	void RunMeshing(const char* qbFilename);
+	void RunAnimators(int numAnimators);
+	void RunThreadScaling();
+	void RunFading();
+	void RunRespawning(int numCycles);
+	void RunCulling();
+
+	// Results
+	void PrintResults();
+	bool WriteResults(const char* fileName);
+
+protected:
+	/* Protected methods */
+
+private:
+	/* Private methods */
+	void StepFrame(WorkerPool* pWorkerPool, bool recordSamples);
+	int RenderCrowd(unsigned int viewport, bool facingCrowd);
+	vector<int> GetThreadCounts();
+
+	static double GetTimeMilliseconds();
+	static void WriteSamples(FILE* pFile, BenchmarkSamples& samples);
+
+public:
+	/* Public members */
+	// Characters are handed out to the update threads a few at a time, to keep the hand out cost down
+	static const int CHARACTER_BATCH_SIZE = 4;
+
+	// Frames for the crowd to fade from fully visible to invisible
+	static const int FADE_FRAMES = 60;
+
+	// Spacing of the crowd when it is drawn, in world units
+	static const int CROWD_SPACING = 2;
+
+	// Times each qubicle file is imported with each reader
+	static const int IMPORT_ITERATIONS = 20;
+
+protected:
+	/* Protected members */
+
+private:
+	/* Private members */
+	Renderer* m_pRenderer;
+	QubicleBinaryManager* m_pQubicleBinaryManager;
+
+	// Settings
+	int m_numCharacters;
+	int m_numFrames;
+	int m_numWarmupFrames;
+	float m_deltaTime;
+	unsigned int m_randomSeed;
+	string m_typeName;
+	string m_modelName;
+	string m_weaponFilename;
+	int m_meshingIterations;
+	MS3DPoseCache* m_pPoseCache;
+	int m_numThreads;
+
+	// The crowd of characters being simulated
+	vector<VoxelCharacter*> m_vpCharacters;
+
+	// Results
+	double m_loadTime;
+	BenchmarkSamples m_frameSamples;
+	BenchmarkSamples m_interpolatorSamples;
+	BenchmarkSamples m_characterUpdateSamples;
+	BenchmarkSamples m_weaponTrailSamples;
+	BenchmarkSamples m_fadingSamples;
+	vector<ImportBenchmarkResult> m_vImportResults;
+	vector<MalformedImportResult> m_vMalformedImportResults;
+	vector<RLEDecodingBenchmarkResult> m_vRLEDecodingResults;
+	vector<MeshingBenchmarkResult> m_vMeshingResults;
+	vector<AnimatorBenchmarkResult> m_vAnimatorResults;
+	vector<ThreadScalingBenchmarkRun> m_vThreadScalingRuns;
+	vector<RespawnBenchmarkResult> m_vRespawnResults;
+	vector<CullingBenchmarkRun> m_vCullingRuns;
+};
@@ -9,6 +9,8 @@
 
 extern bool modelWireframe;
 extern bool modelTalking;
+extern bool modelSkinning;
+extern bool frustumCulling;
 extern int modelAnimationIndex;
 extern VoxelCharacter* pVoxelCharacter;
 
@@ -58,6 +60,17 @@ void KeyPressed(GLFWwindow* window, int key, int scancode, int mods)
 			pVoxelCharacter->SetTalkingAnimationEnabled(modelTalking);
 			break;
 		}
+		case GLFW_KEY_S:
+		{
+			modelSkinning = !modelSkinning;
+			pVoxelCharacter->SetSkinnedRendering(modelSkinning);
+			break;
+		}
+		case GLFW_KEY_C:
+		{
+			frustumCulling = !frustumCulling;
+			break;
+		}
 		case GLFW_KEY_Q:
 		{
 			modelAnimationIndex++;
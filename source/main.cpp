@@ -21,6 +21,8 @@
 
 bool modelWireframe = false;
 bool modelTalking = false;
+bool modelSkinning = false;
+bool frustumCulling = true;
 int modelAnimationIndex = 0;
 VoxelCharacter* pVoxelCharacter = NULL;
 
@@ -84,8 +86,12 @@ int main(void)
 	/* Create the qubicle binary file manager */
 	QubicleBinaryManager* pQubicleBinaryManager = new QubicleBinaryManager(pRenderer);
 
+	/* Create the shared cache of baked animations */
+	MS3DPoseCache* pPoseCache = new MS3DPoseCache();
+
 	/* Create test voxel character */
 	pVoxelCharacter = new VoxelCharacter(pRenderer, pQubicleBinaryManager);
+	pVoxelCharacter->SetPoseCache(pPoseCache);
 	char characterBaseFolder[128];
 	char qbFilename[128];
 	char ms3dFilename[128];
@@ -111,11 +117,11 @@ int main(void)
 	pVoxelCharacter->LoadRightWeapon("media/gamedata/weapons/Sword/Sword.weapon");
 
 	/* Loop until the user closes the window */
+	double timeOld = ((double)timeGetTime() / 1000.0) - (1.0 / 50.0);
 	while (!glfwWindowShouldClose(window))
 	{
 		// Delta time
 		double timeNow = (double)timeGetTime() / 1000.0;
-		static double timeOld = timeNow - (1.0 / 50.0);
 		float deltaTime = (float)timeNow - (float)timeOld;
 		timeOld = timeNow;
 
@@ -128,6 +134,9 @@ int main(void)
 		// Update interpolator singleton
 		Interpolator::GetInstance()->Update();
 
+		// Upload any models that finished loading in the background
+		pQubicleBinaryManager->Update();
+
 		// Update the voxel model
 		float animationSpeeds[AnimationSections_NUMSECTIONS] = { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f };
 		Matrix4x4 worldMatrix;
@@ -147,6 +156,12 @@ int main(void)
 			// Set the lookat camera
 			pGameCamera->Look();
 
+			// Only for the camera pass, anything drawn from somewhere else must not be culled against this view
+			pRenderer->SetFrustumCullingEnabled(frustumCulling);
+
+			// Everything submits into the render queue, and is drawn sorted by state and depth when it is flushed
+			pRenderer->BeginRenderQueue();
+
 			// Render the voxel character
 			Colour OulineColour(1.0f, 1.0f, 0.0f, 1.0f);
 			pRenderer->PushMatrix();
@@ -162,10 +177,14 @@ int main(void)
 				glActiveTextureARB(GL_TEXTURE0_ARB);
 				glDisable(GL_TEXTURE_2D);
 				glBindTexture(GL_TEXTURE_2D, 0);
+				pRenderer->InvalidateStateCache();
 
 				pVoxelCharacter->RenderFace();
 			pRenderer->PopMatrix();
 
+			pRenderer->FlushRenderQueue();
+
+			pRenderer->SetFrustumCullingEnabled(false);
 		pRenderer->PopMatrix();
 
 		// ---------------------------------------
@@ -175,11 +194,18 @@ int main(void)
 		sprintf_s(lFPSBuff, "FPS: %.0f  Delta: %.4f", fps, deltaTime);
 		char lAnimationBuff[128];
 		sprintf_s(lAnimationBuff, "Animation: %s [%i/%i]", pVoxelCharacter->GetAnimationName(modelAnimationIndex), modelAnimationIndex, pVoxelCharacter->GetNumAnimations()-1);
+		char lMatrixCallsBuff[128];
+		sprintf_s(lMatrixCallsBuff, "GL matrix calls: %i  Draw calls: %i%s", pRenderer->GetNumMatrixCalls(), pRenderer->GetNumDrawCalls(), pRenderer->IsInstancedRenderingSupported() ? " (instanced)" : "");
+		char lStateChangesBuff[128];
+		sprintf_s(lStateChangesBuff, "GL state changes: %i (%i filtered)  Draw packets: %i", pRenderer->GetNumStateChanges(), pRenderer->GetNumFilteredStateChanges(), pRenderer->GetNumRenderPackets());
+		char lCullingBuff[128];
+		sprintf_s(lCullingBuff, "Frustum culling: %s  Culled: %i  Visible: %i", frustumCulling ? "on" : "off", pRenderer->GetNumFrustumCulled(), pRenderer->GetNumFrustumVisible());
 
 		pRenderer->PushMatrix();
 			glActiveTextureARB(GL_TEXTURE0_ARB);
 			glDisable(GL_TEXTURE_2D);
 			glBindTexture(GL_TEXTURE_2D, 0);
+			pRenderer->InvalidateStateCache();
 
 			pRenderer->SetRenderMode(RM_SOLID);
 			pRenderer->SetProjectionMode(PM_2D, defaultViewport);
@@ -189,6 +215,12 @@ int main(void)
 
 			pRenderer->RenderFreeTypeText(defaultFont, 335.0f, 15.0f, 1.0f, Colour(1.0f, 1.0f, 1.0f), 1.0f, lAnimationBuff);
 
+			pRenderer->RenderFreeTypeText(defaultFont, 15.0f, 35.0f, 1.0f, Colour(1.0f, 1.0f, 1.0f), 1.0f, lMatrixCallsBuff);
+			pRenderer->RenderFreeTypeText(defaultFont, 15.0f, 55.0f, 1.0f, Colour(1.0f, 1.0f, 1.0f), 1.0f, lStateChangesBuff);
+			pRenderer->RenderFreeTypeText(defaultFont, 15.0f, 75.0f, 1.0f, Colour(1.0f, 1.0f, 1.0f), 1.0f, lCullingBuff);
+
+			pRenderer->RenderFreeTypeText(defaultFont, 635.0f, 95.0f, 1.0f, Colour(1.0f, 1.0f, 1.0f), 1.0f, "C - Toggle frustum culling");
+			pRenderer->RenderFreeTypeText(defaultFont, 635.0f, 75.0f, 1.0f, Colour(1.0f, 1.0f, 1.0f), 1.0f, "S - Toggle GPU skinning");
 			pRenderer->RenderFreeTypeText(defaultFont, 635.0f, 55.0f, 1.0f, Colour(1.0f, 1.0f, 1.0f), 1.0f, "E - Toggle Talking");
 			pRenderer->RenderFreeTypeText(defaultFont, 635.0f, 35.0f, 1.0f, Colour(1.0f, 1.0f, 1.0f), 1.0f, "W - Toggle wireframe");
 			pRenderer->RenderFreeTypeText(defaultFont, 635.0f, 15.0f, 1.0f, Colour(1.0f, 1.0f, 1.0f), 1.0f, "Q - Cycle Animations");
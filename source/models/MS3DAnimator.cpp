@@ -1,7 +1,13 @@
 #include "MS3DAnimator.h"
+#include "MS3DPoseCache.h"
 
 #include <assert.h>
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MS3D_POSE_SSE
+#include <xmmintrin.h>
+#endif
+
 #include <fstream>
 using namespace std;
 
@@ -21,8 +27,24 @@ MS3DAnimator::MS3DAnimator(Renderer *lpRenderer, MS3DModel* pModel)
 	// Once we have some model data, create out joint animations
 	CreateJointAnimations();
 
-	// Calculate the initial bounding box
-	CalculateBoundingBox();
+	CreatePoseEvaluation(&m_fullPose, NULL);
+	memset(&m_maskedPose, 0, sizeof(PoseEvaluation));
+	m_pJointMask = NULL;
+	m_bFullPoseDirty = false;
+	m_bPoseFromBlend = false;
+	m_poseBlendInterpolation = 0.0f;
+	m_bPoseUpToDate = false;
+	m_poseTimer = 0.0;
+	m_poseVersion = 0;
+
+	m_pPoseCache = NULL;
+	m_ppBakedAnimations = NULL;
+	m_pBakedAnimationRequested = NULL;
+	m_pPoseBakedAnimation = NULL;
+	m_bBlendValuesDirty = false;
+
+	// The initial bounding box is calculated when it is first asked for
+	m_boundingBoxDirty = true;
 
 	mCurrentAnimationIndex = 0;
 	mCurrentAnimationStartTime = 0.0;
@@ -56,6 +78,17 @@ MS3DAnimator::~MS3DAnimator()
 		delete[] pAnimations;
 		pAnimations = NULL;
 	}
+
+	// The baked animations themselves belong to the pose cache
+	delete[] m_ppBakedAnimations;
+	m_ppBakedAnimations = NULL;
+	delete[] m_pBakedAnimationRequested;
+	m_pBakedAnimationRequested = NULL;
+
+	DeletePoseEvaluation(&m_fullPose);
+	DeletePoseEvaluation(&m_maskedPose);
+	delete[] m_pJointMask;
+	m_pJointMask = NULL;
 }
 
 MS3DModel* MS3DAnimator::GetModel()
@@ -77,6 +110,289 @@ void MS3DAnimator::CreateJointAnimations()
 	}
 }
 
+// Builds the pose arrays for the masked joints and all of their parents, in the model's evaluation order
+void MS3DAnimator::CreatePoseEvaluation(PoseEvaluation* pPose, const bool* pJointMask)
+{
+	int numJoints = mpModel->numJoints;
+	const int* pOrder = mpModel->pJointEvaluationOrder;
+	const int* pParent = mpModel->pJointEvaluationParent;
+	int slot;
+	int i;
+
+	bool* pSlotNeeded = new bool[numJoints];
+	for(slot = 0; slot < numJoints; slot++)
+	{
+		pSlotNeeded[slot] = (pJointMask == NULL) || pJointMask[pOrder[slot]];
+	}
+
+	// Walk backwards, so that every child has already added its parent to the set
+	for(slot = numJoints-1; slot >= 0; slot--)
+	{
+		if(pSlotNeeded[slot] && pParent[slot] != -1)
+		{
+			pSlotNeeded[pParent[slot]] = true;
+		}
+	}
+
+	// Model evaluation slot to pose entry
+	int* pSlotEntry = new int[numJoints];
+	pPose->numJoints = 0;
+	for(slot = 0; slot < numJoints; slot++)
+	{
+		pSlotEntry[slot] = pSlotNeeded[slot] ? pPose->numJoints++ : -1;
+	}
+
+	int stride = (pPose->numJoints + 3) & ~3;
+	pPose->stride = stride;
+	pPose->pJointIndex = new int[stride];
+	pPose->pParent = new int[stride];
+	pPose->pUseBindPose = new bool[stride];
+
+	const int numArrays = 39;
+	pPose->pBuffer = new float[numArrays*stride];
+	memset(pPose->pBuffer, 0, sizeof(float)*numArrays*stride);
+
+	for(i = 0; i < 12; i++)
+	{
+		pPose->pRelative[i] = pPose->pBuffer + stride*i;
+		pPose->pLocal[i] = pPose->pBuffer + stride*(12 + i);
+	}
+	for(i = 0; i < 4; i++)
+	{
+		pPose->pStartRotation[i] = pPose->pBuffer + stride*(24 + i);
+		pPose->pEndRotation[i] = pPose->pBuffer + stride*(28 + i);
+	}
+	for(i = 0; i < 3; i++)
+	{
+		pPose->pTranslation[i] = pPose->pBuffer + stride*(32 + i);
+	}
+	pPose->pRotationInterpolation = pPose->pBuffer + stride*35;
+	pPose->pSlerpDot = pPose->pBuffer + stride*36;
+	pPose->pSlerpWeight[0] = pPose->pBuffer + stride*37;
+	pPose->pSlerpWeight[1] = pPose->pBuffer + stride*38;
+
+	// Start with identity rotations, this also keeps the padding at the end of the arrays well defined
+	for(i = 0; i < stride; i++)
+	{
+		pPose->pJointIndex[i] = -1;
+		pPose->pParent[i] = -1;
+		pPose->pUseBindPose[i] = true;
+		pPose->pStartRotation[3][i] = 1.0f;
+		pPose->pEndRotation[3][i] = 1.0f;
+	}
+
+	for(slot = 0; slot < numJoints; slot++)
+	{
+		int entry = pSlotEntry[slot];
+		if(entry == -1)
+		{
+			continue;
+		}
+
+		pPose->pJointIndex[entry] = pOrder[slot];
+		pPose->pParent[entry] = (pParent[slot] == -1) ? -1 : pSlotEntry[pParent[slot]];
+
+		for(i = 0; i < 12; i++)
+		{
+			pPose->pRelative[i][entry] = mpModel->pJointRelative[i*mpModel->jointStride + slot];
+		}
+	}
+
+	delete[] pSlotNeeded;
+	delete[] pSlotEntry;
+}
+
+void MS3DAnimator::DeletePoseEvaluation(PoseEvaluation* pPose)
+{
+	delete[] pPose->pJointIndex;
+	pPose->pJointIndex = NULL;
+	delete[] pPose->pParent;
+	pPose->pParent = NULL;
+	delete[] pPose->pUseBindPose;
+	pPose->pUseBindPose = NULL;
+	delete[] pPose->pBuffer;
+	pPose->pBuffer = NULL;
+
+	pPose->numJoints = 0;
+	pPose->stride = 0;
+}
+
+void MS3DAnimator::SetPoseRotation(PoseEvaluation* pPose, int entry, const float* pStart, const float* pEnd, float interpolation)
+{
+	pPose->pStartRotation[0][entry] = pStart[0];
+	pPose->pStartRotation[1][entry] = pStart[1];
+	pPose->pStartRotation[2][entry] = pStart[2];
+	pPose->pStartRotation[3][entry] = pStart[3];
+	pPose->pEndRotation[0][entry] = pEnd[0];
+	pPose->pEndRotation[1][entry] = pEnd[1];
+	pPose->pEndRotation[2][entry] = pEnd[2];
+	pPose->pEndRotation[3][entry] = pEnd[3];
+	pPose->pRotationInterpolation[entry] = interpolation;
+}
+
+// Evaluates the pose from the rotations and translations that have been gathered into the pose arrays.
+// The slerp and local matrix passes work on all the joints at once, so the compiler can vectorize them, then
+// the local matrices are concatenated down the hierarchy in evaluation order, parents always come first.
+void MS3DAnimator::EvaluatePose(PoseEvaluation* pPose)
+{
+	m_poseVersion++;
+
+	int numJoints = pPose->numJoints;
+	int stride = pPose->stride;
+	int s;
+
+	float* ax = pPose->pStartRotation[0]; float* ay = pPose->pStartRotation[1]; float* az = pPose->pStartRotation[2]; float* aw = pPose->pStartRotation[3];
+	float* bx = pPose->pEndRotation[0]; float* by = pPose->pEndRotation[1]; float* bz = pPose->pEndRotation[2]; float* bw = pPose->pEndRotation[3];
+	float* pInterpolation = pPose->pRotationInterpolation;
+	float* pDot = pPose->pSlerpDot;
+	float* pWeight0 = pPose->pSlerpWeight[0];
+	float* pWeight1 = pPose->pSlerpWeight[1];
+
+	// Slerp weights, taking the shortest path. Nearby rotations use linear weights, the same as Quaternion::Slerp()
+	for(s = 0; s < stride; s++)
+	{
+		float dot = (ax[s] * bx[s]) + (ay[s] * by[s]) + (az[s] * bz[s]) + (aw[s] * bw[s]);
+		float sign = (dot < 0.0f) ? -1.0f : 1.0f;
+
+		bx[s] *= sign;
+		by[s] *= sign;
+		bz[s] *= sign;
+		bw[s] *= sign;
+
+		pDot[s] = dot * sign;
+		pWeight0[s] = 1.0f - pInterpolation[s];
+		pWeight1[s] = pInterpolation[s];
+	}
+
+	// Rotations that are far apart need the real spherical weights, these are rare between keyframes so do them one at a time
+	for(s = 0; s < numJoints; s++)
+	{
+		if(1.0f - pDot[s] > 0.1f)
+		{
+			float theta = (float)acos(pDot[s]);
+			float sinTheta = (float)sin(theta);
+
+			pWeight0[s] = (float)sin((1.0f - pInterpolation[s]) * theta) / sinTheta;
+			pWeight1[s] = (float)sin(pInterpolation[s] * theta) / sinTheta;
+		}
+	}
+
+	// Build the local matrices, relative * (rotation + translation), with the same arithmetic as
+	// Quaternion::GetMatrix() and Matrix4x4::PostMultiply()
+	float** R = pPose->pRelative;
+	const float* R0 = R[0]; const float* R1 = R[1];  const float* R2 = R[2];
+	const float* R4 = R[3]; const float* R5 = R[4];  const float* R6 = R[5];
+	const float* R8 = R[6]; const float* R9 = R[7];  const float* R10 = R[8];
+	const float* R12 = R[9]; const float* R13 = R[10]; const float* R14 = R[11];
+	const float* tx = pPose->pTranslation[0]; const float* ty = pPose->pTranslation[1]; const float* tz = pPose->pTranslation[2];
+	float** L = pPose->pLocal;
+
+	for(s = 0; s < stride; s++)
+	{
+		float x = (pWeight0[s] * ax[s]) + (pWeight1[s] * bx[s]);
+		float y = (pWeight0[s] * ay[s]) + (pWeight1[s] * by[s]);
+		float z = (pWeight0[s] * az[s]) + (pWeight1[s] * bz[s]);
+		float w = (pWeight0[s] * aw[s]) + (pWeight1[s] * bw[s]);
+
+		float x2 = x * x;
+		float y2 = y * y;
+		float z2 = z * z;
+		float xy = x * y;
+		float xz = x * z;
+		float yz = y * z;
+		float wx = w * x;
+		float wy = w * y;
+		float wz = w * z;
+
+		float r0 = 1 - 2 * (y2 + z2);
+		float r1 = 2 * (xy + wz);
+		float r2 = 2 * (xz - wy);
+		float r4 = 2 * (xy - wz);
+		float r5 = 1 - 2 * (x2 + z2);
+		float r6 = 2 * (yz + wx);
+		float r8 = 2 * (xz + wy);
+		float r9 = 2 * (yz - wx);
+		float r10 = 1 - 2 * (x2 + y2);
+
+		L[0][s] = R0[s]*r0 + R4[s]*r1 + R8[s]*r2;
+		L[1][s] = R1[s]*r0 + R5[s]*r1 + R9[s]*r2;
+		L[2][s] = R2[s]*r0 + R6[s]*r1 + R10[s]*r2;
+
+		L[3][s] = R0[s]*r4 + R4[s]*r5 + R8[s]*r6;
+		L[4][s] = R1[s]*r4 + R5[s]*r5 + R9[s]*r6;
+		L[5][s] = R2[s]*r4 + R6[s]*r5 + R10[s]*r6;
+
+		L[6][s] = R0[s]*r8 + R4[s]*r9 + R8[s]*r10;
+		L[7][s] = R1[s]*r8 + R5[s]*r9 + R9[s]*r10;
+		L[8][s] = R2[s]*r8 + R6[s]*r9 + R10[s]*r10;
+
+		L[9][s] = R0[s]*tx[s] + R4[s]*ty[s] + R8[s]*tz[s] + R12[s];
+		L[10][s] = R1[s]*tx[s] + R5[s]*ty[s] + R9[s]*tz[s] + R13[s];
+		L[11][s] = R2[s]*tx[s] + R6[s]*ty[s] + R10[s]*tz[s] + R14[s];
+	}
+
+	// Concatenate down the hierarchy
+	const int* pJointIndex = pPose->pJointIndex;
+	const int* pParent = pPose->pParent;
+
+	for(s = 0; s < numJoints; s++)
+	{
+		int jointIndex = pJointIndex[s];
+		float* pFinal = pJointAnimations[jointIndex].final.m;
+
+		if(pPose->pUseBindPose[s])
+		{
+			pJointAnimations[jointIndex].final = mpModel->pJoints[jointIndex].absolute;
+			continue;
+		}
+
+		if(pParent[s] == -1)
+		{
+			pFinal[0] = L[0][s];  pFinal[1] = L[1][s];   pFinal[2] = L[2][s];   pFinal[3] = 0.0f;
+			pFinal[4] = L[3][s];  pFinal[5] = L[4][s];   pFinal[6] = L[5][s];   pFinal[7] = 0.0f;
+			pFinal[8] = L[6][s];  pFinal[9] = L[7][s];   pFinal[10] = L[8][s];  pFinal[11] = 0.0f;
+			pFinal[12] = L[9][s]; pFinal[13] = L[10][s]; pFinal[14] = L[11][s]; pFinal[15] = 1.0f;
+			continue;
+		}
+
+		const float* p = pJointAnimations[pJointIndex[pParent[s]]].final.m;
+
+#ifdef MS3D_POSE_SSE
+		// The bottom row of every final matrix is (0, 0, 0, 1), so whole columns can be done at once
+		__m128 c0 = _mm_loadu_ps(p);
+		__m128 c1 = _mm_loadu_ps(p + 4);
+		__m128 c2 = _mm_loadu_ps(p + 8);
+		__m128 c3 = _mm_loadu_ps(p + 12);
+
+		for(int column = 0; column < 3; column++)
+		{
+			__m128 result = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(L[column*3][s])), _mm_mul_ps(c1, _mm_set1_ps(L[column*3 + 1][s]))), _mm_mul_ps(c2, _mm_set1_ps(L[column*3 + 2][s])));
+			_mm_storeu_ps(pFinal + column*4, result);
+		}
+
+		__m128 translation = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(L[9][s])), _mm_mul_ps(c1, _mm_set1_ps(L[10][s]))), _mm_mul_ps(c2, _mm_set1_ps(L[11][s]))), c3);
+		_mm_storeu_ps(pFinal + 12, translation);
+#else
+		for(int column = 0; column < 3; column++)
+		{
+			float l0 = L[column*3][s];
+			float l1 = L[column*3 + 1][s];
+			float l2 = L[column*3 + 2][s];
+
+			pFinal[column*4] = p[0]*l0 + p[4]*l1 + p[8]*l2;
+			pFinal[column*4 + 1] = p[1]*l0 + p[5]*l1 + p[9]*l2;
+			pFinal[column*4 + 2] = p[2]*l0 + p[6]*l1 + p[10]*l2;
+			pFinal[column*4 + 3] = 0.0f;
+		}
+
+		pFinal[12] = p[0]*L[9][s] + p[4]*L[10][s] + p[8]*L[11][s] + p[12];
+		pFinal[13] = p[1]*L[9][s] + p[5]*L[10][s] + p[9]*L[11][s] + p[13];
+		pFinal[14] = p[2]*L[9][s] + p[6]*L[10][s] + p[10]*L[11][s] + p[14];
+		pFinal[15] = 1.0f;
+#endif
+	}
+}
+
 bool MS3DAnimator::LoadAnimations(const char *animationFileName)
 {
 	ifstream file;
@@ -119,80 +435,106 @@ bool MS3DAnimator::LoadAnimations(const char *animationFileName)
 		// Close the file
 		file.close();
 
+		delete[] m_ppBakedAnimations;
+		delete[] m_pBakedAnimationRequested;
+		m_ppBakedAnimations = new MS3DBakedAnimation*[numAnimations];
+		m_pBakedAnimationRequested = new bool[numAnimations];
+		for(int i = 0; i < numAnimations; i++)
+		{
+			m_ppBakedAnimations[i] = NULL;
+			m_pBakedAnimationRequested[i] = false;
+		}
+
 		return true;
 	}
 
 	return false;
 }
 
+void MS3DAnimator::SetPoseCache(MS3DPoseCache* pPoseCache)
+{
+	// Make sure the current pose doesn't refer to the old cache
+	EvaluateFullPose();
+	UpdateBlendValues();
+	m_pPoseBakedAnimation = NULL;
+
+	m_pPoseCache = pPoseCache;
+
+	for(int i = 0; i < numAnimations; i++)
+	{
+		m_ppBakedAnimations[i] = NULL;
+		m_pBakedAnimationRequested[i] = false;
+	}
+}
+
+// Derives the bounding box from the joints' bind pose bounds, transformed by the animated joint matrices. This is O(joints)
+// rather than O(vertices), and gives a box that always contains the skinned vertices, though it can be slightly larger.
 void MS3DAnimator::CalculateBoundingBox()
 {
-	for(int i = 0; i < mpModel->numVertices; i++)
+	EvaluateFullPose();
+
+	bool first = true;
+
+	for(int i = 0; i < mpModel->numJoints; i++)
 	{
-		if(mpModel->pVertices[i].boneID == -1)
+		const Joint& joint = mpModel->pJoints[i];
+		if(joint.hasVertices == false)
 		{
-			// Don't use this vertex if it doesnt have a valid boneID, since this will mess up the matrix math
 			continue;
 		}
 
-		Matrix4x4& final = pJointAnimations[mpModel->pVertices[i].boneID].final;
-		Vector3d newVertex( mpModel->pVertices[i].location[0], mpModel->pVertices[i].location[1], mpModel->pVertices[i].location[2]);
-
-		newVertex = final * newVertex;
+		const float* m = pJointAnimations[i].final.m;
+		const BoundingBox& bounds = joint.localBounds;
 
-		float tempVertex[3];
-		tempVertex[0] = newVertex.x;
-		tempVertex[1] = newVertex.y;
-		tempVertex[2] = newVertex.z;
+		float centre[3] = { (bounds.mMinX + bounds.mMaxX) * 0.5f, (bounds.mMinY + bounds.mMaxY) * 0.5f, (bounds.mMinZ + bounds.mMaxZ) * 0.5f };
+		float extent[3] = { (bounds.mMaxX - bounds.mMinX) * 0.5f, (bounds.mMaxY - bounds.mMinY) * 0.5f, (bounds.mMaxZ - bounds.mMinZ) * 0.5f };
 
-		// Always set the first vertex values
-		if(i == 0)
+		float boxMin[3];
+		float boxMax[3];
+		for(int r = 0; r < 3; r++)
 		{
-			m_BoundingBox.mMinX = tempVertex[0];
-			m_BoundingBox.mMinY = tempVertex[1];
-			m_BoundingBox.mMinZ = tempVertex[2];
+			float newCentre = m[r]*centre[0] + m[4 + r]*centre[1] + m[8 + r]*centre[2] + m[12 + r];
+			float newExtent = fabs(m[r])*extent[0] + fabs(m[4 + r])*extent[1] + fabs(m[8 + r])*extent[2];
 
-			m_BoundingBox.mMaxX = tempVertex[0];
-			m_BoundingBox.mMaxY = tempVertex[1];
-			m_BoundingBox.mMaxZ = tempVertex[2];
+			boxMin[r] = newCentre - newExtent;
+			boxMax[r] = newCentre + newExtent;
 		}
-		else
-		{
-			if(tempVertex[0] < m_BoundingBox.mMinX)
-			{
-				m_BoundingBox.mMinX = tempVertex[0];
-			}
 
-			if(tempVertex[1] < m_BoundingBox.mMinY)
-			{
-				m_BoundingBox.mMinY = tempVertex[1];
-			}
-
-			if(tempVertex[2] < m_BoundingBox.mMinZ)
-			{
-				m_BoundingBox.mMinZ = tempVertex[2];
-			}
+		if(first)
+		{
+			m_BoundingBox.mMinX = boxMin[0];
+			m_BoundingBox.mMinY = boxMin[1];
+			m_BoundingBox.mMinZ = boxMin[2];
 
-			if(tempVertex[0] > m_BoundingBox.mMaxX)
-			{
-				m_BoundingBox.mMaxX = tempVertex[0];
-			}
+			m_BoundingBox.mMaxX = boxMax[0];
+			m_BoundingBox.mMaxY = boxMax[1];
+			m_BoundingBox.mMaxZ = boxMax[2];
 
-			if(tempVertex[1] > m_BoundingBox.mMaxY)
-			{
-				m_BoundingBox.mMaxY = tempVertex[1];
-			}
+			first = false;
+		}
+		else
+		{
+			m_BoundingBox.mMinX = min(m_BoundingBox.mMinX, boxMin[0]);
+			m_BoundingBox.mMinY = min(m_BoundingBox.mMinY, boxMin[1]);
+			m_BoundingBox.mMinZ = min(m_BoundingBox.mMinZ, boxMin[2]);
 
-			if(tempVertex[2] > m_BoundingBox.mMaxZ)
-			{
-				m_BoundingBox.mMaxZ = tempVertex[2];
-			}
+			m_BoundingBox.mMaxX = max(m_BoundingBox.mMaxX, boxMax[0]);
+			m_BoundingBox.mMaxY = max(m_BoundingBox.mMaxY, boxMax[1]);
+			m_BoundingBox.mMaxZ = max(m_BoundingBox.mMaxZ, boxMax[2]);
 		}
 	}
+
+	m_boundingBoxDirty = false;
 }
 
+// The bounding box is only worked out when it is asked for, most animators never need it
 BoundingBox* MS3DAnimator::GetBoundingBox()
 {
+	if(m_boundingBoxDirty)
+	{
+		CalculateBoundingBox();
+	}
+
 	return &m_BoundingBox;
 }
 
@@ -325,10 +667,18 @@ int MS3DAnimator::GetCurrentFrame()
 
 void MS3DAnimator::StartBlendAnimation(int startIndex, int endIndex, float blendTime)
 {
+	if(startIndex == -1)
+	{
+		// Blending from the current pose, so every joint needs to be up to date
+		EvaluateFullPose();
+		UpdateBlendValues();
+	}
+
 	m_bBlending = true;
 	m_bPaused = false;
 	m_bLooped = false;
 	m_bFinished = false;
+	m_bPoseUpToDate = false;
 	m_blendTime = blendTime;
 	m_blendTimer = 0.0f;
 	m_blendStartAnimationIndex = startIndex;
@@ -460,6 +810,26 @@ void MS3DAnimator::StartBlendAnimation(int startIndex, int endIndex, float blend
 			memcpy(pJointAnimation->endBlendRot, pJoint->pRotationKeyframes[frame].parameter, sizeof ( float )*3);
 		}
 	}
+
+	// Convert the blend rotations to quaternions once, rather than every frame of the blend
+	for ( int i = 0; i < mpModel->numJoints; i++ )
+	{
+		JointAnimation *pJointAnimation = &(pJointAnimations[i]);
+
+		Quaternion q1;
+		q1.SetEuler(RadToDeg(pJointAnimation->startBlendRot[0]), RadToDeg(pJointAnimation->startBlendRot[1]), RadToDeg(pJointAnimation->startBlendRot[2]));
+		Quaternion q2;
+		q2.SetEuler(RadToDeg(pJointAnimation->endBlendRot[0]), RadToDeg(pJointAnimation->endBlendRot[1]), RadToDeg(pJointAnimation->endBlendRot[2]));
+
+		pJointAnimation->startBlendQuaternion[0] = q1.x;
+		pJointAnimation->startBlendQuaternion[1] = q1.y;
+		pJointAnimation->startBlendQuaternion[2] = q1.z;
+		pJointAnimation->startBlendQuaternion[3] = q1.w;
+		pJointAnimation->endBlendQuaternion[0] = q2.x;
+		pJointAnimation->endBlendQuaternion[1] = q2.y;
+		pJointAnimation->endBlendQuaternion[2] = q2.z;
+		pJointAnimation->endBlendQuaternion[3] = q2.w;
+	}
 }
 
 void MS3DAnimator::StartBlendAnimation(const char *lStartAnimationName, const char *lEndAnimationName, float blendTime)
@@ -506,6 +876,12 @@ void MS3DAnimator::BlendIntoAnimation(const char *lAnimationName, float blendTim
 
 void MS3DAnimator::GetCurrentBlendTranslation(int jointIndex, float* x, float* y, float* z)
 {
+	if(IsJointEvaluated(jointIndex) == false)
+	{
+		EvaluateFullPose();
+	}
+	UpdateBlendValues();
+
 	JointAnimation *pJointAnimation = &(pJointAnimations[jointIndex]);
 	*x = pJointAnimation->currentBlendTrans[0];
 	*y = pJointAnimation->currentBlendTrans[1];
@@ -514,6 +890,12 @@ void MS3DAnimator::GetCurrentBlendTranslation(int jointIndex, float* x, float* y
 
 void MS3DAnimator::GetCurrentBlendRotation(int jointIndex, float* x, float* y, float* z)
 {
+	if(IsJointEvaluated(jointIndex) == false)
+	{
+		EvaluateFullPose();
+	}
+	UpdateBlendValues();
+
 	JointAnimation *pJointAnimation = &(pJointAnimations[jointIndex]);
 	*x = pJointAnimation->currentBlendRot[0];
 	*y = pJointAnimation->currentBlendRot[1];
@@ -535,10 +917,56 @@ void MS3DAnimator::Restart()
 void MS3DAnimator::SetTimerForStartOfAnimation()
 {
 	m_timer = pAnimations[mCurrentAnimationIndex].startTime;
+
+	m_bPoseUpToDate = false;
+}
+
+void MS3DAnimator::SetJointMask(const bool* pJointMask)
+{
+	// Joints can move in or out of the mask, so make sure they are all up to date first
+	EvaluateFullPose();
+
+	DeletePoseEvaluation(&m_maskedPose);
+	delete[] m_pJointMask;
+	m_pJointMask = NULL;
+
+	if(pJointMask != NULL)
+	{
+		CreatePoseEvaluation(&m_maskedPose, pJointMask);
+
+		// Also includes the parents of the masked joints, since they get evaluated too
+		m_pJointMask = new bool[mpModel->numJoints];
+		for(int i = 0; i < mpModel->numJoints; i++)
+		{
+			m_pJointMask[i] = false;
+		}
+		for(int i = 0; i < m_maskedPose.numJoints; i++)
+		{
+			m_pJointMask[m_maskedPose.pJointIndex[i]] = true;
+		}
+	}
+
+	m_bPoseUpToDate = false;
+}
+
+bool MS3DAnimator::IsJointEvaluated(int jointIndex) const
+{
+	return (m_pJointMask == NULL) || m_pJointMask[jointIndex];
+}
+
+// Changes whenever the bone matrices are evaluated, so that anything built from them knows to rebuild
+unsigned int MS3DAnimator::GetPoseVersion() const
+{
+	return m_poseVersion;
 }
 
 Matrix4x4 MS3DAnimator::GetBoneMatrix(int index)
 {
+	if(IsJointEvaluated(index) == false)
+	{
+		EvaluateFullPose();
+	}
+
 	Matrix4x4& final = pJointAnimations[index].final;
 
 	return final;
@@ -574,22 +1002,94 @@ void MS3DAnimator::Update(float dt)
 		}
 	}
 
-	for ( int i = 0; i < mpModel->numJoints; i++ )
+	// A finished or paused animation holds the same pose, so there is nothing to evaluate
+	if(m_bPoseUpToDate && m_timer == m_poseTimer)
+	{
+		return;
+	}
+
+	// Only the masked joints are evaluated here, the rest of the skeleton is brought up to date if it is asked for
+	PoseEvaluation* pPose = (m_pJointMask != NULL) ? &m_maskedPose : &m_fullPose;
+
+	MS3DBakedAnimation* pBakedAnimation = GetBakedAnimation(mCurrentAnimationIndex);
+	if(pBakedAnimation != NULL)
+	{
+		SampleBakedPose(pPose, pBakedAnimation, m_timer);
+
+		m_bBlendValuesDirty = true;
+	}
+	else
 	{
+		GatherAnimationPose(pPose);
+		EvaluatePose(pPose);
+
+		m_bBlendValuesDirty = false;
+	}
+
+	m_pPoseBakedAnimation = pBakedAnimation;
+	m_bPoseFromBlend = false;
+	m_bFullPoseDirty = (pPose != &m_fullPose);
+	m_bPoseUpToDate = true;
+	m_poseTimer = m_timer;
+
+	// The bounding box needs re-calculating, since vertices *might* now have new positions, given that we have updated all the bones!
+	m_boundingBoxDirty = true;
+}
+
+void MS3DAnimator::UpdateBlending(float dt)
+{
+	if(!m_bPaused)
+	{
+		m_blendTimer += dt;
+	}
+
+	if (m_blendTimer > m_blendTime)
+	{
+		// Finished blending
+		m_bBlending = false;
+		PlayAnimation(m_blendEndAnimationIndex);
+	}
+
+	float interpValue = (float)(m_blendTimer/m_blendTime);
+
+	PoseEvaluation* pPose = (m_pJointMask != NULL) ? &m_maskedPose : &m_fullPose;
+
+	GatherBlendPose(pPose, interpValue);
+	EvaluatePose(pPose);
+
+	m_pPoseBakedAnimation = NULL;
+	m_bBlendValuesDirty = false;
+	m_bPoseFromBlend = true;
+	m_poseBlendInterpolation = interpValue;
+	m_bFullPoseDirty = (pPose != &m_fullPose);
+	m_bPoseUpToDate = false;
+
+	m_boundingBoxDirty = true;
+}
+
+// Gathers the current keyframes for each joint in the pose into the pose arrays
+void MS3DAnimator::GatherAnimationPose(PoseEvaluation* pPose)
+{
+	static const float identityRotation[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+	for ( int entry = 0; entry < pPose->numJoints; entry++ )
+	{
+		int i = pPose->pJointIndex[entry];
 		float transVec[3];
 		float rotVec[3];
-		Matrix4x4 transform;
 		int frame;
 		Joint *pJoint = &(mpModel->pJoints[i]);
 		JointAnimation *pJointAnimation = &(pJointAnimations[i]);
 
 		if ( pJoint->numRotationKeyframes == 0 && pJoint->numTranslationKeyframes == 0 )
 		{
-			pJointAnimation->final = pJoint->absolute;
+			pPose->pUseBindPose[entry] = true;
 
 			continue;
 		}
 
+		pPose->pUseBindPose[entry] = false;
+
 		// Translation
 		frame = pJointAnimation->currentTranslationKeyframe;
 		while ( frame < pJoint->numTranslationKeyframes && pJoint->pTranslationKeyframes[frame].time < m_timer )
@@ -628,6 +1128,10 @@ void MS3DAnimator::Update(float dt)
 			}
 		}
 
+		pPose->pTranslation[0][entry] = transVec[0];
+		pPose->pTranslation[1][entry] = transVec[1];
+		pPose->pTranslation[2][entry] = transVec[2];
+
 		// Rotation
 		frame = pJointAnimation->currentRotationKeyframe;
 		while ( frame < pJoint->numRotationKeyframes && pJoint->pRotationKeyframes[frame].time < m_timer )
@@ -638,25 +1142,22 @@ void MS3DAnimator::Update(float dt)
 
 		if(pJoint->numRotationKeyframes == 0)
 		{
-			// Do nothing
+			SetPoseRotation(pPose, entry, identityRotation, identityRotation, 0.0f);
+
+			rotVec[0] = 0.0f;
+			rotVec[1] = 0.0f;
+			rotVec[2] = 0.0f;
 		}
 		else
 		{
-			if ( frame == 0 )
+			if ( frame == 0 || frame == pJoint->numRotationKeyframes )
 			{
-				rotVec[0] = pJoint->pRotationKeyframes[0].parameter[0];
-				rotVec[1] = pJoint->pRotationKeyframes[0].parameter[1];
-				rotVec[2] = pJoint->pRotationKeyframes[0].parameter[2];
+				int keyframe = (frame == 0) ? 0 : frame-1;
+				const float* pRotation = &pJoint->pRotationQuaternions[keyframe*4];
 
-				transform.SetRotationRadians( rotVec );
-			}
-			else if ( frame == pJoint->numRotationKeyframes )
-			{
-				rotVec[0] = pJoint->pRotationKeyframes[frame-1].parameter[0];
-				rotVec[1] = pJoint->pRotationKeyframes[frame-1].parameter[1];
-				rotVec[2] = pJoint->pRotationKeyframes[frame-1].parameter[2];
+				SetPoseRotation(pPose, entry, pRotation, pRotation, 0.0f);
 
-				transform.SetRotationRadians( rotVec );
+				memcpy( rotVec, pJoint->pRotationKeyframes[keyframe].parameter, sizeof ( float )*3 );
 			}
 			else
 			{
@@ -666,13 +1167,7 @@ void MS3DAnimator::Update(float dt)
 				float timeDelta = curFrame.time-prevFrame.time;
 				float interpValue = ( float )(( m_timer-prevFrame.time )/timeDelta );
 
-				Quaternion q1;
-				q1.SetEuler(RadToDeg(prevFrame.parameter[0]), RadToDeg(prevFrame.parameter[1]), RadToDeg(prevFrame.parameter[2]));
-				Quaternion q2;
-				q2.SetEuler(RadToDeg(curFrame.parameter[0]), RadToDeg(curFrame.parameter[1]), RadToDeg(curFrame.parameter[2]));
-				Quaternion q3 = Quaternion::Slerp(q1, q2, interpValue);
-
-				transform = q3.GetMatrix();
+				SetPoseRotation(pPose, entry, &pJoint->pRotationQuaternions[(frame-1)*4], &pJoint->pRotationQuaternions[frame*4], interpValue);
 
 				// To preserve blending, since the matrix-to-angles functionality is broken
 				rotVec[0] = prevFrame.parameter[0]+( curFrame.parameter[0]-prevFrame.parameter[0] )*interpValue;
@@ -680,104 +1175,183 @@ void MS3DAnimator::Update(float dt)
 				rotVec[2] = prevFrame.parameter[2]+( curFrame.parameter[2]-prevFrame.parameter[2] )*interpValue;
 			}
 		}
-		
-		// Combine and create the final animation matrix
-		transform.SetTranslation( transVec );
 
-		Matrix4x4 relativeFinal( pJoint->relative );
-		relativeFinal.PostMultiply( transform );
+		// Also store the current trans and rot values in the start blend variables, in case we want to start a new blend.
+		pJointAnimation->currentBlendTrans[0] = transVec[0];
+		pJointAnimation->currentBlendTrans[1] = transVec[1];
+		pJointAnimation->currentBlendTrans[2] = transVec[2];
+		pJointAnimation->currentBlendRot[0] = rotVec[0];
+		pJointAnimation->currentBlendRot[1] = rotVec[1];
+		pJointAnimation->currentBlendRot[2] = rotVec[2];
+	}
+}
 
-		if ( pJoint->parent == -1 )
+void MS3DAnimator::GatherBlendPose(PoseEvaluation* pPose, float interpValue)
+{
+	for (int entry = 0; entry < pPose->numJoints; entry++)
+	{
+		int i = pPose->pJointIndex[entry];
+		JointAnimation *pJointAnimation = &(pJointAnimations[i]);
+
+		pPose->pUseBindPose[entry] = false;
+
+		pPose->pTranslation[0][entry] = pJointAnimation->startBlendTrans[0]+( pJointAnimation->endBlendTrans[0]-pJointAnimation->startBlendTrans[0] )*interpValue;
+		pPose->pTranslation[1][entry] = pJointAnimation->startBlendTrans[1]+( pJointAnimation->endBlendTrans[1]-pJointAnimation->startBlendTrans[1] )*interpValue;
+		pPose->pTranslation[2][entry] = pJointAnimation->startBlendTrans[2]+( pJointAnimation->endBlendTrans[2]-pJointAnimation->startBlendTrans[2] )*interpValue;
+
+		SetPoseRotation(pPose, entry, pJointAnimation->startBlendQuaternion, pJointAnimation->endBlendQuaternion, interpValue);
+
+		// Also store the current trans and rot values in the start blend variables, in case we want to start a new blend.
+		pJointAnimation->currentBlendTrans[0] = pPose->pTranslation[0][entry];
+		pJointAnimation->currentBlendTrans[1] = pPose->pTranslation[1][entry];
+		pJointAnimation->currentBlendTrans[2] = pPose->pTranslation[2][entry];
+		// To preserve blending, since the matrix-to-angles functionality is broken
+		pJointAnimation->currentBlendRot[0] = pJointAnimation->startBlendRot[0]+( pJointAnimation->endBlendRot[0]-pJointAnimation->startBlendRot[0] )*interpValue;
+		pJointAnimation->currentBlendRot[1] = pJointAnimation->startBlendRot[1]+( pJointAnimation->endBlendRot[1]-pJointAnimation->startBlendRot[1] )*interpValue;
+		pJointAnimation->currentBlendRot[2] = pJointAnimation->startBlendRot[2]+( pJointAnimation->endBlendRot[2]-pJointAnimation->startBlendRot[2] )*interpValue;
+	}
+}
+
+// Brings the joints outside of the joint mask up to date, using the same animation state as the last update
+void MS3DAnimator::EvaluateFullPose()
+{
+	if(m_bFullPoseDirty == false)
+	{
+		return;
+	}
+
+	if(m_pPoseBakedAnimation != NULL)
+	{
+		SampleBakedPose(&m_fullPose, m_pPoseBakedAnimation, m_poseTimer);
+	}
+	else
+	{
+		if(m_bPoseFromBlend)
 		{
-			pJointAnimation->final = relativeFinal;
+			GatherBlendPose(&m_fullPose, m_poseBlendInterpolation);
 		}
 		else
 		{
-			pJointAnimation->final = pJointAnimations[pJoint->parent].final;
-
-			pJointAnimation->final.PostMultiply( relativeFinal );
+			GatherAnimationPose(&m_fullPose);
 		}
 
-		// Also store the current trans and rot values in the start blend variables, in case we want to start a new blend.
-		pJointAnimation->currentBlendTrans[0] = transform.GetTranslationVector().x;
-		pJointAnimation->currentBlendTrans[1] = transform.GetTranslationVector().y;
-		pJointAnimation->currentBlendTrans[2] = transform.GetTranslationVector().z;
-		//transform.GetEuler(&pJointAnimation->currentBlendRot[0], &pJointAnimation->currentBlendRot[1], &pJointAnimation->currentBlendRot[2]); // TODO : Currently broken
-		pJointAnimation->currentBlendRot[0] = rotVec[0];
-		pJointAnimation->currentBlendRot[1] = rotVec[1];
-		pJointAnimation->currentBlendRot[2] = rotVec[2];
+		EvaluatePose(&m_fullPose);
+
+		m_bBlendValuesDirty = false;
 	}
 
-	// Also re-calculate the bounding box, since vertices *might* now have new positions, given that we have updated all the bones!
-	CalculateBoundingBox();
+	m_bFullPoseDirty = false;
 }
 
-void MS3DAnimator::UpdateBlending(float dt)
+// Works out the keyframe translations and rotations that a blend would start from, when the pose came from a baked animation
+void MS3DAnimator::UpdateBlendValues()
 {
-	if(!m_bPaused)
+	if(m_bBlendValuesDirty == false)
 	{
-		m_blendTimer += dt;
+		return;
 	}
 
-	if (m_blendTimer > m_blendTime)
+	GatherAnimationPose(&m_fullPose);
+
+	m_bBlendValuesDirty = false;
+}
+
+MS3DBakedAnimation* MS3DAnimator::GetBakedAnimation(int animationIndex)
+{
+	if(m_pPoseCache == NULL || animationIndex < 0 || animationIndex >= numAnimations)
 	{
-		// Finished blending
-		m_bBlending = false;
-		PlayAnimation(m_blendEndAnimationIndex);
+		return NULL;
 	}
 
-	for (int i = 0; i < mpModel->numJoints; i++)
+	if(m_pBakedAnimationRequested[animationIndex] == false)
 	{
-		float transVec[3];
-		float rotVec[3];
-		Matrix4x4 transform;
-		Joint *pJoint = &(mpModel->pJoints[i]);
-		JointAnimation *pJointAnimation = &(pJointAnimations[i]);
-
-		float interpValue = (float)(m_blendTimer/m_blendTime);
+		m_ppBakedAnimations[animationIndex] = m_pPoseCache->GetBakedAnimation(mpModel, pAnimations[animationIndex].startTime, pAnimations[animationIndex].endTime);
+		m_pBakedAnimationRequested[animationIndex] = true;
+	}
 
-		transVec[0] = pJointAnimation->startBlendTrans[0]+( pJointAnimation->endBlendTrans[0]-pJointAnimation->startBlendTrans[0] )*interpValue;
-		transVec[1] = pJointAnimation->startBlendTrans[1]+( pJointAnimation->endBlendTrans[1]-pJointAnimation->startBlendTrans[1] )*interpValue;
-		transVec[2] = pJointAnimation->startBlendTrans[2]+( pJointAnimation->endBlendTrans[2]-pJointAnimation->startBlendTrans[2] )*interpValue;
-		// To preserve blending, since the matrix-to-angles functionality is broken
-		rotVec[0] = pJointAnimation->startBlendRot[0]+( pJointAnimation->endBlendRot[0]-pJointAnimation->startBlendRot[0] )*interpValue;
-		rotVec[1] = pJointAnimation->startBlendRot[1]+( pJointAnimation->endBlendRot[1]-pJointAnimation->startBlendRot[1] )*interpValue;
-		rotVec[2] = pJointAnimation->startBlendRot[2]+( pJointAnimation->endBlendRot[2]-pJointAnimation->startBlendRot[2] )*interpValue;
+	return m_ppBakedAnimations[animationIndex];
+}
 
-		Quaternion q1;
-		q1.SetEuler(RadToDeg(pJointAnimation->startBlendRot[0]), RadToDeg(pJointAnimation->startBlendRot[1]), RadToDeg(pJointAnimation->startBlendRot[2]));
-		Quaternion q2;
-		q2.SetEuler(RadToDeg(pJointAnimation->endBlendRot[0]), RadToDeg(pJointAnimation->endBlendRot[1]), RadToDeg(pJointAnimation->endBlendRot[2]));
-		Quaternion q3 = Quaternion::Slerp(q1, q2, interpValue);
-		transform = q3.GetMatrix();
-		
-		transform.SetTranslation(transVec);
+// Looks up the two samples either side of the time and nlerps between them. The samples are already in model
+// space, so there is no hierarchy to walk and each joint in the pose is independent of the others.
+void MS3DAnimator::SampleBakedPose(PoseEvaluation* pPose, MS3DBakedAnimation* pBakedAnimation, double time)
+{
+	m_poseVersion++;
 
-		Matrix4x4 relativeFinal(pJoint->relative);
-		relativeFinal.PostMultiply(transform);
+	int sample = 0;
+	float interpolation = 0.0f;
 
-		if (pJoint->parent == -1)
+	if(pBakedAnimation->m_numSamples > 1)
+	{
+		double position = (time - pBakedAnimation->m_startTime) / pBakedAnimation->m_sampleInterval;
+		if(position < 0.0)
 		{
-			pJointAnimation->final = relativeFinal;
+			position = 0.0;
 		}
-		else
+
+		sample = (int)position;
+		if(sample > pBakedAnimation->m_numSamples - 2)
 		{
-			pJointAnimation->final = pJointAnimations[pJoint->parent].final;
+			sample = pBakedAnimation->m_numSamples - 2;
+		}
 
-			pJointAnimation->final.PostMultiply(relativeFinal);
+		interpolation = (float)(position - sample);
+		if(interpolation > 1.0f)
+		{
+			interpolation = 1.0f;
 		}
+	}
 
-		// Also store the current trans and rot values in the start blend variables, in case we want to start a new blend.
-		pJointAnimation->currentBlendTrans[0] = transform.GetTranslationVector().x;
-		pJointAnimation->currentBlendTrans[1] = transform.GetTranslationVector().y;
-		pJointAnimation->currentBlendTrans[2] = transform.GetTranslationVector().z;
-		//transform.GetEuler(&pJointAnimation->currentBlendRot[0], &pJointAnimation->currentBlendRot[1], &pJointAnimation->currentBlendRot[2]); // TODO : Currently broken
-		pJointAnimation->currentBlendRot[0] = rotVec[0];
-		pJointAnimation->currentBlendRot[1] = rotVec[1];
-		pJointAnimation->currentBlendRot[2] = rotVec[2];
+	const float* pStartSample = pBakedAnimation->GetSample(sample);
+	const float* pEndSample = (pBakedAnimation->m_numSamples > 1) ? pBakedAnimation->GetSample(sample + 1) : pStartSample;
+
+	for(int entry = 0; entry < pPose->numJoints; entry++)
+	{
+		int jointIndex = pPose->pJointIndex[entry];
+		const float* a = pStartSample + jointIndex*MS3DBakedAnimation::SAMPLE_FLOATS;
+		const float* b = pEndSample + jointIndex*MS3DBakedAnimation::SAMPLE_FLOATS;
+
+		float x = a[0] + (b[0] - a[0]) * interpolation;
+		float y = a[1] + (b[1] - a[1]) * interpolation;
+		float z = a[2] + (b[2] - a[2]) * interpolation;
+		float w = a[3] + (b[3] - a[3]) * interpolation;
+
+		float inverseLength = 1.0f / sqrtf((x * x) + (y * y) + (z * z) + (w * w));
+		x *= inverseLength;
+		y *= inverseLength;
+		z *= inverseLength;
+		w *= inverseLength;
+
+		float* pFinal = pJointAnimations[jointIndex].final.m;
+
+		pFinal[0] = 1 - 2 * (y * y + z * z);
+		pFinal[1] = 2 * (x * y + w * z);
+		pFinal[2] = 2 * (x * z - w * y);
+		pFinal[3] = 0.0f;
+		pFinal[4] = 2 * (x * y - w * z);
+		pFinal[5] = 1 - 2 * (x * x + z * z);
+		pFinal[6] = 2 * (y * z + w * x);
+		pFinal[7] = 0.0f;
+		pFinal[8] = 2 * (x * z + w * y);
+		pFinal[9] = 2 * (y * z - w * x);
+		pFinal[10] = 1 - 2 * (x * x + y * y);
+		pFinal[11] = 0.0f;
+		pFinal[12] = a[4] + (b[4] - a[4]) * interpolation;
+		pFinal[13] = a[5] + (b[5] - a[5]) * interpolation;
+		pFinal[14] = a[6] + (b[6] - a[6]) * interpolation;
+		pFinal[15] = 1.0f;
 	}
 }
 
+// Used by the pose cache to bake animations, times must be increasing between restarts
+void MS3DAnimator::EvaluatePoseAtTime(double time)
+{
+	m_timer = time;
+
+	GatherAnimationPose(&m_fullPose);
+	EvaluatePose(&m_fullPose);
+}
+
 void MS3DAnimator::Render(bool lMesh, bool lNormals, bool lBones, bool lBoundingBox)
 {
 	if(lMesh)
@@ -800,6 +1374,11 @@ void MS3DAnimator::Render(bool lMesh, bool lNormals, bool lBones, bool lBounding
 
 void MS3DAnimator::RenderMesh()
 {
+	EvaluateFullPose();
+
+	// Drawn with GL directly, so the model view needs loading first
+	mpRenderer->ApplyModelViewMatrix();
+
 	//Draw by group
 	for ( int i = 0; i < mpModel->numMeshes; i++ )
 	{
@@ -869,6 +1448,8 @@ void MS3DAnimator::RenderNormals()
 	glDisable(GL_LIGHTING);
 	mpRenderer->SetRenderMode(RM_SOLID);
 
+	mpRenderer->ApplyModelViewMatrix();
+
 	for ( int i = 0; i < mpModel->numMeshes; i++ )
 	{
 		glBegin( GL_LINES );
@@ -927,9 +1508,13 @@ void MS3DAnimator::RenderNormals()
 
 void MS3DAnimator::RenderBones()
 {
+	EvaluateFullPose();
+
 	//Make the colour white
 	glColor3ub(255, 255, 255);
 
+	mpRenderer->ApplyModelViewMatrix();
+
 	for ( int i = 0; i < numJointAnimations; i++ )
 	{
 		glBegin( GL_LINES );
@@ -965,6 +1550,8 @@ void MS3DAnimator::RenderBones()
 
 void MS3DAnimator::RenderBoundingBox()
 {
+	GetBoundingBox();
+
 	mpRenderer->PushMatrix();
 		mpRenderer->ImmediateColourAlpha(1.0f, 1.0f, 0.0f, 1.0f);
 
@@ -3,6 +3,9 @@
 #include "../Renderer/Renderer.h"
 #include "MS3DModel.h"
 
+class MS3DPoseCache;
+class MS3DBakedAnimation;
+
 // Joint animation structure
 typedef struct JointAnimation
 {
@@ -15,11 +18,35 @@ typedef struct JointAnimation
 	float endBlendRot[3];
 	float currentBlendTrans[3];
 	float currentBlendRot[3];
+	float startBlendQuaternion[4];
+	float endBlendQuaternion[4];
 
 	Matrix4x4 final;
 
 } JointAnimation;
 
+// A set of joints that are evaluated together. Stored as a structure of arrays in the
+// model's evaluation order, so parents always come before their children.
+typedef struct PoseEvaluation
+{
+	int numJoints;
+	int stride;						// Length of each array, padded to a multiple of 4
+
+	int *pJointIndex;				// Joint index of each entry
+	int *pParent;					// Entry of the parent joint, -1 for root joints
+	bool *pUseBindPose;				// Joints without keyframes just take their bind pose
+
+	float *pBuffer;					// Storage for all of the float arrays below
+	float *pRelative[12];			// Relative joint matrices, 3x4 column-major
+	float *pStartRotation[4];
+	float *pEndRotation[4];
+	float *pRotationInterpolation;
+	float *pSlerpDot;
+	float *pSlerpWeight[2];
+	float *pTranslation[3];
+	float *pLocal[12];
+} PoseEvaluation;
+
 // Animation structure
 static const int MAX_ANIMATION_NAME = 64;
 typedef struct Animation
@@ -46,6 +73,9 @@ public:
 
 	bool LoadAnimations(const char *animationFileName);
 
+	// Play back baked animations from a shared cache where they fit in its budget, NULL always samples the keyframes
+	void SetPoseCache(MS3DPoseCache* pPoseCache);
+
 	void CalculateBoundingBox();
 	BoundingBox* GetBoundingBox();
 
@@ -75,9 +105,14 @@ public:
 
 	void Restart();
 
+	// Only evaluate the masked joints (and their parents) on update, the rest are evaluated on demand. NULL evaluates every joint.
+	void SetJointMask(const bool* pJointMask);
+	bool IsJointEvaluated(int jointIndex) const;
+
 	void SetTimerForStartOfAnimation();
 
 	Matrix4x4 GetBoneMatrix(int index);
+	unsigned int GetPoseVersion() const;
 
 	void Update(float dt);
 	void UpdateBlending(float dt);
@@ -88,6 +123,22 @@ public:
 	void RenderBones();
 	void RenderBoundingBox();
 
+private:
+	void CreatePoseEvaluation(PoseEvaluation* pPose, const bool* pJointMask);
+	void DeletePoseEvaluation(PoseEvaluation* pPose);
+	void SetPoseRotation(PoseEvaluation* pPose, int entry, const float* pStart, const float* pEnd, float interpolation);
+	void GatherAnimationPose(PoseEvaluation* pPose);
+	void GatherBlendPose(PoseEvaluation* pPose, float interpValue);
+	void EvaluatePose(PoseEvaluation* pPose);
+	void EvaluateFullPose();
+	void UpdateBlendValues();
+
+	MS3DBakedAnimation* GetBakedAnimation(int animationIndex);
+	void SampleBakedPose(PoseEvaluation* pPose, MS3DBakedAnimation* pBakedAnimation, double time);
+	void EvaluatePoseAtTime(double time);
+
+	friend class MS3DPoseCache;
+
 private:
 	Renderer *mpRenderer;
 
@@ -121,6 +172,31 @@ private:
 	int m_blendStartAnimationIndex;
 	int m_blendEndAnimationIndex;
 
-	// Bounding box
+	// Bounding box, only calculated when it is asked for
 	BoundingBox m_BoundingBox;
+	bool m_boundingBoxDirty;
+
+	// Pose evaluation. With a joint mask, updates only evaluate the masked pose and the
+	// full pose is brought up to date when a joint outside of the mask is needed.
+	PoseEvaluation m_fullPose;
+	PoseEvaluation m_maskedPose;
+	bool *m_pJointMask;
+	bool m_bFullPoseDirty;
+	bool m_bPoseFromBlend;
+	float m_poseBlendInterpolation;
+
+	// Finished or paused animations hold their pose, so it isn't evaluated again until the timer moves
+	bool m_bPoseUpToDate;
+	double m_poseTimer;
+	unsigned int m_poseVersion;
+
+	// Baked animations, looked up from the pose cache the first time each animation is played
+	MS3DPoseCache* m_pPoseCache;
+	MS3DBakedAnimation** m_ppBakedAnimations;
+	bool* m_pBakedAnimationRequested;
+
+	// The baked animation the current pose was sampled from, NULL if it was evaluated from the keyframes. Baked
+	// poses don't produce the blend values, so they are gathered from the keyframes when something asks for them.
+	MS3DBakedAnimation* m_pPoseBakedAnimation;
+	bool m_bBlendValuesDirty;
 };
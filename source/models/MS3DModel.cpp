@@ -25,6 +25,11 @@ MS3DModel::MS3DModel(Renderer *lpRenderer)
 	numJoints = 0;
 	pJoints = NULL;
 
+	jointStride = 0;
+	pJointEvaluationOrder = NULL;
+	pJointEvaluationParent = NULL;
+	pJointRelative = NULL;
+
 	mbStatic = false;
 }
 
@@ -68,6 +73,7 @@ MS3DModel::~MS3DModel()
 	for(i = 0; i < numJoints; i++)
 	{
 		delete[] pJoints[i].pRotationKeyframes;
+		delete[] pJoints[i].pRotationQuaternions;
 		delete[] pJoints[i].pTranslationKeyframes;
 	}
 
@@ -77,6 +83,14 @@ MS3DModel::~MS3DModel()
 		delete[] pJoints;
 		pJoints = NULL;
 	}
+
+	jointStride = 0;
+	delete[] pJointEvaluationOrder;
+	pJointEvaluationOrder = NULL;
+	delete[] pJointEvaluationParent;
+	pJointEvaluationParent = NULL;
+	delete[] pJointRelative;
+	pJointRelative = NULL;
 }
 
 bool MS3DModel::LoadModel(const char *modelFileName, bool lStatic)
@@ -89,6 +103,8 @@ bool MS3DModel::LoadModel(const char *modelFileName, bool lStatic)
 		return false;
 	}
 
+	mModelFileName = modelFileName;
+
 	char pathTemp[PATH_MAX + 1];
 	int pathLength;
 	for ( pathLength = (int)strlen( modelFileName ); --pathLength; )
@@ -301,6 +317,7 @@ bool MS3DModel::LoadModel(const char *modelFileName, bool lStatic)
 		pJoints[i].parent = parentIndex;
 		pJoints[i].numRotationKeyframes = pJoint->numRotationKeyframes;
 		pJoints[i].pRotationKeyframes = new Keyframe[pJoint->numRotationKeyframes];
+		pJoints[i].pRotationQuaternions = new float[pJoint->numRotationKeyframes*4];
 		pJoints[i].numTranslationKeyframes = pJoint->numTranslationKeyframes;
 		pJoints[i].pTranslationKeyframes = new Keyframe[pJoint->numTranslationKeyframes];
 
@@ -325,6 +342,7 @@ bool MS3DModel::LoadModel(const char *modelFileName, bool lStatic)
 
 	// Setup the joints
 	SetupJoints();
+	CalculateJointBoundingBoxes();
 
 	// Load the textures
 	if(!LoadTextures())
@@ -371,6 +389,11 @@ bool MS3DModel::LoadTextures()
 	return true;
 }
 
+const char* MS3DModel::GetModelFileName()
+{
+	return mModelFileName.c_str();
+}
+
 void MS3DModel::SetupStaticBuffer()
 {
 	mStaticRenderBuffers = new unsigned int[numMeshes];
@@ -431,14 +454,29 @@ void MS3DModel::SetJointKeyframe( int jointIndex, int keyframeIndex, float time,
 	keyframe.jointIndex = jointIndex;
 	keyframe.time = time;
 	memcpy( keyframe.parameter, parameter, sizeof( float )*3 );
+
+	if ( isRotation )
+	{
+		// Convert the euler angles to a quaternion once here, rather than every time an animator interpolates this keyframe
+		Quaternion rotation;
+		rotation.SetEuler( RadToDeg( parameter[0] ), RadToDeg( parameter[1] ), RadToDeg( parameter[2] ) );
+
+		float* pQuaternion = &pJoints[jointIndex].pRotationQuaternions[keyframeIndex*4];
+		pQuaternion[0] = rotation.x;
+		pQuaternion[1] = rotation.y;
+		pQuaternion[2] = rotation.z;
+		pQuaternion[3] = rotation.w;
+	}
 }
 
 void MS3DModel::SetupJoints()
 {
+	SetupJointEvaluationOrder();
+
 	int i;
 	for( i = 0; i < numJoints; i++ )
 	{
-		Joint& joint = pJoints[i];
+		Joint& joint = pJoints[pJointEvaluationOrder[i]];
 
 		joint.relative.AddRotationRadians( joint.localRotation );
 		joint.relative.AddTranslation( joint.localTranslation );
@@ -455,6 +493,17 @@ void MS3DModel::SetupJoints()
 		}
 	}
 
+	// Store the relative matrices in evaluation order, as a structure of arrays for the animators
+	static const int relativeElements[12] = { 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14 };
+	for( i = 0; i < numJoints; i++ )
+	{
+		const Matrix4x4& relative = pJoints[pJointEvaluationOrder[i]].relative;
+		for ( int j = 0; j < 12; j++ )
+		{
+			pJointRelative[j*jointStride + i] = relative.m[relativeElements[j]];
+		}
+	}
+
 	for( i = 0; i < numVertices; i++ )
 	{
 		Vertex& vertex = pVertices[i];
@@ -483,6 +532,70 @@ void MS3DModel::SetupJoints()
 	}
 }
 
+void MS3DModel::SetupJointEvaluationOrder()
+{
+	delete[] pJointEvaluationOrder;
+	delete[] pJointEvaluationParent;
+	delete[] pJointRelative;
+
+	jointStride = (numJoints + 3) & ~3;
+	pJointEvaluationOrder = new int[numJoints];
+	pJointEvaluationParent = new int[numJoints];
+	pJointRelative = new float[12*jointStride];
+	memset( pJointRelative, 0, sizeof( float )*12*jointStride );
+
+	// Joint index to evaluation slot, -1 until the joint has been placed
+	int *pJointSlot = new int[numJoints];
+	int i;
+	for( i = 0; i < numJoints; i++ )
+	{
+		pJointSlot[i] = -1;
+	}
+
+	// Keep the file order where possible, milkshape files normally list parents first anyway
+	int numPlaced = 0;
+	while ( numPlaced < numJoints )
+	{
+		int numPlacedBefore = numPlaced;
+
+		for( i = 0; i < numJoints; i++ )
+		{
+			int parent = pJoints[i].parent;
+			if ( pJointSlot[i] == -1 && ( parent == -1 || pJointSlot[parent] != -1 ) )
+			{
+				pJointSlot[i] = numPlaced;
+				pJointEvaluationOrder[numPlaced] = i;
+				numPlaced++;
+			}
+		}
+
+		if ( numPlaced == numPlacedBefore )
+		{
+			// The remaining joints have a cyclic parent chain, treat them as root joints
+			cout << "Warning: MS3D model has a cyclic joint hierarchy\n";
+
+			for( i = 0; i < numJoints; i++ )
+			{
+				if ( pJointSlot[i] == -1 )
+				{
+					pJoints[i].parent = -1;
+					pJointSlot[i] = numPlaced;
+					pJointEvaluationOrder[numPlaced] = i;
+					numPlaced++;
+				}
+			}
+		}
+	}
+
+	for( i = 0; i < numJoints; i++ )
+	{
+		int parent = pJoints[pJointEvaluationOrder[i]].parent;
+		pJointEvaluationParent[i] = ( parent == -1 ) ? -1 : pJointSlot[parent];
+	}
+
+	delete[] pJointSlot;
+}
+
 void MS3DModel::CalculateBoundingBox()
 {
 	for(int i = 0; i < numVertices; i++)
@@ -549,6 +662,48 @@ void MS3DModel::CalculateBoundingBox()
 	}
 }
 
+// Bind pose bounds for each joint, in joint space. The animators transform these by the animated joint matrices
+// to get their bounding box, instead of having to transform every vertex.
+void MS3DModel::CalculateJointBoundingBoxes()
+{
+	int i;
+	for(i = 0; i < numJoints; i++)
+	{
+		pJoints[i].hasVertices = false;
+	}
+
+	for(i = 0; i < numVertices; i++)
+	{
+		if(pVertices[i].boneID == -1)
+		{
+			continue;
+		}
+
+		Joint& joint = pJoints[pVertices[i].boneID];
+		BoundingBox& bounds = joint.localBounds;
+		const float* location = pVertices[i].location;
+
+		if(joint.hasVertices == false)
+		{
+			bounds.mMinX = bounds.mMaxX = location[0];
+			bounds.mMinY = bounds.mMaxY = location[1];
+			bounds.mMinZ = bounds.mMaxZ = location[2];
+
+			joint.hasVertices = true;
+		}
+		else
+		{
+			bounds.mMinX = min(bounds.mMinX, location[0]);
+			bounds.mMinY = min(bounds.mMinY, location[1]);
+			bounds.mMinZ = min(bounds.mMinZ, location[2]);
+
+			bounds.mMaxX = max(bounds.mMaxX, location[0]);
+			bounds.mMaxY = max(bounds.mMaxY, location[1]);
+			bounds.mMaxZ = max(bounds.mMaxZ, location[2]);
+		}
+	}
+}
+
 BoundingBox* MS3DModel::GetBoundingBox()
 {
 	return &m_BoundingBox;
@@ -628,6 +783,9 @@ void MS3DModel::Render(bool lMesh, bool lNormals, bool lBones, bool lBoundingBox
 
 void MS3DModel::RenderMesh()
 {
+	// Drawn with GL directly, so the model view needs loading first
+	mpRenderer->ApplyModelViewMatrix();
+
 	//Draw by group
 	for ( int i = 0; i < numMeshes; i++ )
 	{
@@ -709,6 +867,8 @@ void MS3DModel::RenderNormals()
 	glDisable(GL_LIGHTING);
 	mpRenderer->SetRenderMode(RM_SOLID);
 
+	mpRenderer->ApplyModelViewMatrix();
+
 	for ( int i = 0; i < numMeshes; i++ )
 	{
 		glBegin( GL_LINES );
@@ -770,6 +930,8 @@ void MS3DModel::RenderBones()
 	//Make the colour white
 	glColor3ub(255, 255, 255);
 
+	mpRenderer->ApplyModelViewMatrix();
+
 	for ( int i = 0; i < numJoints; i++ )
 	{
 		glBegin( GL_LINES );
@@ -165,9 +165,14 @@ typedef struct Joint
 	int numRotationKeyframes, numTranslationKeyframes;
 	Keyframe *pTranslationKeyframes;
 	Keyframe *pRotationKeyframes;
+	float *pRotationQuaternions;	// Rotation keyframes converted to quaternions at load, x, y, z, w per keyframe
 
 	int parent;
 
+	// Bounds of the vertices attached to this joint, in the joint's local space
+	bool hasVertices;
+	BoundingBox localBounds;
+
 	char name[32];
 } Joint;
 
@@ -181,12 +186,16 @@ public:
 	bool LoadModel(const char *modelFileName, bool lStatic = false);
 	bool LoadTextures();
 
+	const char* GetModelFileName();
+
 	void SetupStaticBuffer();
 
 	void SetJointKeyframe( int jointIndex, int keyframeIndex, float time, float *parameter, bool isRotation );
 	void SetupJoints();
+	void SetupJointEvaluationOrder();
 
 	void CalculateBoundingBox();
+	void CalculateJointBoundingBoxes();
 	BoundingBox* GetBoundingBox();
 
 	int GetBoneIndex(const char* boneName);
@@ -228,6 +237,17 @@ private:
 	int numJoints;
 	Joint *pJoints;
 
+	// Joint evaluation order, parents always come before their children. The relative joint matrices are
+	// also stored in this order as a structure of arrays, so the animators can evaluate a whole pose in one pass.
+	// Each of the 12 arrays (3x4, column-major) is jointStride floats long, padded to a multiple of 4.
+	int jointStride;
+	int *pJointEvaluationOrder;
+	int *pJointEvaluationParent;
+	float *pJointRelative;
+
+	// The file this model was loaded from, models loaded from the same file share baked animations
+	string mModelFileName;
+
 	// Animation FPS
 	float mAnimationFPS;
 
@@ -0,0 +1,271 @@
+// ******************************************************************************
+//
+// Filename:	MS3DPoseCache.cpp
+// Project:		Game
+// Author:		Steven Ball
+//
+// Purpose:
+//   Shared cache of baked MS3D animations. Each animation of a model is
+//   sampled once at a fixed rate into model space joint rotations and
+//   translations, so that every animator playing it only has to look up two
+//   samples and nlerp between them. Models loaded from the same file share
+//   the baked data. Animations that don't fit in the memory budget are not
+//   baked, and the animators just keep sampling the keyframes live.
+//
+// Revision History:
+//   Initial Revision - 18/10/26
+//
+// Copyright (c) 2005-2015, Steven Ball
+//
+// ******************************************************************************
+
+#include "MS3DPoseCache.h"
+#include "MS3DAnimator.h"
+
+#include <math.h>
+#include <iostream>
+
+
+const float MS3DPoseCache::DEFAULT_SAMPLES_PER_SECOND = 60.0f;
+
+// Rotation part of a rigid joint matrix to a quaternion, the inverse of Quaternion::GetMatrix()
+static void MatrixToQuaternion(const float* m, float* pQuaternion)
+{
+	float trace = m[0] + m[5] + m[10];
+
+	if(trace > 0.0f)
+	{
+		float s = sqrtf(trace + 1.0f) * 2.0f;
+		pQuaternion[0] = (m[6] - m[9]) / s;
+		pQuaternion[1] = (m[8] - m[2]) / s;
+		pQuaternion[2] = (m[1] - m[4]) / s;
+		pQuaternion[3] = 0.25f * s;
+	}
+	else if(m[0] > m[5] && m[0] > m[10])
+	{
+		float s = sqrtf(1.0f + m[0] - m[5] - m[10]) * 2.0f;
+		pQuaternion[0] = 0.25f * s;
+		pQuaternion[1] = (m[4] + m[1]) / s;
+		pQuaternion[2] = (m[8] + m[2]) / s;
+		pQuaternion[3] = (m[6] - m[9]) / s;
+	}
+	else if(m[5] > m[10])
+	{
+		float s = sqrtf(1.0f + m[5] - m[0] - m[10]) * 2.0f;
+		pQuaternion[0] = (m[4] + m[1]) / s;
+		pQuaternion[1] = 0.25f * s;
+		pQuaternion[2] = (m[9] + m[6]) / s;
+		pQuaternion[3] = (m[8] - m[2]) / s;
+	}
+	else
+	{
+		float s = sqrtf(1.0f + m[10] - m[0] - m[5]) * 2.0f;
+		pQuaternion[0] = (m[8] + m[2]) / s;
+		pQuaternion[1] = (m[9] + m[6]) / s;
+		pQuaternion[2] = 0.25f * s;
+		pQuaternion[3] = (m[1] - m[4]) / s;
+	}
+}
+
+
+MS3DPoseCache::MS3DPoseCache(unsigned int memoryBudget, float samplesPerSecond)
+{
+	m_memoryBudget = memoryBudget;
+	m_memoryUsed = 0;
+	m_samplesPerSecond = samplesPerSecond;
+
+	m_numBaked = 0;
+	m_numRejected = 0;
+}
+
+MS3DPoseCache::~MS3DPoseCache()
+{
+	ClearBakedAnimations();
+}
+
+// Any animators that are still using baked animations from this cache must be deleted first
+void MS3DPoseCache::ClearBakedAnimations()
+{
+	std::lock_guard<std::mutex> lock(m_cacheMutex);
+
+	std::map<string, MS3DBakedAnimation*>::iterator iter;
+	for(iter = m_bakedAnimationMap.begin(); iter != m_bakedAnimationMap.end(); ++iter)
+	{
+		MS3DBakedAnimation* pBakedAnimation = iter->second;
+
+		if(pBakedAnimation != NULL)
+		{
+			delete[] pBakedAnimation->m_pSamples;
+			delete pBakedAnimation;
+		}
+	}
+	m_bakedAnimationMap.clear();
+
+	m_memoryUsed = 0;
+	m_numBaked = 0;
+	m_numRejected = 0;
+}
+
+MS3DBakedAnimation* MS3DPoseCache::GetBakedAnimation(MS3DModel* pModel, double startTime, double endTime)
+{
+	char timeRange[64];
+	sprintf_s(timeRange, 64, ":%.3f:%.3f", startTime, endTime);
+	string key = string(pModel->GetModelFileName()) + timeRange;
+
+	std::unique_lock<std::mutex> lock(m_cacheMutex);
+
+	std::map<string, MS3DBakedAnimation*>::iterator iter = m_bakedAnimationMap.find(key);
+	if(iter != m_bakedAnimationMap.end())
+	{
+		return iter->second;
+	}
+
+	// Sample the whole time range evenly, the first and last samples are exactly on the start and end of the animation
+	double duration = endTime - startTime;
+	int numSamples = 1;
+	if(duration > 0.0)
+	{
+		numSamples = (int)ceil(duration * 0.001 * m_samplesPerSecond) + 1;
+		if(numSamples < 2)
+		{
+			numSamples = 2;
+		}
+	}
+
+	unsigned int memorySize = sizeof(MS3DBakedAnimation) + sizeof(float)*numSamples*pModel->GetNumJoints()*MS3DBakedAnimation::SAMPLE_FLOATS;
+
+	if(pModel->GetNumJoints() == 0 || m_memoryUsed + memorySize > m_memoryBudget)
+	{
+		m_bakedAnimationMap[key] = NULL;
+		m_numRejected++;
+
+		return NULL;
+	}
+
+	// Baked without the lock, so animators looking up animations that are already baked aren't held up behind it
+	lock.unlock();
+	MS3DBakedAnimation* pBakedAnimation = BakeAnimation(pModel, startTime, endTime, numSamples);
+	lock.lock();
+
+	// Another thread may have baked the same animation in the meantime, or used up the rest of the budget
+	iter = m_bakedAnimationMap.find(key);
+	if(iter != m_bakedAnimationMap.end() || m_memoryUsed + memorySize > m_memoryBudget)
+	{
+		delete[] pBakedAnimation->m_pSamples;
+		delete pBakedAnimation;
+
+		if(iter != m_bakedAnimationMap.end())
+		{
+			return iter->second;
+		}
+
+		m_bakedAnimationMap[key] = NULL;
+		m_numRejected++;
+
+		return NULL;
+	}
+
+	m_bakedAnimationMap[key] = pBakedAnimation;
+	m_memoryUsed += memorySize;
+	m_numBaked++;
+
+	return pBakedAnimation;
+}
+
+void MS3DPoseCache::SetMemoryBudget(unsigned int memoryBudget)
+{
+	std::lock_guard<std::mutex> lock(m_cacheMutex);
+
+	// Only affects animations that haven't been asked for yet
+	m_memoryBudget = memoryBudget;
+}
+
+unsigned int MS3DPoseCache::GetMemoryBudget()
+{
+	return m_memoryBudget;
+}
+
+unsigned int MS3DPoseCache::GetMemoryUsed()
+{
+	std::lock_guard<std::mutex> lock(m_cacheMutex);
+
+	return m_memoryUsed;
+}
+
+float MS3DPoseCache::GetSamplesPerSecond()
+{
+	return m_samplesPerSecond;
+}
+
+int MS3DPoseCache::GetNumBaked()
+{
+	std::lock_guard<std::mutex> lock(m_cacheMutex);
+
+	return m_numBaked;
+}
+
+int MS3DPoseCache::GetNumRejected()
+{
+	std::lock_guard<std::mutex> lock(m_cacheMutex);
+
+	return m_numRejected;
+}
+
+void MS3DPoseCache::PrintStatistics()
+{
+	std::lock_guard<std::mutex> lock(m_cacheMutex);
+
+	cout << "MS3D pose cache: " << m_numBaked << " animations baked (" << m_memoryUsed / 1024 << "KB of " << m_memoryBudget / 1024 << "KB), " << m_numRejected << " over budget\n";
+}
+
+// Plays the animation through a private animator and stores the model space joint transforms at each sample time
+MS3DBakedAnimation* MS3DPoseCache::BakeAnimation(MS3DModel* pModel, double startTime, double endTime, int numSamples)
+{
+	int numJoints = pModel->GetNumJoints();
+
+	MS3DBakedAnimation* pBakedAnimation = new MS3DBakedAnimation();
+	pBakedAnimation->m_startTime = startTime;
+	pBakedAnimation->m_endTime = endTime;
+	pBakedAnimation->m_sampleInterval = (numSamples > 1) ? (endTime - startTime) / (numSamples - 1) : 0.0;
+	pBakedAnimation->m_numJoints = numJoints;
+	pBakedAnimation->m_numSamples = numSamples;
+	pBakedAnimation->m_pSamples = new float[numSamples*numJoints*MS3DBakedAnimation::SAMPLE_FLOATS];
+
+	MS3DAnimator bakeAnimator(NULL, pModel);
+
+	for(int sample = 0; sample < numSamples; sample++)
+	{
+		double time = (sample == numSamples - 1) ? endTime : startTime + sample*pBakedAnimation->m_sampleInterval;
+		bakeAnimator.EvaluatePoseAtTime(time);
+
+		float* pSample = pBakedAnimation->m_pSamples + sample*numJoints*MS3DBakedAnimation::SAMPLE_FLOATS;
+
+		for(int i = 0; i < numJoints; i++)
+		{
+			Matrix4x4 boneMatrix = bakeAnimator.GetBoneMatrix(i);
+			float* pJointSample = pSample + i*MS3DBakedAnimation::SAMPLE_FLOATS;
+
+			MatrixToQuaternion(boneMatrix.m, pJointSample);
+
+			// Keep the rotation on the same side as the previous sample, so the playback never needs to check
+			if(sample > 0)
+			{
+				const float* pPrevious = pJointSample - numJoints*MS3DBakedAnimation::SAMPLE_FLOATS;
+				float dot = pPrevious[0]*pJointSample[0] + pPrevious[1]*pJointSample[1] + pPrevious[2]*pJointSample[2] + pPrevious[3]*pJointSample[3];
+				if(dot < 0.0f)
+				{
+					pJointSample[0] = -pJointSample[0];
+					pJointSample[1] = -pJointSample[1];
+					pJointSample[2] = -pJointSample[2];
+					pJointSample[3] = -pJointSample[3];
+				}
+			}
+
+			pJointSample[4] = boneMatrix.m[12];
+			pJointSample[5] = boneMatrix.m[13];
+			pJointSample[6] = boneMatrix.m[14];
+		}
+	}
+
+	return pBakedAnimation;
+}
@@ -0,0 +1,105 @@
+// ******************************************************************************
+//
+// Filename:	MS3DPoseCache.h
+// Project:		Game
+// Author:		Steven Ball
+//
+// Purpose:
+//   Shared cache of baked MS3D animations. Each animation of a model is
+//   sampled once at a fixed rate into model space joint rotations and
+//   translations, so that every animator playing it only has to look up two
+//   samples and nlerp between them. Models loaded from the same file share
+//   the baked data. Animations that don't fit in the memory budget are not
+//   baked, and the animators just keep sampling the keyframes live.
+//
+// Revision History:
+//   Initial Revision - 18/10/26
+//
+// Copyright (c) 2005-2015, Steven Ball
+//
+// ******************************************************************************
+
+#pragma once
+
+#include "MS3DModel.h"
+
+#include <map>
+#include <mutex>
+
+
+// One animation of a model, baked at a fixed rate
+class MS3DBakedAnimation
+{
+public:
+	/* Public methods */
+	const float* GetSample(int sampleIndex) const { return m_pSamples + sampleIndex*m_numJoints*SAMPLE_FLOATS; }
+
+public:
+	/* Public members */
+	// Each joint sample is a model space rotation quaternion (x, y, z, w) and translation (x, y, z)
+	static const int SAMPLE_FLOATS = 7;
+
+	double m_startTime;
+	double m_endTime;
+	double m_sampleInterval;
+
+	int m_numJoints;
+	int m_numSamples;
+
+	// [sample][joint], neighbouring samples of a joint are always in the same hemisphere so they can be nlerped directly
+	float* m_pSamples;
+};
+
+
+class MS3DPoseCache
+{
+public:
+	/* Public methods */
+	MS3DPoseCache(unsigned int memoryBudget = DEFAULT_MEMORY_BUDGET, float samplesPerSecond = DEFAULT_SAMPLES_PER_SECOND);
+	~MS3DPoseCache();
+
+	void ClearBakedAnimations();
+
+	// Returns NULL if the animation would go over the memory budget, the caller should sample the keyframes instead
+	MS3DBakedAnimation* GetBakedAnimation(MS3DModel* pModel, double startTime, double endTime);
+
+	void SetMemoryBudget(unsigned int memoryBudget);
+	unsigned int GetMemoryBudget();
+	unsigned int GetMemoryUsed();
+	float GetSamplesPerSecond();
+
+	// Statistics
+	int GetNumBaked();
+	int GetNumRejected();
+	void PrintStatistics();
+
+protected:
+	/* Protected methods */
+
+private:
+	/* Private methods */
+	MS3DBakedAnimation* BakeAnimation(MS3DModel* pModel, double startTime, double endTime, int numSamples);
+
+public:
+	/* Public members */
+	static const unsigned int DEFAULT_MEMORY_BUDGET = 8*1024*1024;
+	static const float DEFAULT_SAMPLES_PER_SECOND;
+
+protected:
+	/* Protected members */
+
+private:
+	/* Private members */
+	unsigned int m_memoryBudget;
+	unsigned int m_memoryUsed;
+	float m_samplesPerSecond;
+
+	// Keyed by model file name and animation time range. Rejected animations are stored as NULL, so they aren't tried again.
+	std::map<string, MS3DBakedAnimation*> m_bakedAnimationMap;
+	int m_numBaked;
+	int m_numRejected;
+
+	// Animations are baked the first time they are asked for, which can be from any thread that updates animators. The
+	// lock is only held to look up and insert, never while baking.
+	std::mutex m_cacheMutex;
+};
@@ -15,6 +15,22 @@
 
 #include "QubicleBinary.h"
 #include "VoxelCharacter.h"
+#include "QubicleMeshCache.h"
+#include "../Renderer/RenderQueue.h"
+#include "../utils/WorkerPool.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QUBICLE_RLE_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 
 const float QubicleBinary::BLOCK_RENDER_SIZE = 0.5f;
@@ -24,6 +40,16 @@ QubicleBinary::QubicleBinary(Renderer* pRenderer)
 {
 	m_pRenderer = pRenderer;
 
+	m_meshingMethod = QubicleMeshingMethod_Bitmask;
+	m_pMeshingWorkerPool = NULL;
+
+	m_meshRebuildReady = false;
+	m_meshRebuildInFlight = false;
+	m_meshRebuildPending = false;
+	m_meshRebuildStale = false;
+
+	m_mergedStaticBufferId = -1;
+
 	Reset();
 
 	m_renderWireFrame = false;
@@ -41,6 +67,8 @@ QubicleBinary::QubicleBinary(Renderer* pRenderer)
 	m_meshSingleColourG = 1.0f;
 	m_meshSingleColourB = 1.0f;
 	m_singleMeshColour = false;
+
+	m_pMeshCache = NULL;
 }
 
 QubicleBinary::~QubicleBinary()
@@ -48,6 +76,8 @@ QubicleBinary::~QubicleBinary()
 	Unload();
 
 	Reset();
+
+	m_pRenderer->DeleteMaterial(m_materialID);
 }
 
 void QubicleBinary::Unload()
@@ -60,17 +90,30 @@ void QubicleBinary::Unload()
 
 void QubicleBinary::ClearMatrices()
 {
+	CancelMeshRebuild();
+
 	for(unsigned int i = 0; i < m_vpMatrices.size(); i++)
 	{
-		m_pRenderer->ClearMesh(m_vpMatrices[i]->m_pMesh);
-		m_vpMatrices[i]->m_pMesh = NULL;
+		if(m_vpMatrices[i]->m_pMesh != NULL)
+		{
+			m_pRenderer->ClearMesh(m_vpMatrices[i]->m_pMesh);
+			m_vpMatrices[i]->m_pMesh = NULL;
+		}
 
 		delete [] m_vpMatrices[i]->m_pColour;
+		delete [] m_vpMatrices[i]->m_name;
 
 		delete m_vpMatrices[i];
 		m_vpMatrices[i] = 0;
 	}
 	m_vpMatrices.clear();
+
+	if(m_mergedStaticBufferId != (unsigned int)-1)
+	{
+		m_pRenderer->DeleteStaticBuffer(m_mergedStaticBufferId);
+		m_mergedStaticBufferId = -1;
+	}
+	m_vpFinishedMeshes.clear();
 }
 
 void QubicleBinary::Reset()
@@ -92,6 +135,11 @@ void QubicleBinary::Reset()
 	m_renderWireFrame = false;
 }
 
+void QubicleBinary::SetMeshCache(QubicleMeshCache* pMeshCache)
+{
+	m_pMeshCache = pMeshCache;
+}
+
 string QubicleBinary::GetFileName()
 {
 	return m_fileName;
@@ -132,133 +180,373 @@ void QubicleBinary::GetMatrixPosition(int index, int* aX, int* aY, int* aZ)
 	*aZ = m_vpMatrices[index]->m_matrixPosZ;
 }
 
-bool QubicleBinary::Import(const char* fileName)
+// Reads a little endian 32 bit value from a (possibly unaligned) position in the file buffer
+static inline unsigned int ReadUnsignedInt(const unsigned char* pData)
 {
-	m_fileName = fileName;
-
-	char qbFilename[256];
-	sprintf_s(qbFilename, fileName);;
+	unsigned int value;
+	memcpy(&value, pData, sizeof(unsigned int));
+	return value;
+}
 
-	FILE* pQBfile = NULL;
-	fopen_s(&pQBfile, qbFilename, "rb");
+// Writes count copies of colour, using the widest stores available since long runs of the same colour (and of empty space) are the common case
+static inline void FillColourRun(unsigned int* pDest, unsigned int count, unsigned int colour)
+{
+#if defined(__AVX2__)
+	__m256i colour8 = _mm256_set1_epi32((int)colour);
+	while(count >= 8)
+	{
+		_mm256_storeu_si256((__m256i*)pDest, colour8);
+		pDest += 8;
+		count -= 8;
+	}
+#endif
+#if defined(QUBICLE_RLE_SSE2)
+	__m128i colour4 = _mm_set1_epi32((int)colour);
+	while(count >= 4)
+	{
+		_mm_storeu_si128((__m128i*)pDest, colour4);
+		pDest += 4;
+		count -= 4;
+	}
+#endif
+	std::fill_n(pDest, count, colour);
+}
 
+bool DecodeQubicleRLESlice(const unsigned char** ppRead, const unsigned char* pEnd, unsigned int* pSlice, unsigned int sliceSize)
+{
 	const unsigned int CODEFLAG = 2;
 	const unsigned int NEXTSLICEFLAG = 6;
 
-	if (pQBfile != NULL)
+	const unsigned char* pRead = *ppRead;
+	unsigned int index = 0;
+
+	while(true)
 	{
-		int ok = 0;
-		ok = fread(&m_version[0], sizeof(char)*4, 1, pQBfile) == 1;
-		ok = fread(&m_colourFormat, sizeof(unsigned int), 1, pQBfile) == 1;
-		ok = fread(&m_zAxisOrientation, sizeof(unsigned int), 1, pQBfile) == 1;
-		ok = fread(&m_compressed, sizeof(unsigned int), 1, pQBfile) == 1;
-		ok = fread(&m_visibilityMaskEncoded, sizeof(unsigned int), 1, pQBfile) == 1;
-		ok = fread(&m_numMatrices, sizeof(unsigned int), 1, pQBfile) == 1;
+		// Literal colours are stored as they are read, up until the next flag
+		unsigned int data = 0;
+		bool foundFlag = false;
+		while(pEnd - pRead >= 4)
+		{
+			data = ReadUnsignedInt(pRead);
+			pRead += 4;
 
-		for(unsigned int i = 0; i < m_numMatrices; i++)
+			if(data == CODEFLAG || data == NEXTSLICEFLAG)
+			{
+				foundFlag = true;
+				break;
+			}
+
+			if(index == sliceSize)
+			{
+				return false;
+			}
+
+			pSlice[index++] = data;
+		}
+
+		if(foundFlag == false)
 		{
-			QubicleMatrix* pNewMatrix = new QubicleMatrix();
+			return false;
+		}
 
-			ok = fread((char *)&pNewMatrix->m_nameLength, sizeof(char), 1, pQBfile) == 1;
-			pNewMatrix->m_name = new char[pNewMatrix->m_nameLength+1];
-			ok = fread(&pNewMatrix->m_name[0], sizeof(char)*pNewMatrix->m_nameLength, 1, pQBfile) == 1;
-			pNewMatrix->m_name[pNewMatrix->m_nameLength] = 0;
+		if(data == NEXTSLICEFLAG)
+		{
+			break;
+		}
 
-			ok = fread(&pNewMatrix->m_matrixSizeX, sizeof(unsigned int), 1, pQBfile) == 1;
-			ok = fread(&pNewMatrix->m_matrixSizeY, sizeof(unsigned int), 1, pQBfile) == 1;
-			ok = fread(&pNewMatrix->m_matrixSizeZ, sizeof(unsigned int), 1, pQBfile) == 1;
-			
-			ok = fread(&pNewMatrix->m_matrixPosX, sizeof(int), 1, pQBfile) == 1;
-			ok = fread(&pNewMatrix->m_matrixPosY, sizeof(int), 1, pQBfile) == 1;
-			ok = fread(&pNewMatrix->m_matrixPosZ, sizeof(int), 1, pQBfile) == 1;
+		// CODEFLAG, followed by the run length and the colour
+		if(pEnd - pRead < 8)
+		{
+			return false;
+		}
 
-			pNewMatrix->m_boneIndex = -1;
-			pNewMatrix->m_pMesh = NULL;
+		unsigned int count = ReadUnsignedInt(pRead);
+		unsigned int colour = ReadUnsignedInt(pRead + 4);
+		pRead += 8;
 
-			pNewMatrix->m_scale = 1.0f;
-			pNewMatrix->m_offsetX = 0.0f;
-			pNewMatrix->m_offsetY = 0.0f;
-			pNewMatrix->m_offsetZ = 0.0f;
+		if(count > sliceSize - index)
+		{
+			return false;
+		}
 
-			pNewMatrix->m_removed = false;
+		FillColourRun(&pSlice[index], count, colour);
+		index += count;
+	}
 
-			pNewMatrix->m_pColour = new unsigned int[pNewMatrix->m_matrixSizeX * pNewMatrix->m_matrixSizeY * pNewMatrix->m_matrixSizeZ];
+	// Anything the slice didn't cover is empty space
+	FillColourRun(&pSlice[index], sliceSize - index, 0);
 
-			if(m_compressed == 0)
-			{
-				for(unsigned int z = 0; z < pNewMatrix->m_matrixSizeZ; z++)
-				{
-					for(unsigned int y = 0; y < pNewMatrix->m_matrixSizeY; y++)
-					{
-						for(unsigned int x = 0; x < pNewMatrix->m_matrixSizeX; x++)
-						{
-							unsigned int colour = 0;
-							ok = fread(&colour, sizeof(unsigned int), 1, pQBfile) == 1;
+	*ppRead = pRead;
 
-							pNewMatrix->m_pColour[x + pNewMatrix->m_matrixSizeX * (y + pNewMatrix->m_matrixSizeY * z)] = colour;
-						}
-					}
-				}
-			}
-			else
-			{
-				unsigned int z = 0;
+	return true;
+}
 
-				while (z < pNewMatrix->m_matrixSizeZ) 
-				{
-					unsigned int index = 0;
+bool DecodeQubicleRLEMatrix(const unsigned char** ppRead, const unsigned char* pEnd, unsigned int* pColour, unsigned int sizeX, unsigned int sizeY, unsigned int sizeZ)
+{
+	unsigned int sliceSize = sizeX * sizeY;
 
-					while(true)
-					{
-						unsigned int data = 0;
-						ok = fread(&data, sizeof(unsigned int), 1, pQBfile) == 1;
+	for(unsigned int z = 0; z < sizeZ; z++)
+	{
+		if(DecodeQubicleRLESlice(ppRead, pEnd, &pColour[sliceSize * z], sliceSize) == false)
+		{
+			return false;
+		}
+	}
 
-						if (data == NEXTSLICEFLAG)
-							break;
-						else if (data == CODEFLAG) 
-						{
-							unsigned int count = 0;
-							ok = fread(&count, sizeof(unsigned int), 1, pQBfile) == 1;
-							ok = fread(&data, sizeof(unsigned int), 1, pQBfile) == 1;
+	return true;
+}
 
-							for(unsigned int j = 0; j < count; j++) 
-							{
-								unsigned int x = index % pNewMatrix->m_matrixSizeX;
-								unsigned int y = index / pNewMatrix->m_matrixSizeX;
+bool QubicleBinary::Import(const char* fileName, bool finishMesh)
+{
+	m_fileName = fileName;
 
-								pNewMatrix->m_pColour[x + pNewMatrix->m_matrixSizeX * (y + pNewMatrix->m_matrixSizeY * z)] = data;
+	FILE* pQBfile = NULL;
+	fopen_s(&pQBfile, fileName, "rb");
 
-								index++;
-							}
-						}
-						else
-						{
-							unsigned int x = index % pNewMatrix->m_matrixSizeX;
-							unsigned int y = index / pNewMatrix->m_matrixSizeX;
+	if(pQBfile == NULL)
+	{
+		return false;
+	}
 
-							pNewMatrix->m_pColour[x + pNewMatrix->m_matrixSizeX * (y + pNewMatrix->m_matrixSizeY * z)] = data;
+	// Pull the whole file into memory with a single read, all the decoding is then done straight out of this buffer
+	fseek(pQBfile, 0, SEEK_END);
+	long fileSize = ftell(pQBfile);
+	fseek(pQBfile, 0, SEEK_SET);
 
-							index++;
-						}
-					}
+	if(fileSize <= 0)
+	{
+		fclose(pQBfile);
+		return false;
+	}
 
-					z++;
-				}
+	unsigned char* pFileData = new unsigned char[fileSize];
+	bool readOk = fread(pFileData, 1, fileSize, pQBfile) == (size_t)fileSize;
+	fclose(pQBfile);
+
+	bool decodeOk = readOk && ImportFromMemory(pFileData, (unsigned int)fileSize);
+
+	// The cooked mesh cache is keyed on the file contents, single colour meshes are never cached
+	bool useMeshCache = decodeOk && m_pMeshCache != NULL && m_singleMeshColour == false;
+	unsigned long long contentHash = 0;
+	if(useMeshCache)
+	{
+		contentHash = QubicleMeshCache::HashData(pFileData, (unsigned int)fileSize);
+	}
+
+	delete [] pFileData;
+
+	if(decodeOk == false)
+	{
+		cout << "Failed to import qubicle binary file: " << fileName << "\n";
+
+		ClearMatrices();
+		m_numMatrices = 0;
+
+		return false;
+	}
+
+	// Cached before the meshes are finished, which releases their vertex data
+	if(useMeshCache == false || m_pMeshCache->LoadMeshes(contentHash, GetMeshCacheVersion(), m_vpMatrices, m_pRenderer) == false)
+	{
+		CreateMesh(false);
+
+		if(useMeshCache)
+		{
+			m_pMeshCache->SaveMeshes(contentHash, GetMeshCacheVersion(), m_vpMatrices);
+		}
+	}
+
+	if(finishMesh)
+	{
+		FinishMesh();
+	}
+
+	m_loaded = true;
+
+	return true;
+}
+
+bool QubicleBinary::ImportFromMemory(const unsigned char* pData, unsigned int dataSize)
+{
+	const unsigned int HEADER_SIZE = sizeof(char)*4 + sizeof(unsigned int)*5;
+	const unsigned int MATRIX_HEADER_SIZE = sizeof(unsigned int)*3 + sizeof(int)*3;
+
+	if(dataSize < HEADER_SIZE)
+	{
+		return false;
+	}
+
+	const unsigned char* pRead = pData;
+	const unsigned char* pEnd = pData + dataSize;
+
+	memcpy(&m_version[0], pRead, sizeof(char)*4);
+	m_colourFormat = ReadUnsignedInt(pRead + 4);
+	m_zAxisOrientation = ReadUnsignedInt(pRead + 8);
+	m_compressed = ReadUnsignedInt(pRead + 12);
+	m_visibilityMaskEncoded = ReadUnsignedInt(pRead + 16);
+	m_numMatrices = ReadUnsignedInt(pRead + 20);
+	pRead += HEADER_SIZE;
+
+	for(unsigned int i = 0; i < m_numMatrices; i++)
+	{
+		// Matrix header, bounds checked once up front
+		if(pRead >= pEnd)
+		{
+			return false;
+		}
+
+		unsigned int nameLength = (unsigned char)*pRead;
+		if((unsigned int)(pEnd - pRead) < 1 + nameLength + MATRIX_HEADER_SIZE)
+		{
+			return false;
+		}
+
+		QubicleMatrix* pNewMatrix = new QubicleMatrix();
+
+		pNewMatrix->m_nameLength = (char)nameLength;
+		pNewMatrix->m_name = new char[nameLength+1];
+		memcpy(&pNewMatrix->m_name[0], pRead + 1, nameLength);
+		pNewMatrix->m_name[nameLength] = 0;
+		pRead += 1 + nameLength;
+
+		pNewMatrix->m_matrixSizeX = ReadUnsignedInt(pRead);
+		pNewMatrix->m_matrixSizeY = ReadUnsignedInt(pRead + 4);
+		pNewMatrix->m_matrixSizeZ = ReadUnsignedInt(pRead + 8);
+
+		pNewMatrix->m_matrixPosX = (int)ReadUnsignedInt(pRead + 12);
+		pNewMatrix->m_matrixPosY = (int)ReadUnsignedInt(pRead + 16);
+		pNewMatrix->m_matrixPosZ = (int)ReadUnsignedInt(pRead + 20);
+		pRead += MATRIX_HEADER_SIZE;
+
+		pNewMatrix->m_boneIndex = -1;
+		pNewMatrix->m_pMesh = NULL;
+
+		pNewMatrix->m_scale = 1.0f;
+		pNewMatrix->m_offsetX = 0.0f;
+		pNewMatrix->m_offsetY = 0.0f;
+		pNewMatrix->m_offsetZ = 0.0f;
+
+		pNewMatrix->m_removed = false;
+
+		// Push the matrix straight away, so that any failure below gets cleaned up with the rest of the matrices
+		pNewMatrix->m_pColour = NULL;
+		m_vpMatrices.push_back(pNewMatrix);
+
+		// The header sizes are checked before anything is allocated from them
+		if(IsValidMatrixSize(pNewMatrix) == false)
+		{
+			return false;
+		}
+
+		unsigned int numVoxels = pNewMatrix->m_matrixSizeX * pNewMatrix->m_matrixSizeY * pNewMatrix->m_matrixSizeZ;
+
+		if(m_compressed == 0)
+		{
+			// Voxel payload is stored in the same x, y, z order as our colour array, so it is just one copy
+			if((unsigned long long)numVoxels * sizeof(unsigned int) > (unsigned long long)(pEnd - pRead))
+			{
+				return false;
+			}
+
+			pNewMatrix->m_pColour = new unsigned int[numVoxels];
+			memcpy(pNewMatrix->m_pColour, pRead, (size_t)numVoxels * sizeof(unsigned int));
+			pRead += (size_t)numVoxels * sizeof(unsigned int);
+		}
+		else
+		{
+			// Every slice ends with at least its next slice flag, so a payload shorter than that can't be this matrix
+			if((unsigned long long)pNewMatrix->m_matrixSizeZ * sizeof(unsigned int) > (unsigned long long)(pEnd - pRead))
+			{
+				return false;
 			}
 
-			m_vpMatrices.push_back(pNewMatrix);
+			pNewMatrix->m_pColour = new unsigned int[numVoxels];
+
+			if(DecodeQubicleRLEMatrix(&pRead, pEnd, pNewMatrix->m_pColour, pNewMatrix->m_matrixSizeX, pNewMatrix->m_matrixSizeY, pNewMatrix->m_matrixSizeZ) == false)
+			{
+				return false;
+			}
 		}
 
-		fclose(pQBfile);
+		CalculateMatrixBounds(pNewMatrix);
+	}
 
-		CreateMesh();
+	return true;
+}
 
-		m_loaded = true;
+// Rejects empty matrices, and ones whose slice or voxel count would overflow the 32 bit indexing or exceed MAX_MATRIX_VOXELS
+bool QubicleBinary::IsValidMatrixSize(QubicleMatrix* pMatrix)
+{
+	if(pMatrix->m_matrixSizeX == 0 || pMatrix->m_matrixSizeY == 0 || pMatrix->m_matrixSizeZ == 0)
+	{
+		return false;
+	}
 
-		return true;
+	unsigned long long sliceSize = (unsigned long long)pMatrix->m_matrixSizeX * pMatrix->m_matrixSizeY;
+	if(sliceSize > MAX_MATRIX_VOXELS)
+	{
+		return false;
 	}
 
-	return false;
+	unsigned long long numVoxels = sliceSize * pMatrix->m_matrixSizeZ;
+	if(numVoxels > MAX_MATRIX_VOXELS)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+// A box around the solid voxels, each voxel filling BLOCK_RENDER_SIZE either side of its position as it does in the mesh
+void QubicleBinary::CalculateMatrixBounds(QubicleMatrix* pMatrix)
+{
+	bool empty = true;
+	unsigned int minX = 0, minY = 0, minZ = 0;
+	unsigned int maxX = 0, maxY = 0, maxZ = 0;
+
+	for(unsigned int z = 0; z < pMatrix->m_matrixSizeZ; z++)
+	{
+		for(unsigned int y = 0; y < pMatrix->m_matrixSizeY; y++)
+		{
+			for(unsigned int x = 0; x < pMatrix->m_matrixSizeX; x++)
+			{
+				if(pMatrix->GetActive(x, y, z) == false)
+				{
+					continue;
+				}
+
+				if(empty)
+				{
+					minX = maxX = x;
+					minY = maxY = y;
+					minZ = maxZ = z;
+					empty = false;
+				}
+				else
+				{
+					minX = (x < minX) ? x : minX;
+					minY = (y < minY) ? y : minY;
+					minZ = (z < minZ) ? z : minZ;
+					maxX = (x > maxX) ? x : maxX;
+					maxY = (y > maxY) ? y : maxY;
+					maxZ = (z > maxZ) ? z : maxZ;
+				}
+			}
+		}
+	}
+
+	if(empty)
+	{
+		pMatrix->m_boundingCentre = Vector3d(0.0f, 0.0f, 0.0f);
+		pMatrix->m_boundingRadius = 0.0f;
+		return;
+	}
+
+	Vector3d boxMin((float)minX - BLOCK_RENDER_SIZE, (float)minY - BLOCK_RENDER_SIZE, (float)minZ - BLOCK_RENDER_SIZE);
+	Vector3d boxMax((float)maxX + BLOCK_RENDER_SIZE, (float)maxY + BLOCK_RENDER_SIZE, (float)maxZ + BLOCK_RENDER_SIZE);
+
+	pMatrix->m_boundingCentre = (boxMin + boxMax) * 0.5f;
+	pMatrix->m_boundingRadius = (boxMax - boxMin).GetLength() * 0.5f;
 }
 
 bool QubicleBinary::Export(const char* fileName)
@@ -421,14 +709,10 @@ bool QubicleBinary::GetActive(int matrixIndex, int x, int y, int z)
 	return pMatrix->GetActive(x, y, z);
 }
 
+// Alpha and single colour are applied as a tint when the meshes are drawn, so changing them leaves the meshes alone
 void QubicleBinary::SetMeshAlpha(float alpha)
 {
 	m_meshAlpha = alpha;
-
-	for(unsigned int i = 0; i < m_vpMatrices.size(); i++)
-	{
-		m_pRenderer->ModifyMeshAlpha(alpha, m_vpMatrices[i]->m_pMesh);
-	}
 }
 
 void QubicleBinary::SetMeshSingleColour(float r, float g, float b)
@@ -437,11 +721,16 @@ void QubicleBinary::SetMeshSingleColour(float r, float g, float b)
 	m_meshSingleColourR = r;
 	m_meshSingleColourG = g;
 	m_meshSingleColourB = b;
+}
 
-	for(unsigned int i = 0; i < m_vpMatrices.size(); i++)
+Colour QubicleBinary::GetMeshTint()
+{
+	if(m_singleMeshColour)
 	{
-		m_pRenderer->ModifyMeshColour(r, g, b, m_vpMatrices[i]->m_pMesh);
+		return Colour(m_meshSingleColourR, m_meshSingleColourG, m_meshSingleColourB, m_meshAlpha);
 	}
+
+	return Colour(1.0f, 1.0f, 1.0f, m_meshAlpha);
 }
 
 void QubicleBinary::SetForceTransparency(bool force)
@@ -456,529 +745,1180 @@ bool IsMergedYPositive(int *merged, int x, int y, int z, int width, int height)
 bool IsMergedZNegative(int *merged, int x, int y, int z, int width, int height) { return (merged[x + y*width + z*width*height] & MergedSide_Z_Negative) == MergedSide_Z_Negative; }
 bool IsMergedZPositive(int *merged, int x, int y, int z, int width, int height) { return (merged[x + y*width + z*width*height] & MergedSide_Z_Positive) == MergedSide_Z_Positive; }
 
-void QubicleBinary::CreateMesh()
+void QubicleBinary::SetMeshingMethod(QubicleMeshingMethod method)
 {
-	for(unsigned int matrixIndex = 0; matrixIndex < m_vpMatrices.size(); matrixIndex++)
-	{
-		QubicleMatrix* pMatrix = m_vpMatrices[matrixIndex];
+	m_meshingMethod = method;
+}
 
-		int *l_merged;
+QubicleMeshingMethod QubicleBinary::GetMeshingMethod()
+{
+	return m_meshingMethod;
+}
 
-		l_merged = new int[pMatrix->m_matrixSizeX*pMatrix->m_matrixSizeY*pMatrix->m_matrixSizeZ];
+void QubicleBinary::SetMeshingWorkerPool(WorkerPool* pWorkerPool)
+{
+	m_pMeshingWorkerPool = pWorkerPool;
+}
 
-		for(unsigned int i = 0; i < pMatrix->m_matrixSizeX*pMatrix->m_matrixSizeY*pMatrix->m_matrixSizeZ; i++)
-		{
-			l_merged[i] = MergedSide_None;
-		}
+WorkerPool* QubicleBinary::GetMeshingWorkerPool()
+{
+	if(m_pMeshingWorkerPool != NULL)
+	{
+		return m_pMeshingWorkerPool;
+	}
 
-		if(pMatrix->m_pMesh == NULL)
-		{
-			pMatrix->m_pMesh = m_pRenderer->CreateMesh(OGLMeshType_Textured);
-		}
+	// One pool for every model, so models being loaded on several threads at once don't each start a full set of threads
+	static WorkerPool sharedMeshingWorkerPool;
 
-		float r = 1.0f;
-		float g = 1.0f;
-		float b = 1.0f;
-		float a = 1.0f;	
+	return &sharedMeshingWorkerPool;
+}
 
-		for(unsigned int x = 0; x < pMatrix->m_matrixSizeX; x++)
-		{
-			for(unsigned int y = 0; y < pMatrix->m_matrixSizeY; y++)
-			{
-				for(unsigned int z = 0; z < pMatrix->m_matrixSizeZ; z++)
-				{
-					if(GetActive(matrixIndex, x, y, z) == false)
-					{
-						continue;
-					}
-					else
-					{
-						GetColour(matrixIndex, x, y, z, &r, &g, &b, &a);
+void QubicleBinary::CreateMesh(bool finishMesh)
+{
+	// Meshing straight away replaces anything a background rebuild would have given us
+	CancelMeshRebuild();
 
-						a = 1.0f;
+	QubicleMeshingSource source;
+	CreateMeshingSource(&source, false);
 
-						Vector3d p1(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						Vector3d p2(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						Vector3d p3(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						Vector3d p4(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						Vector3d p5(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-						Vector3d p6(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-						Vector3d p7(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-						Vector3d p8(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-
-						Vector3d n1;
-						unsigned int v1, v2, v3, v4;
-						unsigned int t1, t2, t3, t4;
-
-						bool doXPositive = (IsMergedXPositive(l_merged, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY) == false);
-						bool doXNegative = (IsMergedXNegative(l_merged, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY) == false);
-						bool doYPositive = (IsMergedYPositive(l_merged, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY) == false);
-						bool doYNegative = (IsMergedYNegative(l_merged, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY) == false);
-						bool doZPositive = (IsMergedZPositive(l_merged, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY) == false);
-						bool doZNegative = (IsMergedZNegative(l_merged, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY) == false);
-
-						// Front
-						if(doZPositive && ((z == pMatrix->m_matrixSizeZ-1) || z < pMatrix->m_matrixSizeZ-1 && GetActive(matrixIndex, x, y, z+1) == false))
-						{
-							int endX = pMatrix->m_matrixSizeX;
-							int endY = pMatrix->m_matrixSizeY;
-
-							UpdateMergedSide(l_merged, matrixIndex, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY, &p1, &p2, &p3, &p4, x, y, endX, endY, true, true, false, false);
-
-							n1 = Vector3d(0.0f, 0.0f, 1.0f);
-							v1 = m_pRenderer->AddVertexToMesh(p1, n1, r, g, b, a, pMatrix->m_pMesh);
-							t1 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 0.0f, pMatrix->m_pMesh);
-							v2 = m_pRenderer->AddVertexToMesh(p2, n1, r, g, b, a, pMatrix->m_pMesh);
-							t2 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 0.0f, pMatrix->m_pMesh);
-							v3 = m_pRenderer->AddVertexToMesh(p3, n1, r, g, b, a, pMatrix->m_pMesh);
-							t3 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 1.0f, pMatrix->m_pMesh);
-							v4 = m_pRenderer->AddVertexToMesh(p4, n1, r, g, b, a, pMatrix->m_pMesh);
-							t4 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 1.0f, pMatrix->m_pMesh);
-
-							m_pRenderer->AddTriangleToMesh(v1, v2, v3, pMatrix->m_pMesh);
-							m_pRenderer->AddTriangleToMesh(v1, v3, v4, pMatrix->m_pMesh);
-						}
+	// Every matrix is meshed before any of them are swapped over, so we never render a mix of old and new meshes
+	vector<OpenGLTriangleMesh*> vpNewMeshes;
+	BuildMatrixMeshes(source, vpNewMeshes);
 
-						p1 = Vector3d(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						p2 = Vector3d(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						p3 = Vector3d(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						p4 = Vector3d(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						p5 = Vector3d(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-						p6 = Vector3d(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-						p7 = Vector3d(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-						p8 = Vector3d(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-
-						// Back
-						if(doZNegative && ((z == 0) || (z > 0 && GetActive(matrixIndex, x, y, z-1) == false)))
-						{
-							int endX = pMatrix->m_matrixSizeX;
-							int endY = pMatrix->m_matrixSizeY;
-
-							UpdateMergedSide(l_merged, matrixIndex, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY, &p6, &p5, &p8, &p7, x, y, endX, endY, false, true, false, false);
-
-							n1 = Vector3d(0.0f, 0.0f, -1.0f);
-							v1 = m_pRenderer->AddVertexToMesh(p5, n1, r, g, b, a, pMatrix->m_pMesh);
-							t1 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 0.0f, pMatrix->m_pMesh);
-							v2 = m_pRenderer->AddVertexToMesh(p6, n1, r, g, b, a, pMatrix->m_pMesh);
-							t2 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 0.0f, pMatrix->m_pMesh);
-							v3 = m_pRenderer->AddVertexToMesh(p7, n1, r, g, b, a, pMatrix->m_pMesh);
-							t3 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 1.0f, pMatrix->m_pMesh);
-							v4 = m_pRenderer->AddVertexToMesh(p8, n1, r, g, b, a, pMatrix->m_pMesh);
-							t4 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 1.0f, pMatrix->m_pMesh);
-
-							m_pRenderer->AddTriangleToMesh(v1, v2, v3, pMatrix->m_pMesh);
-							m_pRenderer->AddTriangleToMesh(v1, v3, v4, pMatrix->m_pMesh);
-						}
+	ReleaseMeshingSource(&source);
 
-						p1 = Vector3d(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						p2 = Vector3d(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						p3 = Vector3d(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						p4 = Vector3d(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						p5 = Vector3d(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-						p6 = Vector3d(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-						p7 = Vector3d(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-						p8 = Vector3d(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-
-						// Right
-						if(doXPositive && ((x == pMatrix->m_matrixSizeX-1) || (x < pMatrix->m_matrixSizeX-1 && GetActive(matrixIndex, x+1, y, z) == false)))
-						{
-							int endX = pMatrix->m_matrixSizeZ;
-							int endY = pMatrix->m_matrixSizeY;
-
-							UpdateMergedSide(l_merged, matrixIndex, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY, &p5, &p2, &p3, &p8, z, y, endX, endY, true, false, true, false);
-
-							n1 = Vector3d(1.0f, 0.0f, 0.0f);
-							v1 = m_pRenderer->AddVertexToMesh(p2, n1, r, g, b, a, pMatrix->m_pMesh);
-							t1 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 0.0f, pMatrix->m_pMesh);
-							v2 = m_pRenderer->AddVertexToMesh(p5, n1, r, g, b, a, pMatrix->m_pMesh);
-							t2 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 0.0f, pMatrix->m_pMesh);
-							v3 = m_pRenderer->AddVertexToMesh(p8, n1, r, g, b, a, pMatrix->m_pMesh);
-							t3 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 1.0f, pMatrix->m_pMesh);
-							v4 = m_pRenderer->AddVertexToMesh(p3, n1, r, g, b, a, pMatrix->m_pMesh);
-							t4 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 1.0f, pMatrix->m_pMesh);
-
-							m_pRenderer->AddTriangleToMesh(v1, v2, v3, pMatrix->m_pMesh);
-							m_pRenderer->AddTriangleToMesh(v1, v3, v4, pMatrix->m_pMesh);
-						}
+	for(unsigned int matrixIndex = 0; matrixIndex < m_vpMatrices.size(); matrixIndex++)
+	{
+		SwapMatrixMesh(matrixIndex, vpNewMeshes[matrixIndex]);
+	}
 
-						p1 = Vector3d(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						p2 = Vector3d(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						p3 = Vector3d(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						p4 = Vector3d(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						p5 = Vector3d(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-						p6 = Vector3d(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-						p7 = Vector3d(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-						p8 = Vector3d(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-
-						// Left
-						if(doXNegative && ((x == 0) || (x > 0 && GetActive(matrixIndex, x-1, y, z) == false)))
-						{
-							int endX = pMatrix->m_matrixSizeZ;
-							int endY = pMatrix->m_matrixSizeY;
-
-							UpdateMergedSide(l_merged, matrixIndex, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY, &p6, &p1, &p4, &p7, z, y, endX, endY, false, false, true, false);
-
-							n1 = Vector3d(-1.0f, 0.0f, 0.0f);
-							v1 = m_pRenderer->AddVertexToMesh(p6, n1, r, g, b, a, pMatrix->m_pMesh);
-							t1 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 0.0f, pMatrix->m_pMesh);
-							v2 = m_pRenderer->AddVertexToMesh(p1, n1, r, g, b, a, pMatrix->m_pMesh);
-							t2 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 0.0f, pMatrix->m_pMesh);
-							v3 = m_pRenderer->AddVertexToMesh(p4, n1, r, g, b, a, pMatrix->m_pMesh);
-							t3 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 1.0f, pMatrix->m_pMesh);
-							v4 = m_pRenderer->AddVertexToMesh(p7, n1, r, g, b, a, pMatrix->m_pMesh);
-							t4 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 1.0f, pMatrix->m_pMesh);
-
-							m_pRenderer->AddTriangleToMesh(v1, v2, v3, pMatrix->m_pMesh);
-							m_pRenderer->AddTriangleToMesh(v1, v3, v4, pMatrix->m_pMesh);
-						}
+	if(finishMesh)
+	{
+		FinishMesh();
+	}
+}
 
-						p1 = Vector3d(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						p2 = Vector3d(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						p3 = Vector3d(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						p4 = Vector3d(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						p5 = Vector3d(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-						p6 = Vector3d(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-						p7 = Vector3d(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-						p8 = Vector3d(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-
-						// Top
-						if(doYPositive && ((y == pMatrix->m_matrixSizeY-1) || (y < pMatrix->m_matrixSizeY-1 && GetActive(matrixIndex, x, y+1, z) == false)))
-						{
-							int endX = pMatrix->m_matrixSizeX;
-							int endY = pMatrix->m_matrixSizeZ;
-
-							UpdateMergedSide(l_merged, matrixIndex, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY, &p7, &p8, &p3, &p4, x, z, endX, endY, true, false, false, true);
-
-							n1 = Vector3d(0.0f, 1.0f, 0.0f);
-							v1 = m_pRenderer->AddVertexToMesh(p4, n1, r, g, b, a, pMatrix->m_pMesh);
-							t1 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 0.0f, pMatrix->m_pMesh);
-							v2 = m_pRenderer->AddVertexToMesh(p3, n1, r, g, b, a, pMatrix->m_pMesh);
-							t2 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 0.0f, pMatrix->m_pMesh);
-							v3 = m_pRenderer->AddVertexToMesh(p8, n1, r, g, b, a, pMatrix->m_pMesh);
-							t3 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 1.0f, pMatrix->m_pMesh);
-							v4 = m_pRenderer->AddVertexToMesh(p7, n1, r, g, b, a, pMatrix->m_pMesh);
-							t4 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 1.0f, pMatrix->m_pMesh);
-
-							m_pRenderer->AddTriangleToMesh(v1, v2, v3, pMatrix->m_pMesh);
-							m_pRenderer->AddTriangleToMesh(v1, v3, v4, pMatrix->m_pMesh);
-						}
+void QubicleBinary::RebuildMeshAsync()
+{
+	if(m_meshRebuildInFlight)
+	{
+		// The rebuild in flight is already working from older voxels, so run one more once it has finished
+		m_meshRebuildPending = true;
+		return;
+	}
 
-						p1 = Vector3d(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						p2 = Vector3d(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						p3 = Vector3d(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						p4 = Vector3d(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
-						p5 = Vector3d(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-						p6 = Vector3d(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-						p7 = Vector3d(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-						p8 = Vector3d(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
-
-						// Bottom
-						if(doYNegative && ((y == 0) || (y > 0 && GetActive(matrixIndex, x, y-1, z) == false)))
-						{
-							int endX = pMatrix->m_matrixSizeX;
-							int endY = pMatrix->m_matrixSizeZ;
-
-							UpdateMergedSide(l_merged, matrixIndex, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY, &p6, &p5, &p2, &p1, x, z, endX, endY, false, false, false, true);
-
-							n1 = Vector3d(0.0f, -1.0f, 0.0f);
-							v1 = m_pRenderer->AddVertexToMesh(p6, n1, r, g, b, a, pMatrix->m_pMesh);
-							t1 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 0.0f, pMatrix->m_pMesh);
-							v2 = m_pRenderer->AddVertexToMesh(p5, n1, r, g, b, a, pMatrix->m_pMesh);
-							t2 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 0.0f, pMatrix->m_pMesh);
-							v3 = m_pRenderer->AddVertexToMesh(p2, n1, r, g, b, a, pMatrix->m_pMesh);
-							t3 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 1.0f, pMatrix->m_pMesh);
-							v4 = m_pRenderer->AddVertexToMesh(p1, n1, r, g, b, a, pMatrix->m_pMesh);
-							t4 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 1.0f, pMatrix->m_pMesh);
-
-							m_pRenderer->AddTriangleToMesh(v1, v2, v3, pMatrix->m_pMesh);
-							m_pRenderer->AddTriangleToMesh(v1, v3, v4, pMatrix->m_pMesh);
-						}
-					}
-				}
-			}
-		}
+	m_meshRebuildInFlight = true;
+	m_meshRebuildPending = false;
+	m_meshRebuildStale = false;
+	m_meshRebuildReady = false;
 
-		m_pRenderer->FinishMesh(-1, m_materialID, pMatrix->m_pMesh);
+	CreateMeshingSource(&m_meshRebuildSource, true);
 
-		// Delete the merged array
-		delete [] l_merged;
-	}
+	m_meshRebuildThread = std::thread([this]()
+	{
+		BuildMatrixMeshes(m_meshRebuildSource, m_vpRebuiltMeshes);
+
+		m_meshRebuildReady = true;
+	});
 }
 
-void QubicleBinary::UpdateMergedSide(int *merged, int matrixIndex, int blockx, int blocky, int blockz, int width, int height, Vector3d *p1, Vector3d *p2, Vector3d *p3, Vector3d *p4, int startX, int startY, int maxX, int maxY, bool positive, bool zFace, bool xFace, bool yFace)
+bool QubicleBinary::IsMeshRebuilding()
 {
-	QubicleMatrix* pMatrix = m_vpMatrices[matrixIndex];
+	return m_meshRebuildInFlight || m_meshRebuildPending;
+}
 
-	bool doMore = true;
-	unsigned int incrementX = 0;
-	unsigned int incrementZ = 0;
-	unsigned int incrementY = 0;
+// Swaps in the meshes from a finished background rebuild, this has to happen on the render thread since it finishes the meshes
+void QubicleBinary::UpdateMeshRebuild()
+{
+	if(m_meshRebuildInFlight == false || m_meshRebuildReady == false)
+	{
+		return;
+	}
 
-	int change = 1;
-	if(positive == false)
+	m_meshRebuildThread.join();
+	m_meshRebuildInFlight = false;
+	ReleaseMeshingSource(&m_meshRebuildSource);
+
+	if(m_meshRebuildStale)
 	{
-		//change = -1;
+		// The matrices changed under the rebuild, so its meshes no longer line up with them
+		for(unsigned int i = 0; i < m_vpRebuiltMeshes.size(); i++)
+		{
+			m_pRenderer->ClearMesh(m_vpRebuiltMeshes[i]);
+		}
+		m_vpRebuiltMeshes.clear();
+
+		RebuildMeshAsync();
+		return;
 	}
 
-	if(zFace || yFace)
+	for(unsigned int matrixIndex = 0; matrixIndex < m_vpMatrices.size(); matrixIndex++)
 	{
-		incrementX = 1;
-		incrementY = 1;
+		SwapMatrixMesh(matrixIndex, m_vpRebuiltMeshes[matrixIndex]);
 	}
-	if(xFace)
+	m_vpRebuiltMeshes.clear();
+
+	FinishMesh();
+
+	if(m_meshRebuildPending)
 	{
-		incrementZ = 1;
-		incrementY = 1;
+		RebuildMeshAsync();
 	}
+}
 
-	// 1st phase
-	int incrementer = 1;
-	while(doMore)
+// Waits for any background rebuild and throws its meshes away
+void QubicleBinary::CancelMeshRebuild()
+{
+	m_meshRebuildPending = false;
+
+	if(m_meshRebuildInFlight == false)
 	{
-		if(startX + incrementer >= maxX)
+		return;
+	}
+
+	m_meshRebuildThread.join();
+	m_meshRebuildInFlight = false;
+	m_meshRebuildStale = false;
+	ReleaseMeshingSource(&m_meshRebuildSource);
+
+	for(unsigned int i = 0; i < m_vpRebuiltMeshes.size(); i++)
+	{
+		m_pRenderer->ClearMesh(m_vpRebuiltMeshes[i]);
+	}
+	m_vpRebuiltMeshes.clear();
+}
+
+// Fills in what the meshers need, copying the voxels when the mesh is going to be built on another thread
+void QubicleBinary::CreateMeshingSource(QubicleMeshingSource* pSource, bool copyMatrices)
+{
+	pSource->m_copiedMatrices = copyMatrices;
+	pSource->m_meshingMethod = m_meshingMethod;
+	pSource->m_pWorkerPool = GetMeshingWorkerPool();
+	pSource->m_singleMeshColour = m_singleMeshColour;
+	pSource->m_meshSingleColourR = m_meshSingleColourR;
+	pSource->m_meshSingleColourG = m_meshSingleColourG;
+	pSource->m_meshSingleColourB = m_meshSingleColourB;
+
+	pSource->m_vpMatrices.clear();
+	pSource->m_vNumVertices.clear();
+	pSource->m_vNumTriangles.clear();
+
+	for(unsigned int matrixIndex = 0; matrixIndex < m_vpMatrices.size(); matrixIndex++)
+	{
+		QubicleMatrix* pMatrix = m_vpMatrices[matrixIndex];
+
+		if(copyMatrices)
 		{
-			doMore = false;
+			// The meshers only look at the size and the colours
+			QubicleMatrix* pCopy = new QubicleMatrix();
+			pCopy->m_matrixSizeX = pMatrix->m_matrixSizeX;
+			pCopy->m_matrixSizeY = pMatrix->m_matrixSizeY;
+			pCopy->m_matrixSizeZ = pMatrix->m_matrixSizeZ;
+
+			unsigned int numVoxels = pMatrix->m_matrixSizeX*pMatrix->m_matrixSizeY*pMatrix->m_matrixSizeZ;
+			pCopy->m_pColour = new unsigned int[numVoxels];
+			memcpy(pCopy->m_pColour, pMatrix->m_pColour, numVoxels*sizeof(unsigned int));
+
+			pSource->m_vpMatrices.push_back(pCopy);
 		}
 		else
 		{
-			bool doPhase1Merge = true;
-			float r1, r2, g1, g2, b1, b2, a1, a2;
-			GetColour(matrixIndex, blockx, blocky, blockz, &r1, &g1, &b1, &a1);
-			GetColour(matrixIndex, blockx + incrementX, blocky, blockz + incrementZ, &r2, &g2, &b2, &a2);
-			//if(m_pBlocks[blockx][blocky][blockz].GetBlockType() != m_pBlocks[blockx + incrementX][blocky][blockz + incrementZ].GetBlockType())
-			//{
-				// Don't do any phase 1 merging if we don't have the same block type.
-			//	doPhase1Merge = false;
-			//	doMore = false;
-			//}
-			/*//else*/ if((r1 != r2 || g1 != g2 || b1 != b2 || a1 != a2) /*&& allMerge == false*/)
+			pSource->m_vpMatrices.push_back(pMatrix);
+		}
+
+		int numVertices = 0;
+		int numTriangles = 0;
+		if(pMatrix->m_pMesh != NULL)
+		{
+			m_pRenderer->GetMeshInformation(&numVertices, &numTriangles, pMatrix->m_pMesh);
+		}
+		pSource->m_vNumVertices.push_back(numVertices);
+		pSource->m_vNumTriangles.push_back(numTriangles);
+	}
+}
+
+void QubicleBinary::ReleaseMeshingSource(QubicleMeshingSource* pSource)
+{
+	if(pSource->m_copiedMatrices)
+	{
+		for(unsigned int i = 0; i < pSource->m_vpMatrices.size(); i++)
+		{
+			delete [] pSource->m_vpMatrices[i]->m_pColour;
+			delete pSource->m_vpMatrices[i];
+		}
+	}
+
+	pSource->m_vpMatrices.clear();
+	pSource->m_vNumVertices.clear();
+	pSource->m_vNumTriangles.clear();
+}
+
+// Meshes every matrix into a brand new mesh, without touching the meshes that are currently being rendered
+void QubicleBinary::BuildMatrixMeshes(const QubicleMeshingSource& source, vector<OpenGLTriangleMesh*>& vpNewMeshes)
+{
+	WorkerPool* pWorkerPool = source.m_pWorkerPool;
+
+	// Large matrices are split up by face direction, so a single big matrix doesn't leave the other threads idle
+	vector<QubicleMeshingTask> vTasks;
+	for(unsigned int matrixIndex = 0; matrixIndex < source.m_vpMatrices.size(); matrixIndex++)
+	{
+		QubicleMatrix* pMatrix = source.m_vpMatrices[matrixIndex];
+		unsigned int numVoxels = pMatrix->m_matrixSizeX*pMatrix->m_matrixSizeY*pMatrix->m_matrixSizeZ;
+
+		bool splitMatrix = source.m_meshingMethod == QubicleMeshingMethod_Bitmask && pWorkerPool->GetNumThreads() > 1 && numVoxels >= MESHING_TASK_SPLIT_VOXELS;
+		int numFaceTasks = splitMatrix ? 6 : 1;
+
+		for(int i = 0; i < numFaceTasks; i++)
+		{
+			QubicleMeshingTask task;
+			task.m_matrixIndex = matrixIndex;
+			task.m_startFace = splitMatrix ? i : 0;
+			task.m_endFace = splitMatrix ? i + 1 : 6;
+			task.m_pMesh = m_pRenderer->CreateMesh(OGLMeshType_Packed);
+			vTasks.push_back(task);
+
+			// A rebuild usually ends up close to the size of the previous mesh, so start with that much room
+			if(splitMatrix == false && source.m_vNumVertices[matrixIndex] > 0)
 			{
-				// Don't do any phase 1 merging if we don't have the same colour variation
-				doPhase1Merge = false;
-				doMore = false;
+				m_pRenderer->ReserveMesh((unsigned int)source.m_vNumVertices[matrixIndex], (unsigned int)source.m_vNumTriangles[matrixIndex], task.m_pMesh);
 			}
-			else
+		}
+	}
+
+	// Each task writes into its own mesh, so the tasks don't need to share anything
+	pWorkerPool->ParallelFor((int)vTasks.size(), [this, &source, &vTasks](int taskIndex)
+	{
+		QubicleMeshingTask& task = vTasks[taskIndex];
+
+		if(source.m_meshingMethod == QubicleMeshingMethod_Bitmask)
+		{
+			CreateMatrixMeshBitmask(source, task.m_matrixIndex, task.m_pMesh, task.m_startFace, task.m_endFace);
+		}
+		else
+		{
+			CreateMatrixMeshMergedSide(source, task.m_matrixIndex, task.m_pMesh);
+		}
+	});
+
+	// Stitch the split matrices back together, in face order so the output matches an unsplit mesh
+	vpNewMeshes.clear();
+	vpNewMeshes.resize(source.m_vpMatrices.size(), NULL);
+	for(unsigned int taskIndex = 0; taskIndex < vTasks.size(); taskIndex++)
+	{
+		QubicleMeshingTask& task = vTasks[taskIndex];
+
+		if(vpNewMeshes[task.m_matrixIndex] == NULL)
+		{
+			vpNewMeshes[task.m_matrixIndex] = task.m_pMesh;
+		}
+		else
+		{
+			AppendMesh(vpNewMeshes[task.m_matrixIndex], task.m_pMesh);
+		}
+	}
+}
+
+// Copies all the geometry from pSourceMesh onto the end of pMesh, and deletes pSourceMesh
+void QubicleBinary::AppendMesh(OpenGLTriangleMesh* pMesh, OpenGLTriangleMesh* pSourceMesh)
+{
+	unsigned int vertexOffset = (unsigned int)pMesh->m_vertices.size();
+
+	for(unsigned int i = 0; i < pSourceMesh->m_triangles.size(); i++)
+	{
+		pSourceMesh->m_triangles[i].vertexIndices[0] += vertexOffset;
+		pSourceMesh->m_triangles[i].vertexIndices[1] += vertexOffset;
+		pSourceMesh->m_triangles[i].vertexIndices[2] += vertexOffset;
+	}
+
+	pMesh->m_vertices.insert(pMesh->m_vertices.end(), pSourceMesh->m_vertices.begin(), pSourceMesh->m_vertices.end());
+	pMesh->m_textureCoordinates.insert(pMesh->m_textureCoordinates.end(), pSourceMesh->m_textureCoordinates.begin(), pSourceMesh->m_textureCoordinates.end());
+	pMesh->m_triangles.insert(pMesh->m_triangles.end(), pSourceMesh->m_triangles.begin(), pSourceMesh->m_triangles.end());
+
+	delete pSourceMesh;
+}
+
+// Replaces a matrix mesh, the new mesh takes over any static buffer of the old one's own so it can be recreated in place.
+// The merged static buffer is left for FinishMesh() to refill, until then the new meshes have nothing to draw.
+void QubicleBinary::SwapMatrixMesh(int matrixIndex, OpenGLTriangleMesh* pNewMesh)
+{
+	QubicleMatrix* pMatrix = m_vpMatrices[matrixIndex];
+	OpenGLTriangleMesh* pOldMesh = pMatrix->m_pMesh;
+
+	if(pOldMesh != NULL && pOldMesh->m_sharedStaticBuffer == false)
+	{
+		pNewMesh->m_staticMeshId = pOldMesh->m_staticMeshId;
+		pOldMesh->m_staticMeshId = -1;
+	}
+
+	pMatrix->m_pMesh = pNewMesh;
+
+	if(pOldMesh != NULL)
+	{
+		m_pRenderer->ClearMesh(pOldMesh);
+	}
+
+	m_vpFinishedMeshes.clear();
+}
+
+// The colour a voxel is meshed with, single colour meshes use the same colour everywhere
+static void GetMeshingColour(const QubicleMeshingSource& source, QubicleMatrix* pMatrix, int x, int y, int z, float* r, float* g, float* b, float* a)
+{
+	if(source.m_singleMeshColour)
+	{
+		*r = source.m_meshSingleColourR;
+		*g = source.m_meshSingleColourG;
+		*b = source.m_meshSingleColourB;
+		*a = 1.0f;
+	}
+	else
+	{
+		pMatrix->GetColour(x, y, z, r, g, b, a);
+	}
+}
+
+void QubicleBinary::CreateMatrixMeshMergedSide(const QubicleMeshingSource& source, int matrixIndex, OpenGLTriangleMesh* pMesh)
+{
+	QubicleMatrix* pMatrix = source.m_vpMatrices[matrixIndex];
+
+	int *l_merged;
+
+	l_merged = new int[pMatrix->m_matrixSizeX*pMatrix->m_matrixSizeY*pMatrix->m_matrixSizeZ];
+
+	for(unsigned int i = 0; i < pMatrix->m_matrixSizeX*pMatrix->m_matrixSizeY*pMatrix->m_matrixSizeZ; i++)
+	{
+		l_merged[i] = MergedSide_None;
+	}
+
+	float r = 1.0f;
+	float g = 1.0f;
+	float b = 1.0f;
+	float a = 1.0f;	
+
+	for(unsigned int x = 0; x < pMatrix->m_matrixSizeX; x++)
+	{
+		for(unsigned int y = 0; y < pMatrix->m_matrixSizeY; y++)
+		{
+			for(unsigned int z = 0; z < pMatrix->m_matrixSizeZ; z++)
 			{
-				if((xFace && positive && blockx + incrementX+1 == pMatrix->m_matrixSizeX) ||
-				   (xFace && !positive && blockx + incrementX == 0) ||
-				   (yFace && positive && blocky+1 == pMatrix->m_matrixSizeY) ||
-				   (yFace && !positive && blocky == 0) ||
-				   (zFace && positive && blockz + incrementZ+1 == pMatrix->m_matrixSizeZ) ||
-				   (zFace && !positive && blockz + incrementZ == 0))
-				{
-					doPhase1Merge = false;
-					doMore = false;
-				}
-				// Don't do any phase 1 merging if we find an inactive block or already merged block in our path
-				else if(xFace && positive && (blockx + incrementX+1) < pMatrix->m_matrixSizeX && GetActive(matrixIndex, blockx + incrementX+1, blocky, blockz + incrementZ) == true)
-				{
-					doPhase1Merge = false;
-					doMore = false;
-				}
-				else if(xFace && !positive && (blockx + incrementX) > 0 && GetActive(matrixIndex, blockx + incrementX-1, blocky, blockz + incrementZ) == true)
-				{
-					doPhase1Merge = false;
-					doMore = false;
-				}
-				else if(yFace && positive && (blocky+1) < (int)pMatrix->m_matrixSizeY && GetActive(matrixIndex, blockx + incrementX, blocky+1, blockz + incrementZ) == true)
-				{
-					doPhase1Merge = false;
-					doMore = false;
-				}
-				else if(yFace && !positive && blocky > 0 && GetActive(matrixIndex, blockx + incrementX, blocky-1, blockz + incrementZ) == true)
-				{
-					doPhase1Merge = false;
-					doMore = false;
-				}
-				else if(zFace && positive && (blockz + incrementZ+1) < pMatrix->m_matrixSizeZ && GetActive(matrixIndex, blockx + incrementX, blocky, blockz + incrementZ+1) == true)
-				{
-					doPhase1Merge = false;
-					doMore = false;
-				}
-				else if(zFace && !positive && (blockz + incrementZ) > 0 && GetActive(matrixIndex, blockx + incrementX, blocky, blockz + incrementZ-1) == true)
-				{
-					doPhase1Merge = false;
-					doMore = false;
-				}
-				else if(GetActive(matrixIndex, blockx + incrementX, blocky, blockz + incrementZ) == false)
+				if(pMatrix->GetActive(x, y, z) == false)
 				{
-					doPhase1Merge = false;
-					doMore = false;
+					continue;
 				}
 				else
 				{
-					if(xFace)
-					{
-						doPhase1Merge = positive ? (IsMergedXPositive(merged, blockx + incrementX, blocky, blockz + incrementZ, width, height) == false) : (IsMergedXNegative(merged, blockx + incrementX, blocky, blockz + incrementZ, width, height) == false);
-					}
-					if(zFace)
+					GetMeshingColour(source, pMatrix, x, y, z, &r, &g, &b, &a);
+
+					a = 1.0f;
+
+					Vector3d p1(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					Vector3d p2(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					Vector3d p3(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					Vector3d p4(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					Vector3d p5(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+					Vector3d p6(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+					Vector3d p7(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+					Vector3d p8(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+
+					Vector3d n1;
+					unsigned int v1, v2, v3, v4;
+					unsigned int t1, t2, t3, t4;
+
+					bool doXPositive = (IsMergedXPositive(l_merged, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY) == false);
+					bool doXNegative = (IsMergedXNegative(l_merged, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY) == false);
+					bool doYPositive = (IsMergedYPositive(l_merged, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY) == false);
+					bool doYNegative = (IsMergedYNegative(l_merged, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY) == false);
+					bool doZPositive = (IsMergedZPositive(l_merged, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY) == false);
+					bool doZNegative = (IsMergedZNegative(l_merged, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY) == false);
+
+					// Front
+					if(doZPositive && ((z == pMatrix->m_matrixSizeZ-1) || z < pMatrix->m_matrixSizeZ-1 && pMatrix->GetActive(x, y, z+1) == false))
 					{
-						doPhase1Merge = positive ? (IsMergedZPositive(merged, blockx + incrementX, blocky, blockz + incrementZ, width, height) == false) : (IsMergedZNegative(merged, blockx + incrementX, blocky, blockz + incrementZ, width, height) == false);
+						int endX = pMatrix->m_matrixSizeX;
+						int endY = pMatrix->m_matrixSizeY;
+
+						UpdateMergedSide(source, l_merged, matrixIndex, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY, &p1, &p2, &p3, &p4, x, y, endX, endY, true, true, false, false);
+
+						n1 = Vector3d(0.0f, 0.0f, 1.0f);
+						v1 = m_pRenderer->AddVertexToMesh(p1, n1, r, g, b, a, pMesh);
+						t1 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 0.0f, pMesh);
+						v2 = m_pRenderer->AddVertexToMesh(p2, n1, r, g, b, a, pMesh);
+						t2 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 0.0f, pMesh);
+						v3 = m_pRenderer->AddVertexToMesh(p3, n1, r, g, b, a, pMesh);
+						t3 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 1.0f, pMesh);
+						v4 = m_pRenderer->AddVertexToMesh(p4, n1, r, g, b, a, pMesh);
+						t4 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 1.0f, pMesh);
+
+						m_pRenderer->AddTriangleToMesh(v1, v2, v3, pMesh);
+						m_pRenderer->AddTriangleToMesh(v1, v3, v4, pMesh);
 					}
-					if(yFace)
+
+					p1 = Vector3d(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					p2 = Vector3d(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					p3 = Vector3d(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					p4 = Vector3d(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					p5 = Vector3d(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+					p6 = Vector3d(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+					p7 = Vector3d(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+					p8 = Vector3d(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+
+					// Back
+					if(doZNegative && ((z == 0) || (z > 0 && pMatrix->GetActive(x, y, z-1) == false)))
 					{
-						doPhase1Merge = positive ? (IsMergedYPositive(merged, blockx + incrementX, blocky, blockz + incrementZ, width, height) == false) : (IsMergedYNegative(merged, blockx + incrementX, blocky, blockz + incrementZ, width, height) == false);
+						int endX = pMatrix->m_matrixSizeX;
+						int endY = pMatrix->m_matrixSizeY;
+
+						UpdateMergedSide(source, l_merged, matrixIndex, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY, &p6, &p5, &p8, &p7, x, y, endX, endY, false, true, false, false);
+
+						n1 = Vector3d(0.0f, 0.0f, -1.0f);
+						v1 = m_pRenderer->AddVertexToMesh(p5, n1, r, g, b, a, pMesh);
+						t1 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 0.0f, pMesh);
+						v2 = m_pRenderer->AddVertexToMesh(p6, n1, r, g, b, a, pMesh);
+						t2 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 0.0f, pMesh);
+						v3 = m_pRenderer->AddVertexToMesh(p7, n1, r, g, b, a, pMesh);
+						t3 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 1.0f, pMesh);
+						v4 = m_pRenderer->AddVertexToMesh(p8, n1, r, g, b, a, pMesh);
+						t4 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 1.0f, pMesh);
+
+						m_pRenderer->AddTriangleToMesh(v1, v2, v3, pMesh);
+						m_pRenderer->AddTriangleToMesh(v1, v3, v4, pMesh);
 					}
-				}
 
-				if(doPhase1Merge)
-				{
-					if(zFace || yFace)
+					p1 = Vector3d(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					p2 = Vector3d(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					p3 = Vector3d(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					p4 = Vector3d(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					p5 = Vector3d(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+					p6 = Vector3d(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+					p7 = Vector3d(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+					p8 = Vector3d(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+
+					// Right
+					if(doXPositive && ((x == pMatrix->m_matrixSizeX-1) || (x < pMatrix->m_matrixSizeX-1 && pMatrix->GetActive(x+1, y, z) == false)))
 					{
-						(*p2).x += change * (BLOCK_RENDER_SIZE * 2.0f);
-						(*p3).x += change * (BLOCK_RENDER_SIZE * 2.0f);
+						int endX = pMatrix->m_matrixSizeZ;
+						int endY = pMatrix->m_matrixSizeY;
+
+						UpdateMergedSide(source, l_merged, matrixIndex, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY, &p5, &p2, &p3, &p8, z, y, endX, endY, true, false, true, false);
+
+						n1 = Vector3d(1.0f, 0.0f, 0.0f);
+						v1 = m_pRenderer->AddVertexToMesh(p2, n1, r, g, b, a, pMesh);
+						t1 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 0.0f, pMesh);
+						v2 = m_pRenderer->AddVertexToMesh(p5, n1, r, g, b, a, pMesh);
+						t2 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 0.0f, pMesh);
+						v3 = m_pRenderer->AddVertexToMesh(p8, n1, r, g, b, a, pMesh);
+						t3 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 1.0f, pMesh);
+						v4 = m_pRenderer->AddVertexToMesh(p3, n1, r, g, b, a, pMesh);
+						t4 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 1.0f, pMesh);
+
+						m_pRenderer->AddTriangleToMesh(v1, v2, v3, pMesh);
+						m_pRenderer->AddTriangleToMesh(v1, v3, v4, pMesh);
 					}
-					if(xFace)
+
+					p1 = Vector3d(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					p2 = Vector3d(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					p3 = Vector3d(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					p4 = Vector3d(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					p5 = Vector3d(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+					p6 = Vector3d(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+					p7 = Vector3d(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+					p8 = Vector3d(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+
+					// Left
+					if(doXNegative && ((x == 0) || (x > 0 && pMatrix->GetActive(x-1, y, z) == false)))
 					{
-						(*p2).z += change * (BLOCK_RENDER_SIZE * 2.0f);
-						(*p3).z += change * (BLOCK_RENDER_SIZE * 2.0f);
+						int endX = pMatrix->m_matrixSizeZ;
+						int endY = pMatrix->m_matrixSizeY;
+
+						UpdateMergedSide(source, l_merged, matrixIndex, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY, &p6, &p1, &p4, &p7, z, y, endX, endY, false, false, true, false);
+
+						n1 = Vector3d(-1.0f, 0.0f, 0.0f);
+						v1 = m_pRenderer->AddVertexToMesh(p6, n1, r, g, b, a, pMesh);
+						t1 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 0.0f, pMesh);
+						v2 = m_pRenderer->AddVertexToMesh(p1, n1, r, g, b, a, pMesh);
+						t2 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 0.0f, pMesh);
+						v3 = m_pRenderer->AddVertexToMesh(p4, n1, r, g, b, a, pMesh);
+						t3 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 1.0f, pMesh);
+						v4 = m_pRenderer->AddVertexToMesh(p7, n1, r, g, b, a, pMesh);
+						t4 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 1.0f, pMesh);
+
+						m_pRenderer->AddTriangleToMesh(v1, v2, v3, pMesh);
+						m_pRenderer->AddTriangleToMesh(v1, v3, v4, pMesh);
 					}
 
-					if(positive)
+					p1 = Vector3d(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					p2 = Vector3d(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					p3 = Vector3d(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					p4 = Vector3d(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					p5 = Vector3d(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+					p6 = Vector3d(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+					p7 = Vector3d(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+					p8 = Vector3d(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+
+					// Top
+					if(doYPositive && ((y == pMatrix->m_matrixSizeY-1) || (y < pMatrix->m_matrixSizeY-1 && pMatrix->GetActive(x, y+1, z) == false)))
 					{
-						if(zFace)
-						{
-							merged[(blockx + incrementX) + blocky*width + (blockz + incrementZ)*width*height] |= MergedSide_Z_Positive;
-						}
-						if(xFace)
-						{
-							merged[(blockx + incrementX) + blocky*width + (blockz + incrementZ)*width*height] |= MergedSide_X_Positive;
-						}
-						if(yFace)
-						{
-							merged[(blockx + incrementX)+ blocky*width + (blockz + incrementZ)*width*height] |= MergedSide_Y_Positive;
-						}
+						int endX = pMatrix->m_matrixSizeX;
+						int endY = pMatrix->m_matrixSizeZ;
+
+						UpdateMergedSide(source, l_merged, matrixIndex, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY, &p7, &p8, &p3, &p4, x, z, endX, endY, true, false, false, true);
+
+						n1 = Vector3d(0.0f, 1.0f, 0.0f);
+						v1 = m_pRenderer->AddVertexToMesh(p4, n1, r, g, b, a, pMesh);
+						t1 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 0.0f, pMesh);
+						v2 = m_pRenderer->AddVertexToMesh(p3, n1, r, g, b, a, pMesh);
+						t2 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 0.0f, pMesh);
+						v3 = m_pRenderer->AddVertexToMesh(p8, n1, r, g, b, a, pMesh);
+						t3 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 1.0f, pMesh);
+						v4 = m_pRenderer->AddVertexToMesh(p7, n1, r, g, b, a, pMesh);
+						t4 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 1.0f, pMesh);
+
+						m_pRenderer->AddTriangleToMesh(v1, v2, v3, pMesh);
+						m_pRenderer->AddTriangleToMesh(v1, v3, v4, pMesh);
 					}
-					else
+
+					p1 = Vector3d(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					p2 = Vector3d(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					p3 = Vector3d(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					p4 = Vector3d(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z+BLOCK_RENDER_SIZE);
+					p5 = Vector3d(x+BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+					p6 = Vector3d(x-BLOCK_RENDER_SIZE, y-BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+					p7 = Vector3d(x-BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+					p8 = Vector3d(x+BLOCK_RENDER_SIZE, y+BLOCK_RENDER_SIZE, z-BLOCK_RENDER_SIZE);
+
+					// Bottom
+					if(doYNegative && ((y == 0) || (y > 0 && pMatrix->GetActive(x, y-1, z) == false)))
 					{
-						if(zFace)
-						{
-							merged[(blockx + incrementX)+ blocky*width + (blockz + incrementZ)*width*height] |= MergedSide_Z_Negative;
-						}
-						if(xFace)
-						{
-							merged[(blockx + incrementX) + blocky*width + (blockz + incrementZ)*width*height] |= MergedSide_X_Negative;
-						}
-						if(yFace)
-						{
-							merged[(blockx + incrementX) + blocky*width + (blockz + incrementZ)*width*height] |= MergedSide_Y_Negative;
-						}
+						int endX = pMatrix->m_matrixSizeX;
+						int endY = pMatrix->m_matrixSizeZ;
+
+						UpdateMergedSide(source, l_merged, matrixIndex, x, y, z, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY, &p6, &p5, &p2, &p1, x, z, endX, endY, false, false, false, true);
+
+						n1 = Vector3d(0.0f, -1.0f, 0.0f);
+						v1 = m_pRenderer->AddVertexToMesh(p6, n1, r, g, b, a, pMesh);
+						t1 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 0.0f, pMesh);
+						v2 = m_pRenderer->AddVertexToMesh(p5, n1, r, g, b, a, pMesh);
+						t2 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 0.0f, pMesh);
+						v3 = m_pRenderer->AddVertexToMesh(p2, n1, r, g, b, a, pMesh);
+						t3 = m_pRenderer->AddTextureCoordinatesToMesh(1.0f, 1.0f, pMesh);
+						v4 = m_pRenderer->AddVertexToMesh(p1, n1, r, g, b, a, pMesh);
+						t4 = m_pRenderer->AddTextureCoordinatesToMesh(0.0f, 1.0f, pMesh);
+
+						m_pRenderer->AddTriangleToMesh(v1, v2, v3, pMesh);
+						m_pRenderer->AddTriangleToMesh(v1, v3, v4, pMesh);
 					}
 				}
-				else
-				{
-					doMore = false;
-				}
 			}
 		}
+	}
 
-		if(zFace || yFace)
-		{
-			incrementX += change;
-		}
-		if(xFace)
-		{
-			incrementZ += change;
-		}
+	// Delete the merged array
+	delete [] l_merged;
+}
 
-		incrementer += change;
+// Bitmask mesher helpers, bit u of a row is stored in word u/64
+static inline unsigned int CountTrailingZeros(unsigned long long value)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanForward64(&index, value);
+	return index;
+#elif defined(_MSC_VER)
+	unsigned long index;
+	if(_BitScanForward(&index, (unsigned long)value))
+	{
+		return index;
 	}
+	_BitScanForward(&index, (unsigned long)(value >> 32));
+	return index + 32;
+#else
+	return __builtin_ctzll(value);
+#endif
+}
 
+static inline unsigned long long GetBitRangeMask(unsigned int start, unsigned int length)
+{
+	unsigned long long mask = (length >= 64) ? ~0ULL : ((1ULL << length) - 1);
+	return mask << start;
+}
 
-	// 2nd phase
-	int loop = incrementer;
-	incrementer = 0;
-	incrementer = incrementY;
-
-	doMore = true;
-	while(doMore)
+// Number of consecutive bits set in both rows, starting from bit start
+static unsigned int CountBitRun(const unsigned long long* pRowA, const unsigned long long* pRowB, unsigned int start, unsigned int end)
+{
+	unsigned int bit = start;
+	while(bit < end)
 	{
-		if(startY + incrementer >= maxY)
+		unsigned int offset = bit & 63;
+		unsigned long long unset = ~(pRowA[bit >> 6] & pRowB[bit >> 6]) >> offset;
+		if(unset != 0)
 		{
-			doMore = false;
+			bit += CountTrailingZeros(unset);
+			break;
 		}
-		else
+		bit += 64 - offset;
+	}
+
+	return ((bit < end) ? bit : end) - start;
+}
+
+static bool IsBitRangeSet(const unsigned long long* pRow, unsigned int start, unsigned int length)
+{
+	while(length > 0)
+	{
+		unsigned int offset = start & 63;
+		unsigned int count = (length < 64 - offset) ? length : 64 - offset;
+		unsigned long long mask = GetBitRangeMask(offset, count);
+		if((pRow[start >> 6] & mask) != mask)
 		{
-			for(int i = 0; i < loop-1; i++)
+			return false;
+		}
+		start += count;
+		length -= count;
+	}
+
+	return true;
+}
+
+static void ClearBitRange(unsigned long long* pRow, unsigned int start, unsigned int length)
+{
+	while(length > 0)
+	{
+		unsigned int offset = start & 63;
+		unsigned int count = (length < 64 - offset) ? length : 64 - offset;
+		pRow[start >> 6] &= ~GetBitRangeMask(offset, count);
+		start += count;
+		length -= count;
+	}
+}
+
+// Per face direction: the axis the face points along, the two axes spanning the face, and the order the
+// quad corners are emitted in (bit 0 = u max, bit 1 = v max), so the winding matches the merged side mesher
+struct BitmaskMesherFace
+{
+	int m_normalAxis;
+	int m_uAxis;
+	int m_vAxis;
+	int m_direction;
+	float m_normal[3];
+	int m_corners[4];
+};
+
+static const BitmaskMesherFace s_bitmaskMesherFaces[6] =
+{
+	{ 0, 2, 1,  1, {  1.0f,  0.0f,  0.0f }, { 1, 0, 2, 3 } },	// Right
+	{ 0, 2, 1, -1, { -1.0f,  0.0f,  0.0f }, { 0, 1, 3, 2 } },	// Left
+	{ 1, 0, 2,  1, {  0.0f,  1.0f,  0.0f }, { 2, 3, 1, 0 } },	// Top
+	{ 1, 0, 2, -1, {  0.0f, -1.0f,  0.0f }, { 0, 1, 3, 2 } },	// Bottom
+	{ 2, 0, 1,  1, {  0.0f,  0.0f,  1.0f }, { 0, 1, 3, 2 } },	// Front
+	{ 2, 0, 1, -1, {  0.0f,  0.0f, -1.0f }, { 1, 0, 2, 3 } },	// Back
+};
+
+static const OpenGLMesh_TextureCoordinate s_quadTextureCoordinates[4] = { { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f }, { 0.0f, 1.0f } };
+
+void QubicleBinary::CreateMatrixMeshBitmask(const QubicleMeshingSource& source, int matrixIndex, OpenGLTriangleMesh* pMesh, int startFace, int endFace)
+{
+	QubicleMatrix* pMatrix = source.m_vpMatrices[matrixIndex];
+
+	const unsigned int* pColour = pMatrix->m_pColour;
+	unsigned int size[3] = { pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeY, pMatrix->m_matrixSizeZ };
+	unsigned int stride[3] = { 1, pMatrix->m_matrixSizeX, pMatrix->m_matrixSizeX*pMatrix->m_matrixSizeY };
+
+	// Single colour meshes ignore the voxel colours, so every face can merge with its neighbours
+	unsigned int colourMask = source.m_singleMeshColour ? 0x00000000 : 0x00FFFFFF;
+
+	// One visible face mask and one 'same colour as the voxel before it' mask per slice, big enough for any face direction
+	unsigned int maxMaskSize = 0;
+	for(int faceIndex = startFace; faceIndex < endFace; faceIndex++)
+	{
+		const BitmaskMesherFace& face = s_bitmaskMesherFaces[faceIndex];
+		unsigned int maskSize = ((size[face.m_uAxis] + 63) / 64) * size[face.m_vAxis];
+		maxMaskSize = (maskSize > maxMaskSize) ? maskSize : maxMaskSize;
+	}
+
+	if(maxMaskSize == 0)
+	{
+		return;
+	}
+
+	unsigned long long* pVisibleMask = new unsigned long long[maxMaskSize];
+	unsigned long long* pEqualMask = new unsigned long long[maxMaskSize];
+
+	float r = 1.0f;
+	float g = 1.0f;
+	float b = 1.0f;
+	float a = 1.0f;
+
+	for(int faceIndex = startFace; faceIndex < endFace; faceIndex++)
+	{
+		const BitmaskMesherFace& face = s_bitmaskMesherFaces[faceIndex];
+
+		unsigned int sizeU = size[face.m_uAxis];
+		unsigned int sizeV = size[face.m_vAxis];
+		unsigned int sizeN = size[face.m_normalAxis];
+		unsigned int strideU = stride[face.m_uAxis];
+		unsigned int strideV = stride[face.m_vAxis];
+		unsigned int strideN = stride[face.m_normalAxis];
+		unsigned int numWords = (sizeU + 63) / 64;
+
+		for(unsigned int slice = 0; slice < sizeN; slice++)
+		{
+			// Faces on the outside of the matrix are always visible, otherwise check the voxel in front of the face
+			bool hasNeighbour = (face.m_direction > 0) ? (slice + 1 < sizeN) : (slice > 0);
+			int neighbourOffset = face.m_direction * (int)strideN;
+
+			memset(pVisibleMask, 0, sizeof(unsigned long long) * numWords * sizeV);
+			memset(pEqualMask, 0, sizeof(unsigned long long) * numWords * sizeV);
+
+			bool anyVisible = false;
+			for(unsigned int v = 0; v < sizeV; v++)
 			{
-				// Don't do any phase 2 merging is we have any inactive blocks or already merged blocks on the row
-				if(zFace)
+				unsigned long long* pVisibleRow = &pVisibleMask[v*numWords];
+				unsigned long long* pEqualRow = &pEqualMask[v*numWords];
+
+				unsigned int index = slice*strideN + v*strideV;
+				for(unsigned int u = 0; u < sizeU; u++, index += strideU)
 				{
-					float r1, r2, g1, g2, b1, b2, a1, a2;
-					GetColour(matrixIndex, blockx, blocky, blockz, &r1, &g1, &b1, &a1);
-					GetColour(matrixIndex, blockx + i, blocky + incrementY, blockz, &r2, &g2, &b2, &a2);
+					unsigned int colour = pColour[index];
 
-					if(positive && (blockz+1) < (int)pMatrix->m_matrixSizeZ && GetActive(matrixIndex, blockx + i, blocky + incrementY, blockz+1) == true)
-					{
-						doMore = false;
-					}
-					else if(!positive && blockz > 0 && GetActive(matrixIndex, blockx + i, blocky + incrementY, blockz-1) == true)
+					if((colour & 0xFF000000) == 0)
 					{
-						doMore = false;
+						continue;
 					}
-					else if(GetActive(matrixIndex, blockx + i, blocky + incrementY, blockz) == false || (positive ? (IsMergedZPositive(merged, blockx + i, blocky + incrementY, blockz, width, height) == true) : (IsMergedZNegative(merged, blockx + i, blocky + incrementY, blockz, width, height) == true)))
+
+					if(hasNeighbour && (pColour[index + neighbourOffset] & 0xFF000000) != 0)
 					{
-						// Failed active or already merged check
-						doMore = false;
+						continue;
 					}
-					/*else if(m_pBlocks[blockx][blocky][blockz].GetBlockType() != m_pBlocks[blockx + i][blocky + incrementY][blockz].GetBlockType())
+
+					pVisibleRow[u >> 6] |= 1ULL << (u & 63);
+					anyVisible = true;
+
+					if(u > 0 && ((colour ^ pColour[index - strideU]) & colourMask) == 0)
 					{
-						// Failed block type check
-						doMore = false;
+						pEqualRow[u >> 6] |= 1ULL << (u & 63);
 					}
-					*/
-					else if((r1 != r2 || g1 != g2 || b1 != b2 || a1 != a2) /*&& allMerge == false*/)
+				}
+			}
+
+			if(anyVisible == false)
+			{
+				continue;
+			}
+
+			// Greedily grow each remaining face into the widest, then tallest, single colour rectangle
+			for(unsigned int v = 0; v < sizeV; v++)
+			{
+				unsigned long long* pVisibleRow = &pVisibleMask[v*numWords];
+				unsigned long long* pEqualRow = &pEqualMask[v*numWords];
+
+				for(unsigned int word = 0; word < numWords; word++)
+				{
+					while(pVisibleRow[word] != 0)
 					{
-						// Failed colour check
-						doMore = false;
+						unsigned int u = word*64 + CountTrailingZeros(pVisibleRow[word]);
+						unsigned int width = 1 + CountBitRun(pVisibleRow, pEqualRow, u + 1, sizeU);
+
+						unsigned int startIndex = slice*strideN + v*strideV + u*strideU;
+						unsigned int colourKey = pColour[startIndex] & colourMask;
+
+						unsigned int height = 1;
+						while(v + height < sizeV)
+						{
+							unsigned int row = v + height;
+							if(IsBitRangeSet(&pVisibleMask[row*numWords], u, width) == false)
+							{
+								break;
+							}
+							if(width > 1 && IsBitRangeSet(&pEqualMask[row*numWords], u + 1, width - 1) == false)
+							{
+								break;
+							}
+							if((pColour[startIndex + height*strideV] & colourMask) != colourKey)
+							{
+								break;
+							}
+							height++;
+						}
+
+						for(unsigned int row = v; row < v + height; row++)
+						{
+							ClearBitRange(&pVisibleMask[row*numWords], u, width);
+						}
+
+						unsigned int position[3];
+						position[face.m_normalAxis] = slice;
+						position[face.m_uAxis] = u;
+						position[face.m_vAxis] = v;
+						GetMeshingColour(source, pMatrix, position[0], position[1], position[2], &r, &g, &b, &a);
+
+						a = 1.0f;
+
+						float planeCoord = slice + face.m_direction*BLOCK_RENDER_SIZE;
+						float uCoords[2] = { u - BLOCK_RENDER_SIZE, u + width - BLOCK_RENDER_SIZE };
+						float vCoords[2] = { v - BLOCK_RENDER_SIZE, v + height - BLOCK_RENDER_SIZE };
+
+						// Write the quad straight into the mesh arrays
+						unsigned int firstVertex = (unsigned int)pMesh->m_vertices.size();
+
+						OpenGLMesh_Vertex vertex;
+						vertex.vertexPosition[face.m_normalAxis] = planeCoord;
+						vertex.vertexNormals[0] = face.m_normal[0];
+						vertex.vertexNormals[1] = face.m_normal[1];
+						vertex.vertexNormals[2] = face.m_normal[2];
+						vertex.vertexColour[0] = r;
+						vertex.vertexColour[1] = g;
+						vertex.vertexColour[2] = b;
+						vertex.vertexColour[3] = a;
+
+						for(int corner = 0; corner < 4; corner++)
+						{
+							vertex.vertexPosition[face.m_uAxis] = uCoords[face.m_corners[corner] & 1];
+							vertex.vertexPosition[face.m_vAxis] = vCoords[face.m_corners[corner] >> 1];
+
+							pMesh->m_vertices.push_back(vertex);
+						}
+
+						if(pMesh->m_meshType == OGLMeshType_Textured)
+						{
+							pMesh->m_textureCoordinates.insert(pMesh->m_textureCoordinates.end(), s_quadTextureCoordinates, s_quadTextureCoordinates + 4);
+						}
+
+						OpenGLMesh_Triangle triangles[2] = { { { firstVertex, firstVertex + 1, firstVertex + 2 } }, { { firstVertex, firstVertex + 2, firstVertex + 3 } } };
+						pMesh->m_triangles.insert(pMesh->m_triangles.end(), triangles, triangles + 2);
 					}
 				}
-				if(xFace)
-				{
-					float r1, r2, g1, g2, b1, b2, a1, a2;
-					GetColour(matrixIndex, blockx, blocky, blockz, &r1, &g1, &b1, &a1);
-					GetColour(matrixIndex, blockx, blocky + incrementY, blockz + i, &r2, &g2, &b2, &a2);
+			}
+		}
+	}
+
+	delete [] pVisibleMask;
+	delete [] pEqualMask;
+}
+
+// Each meshing method produces different geometry, so they get separate cache entries
+unsigned int QubicleBinary::GetMeshCacheVersion()
+{
+	return MESHER_VERSION*16 + m_meshingMethod;
+}
+
+// Every matrix mesh goes into the one merged static buffer, built from the same vertex data, and is drawn from its range
+// of it. Only if the meshes can't be merged does each matrix get a static buffer of its own. The vertex data is released
+// once it's on the GPU, so anything that needs it, like the mesh cache, has to be done before the meshes are finished.
+void QubicleBinary::FinishMesh()
+{
+	// Already uploaded, there's no vertex data left to upload them from again
+	if(AreMeshesFinished())
+	{
+		return;
+	}
+
+	m_vpFinishedMeshes.resize(m_vpMatrices.size());
+	for(unsigned int matrixIndex = 0; matrixIndex < m_vpMatrices.size(); matrixIndex++)
+	{
+		m_vpFinishedMeshes[matrixIndex] = m_vpMatrices[matrixIndex]->m_pMesh;
+	}
+
+	if(m_vpFinishedMeshes.empty() || m_pRenderer->CreateMergedStaticBuffer(m_materialID, &m_vpFinishedMeshes[0], (int)m_vpFinishedMeshes.size(), &m_mergedStaticBufferId) == false)
+	{
+		for(unsigned int matrixIndex = 0; matrixIndex < m_vpMatrices.size(); matrixIndex++)
+		{
+			QubicleMatrix* pMatrix = m_vpMatrices[matrixIndex];
+
+			if(pMatrix->m_pMesh != NULL)
+			{
+				m_pRenderer->FinishMesh(-1, m_materialID, pMatrix->m_pMesh);
+			}
+		}
+
+		if(m_mergedStaticBufferId != (unsigned int)-1)
+		{
+			m_pRenderer->DeleteStaticBuffer(m_mergedStaticBufferId);
+			m_mergedStaticBufferId = -1;
+		}
+	}
+
+	for(unsigned int matrixIndex = 0; matrixIndex < m_vpMatrices.size(); matrixIndex++)
+	{
+		if(m_vpMatrices[matrixIndex]->m_pMesh != NULL)
+		{
+			m_pRenderer->ReleaseMeshData(m_vpMatrices[matrixIndex]->m_pMesh);
+		}
+	}
+}
+
+void QubicleBinary::UpdateMergedSide(const QubicleMeshingSource& source, int *merged, int matrixIndex, int blockx, int blocky, int blockz, int width, int height, Vector3d *p1, Vector3d *p2, Vector3d *p3, Vector3d *p4, int startX, int startY, int maxX, int maxY, bool positive, bool zFace, bool xFace, bool yFace)
+{
+	QubicleMatrix* pMatrix = source.m_vpMatrices[matrixIndex];
+
+	bool doMore = true;
+	unsigned int incrementX = 0;
+	unsigned int incrementZ = 0;
+	unsigned int incrementY = 0;
+
+	int change = 1;
+	if(positive == false)
+	{
+		//change = -1;
+	}
+
+	if(zFace || yFace)
+	{
+		incrementX = 1;
+		incrementY = 1;
+	}
+	if(xFace)
+	{
+		incrementZ = 1;
+		incrementY = 1;
+	}
 
-					if(positive && (blockx+1) < (int)pMatrix->m_matrixSizeX && GetActive(matrixIndex, blockx+1, blocky + incrementY, blockz + i) == true)
+	// 1st phase
+	int incrementer = 1;
+	while(doMore)
+	{
+		if(startX + incrementer >= maxX)
+		{
+			doMore = false;
+		}
+		else
+		{
+			bool doPhase1Merge = true;
+			float r1, r2, g1, g2, b1, b2, a1, a2;
+			GetMeshingColour(source, pMatrix, blockx, blocky, blockz, &r1, &g1, &b1, &a1);
+			GetMeshingColour(source, pMatrix, blockx + incrementX, blocky, blockz + incrementZ, &r2, &g2, &b2, &a2);
+			//if(m_pBlocks[blockx][blocky][blockz].GetBlockType() != m_pBlocks[blockx + incrementX][blocky][blockz + incrementZ].GetBlockType())
+			//{
+				// Don't do any phase 1 merging if we don't have the same block type.
+			//	doPhase1Merge = false;
+			//	doMore = false;
+			//}
+			/*//else*/ if((r1 != r2 || g1 != g2 || b1 != b2 || a1 != a2) /*&& allMerge == false*/)
+			{
+				// Don't do any phase 1 merging if we don't have the same colour variation
+				doPhase1Merge = false;
+				doMore = false;
+			}
+			else
+			{
+				if((xFace && positive && blockx + incrementX+1 == pMatrix->m_matrixSizeX) ||
+				   (xFace && !positive && blockx + incrementX == 0) ||
+				   (yFace && positive && blocky+1 == (int)pMatrix->m_matrixSizeY) ||
+				   (yFace && !positive && blocky == 0) ||
+				   (zFace && positive && blockz + incrementZ+1 == pMatrix->m_matrixSizeZ) ||
+				   (zFace && !positive && blockz + incrementZ == 0))
+				{
+					doPhase1Merge = false;
+					doMore = false;
+				}
+				// Don't do any phase 1 merging if we find an inactive block or already merged block in our path
+				else if(xFace && positive && (blockx + incrementX+1) < pMatrix->m_matrixSizeX && pMatrix->GetActive(blockx + incrementX+1, blocky, blockz + incrementZ) == true)
+				{
+					doPhase1Merge = false;
+					doMore = false;
+				}
+				else if(xFace && !positive && (blockx + incrementX) > 0 && pMatrix->GetActive(blockx + incrementX-1, blocky, blockz + incrementZ) == true)
+				{
+					doPhase1Merge = false;
+					doMore = false;
+				}
+				else if(yFace && positive && (blocky+1) < (int)pMatrix->m_matrixSizeY && pMatrix->GetActive(blockx + incrementX, blocky+1, blockz + incrementZ) == true)
+				{
+					doPhase1Merge = false;
+					doMore = false;
+				}
+				else if(yFace && !positive && blocky > 0 && pMatrix->GetActive(blockx + incrementX, blocky-1, blockz + incrementZ) == true)
+				{
+					doPhase1Merge = false;
+					doMore = false;
+				}
+				else if(zFace && positive && (blockz + incrementZ+1) < pMatrix->m_matrixSizeZ && pMatrix->GetActive(blockx + incrementX, blocky, blockz + incrementZ+1) == true)
+				{
+					doPhase1Merge = false;
+					doMore = false;
+				}
+				else if(zFace && !positive && (blockz + incrementZ) > 0 && pMatrix->GetActive(blockx + incrementX, blocky, blockz + incrementZ-1) == true)
+				{
+					doPhase1Merge = false;
+					doMore = false;
+				}
+				else if(pMatrix->GetActive(blockx + incrementX, blocky, blockz + incrementZ) == false)
+				{
+					doPhase1Merge = false;
+					doMore = false;
+				}
+				else
+				{
+					if(xFace)
 					{
-						doMore = false;
+						doPhase1Merge = positive ? (IsMergedXPositive(merged, blockx + incrementX, blocky, blockz + incrementZ, width, height) == false) : (IsMergedXNegative(merged, blockx + incrementX, blocky, blockz + incrementZ, width, height) == false);
 					}
-					else if(!positive && (blockx) > 0 && GetActive(matrixIndex, blockx-1, blocky + incrementY, blockz + i) == true)
+					if(zFace)
 					{
-						doMore = false;
+						doPhase1Merge = positive ? (IsMergedZPositive(merged, blockx + incrementX, blocky, blockz + incrementZ, width, height) == false) : (IsMergedZNegative(merged, blockx + incrementX, blocky, blockz + incrementZ, width, height) == false);
 					}
-					else if(GetActive(matrixIndex, blockx, blocky + incrementY, blockz + i) == false || (positive ? (IsMergedXPositive(merged, blockx, blocky + incrementY, blockz + i, width, height) == true) : (IsMergedXNegative(merged, blockx, blocky + incrementY, blockz + i, width, height) == true)))
+					if(yFace)
 					{
-						// Failed active or already merged check
-						doMore = false;
+						doPhase1Merge = positive ? (IsMergedYPositive(merged, blockx + incrementX, blocky, blockz + incrementZ, width, height) == false) : (IsMergedYNegative(merged, blockx + incrementX, blocky, blockz + incrementZ, width, height) == false);
 					}
-					/*else if(m_pBlocks[blockx][blocky][blockz].GetBlockType() != m_pBlocks[blockx][blocky + incrementY][blockz + i].GetBlockType())
+				}
+
+				if(doPhase1Merge)
+				{
+					if(zFace || yFace)
 					{
-						// Failed block type check
-						doMore = false;
+						(*p2).x += change * (BLOCK_RENDER_SIZE * 2.0f);
+						(*p3).x += change * (BLOCK_RENDER_SIZE * 2.0f);
 					}
-					*/
-					else if((r1 != r2 || g1 != g2 || b1 != b2 || a1 != a2) /*&& allMerge == false*/)
+					if(xFace)
 					{
-						// Failed colour check
-						doMore = false;
-					}
+						(*p2).z += change * (BLOCK_RENDER_SIZE * 2.0f);
+						(*p3).z += change * (BLOCK_RENDER_SIZE * 2.0f);
+					}
+
+					if(positive)
+					{
+						if(zFace)
+						{
+							merged[(blockx + incrementX) + blocky*width + (blockz + incrementZ)*width*height] |= MergedSide_Z_Positive;
+						}
+						if(xFace)
+						{
+							merged[(blockx + incrementX) + blocky*width + (blockz + incrementZ)*width*height] |= MergedSide_X_Positive;
+						}
+						if(yFace)
+						{
+							merged[(blockx + incrementX)+ blocky*width + (blockz + incrementZ)*width*height] |= MergedSide_Y_Positive;
+						}
+					}
+					else
+					{
+						if(zFace)
+						{
+							merged[(blockx + incrementX)+ blocky*width + (blockz + incrementZ)*width*height] |= MergedSide_Z_Negative;
+						}
+						if(xFace)
+						{
+							merged[(blockx + incrementX) + blocky*width + (blockz + incrementZ)*width*height] |= MergedSide_X_Negative;
+						}
+						if(yFace)
+						{
+							merged[(blockx + incrementX) + blocky*width + (blockz + incrementZ)*width*height] |= MergedSide_Y_Negative;
+						}
+					}
+				}
+				else
+				{
+					doMore = false;
+				}
+			}
+		}
+
+		if(zFace || yFace)
+		{
+			incrementX += change;
+		}
+		if(xFace)
+		{
+			incrementZ += change;
+		}
+
+		incrementer += change;
+	}
+
+
+	// 2nd phase
+	int loop = incrementer;
+	incrementer = 0;
+	incrementer = incrementY;
+
+	doMore = true;
+	while(doMore)
+	{
+		if(startY + incrementer >= maxY)
+		{
+			doMore = false;
+		}
+		else
+		{
+			for(int i = 0; i < loop-1; i++)
+			{
+				// Don't do any phase 2 merging is we have any inactive blocks or already merged blocks on the row
+				if(zFace)
+				{
+					float r1, r2, g1, g2, b1, b2, a1, a2;
+					GetMeshingColour(source, pMatrix, blockx, blocky, blockz, &r1, &g1, &b1, &a1);
+					GetMeshingColour(source, pMatrix, blockx + i, blocky + incrementY, blockz, &r2, &g2, &b2, &a2);
+
+					if(positive && (blockz+1) < (int)pMatrix->m_matrixSizeZ && pMatrix->GetActive(blockx + i, blocky + incrementY, blockz+1) == true)
+					{
+						doMore = false;
+					}
+					else if(!positive && blockz > 0 && pMatrix->GetActive(blockx + i, blocky + incrementY, blockz-1) == true)
+					{
+						doMore = false;
+					}
+					else if(pMatrix->GetActive(blockx + i, blocky + incrementY, blockz) == false || (positive ? (IsMergedZPositive(merged, blockx + i, blocky + incrementY, blockz, width, height) == true) : (IsMergedZNegative(merged, blockx + i, blocky + incrementY, blockz, width, height) == true)))
+					{
+						// Failed active or already merged check
+						doMore = false;
+					}
+					/*else if(m_pBlocks[blockx][blocky][blockz].GetBlockType() != m_pBlocks[blockx + i][blocky + incrementY][blockz].GetBlockType())
+					{
+						// Failed block type check
+						doMore = false;
+					}
+					*/
+					else if((r1 != r2 || g1 != g2 || b1 != b2 || a1 != a2) /*&& allMerge == false*/)
+					{
+						// Failed colour check
+						doMore = false;
+					}
+				}
+				if(xFace)
+				{
+					float r1, r2, g1, g2, b1, b2, a1, a2;
+					GetMeshingColour(source, pMatrix, blockx, blocky, blockz, &r1, &g1, &b1, &a1);
+					GetMeshingColour(source, pMatrix, blockx, blocky + incrementY, blockz + i, &r2, &g2, &b2, &a2);
+
+					if(positive && (blockx+1) < (int)pMatrix->m_matrixSizeX && pMatrix->GetActive(blockx+1, blocky + incrementY, blockz + i) == true)
+					{
+						doMore = false;
+					}
+					else if(!positive && (blockx) > 0 && pMatrix->GetActive(blockx-1, blocky + incrementY, blockz + i) == true)
+					{
+						doMore = false;
+					}
+					else if(pMatrix->GetActive(blockx, blocky + incrementY, blockz + i) == false || (positive ? (IsMergedXPositive(merged, blockx, blocky + incrementY, blockz + i, width, height) == true) : (IsMergedXNegative(merged, blockx, blocky + incrementY, blockz + i, width, height) == true)))
+					{
+						// Failed active or already merged check
+						doMore = false;
+					}
+					/*else if(m_pBlocks[blockx][blocky][blockz].GetBlockType() != m_pBlocks[blockx][blocky + incrementY][blockz + i].GetBlockType())
+					{
+						// Failed block type check
+						doMore = false;
+					}
+					*/
+					else if((r1 != r2 || g1 != g2 || b1 != b2 || a1 != a2) /*&& allMerge == false*/)
+					{
+						// Failed colour check
+						doMore = false;
+					}
 				}
 				if(yFace)
 				{
 					float r1, r2, g1, g2, b1, b2, a1, a2;
-					GetColour(matrixIndex, blockx, blocky, blockz, &r1, &g1, &b1, &a1);
-					GetColour(matrixIndex, blockx + i, blocky, blockz + incrementY, &r2, &g2, &b2, &a2);
+					GetMeshingColour(source, pMatrix, blockx, blocky, blockz, &r1, &g1, &b1, &a1);
+					GetMeshingColour(source, pMatrix, blockx + i, blocky, blockz + incrementY, &r2, &g2, &b2, &a2);
 
-					if(positive && (blocky+1) < (int)pMatrix->m_matrixSizeY && GetActive(matrixIndex, blockx + i, blocky+1, blockz + incrementY) == true)
+					if(positive && (blocky+1) < (int)pMatrix->m_matrixSizeY && pMatrix->GetActive(blockx + i, blocky+1, blockz + incrementY) == true)
 					{
 						doMore = false;
 					}
-					else if(!positive && blocky > 0 && GetActive(matrixIndex, blockx + i, blocky-1, blockz + incrementY) == true)
+					else if(!positive && blocky > 0 && pMatrix->GetActive(blockx + i, blocky-1, blockz + incrementY) == true)
 					{
 						doMore = false;
 					}
-					else if(GetActive(matrixIndex, blockx + i, blocky, blockz + incrementY) == false || (positive ? (IsMergedYPositive(merged, blockx + i, blocky, blockz + incrementY, width, height) == true) : (IsMergedYNegative(merged, blockx + i, blocky, blockz + incrementY, width, height) == true)))
+					else if(pMatrix->GetActive(blockx + i, blocky, blockz + incrementY) == false || (positive ? (IsMergedYPositive(merged, blockx + i, blocky, blockz + incrementY, width, height) == true) : (IsMergedYNegative(merged, blockx + i, blocky, blockz + incrementY, width, height) == true)))
 					{
 						// Failed active or already merged check
 						doMore = false;
@@ -995,248 +1935,777 @@ void QubicleBinary::UpdateMergedSide(int *merged, int matrixIndex, int blockx, i
 						doMore = false;
 					}
 				}
-			}
-
-			if(doMore == true)
-			{
-				if(zFace || xFace)
+			}
+
+			if(doMore == true)
+			{
+				if(zFace || xFace)
+				{
+					(*p3).y += change * (BLOCK_RENDER_SIZE * 2.0f);
+					(*p4).y += change * (BLOCK_RENDER_SIZE * 2.0f);
+				}
+				if(yFace)
+				{
+					(*p3).z += change * (BLOCK_RENDER_SIZE * 2.0f);
+					(*p4).z += change * (BLOCK_RENDER_SIZE * 2.0f);
+				}
+
+				for(int i = 0; i < loop-1; i++)
+				{
+					if(positive)
+					{
+						if(zFace)
+						{
+							merged[(blockx + i) + (blocky + incrementY)*width + blockz*width*height] |= MergedSide_Z_Positive;
+						}
+						if(xFace)
+						{
+							merged[blockx + (blocky + incrementY)*width + (blockz + i)*width*height] |= MergedSide_X_Positive;
+						}
+						if(yFace)
+						{
+							merged[(blockx + i) + blocky*width + (blockz + incrementY)*width*height] |= MergedSide_Y_Positive;
+						}
+					}
+					else
+					{
+						if(zFace)
+						{
+							merged[(blockx + i) + (blocky + incrementY)*width + blockz*width*height] |= MergedSide_Z_Negative;
+						}
+						if(xFace)
+						{
+							merged[blockx + (blocky + incrementY)*width + (blockz + i)*width*height] |= MergedSide_X_Negative;
+						}
+						if(yFace)
+						{
+							merged[(blockx + i) + blocky*width + (blockz + incrementY)*width*height] |= MergedSide_Y_Negative;
+						}
+					}
+				}
+			}
+		}
+
+		incrementY += change;
+		incrementer += change;
+	}
+}
+
+int QubicleBinary::GetNumMatrices()
+{
+	return m_numMatrices;
+}
+
+QubicleMatrix* QubicleBinary::GetQubicleMatrix(int index)
+{
+	return m_vpMatrices[index];
+}
+
+QubicleMatrix* QubicleBinary::GetQubicleMatrix(const char* matrixName)
+{
+	for(unsigned int i = 0; i < m_numMatrices; i++)
+	{
+		if(strcmp(m_vpMatrices[i]->m_name, matrixName) == 0)
+		{
+			return GetQubicleMatrix(i);
+		}
+	}
+
+	return NULL;
+}
+
+const char* QubicleBinary::GetMatrixName(int index)
+{
+	return m_vpMatrices[index]->m_name;
+}
+
+float QubicleBinary::GetMatrixScale(int index)
+{
+	return m_vpMatrices[index]->m_scale;
+}
+
+Vector3d QubicleBinary::GetMatrixOffset(int index)
+{
+	return Vector3d(m_vpMatrices[index]->m_offsetX, m_vpMatrices[index]->m_offsetY, m_vpMatrices[index]->m_offsetZ);
+}
+
+void QubicleBinary::SetupMatrixBones(MS3DAnimator* pSkeleton)
+{
+	for(unsigned int i = 0; i < m_numMatrices; i++)
+	{
+		int boneIndex = pSkeleton->GetModel()->GetBoneIndex(m_vpMatrices[i]->m_name);
+
+		if(boneIndex != -1)
+		{
+			m_vpMatrices[i]->m_boneIndex = boneIndex;
+		}
+	}
+}
+
+void QubicleBinary::SetScaleAndOffsetForMatrix(const char* matrixName, float scale, float xOffset, float yOffset, float zOffset)
+{
+	for(unsigned int i = 0; i < m_numMatrices; i++)
+	{
+		if(strcmp(m_vpMatrices[i]->m_name, matrixName) == 0)
+		{
+			m_vpMatrices[i]->m_scale = scale;
+			m_vpMatrices[i]->m_offsetX = xOffset;
+			m_vpMatrices[i]->m_offsetY = yOffset;
+			m_vpMatrices[i]->m_offsetZ = zOffset;
+		}
+	}
+}
+
+float QubicleBinary::GetScale(const char* matrixName)
+{
+	for(unsigned int i = 0; i < m_numMatrices; i++)
+	{
+		if(strcmp(m_vpMatrices[i]->m_name, matrixName) == 0)
+		{
+			return m_vpMatrices[i]->m_scale;
+		}
+	}
+
+	return 1.0f;
+}
+
+Vector3d QubicleBinary::GetOffset(const char* matrixName)
+{
+	for(unsigned int i = 0; i < m_numMatrices; i++)
+	{
+		if(strcmp(m_vpMatrices[i]->m_name, matrixName) == 0)
+		{
+			return Vector3d(m_vpMatrices[i]->m_offsetX, m_vpMatrices[i]->m_offsetY, m_vpMatrices[i]->m_offsetZ);
+		}
+	}
+
+	return Vector3d(0.0f, 0.0f, 0.0f);
+}
+
+void QubicleBinary::SwapMatrix(const char* matrixName, QubicleMatrix* pMatrix, bool copyMatrixParams)
+{
+	int matrixIndex = GetMatrixIndexForName(matrixName);
+
+	if(matrixIndex != -1)
+	{
+		if(copyMatrixParams)
+		{
+			pMatrix->m_nameLength = m_vpMatrices[matrixIndex]->m_nameLength;
+			pMatrix->m_name = m_vpMatrices[matrixIndex]->m_name;
+			pMatrix->m_boneIndex = m_vpMatrices[matrixIndex]->m_boneIndex;
+			pMatrix->m_scale = m_vpMatrices[matrixIndex]->m_scale;
+			pMatrix->m_offsetX = m_vpMatrices[matrixIndex]->m_offsetX;
+			pMatrix->m_offsetY = m_vpMatrices[matrixIndex]->m_offsetY;
+			pMatrix->m_offsetZ = m_vpMatrices[matrixIndex]->m_offsetZ;
+		}
+
+		m_vpMatrices[matrixIndex]->m_removed = false;
+		m_vpMatrices[matrixIndex] = pMatrix;
+
+		if(m_meshRebuildInFlight)
+		{
+			m_meshRebuildStale = true;
+		}
+	}
+}
+
+void QubicleBinary::AddQubicleMatrix(QubicleMatrix* pNewMatrix, bool copyMatrixParams)
+{
+	// First check if this matrix already exists
+	QubicleMatrix* pExistingMatrix = GetQubicleMatrix(pNewMatrix->m_name);
+	if(pExistingMatrix != NULL)
+	{
+		// Replace existing matrix
+		SwapMatrix(pNewMatrix->m_name, pNewMatrix, copyMatrixParams);
+	}
+	else
+	{
+		// Add new matrix
+		m_vpMatrices.push_back(pNewMatrix);
+		pNewMatrix->m_removed = false;
+		m_numMatrices++;
+
+		if(m_meshRebuildInFlight)
+		{
+			m_meshRebuildStale = true;
+		}
+	}
+}
+
+void QubicleBinary::RemoveQubicleMatrix(const char* matrixName)
+{
+	for(unsigned int i = 0; i < m_vpMatrices.size(); i++)
+	{
+		if(strcmp(m_vpMatrices[i]->m_name, matrixName) == 0)
+		{
+			m_vpMatrices[i]->m_removed = true;
+
+			return;
+		}
+	}
+}
+
+void QubicleBinary::SetQubicleMatrixRender(const char* matrixName, bool render)
+{
+	for(unsigned int i = 0; i < m_vpMatrices.size(); i++)
+	{
+		if(strcmp(m_vpMatrices[i]->m_name, matrixName) == 0)
+		{
+			m_vpMatrices[i]->m_removed = (render == false);
+
+			return;
+		}
+	}
+}
+
+// Sub selection
+string QubicleBinary::GetSubSelectionName(int pickingId)
+{
+	int index = pickingId - SUBSELECTION_NAMEPICKING_OFFSET;
+
+	if(index >= 0 && index <= (int)m_numMatrices-1)
+	{
+		return m_vpMatrices[index]->m_name;
+	}
+
+	return "";
+}
+
+// Rendering modes
+void QubicleBinary::SetWireFrameRender(bool wireframe)
+{
+	m_renderWireFrame = wireframe;
+}
+
+// Update
+void QubicleBinary::Update(float dt)
+{
+	UpdateMeshRebuild();
+}
+
+// Bounds
+// The largest scale a matrix applies along any axis, for taking a bounding sphere through it
+static float GetRenderMatrixMaxScale(const Matrix4x4& matrix)
+{
+	float scaleX = Vector3d(matrix.m[0], matrix.m[1], matrix.m[2]).GetLength();
+	float scaleY = Vector3d(matrix.m[4], matrix.m[5], matrix.m[6]).GetLength();
+	float scaleZ = Vector3d(matrix.m[8], matrix.m[9], matrix.m[10]).GetLength();
+
+	float maxScale = (scaleX > scaleY) ? scaleX : scaleY;
+
+	return (maxScale > scaleZ) ? maxScale : scaleZ;
+}
+
+// Grows a box to hold a sphere, the box starts out as the first sphere
+static void AddSphereToBox(const Vector3d& centre, float radius, bool first, Vector3d* pBoxMin, Vector3d* pBoxMax)
+{
+	Vector3d sphereMin = centre - Vector3d(radius, radius, radius);
+	Vector3d sphereMax = centre + Vector3d(radius, radius, radius);
+
+	if(first)
+	{
+		*pBoxMin = sphereMin;
+		*pBoxMax = sphereMax;
+		return;
+	}
+
+	pBoxMin->x = (sphereMin.x < pBoxMin->x) ? sphereMin.x : pBoxMin->x;
+	pBoxMin->y = (sphereMin.y < pBoxMin->y) ? sphereMin.y : pBoxMin->y;
+	pBoxMin->z = (sphereMin.z < pBoxMin->z) ? sphereMin.z : pBoxMin->z;
+	pBoxMax->x = (sphereMax.x > pBoxMax->x) ? sphereMax.x : pBoxMax->x;
+	pBoxMax->y = (sphereMax.y > pBoxMax->y) ? sphereMax.y : pBoxMax->y;
+	pBoxMax->z = (sphereMax.z > pBoxMax->z) ? sphereMax.z : pBoxMax->z;
+}
+
+void QubicleBinary::GetBoundingSphere(Vector3d* pCentre, float* pRadius)
+{
+	Vector3d boxMin;
+	Vector3d boxMax;
+	bool first = true;
+
+	for(unsigned int i = 0; i < m_numMatrices; i++)
+	{
+		QubicleMatrix* pMatrix = m_vpMatrices[i];
+		if(pMatrix->m_removed == true)
+		{
+			continue;
+		}
+
+		// The same scale and translations as Render() puts the matrix through
+		Vector3d translation(0.5f - (float)pMatrix->m_matrixSizeX*0.5f + pMatrix->m_offsetX, 0.5f - (float)pMatrix->m_matrixSizeY*0.5f + pMatrix->m_offsetY, 0.5f - (float)pMatrix->m_matrixSizeZ*0.5f + pMatrix->m_offsetZ);
+		Vector3d centre = (pMatrix->m_boundingCentre + translation) * pMatrix->m_scale;
+		float radius = pMatrix->m_boundingRadius * fabs(pMatrix->m_scale);
+
+		AddSphereToBox(centre, radius, first, &boxMin, &boxMax);
+		first = false;
+	}
+
+	*pCentre = (boxMin + boxMax) * 0.5f;
+	*pRadius = first ? 0.0f : (boxMax - boxMin).GetLength() * 0.5f;
+}
+
+void QubicleBinary::GetPoseBoundingSphere(MS3DAnimator** pSkeleton, VoxelCharacter* pVoxelCharacter, Vector3d* pCentre, float* pRadius)
+{
+	QubicleMatrixRenderTransform* pRenderTransforms = pVoxelCharacter->GetMatrixRenderTransforms(m_numMatrices);
+
+	Vector3d boxMin;
+	Vector3d boxMax;
+	bool first = true;
+
+	for(unsigned int i = 0; i < m_numMatrices; i++)
+	{
+		if(m_vpMatrices[i]->m_removed == true)
+		{
+			continue;
+		}
+
+		// Composed here for the bounds, RenderWithAnimator() then finds them already up to date
+		UpdateRenderTransform(&pRenderTransforms[i], m_vpMatrices[i], pSkeleton, pVoxelCharacter);
+
+		AddSphereToBox(pRenderTransforms[i].m_boundingCentre, pRenderTransforms[i].m_boundingRadius, first, &boxMin, &boxMax);
+		first = false;
+	}
+
+	*pCentre = (boxMin + boxMax) * 0.5f;
+	*pRadius = first ? 0.0f : (boxMax - boxMin).GetLength() * 0.5f;
+}
+
+//Rendering
+void QubicleBinary::Render(bool renderOutline, bool refelction, bool silhouette, Colour OutlineColour)
+{
+	// The whole model is tested against the view first, the matrices only need testing when it straddles the edge
+	int modelFrustumResult = Frustum::FRUSTUM_INSIDE;
+	if(m_pRenderer->IsFrustumCullingEnabled())
+	{
+		Vector3d boundingCentre;
+		float boundingRadius;
+		GetBoundingSphere(&boundingCentre, &boundingRadius);
+
+		modelFrustumResult = m_pRenderer->ModelSphereInFrustum(boundingCentre, boundingRadius);
+	}
+
+	// Every matrix drawn as a range of the one merged static buffer, which stays bound for the whole model
+	bool mergedRender = (modelFrustumResult != Frustum::FRUSTUM_OUTSIDE && renderOutline == false && silhouette == false && m_pRenderer->IsRecordingRenderQueue() == false && HasMergedStaticBuffer());
+	if(mergedRender)
+	{
+		m_pRenderer->StartMeshRender();
+		mergedRender = m_pRenderer->BeginStaticBufferRanges(m_mergedStaticBufferId);
+		if(mergedRender == false)
+		{
+			m_pRenderer->EndMeshRender();
+		}
+	}
+
+	m_pRenderer->PushMatrix();
+		for(unsigned int i = 0; i < m_numMatrices; i++)
+		{
+			if(m_vpMatrices[i]->m_removed == true)
+			{
+				continue;
+			}
+
+			m_pRenderer->PushMatrix();
+				// Scale for external matrix scale value
+				m_pRenderer->ScaleWorldMatrix(m_vpMatrices[i]->m_scale, m_vpMatrices[i]->m_scale, m_vpMatrices[i]->m_scale);
+
+				// Translate for initial block offset
+				m_pRenderer->TranslateWorldMatrix(0.5f, 0.5f, 0.5f);
+
+				// Translate to center of model
+				m_pRenderer->TranslateWorldMatrix(-(float)m_vpMatrices[i]->m_matrixSizeX*0.5f, -(float)m_vpMatrices[i]->m_matrixSizeY*0.5f, -(float)m_vpMatrices[i]->m_matrixSizeZ*0.5f);
+				
+				// Translate for external matrix offset value
+				m_pRenderer->TranslateWorldMatrix(m_vpMatrices[i]->m_offsetX, m_vpMatrices[i]->m_offsetY, m_vpMatrices[i]->m_offsetZ);
+
+				// Out of view, the model matrix is still stored since lights can be attached to the matrix
+				if(modelFrustumResult == Frustum::FRUSTUM_OUTSIDE || (modelFrustumResult == Frustum::FRUSTUM_INTERSECT &&
+				   m_pRenderer->ModelSphereInFrustum(m_vpMatrices[i]->m_boundingCentre, m_vpMatrices[i]->m_boundingRadius) == Frustum::FRUSTUM_OUTSIDE))
+				{
+					if(refelction == false)
+					{
+						m_pRenderer->GetModelMatrix(&m_vpMatrices[i]->m_modelMatrix);
+					}
+
+					m_pRenderer->PopMatrix();
+					continue;
+				}
+
+				// Drawn later with the rest of the render queue, outlines and silhouettes still draw straight away
+				if(m_pRenderer->IsRecordingRenderQueue() && renderOutline == false && silhouette == false)
+				{
+					if(refelction == false)
+					{
+						m_pRenderer->GetModelMatrix(&m_vpMatrices[i]->m_modelMatrix);
+					}
+
+					SubmitMatrixRenderPacket(m_vpMatrices[i]);
+					m_pRenderer->PopMatrix();
+					continue;
+				}
+
+				// Store cull mode
+				CullMode cullMode = m_pRenderer->GetCullMode();
+
+				if(renderOutline)
+				{
+					m_pRenderer->DisableDepthTest();
+					m_pRenderer->SetLineWidth(3.0f);
+					m_pRenderer->SetCullMode(CM_FRONT);
+					m_pRenderer->SetRenderMode(RM_WIREFRAME);
+					m_pRenderer->ImmediateColourAlpha(OutlineColour.GetRed(), OutlineColour.GetGreen(), OutlineColour.GetBlue(), OutlineColour.GetAlpha());
+				}
+				else if(silhouette)
+				{
+					m_pRenderer->DisableDepthTest();
+					m_pRenderer->SetCullMode(CM_FRONT);
+					m_pRenderer->SetRenderMode(RM_SOLID);
+					m_pRenderer->ImmediateColourAlpha(OutlineColour.GetRed(), OutlineColour.GetGreen(), OutlineColour.GetBlue(), OutlineColour.GetAlpha());
+				}
+				else if(m_renderWireFrame)
 				{
-					(*p3).y += change * (BLOCK_RENDER_SIZE * 2.0f);
-					(*p4).y += change * (BLOCK_RENDER_SIZE * 2.0f);
+					m_pRenderer->SetLineWidth(1.0f);
+					m_pRenderer->SetRenderMode(RM_WIREFRAME);
+					m_pRenderer->SetCullMode(CM_NOCULL);
 				}
-				if(yFace)
+				else
 				{
-					(*p3).z += change * (BLOCK_RENDER_SIZE * 2.0f);
-					(*p4).z += change * (BLOCK_RENDER_SIZE * 2.0f);
+					m_pRenderer->SetRenderMode(RM_SOLID);
 				}
 
-				for(int i = 0; i < loop-1; i++)
+				// Store the model matrix
+				if(refelction == false)
 				{
-					if(positive)
+					m_pRenderer->GetModelMatrix(&m_vpMatrices[i]->m_modelMatrix);
+				}
+
+				m_pRenderer->PushMatrix();
+					if(mergedRender == false)
 					{
-						if(zFace)
-						{
-							merged[(blockx + i) + (blocky + incrementY)*width + blockz*width*height] |= MergedSide_Z_Positive;
-						}
-						if(xFace)
-						{
-							merged[blockx + (blocky + incrementY)*width + (blockz + i)*width*height] |= MergedSide_X_Positive;
-						}
-						if(yFace)
-						{
-							merged[(blockx + i) + blocky*width + (blockz + incrementY)*width*height] |= MergedSide_Y_Positive;
-						}
+						m_pRenderer->StartMeshRender();
+					}
+
+					// Texture manipulation (for shadow rendering)
+					{
+						Matrix4x4 worldMatrix;
+						m_pRenderer->GetModelMatrix(&worldMatrix);
+
+						m_pRenderer->PushTextureMatrix();
+						m_pRenderer->MultiplyWorldMatrix(worldMatrix);
+					}
+
+					if(m_meshAlpha < 1.0f || m_shouldForceTransparency)
+					{
+						m_pRenderer->EnableTransparency(BF_SRC_ALPHA, BF_ONE_MINUS_SRC_ALPHA);
+					}
+					m_pRenderer->EnableMaterial(m_materialID);
+
+					if(renderOutline || silhouette)
+					{
+						m_pRenderer->EndMeshRender();
+						m_pRenderer->RenderMesh_NoColour(m_vpMatrices[i]->m_pMesh);
 					}
 					else
 					{
-						if(zFace)
-						{
-							merged[(blockx + i) + (blocky + incrementY)*width + blockz*width*height] |= MergedSide_Z_Negative;
-						}
-						if(xFace)
+						m_pRenderer->SetMeshTint(GetMeshTint(), m_singleMeshColour);
+						if(mergedRender)
 						{
-							merged[blockx + (blocky + incrementY)*width + (blockz + i)*width*height] |= MergedSide_X_Negative;
+							m_pRenderer->RenderStaticBufferRange(m_vpMatrices[i]->m_pMesh->m_firstIndex, m_vpMatrices[i]->m_pMesh->m_numIndices);
 						}
-						if(yFace)
+						else
 						{
-							merged[(blockx + i) + blocky*width + (blockz + incrementY)*width*height] |= MergedSide_Y_Negative;
+							m_pRenderer->MeshStaticBufferRender(m_vpMatrices[i]->m_pMesh);
 						}
+						m_pRenderer->ClearMeshTint();
+					}
+
+					m_pRenderer->DisableTransparency();
+
+					// Texture manipulation (for shadow rendering)
+					{
+						m_pRenderer->PopTextureMatrix();
+					}
+					if(mergedRender == false)
+					{
+						m_pRenderer->EndMeshRender();
 					}
+				m_pRenderer->PopMatrix();
+
+				// Restore cull mode
+				m_pRenderer->SetCullMode(cullMode);
+
+				if(renderOutline || silhouette)
+				{
+					m_pRenderer->EnableDepthTest(DT_LESS);
 				}
-			}
+			m_pRenderer->PopMatrix();
 		}
+	m_pRenderer->PopMatrix();
 
-		incrementY += change;
-		incrementer += change;
+	if(mergedRender)
+	{
+		m_pRenderer->EndStaticBufferRanges();
+		m_pRenderer->EndMeshRender();
 	}
 }
 
-int QubicleBinary::GetNumMatrices()
-{
-	return m_numMatrices;
-}
-
-QubicleMatrix* QubicleBinary::GetQubicleMatrix(int index)
-{
-	return m_vpMatrices[index];
-}
-
-QubicleMatrix* QubicleBinary::GetQubicleMatrix(const char* matrixName)
+// The same draw as the normal path of Render() and RenderWithAnimator(), as a packet for the render queue
+void QubicleBinary::SubmitMatrixRenderPacket(QubicleMatrix* pMatrix)
 {
-	for(unsigned int i = 0; i < m_numMatrices; i++)
+	RenderPacket packet;
+	packet.m_transparent = (m_meshAlpha < 1.0f || m_shouldForceTransparency);
+	packet.m_materialID = m_materialID;
+	packet.m_staticBufferID = pMatrix->m_pMesh->m_staticMeshId;
+	packet.m_firstIndex = pMatrix->m_pMesh->m_firstIndex;
+	packet.m_numIndices = pMatrix->m_pMesh->m_numIndices;
+	packet.m_tint = GetMeshTint();
+	packet.m_tintReplacesColour = m_singleMeshColour;
+	packet.m_applyTextureMatrix = true;
+
+	if(m_renderWireFrame)
 	{
-		if(strcmp(m_vpMatrices[i]->m_name, matrixName) == 0)
-		{
-			return GetQubicleMatrix(i);
-		}
+		packet.m_renderMode = RM_WIREFRAME;
+		packet.m_cullMode = CM_NOCULL;
+		packet.m_lineWidth = 1.0f;
+	}
+	else
+	{
+		packet.m_renderMode = RM_SOLID;
+		packet.m_cullMode = m_pRenderer->GetCullMode();
 	}
 
-	return NULL;
+	// Depth sorted by the middle of the matrix, voxel i is centred on i
+	Vector3d centre((pMatrix->m_matrixSizeX-1)*0.5f, (pMatrix->m_matrixSizeY-1)*0.5f, (pMatrix->m_matrixSizeZ-1)*0.5f);
+	m_pRenderer->SubmitRenderPacket(&packet, centre);
 }
 
-const char* QubicleBinary::GetMatrixName(int index)
+// CPU versions of the renderer's world matrix manipulations, applied in the same order and with the same arithmetic
+static void TranslateRenderMatrix(Matrix4x4* pMatrix, float x, float y, float z)
 {
-	return m_vpMatrices[index]->m_name;
+	Matrix4x4 translate;
+	translate.SetTranslation(Vector3d(x, y, z));
+	*pMatrix = translate * (*pMatrix);
 }
 
-float QubicleBinary::GetMatrixScale(int index)
+static void RotateRenderMatrix(Matrix4x4* pMatrix, float x, float y, float z)
 {
-	return m_vpMatrices[index]->m_scale;
+	Matrix4x4 rotX;
+	Matrix4x4 rotY;
+	Matrix4x4 rotZ;
+	rotX.SetXRotation(DegToRad(x));
+	rotY.SetYRotation(DegToRad(y));
+	rotZ.SetZRotation(DegToRad(z));
+
+	*pMatrix = rotZ * rotY * rotX * (*pMatrix);
 }
 
-Vector3d QubicleBinary::GetMatrixOffset(int index)
+static void ScaleRenderMatrix(Matrix4x4* pMatrix, float x, float y, float z)
 {
-	return Vector3d(m_vpMatrices[index]->m_offsetX, m_vpMatrices[index]->m_offsetY, m_vpMatrices[index]->m_offsetZ);
+	Matrix4x4 scale;
+	scale.SetScale(Vector3d(x, y, z));
+	*pMatrix = scale * (*pMatrix);
 }
 
-void QubicleBinary::SetupMatrixBones(MS3DAnimator* pSkeleton)
+static void MultiplyRenderMatrix(Matrix4x4* pMatrix, Matrix4x4 matrix)
 {
-	for(unsigned int i = 0; i < m_numMatrices; i++)
-	{
-		int boneIndex = pSkeleton->GetModel()->GetBoneIndex(m_vpMatrices[i]->m_name);
-
-		if(boneIndex != -1)
-		{
-			m_vpMatrices[i]->m_boneIndex = boneIndex;
-		}
-	}
+	*pMatrix = matrix * (*pMatrix);
 }
 
-void QubicleBinary::SetScaleAndOffsetForMatrix(const char* matrixName, float scale, float xOffset, float yOffset, float zOffset)
+static Matrix4x4 GetLookingMatrix(Vector3d lForward)
 {
-	for(unsigned int i = 0; i < m_numMatrices; i++)
+	Vector3d lUp = Vector3d(0.0f, 1.0f, 0.0f);
+	Vector3d lRight = Vector3d::CrossProduct(lUp, lForward).GetUnit();
+	lUp = Vector3d::CrossProduct(lForward, lRight).GetUnit();
+
+	float lMatrix[16] =
 	{
-		if(strcmp(m_vpMatrices[i]->m_name, matrixName) == 0)
-		{
-			m_vpMatrices[i]->m_scale = scale;
-			m_vpMatrices[i]->m_offsetX = xOffset;
-			m_vpMatrices[i]->m_offsetY = yOffset;
-			m_vpMatrices[i]->m_offsetZ = zOffset;
-		}
-	}
+		lRight.x, lRight.y, lRight.z, 0.0f,
+		lUp.x, lUp.y, lUp.z, 0.0f,
+		lForward.x, lForward.y, lForward.z, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f
+	};
+	Matrix4x4 lookingMat;
+	lookingMat.SetValues(lMatrix);
+
+	return lookingMat;
 }
 
-float QubicleBinary::GetScale(const char* matrixName)
+// Brings a matrix's cached render transform up to date, only composing it again if one of its inputs has changed
+void QubicleBinary::UpdateRenderTransform(QubicleMatrixRenderTransform* pTransform, QubicleMatrix* pMatrix, MS3DAnimator** pSkeleton, VoxelCharacter* pVoxelCharacter)
 {
-	for(unsigned int i = 0; i < m_numMatrices; i++)
+	int boneIndex = pMatrix->m_boneIndex;
+
+	// Scale for external matrix scale value, translate for initial block offset, to the center of the model and for the external matrix offset value
+	if(pTransform->m_pMatrix != pMatrix || pTransform->m_scale != pMatrix->m_scale ||
+	   pTransform->m_offsetX != pMatrix->m_offsetX || pTransform->m_offsetY != pMatrix->m_offsetY || pTransform->m_offsetZ != pMatrix->m_offsetZ)
 	{
-		if(strcmp(m_vpMatrices[i]->m_name, matrixName) == 0)
-		{
-			return m_vpMatrices[i]->m_scale;
-		}
+		pTransform->m_pMatrix = pMatrix;
+		pTransform->m_scale = pMatrix->m_scale;
+		pTransform->m_offsetX = pMatrix->m_offsetX;
+		pTransform->m_offsetY = pMatrix->m_offsetY;
+		pTransform->m_offsetZ = pMatrix->m_offsetZ;
+
+		pTransform->m_offsetMatrix.LoadIdentity();
+		ScaleRenderMatrix(&pTransform->m_offsetMatrix, pMatrix->m_scale, pMatrix->m_scale, pMatrix->m_scale);
+		TranslateRenderMatrix(&pTransform->m_offsetMatrix, 0.5f, 0.5f, 0.5f);
+		TranslateRenderMatrix(&pTransform->m_offsetMatrix, -(float)pMatrix->m_matrixSizeX*0.5f, -(float)pMatrix->m_matrixSizeY*0.5f, -(float)pMatrix->m_matrixSizeZ*0.5f);
+		TranslateRenderMatrix(&pTransform->m_offsetMatrix, pMatrix->m_offsetX, pMatrix->m_offsetY, pMatrix->m_offsetZ);
+
+		pTransform->m_valid = false;
 	}
 
-	return 1.0f;
-}
+	// Head and upper body look, each section tilts by a different amount
+	AnimationSections section = pVoxelCharacter->GetAnimationSectionForBone(boneIndex);
+	MS3DAnimator* pSkeletonToUse = pSkeleton[section];
 
-Vector3d QubicleBinary::GetOffset(const char* matrixName)
-{
-	for(unsigned int i = 0; i < m_numMatrices; i++)
+	float lookRotation = 0.0f;
+	float lookzTranslate = 0.0f;
+	if(section == AnimationSections_Head_Body)
 	{
-		if(strcmp(m_vpMatrices[i]->m_name, matrixName) == 0)
-		{
-			return Vector3d(m_vpMatrices[i]->m_offsetX, m_vpMatrices[i]->m_offsetY, m_vpMatrices[i]->m_offsetZ);
-		}
+		lookRotation = pVoxelCharacter->GetHeadAndUpperBodyLookRotation()*0.65f;
+		lookzTranslate = pVoxelCharacter->GetHeadAndUpperBodyLookzTranslate();
+	}
+	else if(section == AnimationSections_Left_Arm_Hand || section == AnimationSections_Right_Arm_Hand)
+	{
+		lookRotation = pVoxelCharacter->GetHeadAndUpperBodyLookRotation();
+	}
+	else if(section == AnimationSections_Legs_Feet)
+	{
+		lookRotation = pVoxelCharacter->GetHeadAndUpperBodyLookRotation()*0.3f;
+		lookzTranslate = pVoxelCharacter->GetHeadAndUpperBodyLookzTranslate();
 	}
 
-	return Vector3d(0.0f, 0.0f, 0.0f);
-}
+	bool breathing = pVoxelCharacter->IsBreathingAnimationStarted();
+	float breathingOffset = 0.0f;
+	if(breathing && boneIndex != -1)
+	{
+		breathingOffset = pVoxelCharacter->GetBreathingAnimationOffsetForBone(boneIndex);
+	}
 
-void QubicleBinary::SwapMatrix(const char* matrixName, QubicleMatrix* pMatrix, bool copyMatrixParams)
-{
-	int matrixIndex = GetMatrixIndexForName(matrixName);
+	// Body and hands/shoulders follow the face looking direction part of the way, and the head follows it fully
+	bool bodyLooking = false;
+	bool faceLooking = false;
+	if(boneIndex != -1)
+	{
+		bodyLooking = (boneIndex == pVoxelCharacter->GetBodyBoneIndex() ||
+					   boneIndex == pVoxelCharacter->GetLeftShoulderBoneIndex() ||
+					   boneIndex == pVoxelCharacter->GetLeftHandBoneIndex() ||
+					   boneIndex == pVoxelCharacter->GetRightShoulderBoneIndex() ||
+					   boneIndex == pVoxelCharacter->GetRightHandBoneIndex());
+		faceLooking = (boneIndex == pVoxelCharacter->GetHeadBoneIndex());
+	}
+	Vector3d faceLookingDirection = (bodyLooking || faceLooking) ? pVoxelCharacter->GetFaceLookingDirection() : Vector3d(0.0f, 0.0f, 0.0f);
 
-	if(matrixIndex != -1)
+	unsigned int poseVersion = 0;
+	Vector3d boneScale = Vector3d(0.0f, 0.0f, 0.0f);
+	if(boneIndex != -1)
 	{
-		if(copyMatrixParams)
-		{
-			pMatrix->m_nameLength = m_vpMatrices[matrixIndex]->m_nameLength;
-			pMatrix->m_name = m_vpMatrices[matrixIndex]->m_name;
-			pMatrix->m_boneIndex = m_vpMatrices[matrixIndex]->m_boneIndex;
-			pMatrix->m_scale = m_vpMatrices[matrixIndex]->m_scale;
-			pMatrix->m_offsetX = m_vpMatrices[matrixIndex]->m_offsetX;
-			pMatrix->m_offsetY = m_vpMatrices[matrixIndex]->m_offsetY;
-			pMatrix->m_offsetZ = m_vpMatrices[matrixIndex]->m_offsetZ;
-		}
+		poseVersion = pSkeletonToUse->GetPoseVersion();
+		boneScale = pVoxelCharacter->GetBoneScale();
+	}
 
-		m_vpMatrices[matrixIndex]->m_removed = false;
-		m_vpMatrices[matrixIndex] = pMatrix;
+	if(pTransform->m_valid &&
+	   pTransform->m_pSkeleton == pSkeletonToUse &&
+	   pTransform->m_poseVersion == poseVersion &&
+	   pTransform->m_lookRotation == lookRotation &&
+	   pTransform->m_lookzTranslate == lookzTranslate &&
+	   pTransform->m_breathing == breathing &&
+	   pTransform->m_breathingOffset == breathingOffset &&
+	   pTransform->m_faceLookingDirection == faceLookingDirection &&
+	   pTransform->m_boneScale == boneScale)
+	{
+		return;
 	}
-}
 
-void QubicleBinary::AddQubicleMatrix(QubicleMatrix* pNewMatrix, bool copyMatrixParams)
-{
-	// First check if this matrix already exists
-	QubicleMatrix* pExistingMatrix = GetQubicleMatrix(pNewMatrix->m_name);
-	if(pExistingMatrix != NULL)
+	Matrix4x4* pRenderMatrix = &pTransform->m_renderMatrix;
+	pRenderMatrix->LoadIdentity();
+
+	if(section != AnimationSections_FullBody)
 	{
-		// Replace existing matrix
-		SwapMatrix(pNewMatrix->m_name, pNewMatrix, copyMatrixParams);
+		TranslateRenderMatrix(pRenderMatrix, 0.0f, 0.0f, -lookzTranslate);
+		RotateRenderMatrix(pRenderMatrix, lookRotation, 0.0f, 0.0f);
+		TranslateRenderMatrix(pRenderMatrix, 0.0f, 0.0f, lookzTranslate);
 	}
-	else
+
+	// Breathing animation
+	if(breathing)
 	{
-		// Add new matrix
-		m_vpMatrices.push_back(pNewMatrix);
-		pNewMatrix->m_removed = false;
-		m_numMatrices++;
+		TranslateRenderMatrix(pRenderMatrix, 0.0f, breathingOffset, 0.0f);
 	}
-}
 
-void QubicleBinary::RemoveQubicleMatrix(const char* matrixName)
-{
-	for(unsigned int i = 0; i < m_vpMatrices.size(); i++)
+	// Body and hands/shoulders looking direction
+	if(bodyLooking)
 	{
-		if(strcmp(m_vpMatrices[i]->m_name, matrixName) == 0)
-		{
-			m_vpMatrices[i]->m_removed = true;
+		Vector3d lForward = faceLookingDirection.GetUnit();
+		lForward.y = 0.0f;
+		lForward.Normalize();
+		Vector3d forwardDiff = lForward - Vector3d(0.0f, 0.0f, 1.0f);
+		lForward = (Vector3d(0.0f, 0.0f, 1.0f) + (forwardDiff*0.5f)).GetUnit();
 
-			return;
-		}
+		MultiplyRenderMatrix(pRenderMatrix, GetLookingMatrix(lForward));
 	}
-}
 
-void QubicleBinary::SetQubicleMatrixRender(const char* matrixName, bool render)
-{
-	for(unsigned int i = 0; i < m_vpMatrices.size(); i++)
+	// Translate by attached bone matrix
+	if(boneIndex != -1)
 	{
-		if(strcmp(m_vpMatrices[i]->m_name, matrixName) == 0)
-		{
-			m_vpMatrices[i]->m_removed = (render == false);
-
-			return;
-		}
+		Matrix4x4 boneMatrix = pSkeletonToUse->GetBoneMatrix(boneIndex);
+		ScaleRenderMatrix(pRenderMatrix, boneScale.x, boneScale.y, boneScale.z);
+		MultiplyRenderMatrix(pRenderMatrix, boneMatrix);
+		ScaleRenderMatrix(pRenderMatrix, 1.0f/boneScale.x, 1.0f/boneScale.y, 1.0f/boneScale.z);
 	}
-}
 
-// Sub selection
-string QubicleBinary::GetSubSelectionName(int pickingId)
-{
-	int index = pickingId - SUBSELECTION_NAMEPICKING_OFFSET;
+	// Rotation due to 3dsmax export affecting the bone rotations
+	RotateRenderMatrix(pRenderMatrix, 0.0f, 0.0f, -90.0f);
 
-	if(index >= 0 && index <= (int)m_numMatrices-1)
+	// Face looking direction
+	if(faceLooking)
 	{
-		return m_vpMatrices[index]->m_name;
+		MultiplyRenderMatrix(pRenderMatrix, GetLookingMatrix(faceLookingDirection.GetUnit()));
 	}
 
-	return "";
+	MultiplyRenderMatrix(pRenderMatrix, pTransform->m_offsetMatrix);
+
+	// Read after GetBoneMatrix(), which can evaluate the rest of the skeleton
+	pTransform->m_pSkeleton = pSkeletonToUse;
+	pTransform->m_poseVersion = (boneIndex != -1) ? pSkeletonToUse->GetPoseVersion() : 0;
+	pTransform->m_lookRotation = lookRotation;
+	pTransform->m_lookzTranslate = lookzTranslate;
+	pTransform->m_breathing = breathing;
+	pTransform->m_breathingOffset = breathingOffset;
+	pTransform->m_faceLookingDirection = faceLookingDirection;
+	pTransform->m_boneScale = boneScale;
+	pTransform->m_valid = true;
+
+	pTransform->m_boundingCentre = pTransform->m_renderMatrix * pMatrix->m_boundingCentre;
+	pTransform->m_boundingRadius = pMatrix->m_boundingRadius * GetRenderMatrixMaxScale(pTransform->m_renderMatrix);
 }
 
-// Rendering modes
-void QubicleBinary::SetWireFrameRender(bool wireframe)
+void QubicleBinary::RenderWithAnimator(MS3DAnimator** pSkeleton, VoxelCharacter* pVoxelCharacter, bool renderOutline, bool refelction, bool silhouette, Colour OutlineColour, bool subSelectionNamePicking, bool cullMatrices)
 {
-	m_renderWireFrame = wireframe;
-}
+	if(pVoxelCharacter == NULL)
+	{
+		return;
+	}
 
-// Update
-void QubicleBinary::Update(float dt)
-{
+	QubicleMatrixRenderTransform* pRenderTransforms = pVoxelCharacter->GetMatrixRenderTransforms(m_numMatrices);
 
-}
+	// The whole model in one draw, with each matrix's render transform as a bone
+	if(pVoxelCharacter->IsSkinnedRendering() && renderOutline == false && silhouette == false && subSelectionNamePicking == false && IsSkinnedRenderingSupported() && HasMergedStaticBuffer())
+	{
+		RenderSkinnedWithAnimator(pSkeleton, pVoxelCharacter, pRenderTransforms, refelction);
+		return;
+	}
+
+	// Otherwise every matrix is drawn as a range of the merged static buffer, which stays bound for the whole model
+	bool mergedRender = (renderOutline == false && silhouette == false && subSelectionNamePicking == false && m_pRenderer->IsRecordingRenderQueue() == false && HasMergedStaticBuffer());
 
-//Rendering
-void QubicleBinary::Render(bool renderOutline, bool refelction, bool silhouette, Colour OutlineColour)
-{
 	m_pRenderer->PushMatrix();
+		m_pRenderer->StartMeshRender();
+
+		if(mergedRender)
+		{
+			mergedRender = m_pRenderer->BeginStaticBufferRanges(m_mergedStaticBufferId);
+		}
+
 		for(unsigned int i = 0; i < m_numMatrices; i++)
 		{
 			if(m_vpMatrices[i]->m_removed == true)
@@ -1244,18 +2713,39 @@ void QubicleBinary::Render(bool renderOutline, bool refelction, bool silhouette,
 				continue;
 			}
 
+			if(subSelectionNamePicking)
+			{
+				m_pRenderer->LoadNameOntoStack(SUBSELECTION_NAMEPICKING_OFFSET + i);
+			}
+
+			// Look, breathing, bone and offset transforms all in one, only recomposed when the character's pose has changed
+			UpdateRenderTransform(&pRenderTransforms[i], m_vpMatrices[i], pSkeleton, pVoxelCharacter);
+
+			if(cullMatrices && m_pRenderer->ModelSphereInFrustum(pRenderTransforms[i].m_boundingCentre, pRenderTransforms[i].m_boundingRadius) == Frustum::FRUSTUM_OUTSIDE)
+			{
+				if(subSelectionNamePicking)
+				{
+					m_pRenderer->EndNameStack();
+				}
+
+				continue;
+			}
+
 			m_pRenderer->PushMatrix();
-				// Scale for external matrix scale value
-				m_pRenderer->ScaleWorldMatrix(m_vpMatrices[i]->m_scale, m_vpMatrices[i]->m_scale, m_vpMatrices[i]->m_scale);
+				m_pRenderer->MultiplyWorldMatrix(pRenderTransforms[i].m_renderMatrix);
 
-				// Translate for initial block offset
-				m_pRenderer->TranslateWorldMatrix(0.5f, 0.5f, 0.5f);
+				// Drawn later with the rest of the render queue, outlines, silhouettes and name picking still draw straight away
+				if(m_pRenderer->IsRecordingRenderQueue() && renderOutline == false && silhouette == false && subSelectionNamePicking == false)
+				{
+					if(refelction == false)
+					{
+						m_pRenderer->GetModelMatrix(&m_vpMatrices[i]->m_modelMatrix);
+					}
 
-				// Translate to center of model
-				m_pRenderer->TranslateWorldMatrix(-(float)m_vpMatrices[i]->m_matrixSizeX*0.5f, -(float)m_vpMatrices[i]->m_matrixSizeY*0.5f, -(float)m_vpMatrices[i]->m_matrixSizeZ*0.5f);
-				
-				// Translate for external matrix offset value
-				m_pRenderer->TranslateWorldMatrix(m_vpMatrices[i]->m_offsetX, m_vpMatrices[i]->m_offsetY, m_vpMatrices[i]->m_offsetZ);
+					SubmitMatrixRenderPacket(m_vpMatrices[i]);
+					m_pRenderer->PopMatrix();
+					continue;
+				}
 
 				// Store cull mode
 				CullMode cullMode = m_pRenderer->GetCullMode();
@@ -1292,42 +2782,46 @@ void QubicleBinary::Render(bool renderOutline, bool refelction, bool silhouette,
 					m_pRenderer->GetModelMatrix(&m_vpMatrices[i]->m_modelMatrix);
 				}
 
-				m_pRenderer->PushMatrix();
-					m_pRenderer->StartMeshRender();
-
-					// Texture manipulation (for shadow rendering)
-					{
-						Matrix4x4 worldMatrix;
-						m_pRenderer->GetModelMatrix(&worldMatrix);
+				// Texture manipulation (for shadow rendering)
+				{
+					Matrix4x4 worldMatrix;
+					m_pRenderer->GetModelMatrix(&worldMatrix);
 
-						m_pRenderer->PushTextureMatrix();
-						m_pRenderer->MultiplyWorldMatrix(worldMatrix);
-					}
+					m_pRenderer->PushTextureMatrix();
+					m_pRenderer->MultiplyWorldMatrix(worldMatrix);
+				}
 
-					if(m_meshAlpha < 1.0f || m_shouldForceTransparency)
-					{
-						m_pRenderer->EnableTransparency(BF_SRC_ALPHA, BF_ONE_MINUS_SRC_ALPHA);
-					}
-					m_pRenderer->EnableMaterial(m_materialID);
+				if(m_meshAlpha < 1.0f || m_shouldForceTransparency)
+				{
+					m_pRenderer->EnableTransparency(BF_SRC_ALPHA, BF_ONE_MINUS_SRC_ALPHA);
+				}
+				m_pRenderer->EnableMaterial(m_materialID);
 
-					if(renderOutline || silhouette)
+				if(renderOutline || silhouette)
+				{
+					m_pRenderer->EndMeshRender();
+					m_pRenderer->RenderMesh_NoColour(m_vpMatrices[i]->m_pMesh);
+				}
+				else
+				{
+					m_pRenderer->SetMeshTint(GetMeshTint(), m_singleMeshColour);
+					if(mergedRender)
 					{
-						m_pRenderer->EndMeshRender();
-						m_pRenderer->RenderMesh_NoColour(m_vpMatrices[i]->m_pMesh);
+						m_pRenderer->RenderStaticBufferRange(m_vpMatrices[i]->m_pMesh->m_firstIndex, m_vpMatrices[i]->m_pMesh->m_numIndices);
 					}
 					else
 					{
 						m_pRenderer->MeshStaticBufferRender(m_vpMatrices[i]->m_pMesh);
 					}
+					m_pRenderer->ClearMeshTint();
+				}
 
-					m_pRenderer->DisableTransparency();
+				m_pRenderer->DisableTransparency();
 
-					// Texture manipulation (for shadow rendering)
-					{
-						m_pRenderer->PopTextureMatrix();
-					}
-					m_pRenderer->EndMeshRender();
-				m_pRenderer->PopMatrix();
+				// Texture manipulation (for shadow rendering)
+				{
+					m_pRenderer->PopTextureMatrix();
+				}
 
 				// Restore cull mode
 				m_pRenderer->SetCullMode(cullMode);
@@ -1337,250 +2831,159 @@ void QubicleBinary::Render(bool renderOutline, bool refelction, bool silhouette,
 					m_pRenderer->EnableDepthTest(DT_LESS);
 				}
 			m_pRenderer->PopMatrix();
+
+			if(subSelectionNamePicking)
+			{
+				m_pRenderer->EndNameStack();
+			}
 		}
+
+		if(mergedRender)
+		{
+			m_pRenderer->EndStaticBufferRanges();
+		}
+
+		m_pRenderer->EndMeshRender();
 	m_pRenderer->PopMatrix();
 }
 
-void QubicleBinary::RenderWithAnimator(MS3DAnimator** pSkeleton, VoxelCharacter* pVoxelCharacter, bool renderOutline, bool refelction, bool silhouette, Colour OutlineColour, bool subSelectionNamePicking)
+// Whether the matrix meshes are still the ones FinishMesh() last uploaded
+bool QubicleBinary::AreMeshesFinished()
 {
-	if(pVoxelCharacter == NULL)
+	if(m_vpFinishedMeshes.empty() || m_vpFinishedMeshes.size() != m_vpMatrices.size())
 	{
-		return;
+		return false;
 	}
 
-	m_pRenderer->PushMatrix();
-		m_pRenderer->StartMeshRender();
-
-		for(unsigned int i = 0; i < m_numMatrices; i++)
+	for(unsigned int i = 0; i < m_vpMatrices.size(); i++)
+	{
+		if(m_vpMatrices[i]->m_pMesh != m_vpFinishedMeshes[i])
 		{
-			if(m_vpMatrices[i]->m_removed == true)
-			{
-				continue;
-			}
-
-			if(subSelectionNamePicking)
-			{
-				m_pRenderer->LoadNameOntoStack(SUBSELECTION_NAMEPICKING_OFFSET + i);
-			}
-
-			m_pRenderer->PushMatrix();
-				MS3DAnimator* pSkeletonToUse = pSkeleton[AnimationSections_FullBody];			
-				if(m_vpMatrices[i]->m_boneIndex == pVoxelCharacter->GetHeadBoneIndex() ||
-				   m_vpMatrices[i]->m_boneIndex == pVoxelCharacter->GetBodyBoneIndex())
-				{
-					pSkeletonToUse = pSkeleton[AnimationSections_Head_Body];
-
-					m_pRenderer->TranslateWorldMatrix(0.0f, 0.0f, -pVoxelCharacter->GetHeadAndUpperBodyLookzTranslate());
-					m_pRenderer->RotateWorldMatrix(pVoxelCharacter->GetHeadAndUpperBodyLookRotation()*0.65f, 0.0f, 0.0f);
-					m_pRenderer->TranslateWorldMatrix(0.0f, 0.0f, pVoxelCharacter->GetHeadAndUpperBodyLookzTranslate());
-				}
-				else if(m_vpMatrices[i]->m_boneIndex == pVoxelCharacter->GetLeftShoulderBoneIndex() ||
-						m_vpMatrices[i]->m_boneIndex == pVoxelCharacter->GetLeftHandBoneIndex())
-				{
-					pSkeletonToUse = pSkeleton[AnimationSections_Left_Arm_Hand];
-
-					//m_pRenderer->TranslateWorldMatrix(0.0f, 0.0f, -pVoxelCharacter->GetHeadAndUpperBodyLookzTranslate());
-					m_pRenderer->RotateWorldMatrix(pVoxelCharacter->GetHeadAndUpperBodyLookRotation(), 0.0f, 0.0f);
-					//m_pRenderer->TranslateWorldMatrix(0.0f, 0.0f, pVoxelCharacter->GetHeadAndUpperBodyLookzTranslate());
-				}
-				else if(m_vpMatrices[i]->m_boneIndex == pVoxelCharacter->GetRightShoulderBoneIndex() ||
-						m_vpMatrices[i]->m_boneIndex == pVoxelCharacter->GetRightHandBoneIndex())
-				{
-					pSkeletonToUse = pSkeleton[AnimationSections_Right_Arm_Hand];
-
-					//m_pRenderer->TranslateWorldMatrix(0.0f, 0.0f, -pVoxelCharacter->GetHeadAndUpperBodyLookzTranslate());
-					m_pRenderer->RotateWorldMatrix(pVoxelCharacter->GetHeadAndUpperBodyLookRotation(), 0.0f, 0.0f);
-					//m_pRenderer->TranslateWorldMatrix(0.0f, 0.0f, pVoxelCharacter->GetHeadAndUpperBodyLookzTranslate());
-				}
-				else if(m_vpMatrices[i]->m_boneIndex == pVoxelCharacter->GetLegsBoneIndex() ||
-						m_vpMatrices[i]->m_boneIndex == pVoxelCharacter->GetRightFootBoneIndex() ||
-						m_vpMatrices[i]->m_boneIndex == pVoxelCharacter->GetLeftFootBoneIndex())
-				{
-					pSkeletonToUse = pSkeleton[AnimationSections_Legs_Feet];
-
-					m_pRenderer->TranslateWorldMatrix(0.0f, 0.0f, -pVoxelCharacter->GetHeadAndUpperBodyLookzTranslate());
-					m_pRenderer->RotateWorldMatrix(pVoxelCharacter->GetHeadAndUpperBodyLookRotation()*0.3f, 0.0f, 0.0f);
-					m_pRenderer->TranslateWorldMatrix(0.0f, 0.0f, pVoxelCharacter->GetHeadAndUpperBodyLookzTranslate());
-				}
-
-				m_pRenderer->PushMatrix();
-					// Breathing animation
-					if(pVoxelCharacter->IsBreathingAnimationStarted())
-					{
-						float offsetAmount = 0.0f;
-						if(m_vpMatrices[i]->m_boneIndex != -1)
-						{
-							offsetAmount = pVoxelCharacter->GetBreathingAnimationOffsetForBone(m_vpMatrices[i]->m_boneIndex);
-						}
-
-						m_pRenderer->TranslateWorldMatrix(0.0f, offsetAmount, 0.0f);
-					}
-
-					// Body and hands/shoulders looking direction
-					if(m_vpMatrices[i]->m_boneIndex != -1)
-					{
-						if( m_vpMatrices[i]->m_boneIndex == pVoxelCharacter->GetBodyBoneIndex() ||
-							m_vpMatrices[i]->m_boneIndex == pVoxelCharacter->GetLeftShoulderBoneIndex() ||
-							m_vpMatrices[i]->m_boneIndex == pVoxelCharacter->GetLeftHandBoneIndex() ||
-							m_vpMatrices[i]->m_boneIndex == pVoxelCharacter->GetRightShoulderBoneIndex() ||
-							m_vpMatrices[i]->m_boneIndex == pVoxelCharacter->GetRightHandBoneIndex() )
-						{
-							Vector3d lForward = pVoxelCharacter->GetFaceLookingDirection().GetUnit();
-							lForward.y = 0.0f;
-							lForward.Normalize();
-							Vector3d forwardDiff = lForward - Vector3d(0.0f, 0.0f, 1.0f);
-							lForward = (Vector3d(0.0f, 0.0f, 1.0f) + (forwardDiff*0.5f)).GetUnit();
-
-							Vector3d lUp = Vector3d(0.0f, 1.0f, 0.0f);
-							Vector3d lRight = Vector3d::CrossProduct(lUp, lForward).GetUnit();
-							lUp = Vector3d::CrossProduct(lForward, lRight).GetUnit();
-
-							float lMatrix[16] =
-							{
-								lRight.x, lRight.y, lRight.z, 0.0f,
-								lUp.x, lUp.y, lUp.z, 0.0f,
-								lForward.x, lForward.y, lForward.z, 0.0f,
-								0.0f, 0.0f, 0.0f, 1.0f
-							};
-							Matrix4x4 lookingMat;
-							lookingMat.SetValues(lMatrix);
-							m_pRenderer->MultiplyWorldMatrix(lookingMat);
-						}
-					}
-
-					// Translate by attached bone matrix
-					if(m_vpMatrices[i]->m_boneIndex != -1)
-					{
-						Matrix4x4 boneMatrix = pSkeletonToUse->GetBoneMatrix(m_vpMatrices[i]->m_boneIndex);
-						Vector3d boneScale = pVoxelCharacter->GetBoneScale();
-						m_pRenderer->ScaleWorldMatrix(boneScale.x, boneScale.y, boneScale.z);
-						m_pRenderer->MultiplyWorldMatrix(boneMatrix);
-						m_pRenderer->ScaleWorldMatrix(1.0f/boneScale.x, 1.0f/boneScale.y, 1.0f/boneScale.z);
-					}
+			return false;
+		}
+	}
 
-					// Rotation due to 3dsmax export affecting the bone rotations
-					m_pRenderer->RotateWorldMatrix(0.0f, 0.0f, -90.0f);
+	return true;
+}
 
-					// Face looking direction
-					if(m_vpMatrices[i]->m_boneIndex != -1)
-					{
-						if(m_vpMatrices[i]->m_boneIndex == pVoxelCharacter->GetHeadBoneIndex())
-						{
-							Vector3d lForward = pVoxelCharacter->GetFaceLookingDirection().GetUnit();
-							Vector3d lUp = Vector3d(0.0f, 1.0f, 0.0f);
-							Vector3d lRight = Vector3d::CrossProduct(lUp, lForward).GetUnit();
-							lUp = Vector3d::CrossProduct(lForward, lRight).GetUnit();
+// Whether every matrix is still drawn from the merged static buffer, with the bone index it was merged with
+bool QubicleBinary::HasMergedStaticBuffer()
+{
+	if(m_mergedStaticBufferId == (unsigned int)-1 || m_vpMatrices.size() != m_numMatrices || AreMeshesFinished() == false)
+	{
+		return false;
+	}
 
-							float lMatrix[16] =
-							{
-								lRight.x, lRight.y, lRight.z, 0.0f,
-								lUp.x, lUp.y, lUp.z, 0.0f,
-								lForward.x, lForward.y, lForward.z, 0.0f,
-								0.0f, 0.0f, 0.0f, 1.0f
-							};
-							Matrix4x4 lookingMat;
-							lookingMat.SetValues(lMatrix);
-							m_pRenderer->MultiplyWorldMatrix(lookingMat);
-						}
-					}
+	for(unsigned int i = 0; i < m_numMatrices; i++)
+	{
+		OpenGLTriangleMesh* pMesh = m_vpMatrices[i]->m_pMesh;
+		if(pMesh == NULL || pMesh->m_staticMeshId != m_mergedStaticBufferId)
+		{
+			return false;
+		}
+	}
 
-					// Scale for external matrix scale value
-					m_pRenderer->ScaleWorldMatrix(m_vpMatrices[i]->m_scale, m_vpMatrices[i]->m_scale, m_vpMatrices[i]->m_scale);
+	return true;
+}
 
-					// Translate for initial block offset
-					m_pRenderer->TranslateWorldMatrix(0.5f, 0.5f, 0.5f);
+// Every matrix needs a bone in the skinning shader
+bool QubicleBinary::IsSkinnedRenderingSupported()
+{
+	return m_pRenderer->IsSkinnedRenderingSupported() && m_numMatrices <= Renderer::MAX_SKINNING_BONES;
+}
 
-					// Translate to center of model
-					m_pRenderer->TranslateWorldMatrix(-(float)m_vpMatrices[i]->m_matrixSizeX*0.5f, -(float)m_vpMatrices[i]->m_matrixSizeY*0.5f, -(float)m_vpMatrices[i]->m_matrixSizeZ*0.5f);
+// The normal path of RenderWithAnimator() as a single skinned draw. The shadow texture matrix isn't applied, the skinning shader doesn't use it.
+// A transparent model is drawn in matrix order, as it is outside of the render queue, rather than with its matrices depth sorted.
+void QubicleBinary::RenderSkinnedWithAnimator(MS3DAnimator** pSkeleton, VoxelCharacter* pVoxelCharacter, QubicleMatrixRenderTransform* pRenderTransforms, bool refelction)
+{
+	Matrix4x4 modelMatrix;
+	m_pRenderer->GetModelMatrix(&modelMatrix);
 
-					// Translate for external matrix offset value
-					m_pRenderer->TranslateWorldMatrix(m_vpMatrices[i]->m_offsetX, m_vpMatrices[i]->m_offsetY, m_vpMatrices[i]->m_offsetZ);
+	for(unsigned int i = 0; i < m_numMatrices; i++)
+	{
+		if(m_vpMatrices[i]->m_removed == true)
+		{
+			continue;
+		}
 
-					// Store cull mode
-					CullMode cullMode = m_pRenderer->GetCullMode();
+		UpdateRenderTransform(&pRenderTransforms[i], m_vpMatrices[i], pSkeleton, pVoxelCharacter);
 
-					if(renderOutline)
-					{
-						m_pRenderer->DisableDepthTest();
-						m_pRenderer->SetLineWidth(3.0f);
-						m_pRenderer->SetCullMode(CM_FRONT);
-						m_pRenderer->SetRenderMode(RM_WIREFRAME);
-						m_pRenderer->ImmediateColourAlpha(OutlineColour.GetRed(), OutlineColour.GetGreen(), OutlineColour.GetBlue(), OutlineColour.GetAlpha());
-					}
-					else if(silhouette)
-					{
-						m_pRenderer->DisableDepthTest();
-						m_pRenderer->SetCullMode(CM_FRONT);
-						m_pRenderer->SetRenderMode(RM_SOLID);
-						m_pRenderer->ImmediateColourAlpha(OutlineColour.GetRed(), OutlineColour.GetGreen(), OutlineColour.GetBlue(), OutlineColour.GetAlpha());
-					}
-					else if(m_renderWireFrame)
-					{
-						m_pRenderer->SetLineWidth(1.0f);
-						m_pRenderer->SetRenderMode(RM_WIREFRAME);
-						m_pRenderer->SetCullMode(CM_NOCULL);
-					}
-					else
-					{
-						m_pRenderer->SetRenderMode(RM_SOLID);
-					}
+		// Store the model matrix, as MultiplyWorldMatrix() would have left it
+		if(refelction == false)
+		{
+			m_vpMatrices[i]->m_modelMatrix = pRenderTransforms[i].m_renderMatrix * modelMatrix;
+		}
+	}
 
-					// Store the model matrix
-					if(refelction == false)
-					{
-						m_pRenderer->GetModelMatrix(&m_vpMatrices[i]->m_modelMatrix);
-					}
+	bool transparent = (m_meshAlpha < 1.0f || m_shouldForceTransparency);
 
-					// Texture manipulation (for shadow rendering)
-					{
-						Matrix4x4 worldMatrix;
-						m_pRenderer->GetModelMatrix(&worldMatrix);
+	if(m_pRenderer->IsRecordingRenderQueue())
+	{
+		// The render transforms belong to the character, so they are still there when the queue is flushed
+		RenderPacket packet;
+		packet.m_transparent = transparent;
+		packet.m_materialID = m_materialID;
+		packet.m_tint = GetMeshTint();
+		packet.m_tintReplacesColour = m_singleMeshColour;
+		packet.m_drawCallback = [this, pRenderTransforms]() { DrawSkinnedStaticBuffer(pRenderTransforms); };
+
+		if(m_renderWireFrame)
+		{
+			packet.m_renderMode = RM_WIREFRAME;
+			packet.m_cullMode = CM_NOCULL;
+			packet.m_lineWidth = 1.0f;
+		}
+		else
+		{
+			packet.m_renderMode = RM_SOLID;
+			packet.m_cullMode = m_pRenderer->GetCullMode();
+		}
 
-						m_pRenderer->PushTextureMatrix();
-						m_pRenderer->MultiplyWorldMatrix(worldMatrix);
-					}
+		m_pRenderer->SubmitRenderPacket(&packet, Vector3d(0.0f, 0.0f, 0.0f));
+		return;
+	}
 
-					if(m_meshAlpha < 1.0f || m_shouldForceTransparency)
-					{
-						m_pRenderer->EnableTransparency(BF_SRC_ALPHA, BF_ONE_MINUS_SRC_ALPHA);
-					}
-					m_pRenderer->EnableMaterial(m_materialID);
+	// Store cull mode
+	CullMode cullMode = m_pRenderer->GetCullMode();
 
-					if(renderOutline || silhouette)
-					{
-						m_pRenderer->EndMeshRender();
-						m_pRenderer->RenderMesh_NoColour(m_vpMatrices[i]->m_pMesh);
-					}
-					else
-					{
-						m_pRenderer->MeshStaticBufferRender(m_vpMatrices[i]->m_pMesh);
-					}
+	if(m_renderWireFrame)
+	{
+		m_pRenderer->SetLineWidth(1.0f);
+		m_pRenderer->SetRenderMode(RM_WIREFRAME);
+		m_pRenderer->SetCullMode(CM_NOCULL);
+	}
+	else
+	{
+		m_pRenderer->SetRenderMode(RM_SOLID);
+	}
 
-					m_pRenderer->DisableTransparency();
+	if(transparent)
+	{
+		m_pRenderer->EnableTransparency(BF_SRC_ALPHA, BF_ONE_MINUS_SRC_ALPHA);
+	}
+	m_pRenderer->EnableMaterial(m_materialID);
 
-					// Texture manipulation (for shadow rendering)
-					{
-						m_pRenderer->PopTextureMatrix();
-					}
+	m_pRenderer->SetMeshTint(GetMeshTint(), m_singleMeshColour);
+	m_pRenderer->StartMeshRender();
+	DrawSkinnedStaticBuffer(pRenderTransforms);
+	m_pRenderer->EndMeshRender();
+	m_pRenderer->ClearMeshTint();
 
-					// Restore cull mode
-					m_pRenderer->SetCullMode(cullMode);
+	m_pRenderer->DisableTransparency();
 
-					if(renderOutline || silhouette)
-					{
-						m_pRenderer->EnableDepthTest(DT_LESS);
-					}
-				m_pRenderer->PopMatrix();
+	// Restore cull mode
+	m_pRenderer->SetCullMode(cullMode);
+}
 
-				if(subSelectionNamePicking)
-				{
-					m_pRenderer->EndNameStack();
-				}
-			m_pRenderer->PopMatrix();
-		}
+void QubicleBinary::DrawSkinnedStaticBuffer(QubicleMatrixRenderTransform* pRenderTransforms)
+{
+	const Matrix4x4* pBoneMatrices[Renderer::MAX_SKINNING_BONES];
+	for(unsigned int i = 0; i < m_numMatrices; i++)
+	{
+		pBoneMatrices[i] = (m_vpMatrices[i]->m_removed == true) ? NULL : &pRenderTransforms[i].m_renderMatrix;
+	}
 
-		m_pRenderer->EndMeshRender();
-	m_pRenderer->PopMatrix();
+	m_pRenderer->RenderSkinnedStaticBuffer(m_mergedStaticBufferId, pBoneMatrices, m_numMatrices);
 }
 
 void QubicleBinary::RenderSingleMatrix(MS3DAnimator** pSkeleton, VoxelCharacter* pVoxelCharacter, string matrixName, bool renderOutline, bool silhouette, Colour OutlineColour)
@@ -1780,7 +3183,9 @@ void QubicleBinary::RenderSingleMatrix(MS3DAnimator** pSkeleton, VoxelCharacter*
 				}
 				else
 				{
+					m_pRenderer->SetMeshTint(GetMeshTint(), m_singleMeshColour);
 					m_pRenderer->MeshStaticBufferRender(m_vpMatrices[matrixIndex]->m_pMesh);
+					m_pRenderer->ClearMeshTint();
 				}
 
 				m_pRenderer->DisableTransparency();
@@ -2085,7 +3490,9 @@ void QubicleBinary::RenderPaperdoll(MS3DAnimator* pSkeleton, VoxelCharacter* pVo
 
 				m_pRenderer->EnableMaterial(m_materialID);
 
+				m_pRenderer->SetMeshTint(GetMeshTint(), m_singleMeshColour);
 				m_pRenderer->MeshStaticBufferRender(m_vpMatrices[i]->m_pMesh);
+				m_pRenderer->ClearMeshTint();
 
 				// Texture manipulation (for shadow rendering)
 				{
@@ -2212,7 +3619,9 @@ void QubicleBinary::RenderPortrait(MS3DAnimator* pSkeleton, VoxelCharacter* pVox
 
 				m_pRenderer->EnableMaterial(m_materialID);
 
+				m_pRenderer->SetMeshTint(GetMeshTint(), m_singleMeshColour);
 				m_pRenderer->MeshStaticBufferRender(m_vpMatrices[matrixIndex]->m_pMesh);
+				m_pRenderer->ClearMeshTint();
 
 				// Texture manipulation (for shadow rendering)
 				{
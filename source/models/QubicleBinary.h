@@ -18,7 +18,12 @@
 #include "MS3DModel.h"
 #include "MS3DAnimator.h"
 
+#include <atomic>
+#include <thread>
+
 class VoxelCharacter;
+class QubicleMeshCache;
+class WorkerPool;
 
 enum MergedSide
 {
@@ -32,6 +37,12 @@ enum MergedSide
 	MergedSide_Z_Negative = 32,
 };
 
+enum QubicleMeshingMethod
+{
+	QubicleMeshingMethod_MergedSide = 0,
+	QubicleMeshingMethod_Bitmask,
+};
+
 bool IsMergedXNegative(int *merged, int x, int y, int z, int width, int height);
 bool IsMergedXPositive(int *merged, int x, int y, int z, int width, int height);
 bool IsMergedYNegative(int *merged, int x, int y, int z, int width, int height);
@@ -39,6 +50,10 @@ bool IsMergedYPositive(int *merged, int x, int y, int z, int width, int height);
 bool IsMergedZNegative(int *merged, int x, int y, int z, int width, int height);
 bool IsMergedZPositive(int *merged, int x, int y, int z, int width, int height);
 
+// Decodes run length encoded .qb voxel data into a caller provided colour buffer, advancing *ppRead past the consumed tokens
+bool DecodeQubicleRLESlice(const unsigned char** ppRead, const unsigned char* pEnd, unsigned int* pSlice, unsigned int sliceSize);
+bool DecodeQubicleRLEMatrix(const unsigned char** ppRead, const unsigned char* pEnd, unsigned int* pColour, unsigned int sizeX, unsigned int sizeY, unsigned int sizeZ);
+
 class QubicleMatrix
 {
 public:
@@ -66,6 +81,10 @@ public:
 
 	bool m_removed;
 
+	// Bounds of the solid voxels, in the space the mesh is built in. Worked out at import.
+	Vector3d m_boundingCentre;
+	float m_boundingRadius;
+
 	OpenGLTriangleMesh* m_pMesh;
 
 	void GetColour(int x, int y, int z, float* r, float* g, float* b, float* a)
@@ -107,6 +126,77 @@ public:
 
 typedef std::vector<QubicleMatrix*> QubicleMatrixList;
 
+// A character's render transform for one matrix of its model, composed on the CPU so the matrix can be drawn
+// with a single matrix multiply. The model is shared between characters, so these belong to the character and
+// are only rebuilt when one of the inputs they were built from changes.
+class QubicleMatrixRenderTransform
+{
+public:
+	QubicleMatrixRenderTransform()
+	{
+		m_pMatrix = NULL;
+		m_pSkeleton = NULL;
+		m_valid = false;
+	}
+
+	// Everything from the character's render origin to the voxels of the matrix
+	Matrix4x4 m_renderMatrix;
+	bool m_valid;
+
+	// The matrix's bounds taken through m_renderMatrix, in the character's space
+	Vector3d m_boundingCentre;
+	float m_boundingRadius;
+
+	// The matrix scale and offset part, which only changes if the matrix is swapped or has its scale and offset set
+	Matrix4x4 m_offsetMatrix;
+	QubicleMatrix* m_pMatrix;
+	float m_scale;
+	float m_offsetX;
+	float m_offsetY;
+	float m_offsetZ;
+
+	// The animation inputs m_renderMatrix was built from, the ones that don't apply to the matrix's bone are left at zero
+	MS3DAnimator* m_pSkeleton;
+	unsigned int m_poseVersion;
+	float m_lookRotation;
+	float m_lookzTranslate;
+	bool m_breathing;
+	float m_breathingOffset;
+	Vector3d m_faceLookingDirection;
+	Vector3d m_boneScale;
+};
+
+// A unit of meshing work, either a whole matrix or a range of face directions from a large matrix
+class QubicleMeshingTask
+{
+public:
+	int m_matrixIndex;
+	int m_startFace;
+	int m_endFace;
+	OpenGLTriangleMesh* m_pMesh;
+};
+
+// Everything the meshers read. CreateMesh() meshes the model's own matrices, a background rebuild meshes copies of the
+// voxels and settings taken when it was started, so the model can carry on being edited and rendered while it runs.
+class QubicleMeshingSource
+{
+public:
+	vector<QubicleMatrix*> m_vpMatrices;
+	bool m_copiedMatrices;
+
+	// Room to reserve for each new mesh, a rebuild usually ends up close to the size of the previous mesh
+	vector<int> m_vNumVertices;
+	vector<int> m_vNumTriangles;
+
+	QubicleMeshingMethod m_meshingMethod;
+	WorkerPool* m_pWorkerPool;
+
+	bool m_singleMeshColour;
+	float m_meshSingleColourR;
+	float m_meshSingleColourG;
+	float m_meshSingleColourB;
+};
+
 
 class QubicleBinary
 {
@@ -120,6 +210,8 @@ public:
 
 	void Reset();
 
+	void SetMeshCache(QubicleMeshCache* pMeshCache);
+
 	string GetFileName();
 
 	unsigned int GetMaterial();
@@ -129,7 +221,8 @@ public:
 	int GetMatrixIndexForName(const char* matrixName);
 	void GetMatrixPosition(int index, int* aX, int* aY, int* aZ);
 
-	bool Import(const char* fileName);
+	bool Import(const char* fileName, bool finishMesh = true);
+	bool ImportFromMemory(const unsigned char* pData, unsigned int dataSize);
 	bool Export(const char* fileName);
 
 	void GetColour(int matrixIndex, int x, int y, int z, float* r, float* g, float* b, float* a);
@@ -141,8 +234,22 @@ public:
 	void SetMeshSingleColour(float r, float g, float b);
 	void SetForceTransparency(bool force);
 
-	void CreateMesh();
-	void UpdateMergedSide(int *merged, int matrixIndex, int blockx, int blocky, int blockz, int width, int height, Vector3d *p1, Vector3d *p2, Vector3d *p3, Vector3d *p4, int startX, int startY, int maxX, int maxY, bool positive, bool zFace, bool xFace, bool yFace);
+	void SetMeshingMethod(QubicleMeshingMethod method);
+	QubicleMeshingMethod GetMeshingMethod();
+
+	// The matrices are meshed in parallel on this pool, NULL goes back to the pool that every model shares
+	void SetMeshingWorkerPool(WorkerPool* pWorkerPool);
+	WorkerPool* GetMeshingWorkerPool();
+
+	void CreateMesh(bool finishMesh = true);
+	void FinishMesh();
+
+	// Rebuilds the meshes on a background thread from a copy of the voxels, the current meshes keep rendering until
+	// Update() swaps the new ones in. Rebuilds asked for while one is in flight are coalesced into one more afterwards.
+	void RebuildMeshAsync();
+	bool IsMeshRebuilding();
+
+	void UpdateMergedSide(const QubicleMeshingSource& source, int *merged, int matrixIndex, int blockx, int blocky, int blockz, int width, int height, Vector3d *p1, Vector3d *p2, Vector3d *p3, Vector3d *p4, int startX, int startY, int maxX, int maxY, bool positive, bool zFace, bool xFace, bool yFace);
 
 	int GetNumMatrices();
 	QubicleMatrix* GetQubicleMatrix(int index);
@@ -171,9 +278,16 @@ public:
 	// Update
 	void Update(float dt);
 
+	// Bounds
+	// The matrices as placed by Render(), and as posed by the character for RenderWithAnimator()
+	void GetBoundingSphere(Vector3d* pCentre, float* pRadius);
+	void GetPoseBoundingSphere(MS3DAnimator** pSkeleton, VoxelCharacter* pVoxelCharacter, Vector3d* pCentre, float* pRadius);
+
 	// Rendering
+	// Matrices outside of the view are culled when the renderer has frustum culling enabled. RenderWithAnimator() leaves the
+	// whole model test to the character, cullMatrices is only needed when the character's bounds straddle the edge of the view.
 	void Render(bool renderOutline, bool refelction, bool silhouette, Colour OutlineColour);
-	void RenderWithAnimator(MS3DAnimator** pSkeleton, VoxelCharacter* pVoxelCharacter, bool renderOutline, bool refelction, bool silhouette, Colour OutlineColour, bool subSelectionNamePicking);
+	void RenderWithAnimator(MS3DAnimator** pSkeleton, VoxelCharacter* pVoxelCharacter, bool renderOutline, bool refelction, bool silhouette, Colour OutlineColour, bool subSelectionNamePicking, bool cullMatrices = false);
 	void RenderSingleMatrix(MS3DAnimator** pSkeleton, VoxelCharacter* pVoxelCharacter, string matrixName, bool renderOutline, bool silhouette, Colour OutlineColour);
 	void RenderFace(MS3DAnimator* pSkeleton, VoxelCharacter* pVoxelCharacter, bool transparency, bool useScale = true, bool useTranslate = true);
 	void RenderPaperdoll(MS3DAnimator* pSkeleton, VoxelCharacter* pVoxelCharacter);
@@ -184,12 +298,48 @@ protected:
 
 private:
 	/* Private methods */
+	void CreateMeshingSource(QubicleMeshingSource* pSource, bool copyMatrices);
+	void ReleaseMeshingSource(QubicleMeshingSource* pSource);
+	void BuildMatrixMeshes(const QubicleMeshingSource& source, vector<OpenGLTriangleMesh*>& vpNewMeshes);
+	void CreateMatrixMeshMergedSide(const QubicleMeshingSource& source, int matrixIndex, OpenGLTriangleMesh* pMesh);
+	void CreateMatrixMeshBitmask(const QubicleMeshingSource& source, int matrixIndex, OpenGLTriangleMesh* pMesh, int startFace = 0, int endFace = 6);
+	void AppendMesh(OpenGLTriangleMesh* pMesh, OpenGLTriangleMesh* pSourceMesh);
+	void SwapMatrixMesh(int matrixIndex, OpenGLTriangleMesh* pNewMesh);
+
+	void UpdateMeshRebuild();
+	void CancelMeshRebuild();
+
+	bool IsValidMatrixSize(QubicleMatrix* pMatrix);
+	void CalculateMatrixBounds(QubicleMatrix* pMatrix);
+
+	void SubmitMatrixRenderPacket(QubicleMatrix* pMatrix);
+
+	void UpdateRenderTransform(QubicleMatrixRenderTransform* pTransform, QubicleMatrix* pMatrix, MS3DAnimator** pSkeleton, VoxelCharacter* pVoxelCharacter);
+
+	Colour GetMeshTint();
+
+	bool AreMeshesFinished();
+	bool HasMergedStaticBuffer();
+	bool IsSkinnedRenderingSupported();
+	void RenderSkinnedWithAnimator(MS3DAnimator** pSkeleton, VoxelCharacter* pVoxelCharacter, QubicleMatrixRenderTransform* pRenderTransforms, bool refelction);
+	void DrawSkinnedStaticBuffer(QubicleMatrixRenderTransform* pRenderTransforms);
+
+	unsigned int GetMeshCacheVersion();
 
 public:
 	/* Public members */
 	static const float BLOCK_RENDER_SIZE;
 	static const int SUBSELECTION_NAMEPICKING_OFFSET = 10000000;
 
+	// Bump whenever CreateMesh output changes, so that stale cooked meshes are not used
+	static const unsigned int MESHER_VERSION = 2;
+
+	// Matrices with at least this many voxels are meshed as one task per face direction
+	static const unsigned int MESHING_TASK_SPLIT_VOXELS = 32*32*32;
+
+	// Imported matrices larger than this are rejected as corrupt, rather than trusting the header with the allocation
+	static const unsigned int MAX_MATRIX_VOXELS = 256*256*256;
+
 protected:
 	/* Protected members */
 
@@ -229,4 +379,27 @@ private:
 
 	// Material
 	unsigned int m_materialID;
+
+	// Meshing
+	QubicleMeshingMethod m_meshingMethod;
+	WorkerPool* m_pMeshingWorkerPool;
+
+	// Background mesh rebuild. The thread only reads m_meshRebuildSource and only writes m_vpRebuiltMeshes, which belong
+	// to it until m_meshRebuildReady is set. Stale means the matrices were swapped or added since the source was taken.
+	std::thread m_meshRebuildThread;
+	std::atomic<bool> m_meshRebuildReady;
+	bool m_meshRebuildInFlight;
+	bool m_meshRebuildPending;
+	bool m_meshRebuildStale;
+	QubicleMeshingSource m_meshRebuildSource;
+	vector<OpenGLTriangleMesh*> m_vpRebuiltMeshes;
+
+	// Cooked mesh cache
+	QubicleMeshCache* m_pMeshCache;
+
+	// Every matrix mesh merged into one static buffer by FinishMesh(), which also keeps the meshes it uploaded, in bone order.
+	// The meshes keep no static buffers of their own, each draws its range of this one, or the whole model is one skinned
+	// draw. Stays -1 if the meshes can't be merged, in which case the matrices are drawn from their own static buffers.
+	unsigned int m_mergedStaticBufferId;
+	vector<OpenGLTriangleMesh*> m_vpFinishedMeshes;
 };
@@ -16,24 +16,63 @@
 #include "QubicleBinaryManager.h"
 
 
-QubicleBinaryManager::QubicleBinaryManager(Renderer* pRenderer)
+QubicleBinaryManager::QubicleBinaryManager(Renderer* pRenderer, int numLoadingThreads)
 {
 	m_pRenderer = pRenderer;
+
+	m_pPlaceholderQubicleBinary = NULL;
+
+	m_pMeshCache = NULL;
+
+	if(numLoadingThreads < 0)
+	{
+		numLoadingThreads = (int)std::thread::hardware_concurrency() - 1;
+		if(numLoadingThreads < 1)
+		{
+			numLoadingThreads = 1;
+		}
+	}
+	m_numLoadingThreads = numLoadingThreads;
+	m_stopLoadingThreads = false;
 }
 
 QubicleBinaryManager::~QubicleBinaryManager()
 {
 	ClearQubicleBinaryList();
+
+	delete m_pMeshCache;
 }
 
 void QubicleBinaryManager::ClearQubicleBinaryList()
 {
+	StopLoadingThreads();
+
+	m_loadQueue.clear();
+	m_uploadQueue.clear();
+
+	// Requests that never completed still own their model
+	std::map<string, QubicleBinaryRequest*>::iterator iter;
+	for(iter = m_requestMap.begin(); iter != m_requestMap.end(); ++iter)
+	{
+		QubicleBinaryRequest* pRequest = iter->second;
+
+		if(pRequest->IsReady() == false)
+		{
+			delete pRequest->m_pQubicleBinary;
+		}
+
+		delete pRequest;
+	}
+	m_requestMap.clear();
+
 	for(unsigned int i = 0; i < m_vpQubicleBinaryList.size(); i++)
 	{
 		delete m_vpQubicleBinaryList[i];
 		m_vpQubicleBinaryList[i] = 0;
 	}
 	m_vpQubicleBinaryList.clear();
+
+	m_pPlaceholderQubicleBinary = NULL;
 }
 
 QubicleBinary* QubicleBinaryManager::GetQubicleBinaryFile(const char* fileName, bool refreshModel)
@@ -52,15 +91,326 @@ QubicleBinary* QubicleBinaryManager::GetQubicleBinaryFile(const char* fileName,
 		}
 	}
 
+	// If this file is already being loaded asynchronously, finish that load rather than loading it twice
+	std::map<string, QubicleBinaryRequest*>::iterator iter = m_requestMap.find(fileName);
+	if(iter != m_requestMap.end() && iter->second->IsFailed() == false)
+	{
+		WaitForQubicleBinary(iter->second);
+
+		if(iter->second->IsReady())
+		{
+			return iter->second->m_pQubicleBinary;
+		}
+	}
+
 	return AddQubicleBinaryFile(fileName);
 }
 
 QubicleBinary* QubicleBinaryManager::AddQubicleBinaryFile(const char* fileName)
 {
 	QubicleBinary* pNewQubicleBinary = new QubicleBinary(m_pRenderer);
+	pNewQubicleBinary->SetMeshCache(m_pMeshCache);
 	pNewQubicleBinary->Import(fileName);
 
 	m_vpQubicleBinaryList.push_back(pNewQubicleBinary);
 
 	return pNewQubicleBinary;
-}
\ No newline at end of file
+}
+
+// Asynchronous loading
+QubicleBinaryRequest* QubicleBinaryManager::GetQubicleBinaryFileAsync(const char* fileName, QubicleBinaryLoadedCallback callback, void *pCallbackData)
+{
+	QubicleBinaryLoadedListener listener;
+	listener.m_callback = callback;
+	listener.m_pCallbackData = pCallbackData;
+
+	// Concurrent requests for the same file share the same request
+	std::map<string, QubicleBinaryRequest*>::iterator iter = m_requestMap.find(fileName);
+	if(iter != m_requestMap.end())
+	{
+		QubicleBinaryRequest* pRequest = iter->second;
+
+		if(pRequest->IsFinished())
+		{
+			if(callback != NULL)
+			{
+				callback(pRequest->IsReady() ? pRequest->m_pQubicleBinary : NULL, pCallbackData);
+			}
+		}
+		else if(callback != NULL)
+		{
+			pRequest->m_vListeners.push_back(listener);
+		}
+
+		return pRequest;
+	}
+
+	QubicleBinaryRequest* pNewRequest = new QubicleBinaryRequest();
+	pNewRequest->m_fileName = fileName;
+	pNewRequest->m_pQubicleBinary = NULL;
+	pNewRequest->m_state = QubicleBinaryRequestState_Queued;
+
+	m_requestMap[pNewRequest->m_fileName] = pNewRequest;
+
+	// Files that were already loaded synchronously are ready straight away
+	for(unsigned int i = 0; i < m_vpQubicleBinaryList.size(); i++)
+	{
+		if(strcmp(m_vpQubicleBinaryList[i]->GetFileName().c_str(), fileName) == 0)
+		{
+			pNewRequest->m_pQubicleBinary = m_vpQubicleBinaryList[i];
+			pNewRequest->m_state = QubicleBinaryRequestState_Ready;
+
+			if(callback != NULL)
+			{
+				callback(pNewRequest->m_pQubicleBinary, pCallbackData);
+			}
+
+			return pNewRequest;
+		}
+	}
+
+	if(callback != NULL)
+	{
+		pNewRequest->m_vListeners.push_back(listener);
+	}
+
+	// The model is created here, since the constructor registers a material with the renderer
+	pNewRequest->m_pQubicleBinary = new QubicleBinary(m_pRenderer);
+	pNewRequest->m_pQubicleBinary->SetMeshCache(m_pMeshCache);
+
+	StartLoadingThreads();
+
+	m_queueMutex.lock();
+	m_loadQueue.push_back(pNewRequest);
+	m_queueMutex.unlock();
+	m_loadQueueCondition.notify_one();
+
+	return pNewRequest;
+}
+
+QubicleBinary* QubicleBinaryManager::GetQubicleBinary(QubicleBinaryRequest* pRequest)
+{
+	if(pRequest != NULL && pRequest->IsReady())
+	{
+		return pRequest->m_pQubicleBinary;
+	}
+
+	return m_pPlaceholderQubicleBinary;
+}
+
+QubicleBinary* QubicleBinaryManager::WaitForQubicleBinary(QubicleBinaryRequest* pRequest)
+{
+	if(pRequest->IsFinished())
+	{
+		return GetQubicleBinary(pRequest);
+	}
+
+	std::unique_lock<std::mutex> lock(m_queueMutex);
+
+	if(pRequest->m_state == QubicleBinaryRequestState_Queued)
+	{
+		// Not picked up by a loading thread yet, so just load it here
+		for(std::deque<QubicleBinaryRequest*>::iterator iter = m_loadQueue.begin(); iter != m_loadQueue.end(); ++iter)
+		{
+			if(*iter == pRequest)
+			{
+				m_loadQueue.erase(iter);
+				break;
+			}
+		}
+		pRequest->m_state = QubicleBinaryRequestState_Loading;
+
+		lock.unlock();
+
+		bool loaded = pRequest->m_pQubicleBinary->Import(pRequest->m_fileName.c_str(), false);
+		pRequest->m_state = loaded ? QubicleBinaryRequestState_WaitingForUpload : QubicleBinaryRequestState_Failed;
+	}
+	else
+	{
+		while(pRequest->m_state == QubicleBinaryRequestState_Loading)
+		{
+			m_uploadQueueCondition.wait(lock);
+		}
+
+		for(std::deque<QubicleBinaryRequest*>::iterator iter = m_uploadQueue.begin(); iter != m_uploadQueue.end(); ++iter)
+		{
+			if(*iter == pRequest)
+			{
+				m_uploadQueue.erase(iter);
+				break;
+			}
+		}
+
+		lock.unlock();
+	}
+
+	FinishRequest(pRequest);
+
+	return GetQubicleBinary(pRequest);
+}
+
+// Placeholder that is handed out while an asynchronous load is in flight
+void QubicleBinaryManager::SetPlaceholderQubicleBinaryFile(const char* fileName)
+{
+	m_pPlaceholderQubicleBinary = GetQubicleBinaryFile(fileName, false);
+}
+
+QubicleBinary* QubicleBinaryManager::GetPlaceholderQubicleBinary()
+{
+	return m_pPlaceholderQubicleBinary;
+}
+
+// Cooked mesh cache
+void QubicleBinaryManager::SetMeshCacheDirectory(const char* cacheDirectory)
+{
+	// Can't swap the cache out from under any loads that are in flight
+	StopLoadingThreads();
+
+	delete m_pMeshCache;
+	m_pMeshCache = NULL;
+
+	if(cacheDirectory != NULL)
+	{
+		m_pMeshCache = new QubicleMeshCache(cacheDirectory);
+	}
+
+	for(unsigned int i = 0; i < m_vpQubicleBinaryList.size(); i++)
+	{
+		m_vpQubicleBinaryList[i]->SetMeshCache(m_pMeshCache);
+	}
+
+	std::map<string, QubicleBinaryRequest*>::iterator iter;
+	for(iter = m_requestMap.begin(); iter != m_requestMap.end(); ++iter)
+	{
+		if(iter->second->m_pQubicleBinary != NULL)
+		{
+			iter->second->m_pQubicleBinary->SetMeshCache(m_pMeshCache);
+		}
+	}
+
+	if(m_loadQueue.empty() == false)
+	{
+		StartLoadingThreads();
+	}
+}
+
+QubicleMeshCache* QubicleBinaryManager::GetMeshCache()
+{
+	return m_pMeshCache;
+}
+
+void QubicleBinaryManager::Update()
+{
+	std::deque<QubicleBinaryRequest*> finishedRequests;
+	std::deque<QubicleBinaryRequest*> queuedRequests;
+
+	m_queueMutex.lock();
+	finishedRequests.swap(m_uploadQueue);
+
+	// With no loading threads nothing else is going to pick the queued loads up, so they are loaded here
+	if(m_numLoadingThreads == 0)
+	{
+		queuedRequests.swap(m_loadQueue);
+	}
+	m_queueMutex.unlock();
+
+	for(unsigned int i = 0; i < queuedRequests.size(); i++)
+	{
+		QubicleBinaryRequest* pRequest = queuedRequests[i];
+		pRequest->m_state = QubicleBinaryRequestState_Loading;
+
+		bool loaded = pRequest->m_pQubicleBinary->Import(pRequest->m_fileName.c_str(), false);
+		pRequest->m_state = loaded ? QubicleBinaryRequestState_WaitingForUpload : QubicleBinaryRequestState_Failed;
+
+		finishedRequests.push_back(pRequest);
+	}
+
+	for(unsigned int i = 0; i < finishedRequests.size(); i++)
+	{
+		FinishRequest(finishedRequests[i]);
+	}
+}
+
+void QubicleBinaryManager::StartLoadingThreads()
+{
+	if(m_loadingThreads.empty() == false || m_numLoadingThreads == 0)
+	{
+		return;
+	}
+
+	m_stopLoadingThreads = false;
+
+	for(int i = 0; i < m_numLoadingThreads; i++)
+	{
+		m_loadingThreads.push_back(std::thread(&QubicleBinaryManager::LoadingThread, this));
+	}
+}
+
+void QubicleBinaryManager::StopLoadingThreads()
+{
+	m_queueMutex.lock();
+	m_stopLoadingThreads = true;
+	m_queueMutex.unlock();
+	m_loadQueueCondition.notify_all();
+
+	for(unsigned int i = 0; i < m_loadingThreads.size(); i++)
+	{
+		m_loadingThreads[i].join();
+	}
+	m_loadingThreads.clear();
+}
+
+void QubicleBinaryManager::LoadingThread()
+{
+	std::unique_lock<std::mutex> lock(m_queueMutex);
+
+	while(true)
+	{
+		while(m_stopLoadingThreads == false && m_loadQueue.empty())
+		{
+			m_loadQueueCondition.wait(lock);
+		}
+
+		if(m_stopLoadingThreads)
+		{
+			return;
+		}
+
+		QubicleBinaryRequest* pRequest = m_loadQueue.front();
+		m_loadQueue.pop_front();
+		pRequest->m_state = QubicleBinaryRequestState_Loading;
+
+		lock.unlock();
+
+		// Parse and mesh on this thread, the GL upload is left for the render thread
+		bool loaded = pRequest->m_pQubicleBinary->Import(pRequest->m_fileName.c_str(), false);
+
+		lock.lock();
+
+		pRequest->m_state = loaded ? QubicleBinaryRequestState_WaitingForUpload : QubicleBinaryRequestState_Failed;
+		m_uploadQueue.push_back(pRequest);
+		m_uploadQueueCondition.notify_all();
+	}
+}
+
+void QubicleBinaryManager::FinishRequest(QubicleBinaryRequest* pRequest)
+{
+	if(pRequest->m_state == QubicleBinaryRequestState_WaitingForUpload)
+	{
+		pRequest->m_pQubicleBinary->FinishMesh();
+		m_vpQubicleBinaryList.push_back(pRequest->m_pQubicleBinary);
+
+		pRequest->m_state = QubicleBinaryRequestState_Ready;
+	}
+	else if(pRequest->m_state == QubicleBinaryRequestState_Failed && pRequest->m_pQubicleBinary != NULL)
+	{
+		delete pRequest->m_pQubicleBinary;
+		pRequest->m_pQubicleBinary = NULL;
+	}
+
+	for(unsigned int i = 0; i < pRequest->m_vListeners.size(); i++)
+	{
+		pRequest->m_vListeners[i].m_callback(pRequest->m_pQubicleBinary, pRequest->m_vListeners[i].m_pCallbackData);
+	}
+	pRequest->m_vListeners.clear();
+}
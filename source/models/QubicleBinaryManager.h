@@ -17,15 +17,55 @@
 
 
 #include "QubicleBinary.h"
+#include "QubicleMeshCache.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
 
 typedef std::vector<QubicleBinary*> QubicleBinaryList;
 
+typedef void(*QubicleBinaryLoadedCallback)(QubicleBinary* pQubicleBinary, void *lpData);
+
+enum QubicleBinaryRequestState
+{
+	QubicleBinaryRequestState_Queued = 0,
+	QubicleBinaryRequestState_Loading,
+	QubicleBinaryRequestState_WaitingForUpload,
+	QubicleBinaryRequestState_Ready,
+	QubicleBinaryRequestState_Failed,
+};
+
+class QubicleBinaryLoadedListener
+{
+public:
+	QubicleBinaryLoadedCallback m_callback;
+	void *m_pCallbackData;
+};
+
+// Handle for an asynchronous load, owned by the QubicleBinaryManager
+class QubicleBinaryRequest
+{
+public:
+	bool IsReady() { return m_state == QubicleBinaryRequestState_Ready; }
+	bool IsFailed() { return m_state == QubicleBinaryRequestState_Failed; }
+	bool IsFinished() { return IsReady() || IsFailed(); }
+
+	string m_fileName;
+	QubicleBinary* m_pQubicleBinary;
+	std::atomic<int> m_state;
+	std::vector<QubicleBinaryLoadedListener> m_vListeners;
+};
+
 
 class QubicleBinaryManager
 {
 public:
 	/* Public methods */
-	QubicleBinaryManager(Renderer* pRenderer);
+	QubicleBinaryManager(Renderer* pRenderer, int numLoadingThreads = -1);
 	~QubicleBinaryManager();
 
 	void ClearQubicleBinaryList();
@@ -33,11 +73,33 @@ public:
 	QubicleBinary* GetQubicleBinaryFile(const char* fileName, bool refreshModel);
 	QubicleBinary* AddQubicleBinaryFile(const char* fileName);
 
+	// Asynchronous loading
+	QubicleBinaryRequest* GetQubicleBinaryFileAsync(const char* fileName, QubicleBinaryLoadedCallback callback = NULL, void *pCallbackData = NULL);
+	QubicleBinary* GetQubicleBinary(QubicleBinaryRequest* pRequest);
+	QubicleBinary* WaitForQubicleBinary(QubicleBinaryRequest* pRequest);
+
+	// Placeholder that is handed out while an asynchronous load is in flight
+	void SetPlaceholderQubicleBinaryFile(const char* fileName);
+	QubicleBinary* GetPlaceholderQubicleBinary();
+
+	// Cooked mesh cache
+	void SetMeshCacheDirectory(const char* cacheDirectory);
+	QubicleMeshCache* GetMeshCache();
+
+	// Must be called from the render thread, uploads finished meshes and fires the load callbacks.
+	// With no loading threads, this is also where the queued loads are done.
+	void Update();
+
 protected:
 	/* Protected methods */
 
 private:
 	/* Private methods */
+	void StartLoadingThreads();
+	void StopLoadingThreads();
+	void LoadingThread();
+
+	void FinishRequest(QubicleBinaryRequest* pRequest);
 
 public:
 	/* Public members */
@@ -50,4 +112,25 @@ private:
 	Renderer* m_pRenderer;
 
 	QubicleBinaryList m_vpQubicleBinaryList;
+
+	// Placeholder model
+	QubicleBinary* m_pPlaceholderQubicleBinary;
+
+	// Cooked mesh cache, shared by all the models we load
+	QubicleMeshCache* m_pMeshCache;
+
+	// Asynchronous requests, keyed by filename so that concurrent requests for the same file share one load
+	std::map<string, QubicleBinaryRequest*> m_requestMap;
+
+	// Loading threads
+	int m_numLoadingThreads;
+	std::vector<std::thread> m_loadingThreads;
+	bool m_stopLoadingThreads;
+
+	// Work queues, guarded by m_queueMutex
+	std::mutex m_queueMutex;
+	std::condition_variable m_loadQueueCondition;
+	std::condition_variable m_uploadQueueCondition;
+	std::deque<QubicleBinaryRequest*> m_loadQueue;
+	std::deque<QubicleBinaryRequest*> m_uploadQueue;
 };
@@ -0,0 +1,323 @@
+// ******************************************************************************
+//
+// Filename:	QubicleMeshCache.cpp
+// Project:		Game
+// Author:		Steven Ball
+//
+// Purpose:
+//   Persistent on-disk cache of the cooked vertex/index data for qubicle
+//   binary files, keyed by a hash of the .qb file contents and the mesher
+//   version, so that unchanged models don't need to be re-meshed every launch.
+//
+// Revision History:
+//   Initial Revision - 18/10/26
+//
+// Copyright (c) 2005-2015, Steven Ball
+//
+// ******************************************************************************
+
+#include "QubicleMeshCache.h"
+
+#include <iostream>
+
+
+// Cache file layout:
+//   char[4]   "QBMC"
+//   uint      cache file version
+//   uint64    .qb content hash
+//   uint      mesher version
+//   uint      number of matrices
+//   per matrix:
+//     uint    number of vertices, texture coordinates and triangles
+//     float   vertices (position, normal, colour), texture coordinates (s, t)
+//     uint    triangle indices
+//   uint64    hash of everything above, to catch truncated or corrupt files
+const unsigned int CACHE_HEADER_SIZE = 4 + sizeof(unsigned int) + sizeof(unsigned long long) + sizeof(unsigned int)*2;
+const unsigned int CACHE_VERTEX_SIZE = sizeof(OpenGLMesh_Vertex);
+const unsigned int CACHE_TEXTURE_COORDINATE_SIZE = sizeof(OpenGLMesh_TextureCoordinate);
+const unsigned int CACHE_TRIANGLE_SIZE = sizeof(OpenGLMesh_Triangle);
+
+// Numbers the temporary files that the cache entries are written to before being renamed into place
+static std::atomic<unsigned int> s_nextTempFileIndex(0);
+
+
+QubicleMeshCache::QubicleMeshCache(const char* cacheDirectory)
+{
+	m_cacheDirectory = cacheDirectory;
+
+	ResetStatistics();
+}
+
+QubicleMeshCache::~QubicleMeshCache()
+{
+}
+
+// 64 bit FNV-1a
+unsigned long long QubicleMeshCache::HashData(const unsigned char* pData, unsigned int dataSize)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+
+	for(unsigned int i = 0; i < dataSize; i++)
+	{
+		hash ^= pData[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+bool QubicleMeshCache::LoadMeshes(unsigned long long contentHash, unsigned int mesherVersion, QubicleMatrixList& matrices, Renderer* pRenderer)
+{
+	string cacheFileName = GetCacheFileName(contentHash, mesherVersion);
+
+	FILE* pCacheFile = NULL;
+	fopen_s(&pCacheFile, cacheFileName.c_str(), "rb");
+
+	if(pCacheFile == NULL)
+	{
+		m_numMisses++;
+		return false;
+	}
+
+	fseek(pCacheFile, 0, SEEK_END);
+	long fileSize = ftell(pCacheFile);
+	fseek(pCacheFile, 0, SEEK_SET);
+
+	unsigned char* pFileData = NULL;
+	bool readOk = false;
+	if(fileSize >= (long)(CACHE_HEADER_SIZE + sizeof(unsigned long long)))
+	{
+		pFileData = new unsigned char[fileSize];
+		readOk = fread(pFileData, 1, fileSize, pCacheFile) == (size_t)fileSize;
+	}
+	fclose(pCacheFile);
+
+	// Validate the whole file before touching any of the meshes, so a bad entry just falls back to meshing
+	bool valid = readOk;
+	const unsigned char* pRead = pFileData;
+	const unsigned char* pEnd = pFileData + fileSize - sizeof(unsigned long long);
+
+	if(valid)
+	{
+		unsigned long long storedChecksum;
+		memcpy(&storedChecksum, pEnd, sizeof(unsigned long long));
+
+		unsigned int fileVersion;
+		unsigned long long storedContentHash;
+		unsigned int storedMesherVersion;
+		unsigned int numMatrices;
+		memcpy(&fileVersion, pRead + 4, sizeof(unsigned int));
+		memcpy(&storedContentHash, pRead + 8, sizeof(unsigned long long));
+		memcpy(&storedMesherVersion, pRead + 16, sizeof(unsigned int));
+		memcpy(&numMatrices, pRead + 20, sizeof(unsigned int));
+
+		valid = memcmp(pRead, "QBMC", 4) == 0 &&
+				fileVersion == CACHE_FILE_VERSION &&
+				storedContentHash == contentHash &&
+				storedMesherVersion == mesherVersion &&
+				numMatrices == matrices.size() &&
+				storedChecksum == HashData(pFileData, (unsigned int)(pEnd - pFileData));
+
+		pRead += CACHE_HEADER_SIZE;
+	}
+
+	const unsigned char* pMatrixStart = pRead;
+	for(unsigned int i = 0; valid && i < matrices.size(); i++)
+	{
+		if(pEnd - pRead < (long)(sizeof(unsigned int)*3))
+		{
+			valid = false;
+			break;
+		}
+
+		unsigned int counts[3];
+		memcpy(counts, pRead, sizeof(unsigned int)*3);
+		pRead += sizeof(unsigned int)*3;
+
+		unsigned long long matrixSize = (unsigned long long)counts[0]*CACHE_VERTEX_SIZE + (unsigned long long)counts[1]*CACHE_TEXTURE_COORDINATE_SIZE + (unsigned long long)counts[2]*CACHE_TRIANGLE_SIZE;
+		if(matrixSize > (unsigned long long)(pEnd - pRead))
+		{
+			valid = false;
+			break;
+		}
+
+		pRead += matrixSize;
+	}
+
+	if(valid == false)
+	{
+		delete [] pFileData;
+
+		m_numRejected++;
+		m_numMisses++;
+		return false;
+	}
+
+	pRead = pMatrixStart;
+	for(unsigned int i = 0; i < matrices.size(); i++)
+	{
+		QubicleMatrix* pMatrix = matrices[i];
+
+		if(pMatrix->m_pMesh == NULL)
+		{
+			pMatrix->m_pMesh = pRenderer->CreateMesh(OGLMeshType_Packed);
+		}
+
+		unsigned int counts[3];
+		memcpy(counts, pRead, sizeof(unsigned int)*3);
+		pRead += sizeof(unsigned int)*3;
+
+		// The cache stores the mesh arrays in the same layout as they are held in memory
+		OpenGLTriangleMesh* pMesh = pMatrix->m_pMesh;
+		pMesh->m_vertices.resize(pMesh->m_vertices.size() + counts[0]);
+		pMesh->m_textureCoordinates.resize(pMesh->m_textureCoordinates.size() + counts[1]);
+		pMesh->m_triangles.resize(pMesh->m_triangles.size() + counts[2]);
+
+		if(counts[0] > 0)
+		{
+			memcpy(&pMesh->m_vertices[pMesh->m_vertices.size() - counts[0]], pRead, counts[0]*CACHE_VERTEX_SIZE);
+			pRead += counts[0]*CACHE_VERTEX_SIZE;
+		}
+		if(counts[1] > 0)
+		{
+			memcpy(&pMesh->m_textureCoordinates[pMesh->m_textureCoordinates.size() - counts[1]], pRead, counts[1]*CACHE_TEXTURE_COORDINATE_SIZE);
+			pRead += counts[1]*CACHE_TEXTURE_COORDINATE_SIZE;
+		}
+		if(counts[2] > 0)
+		{
+			memcpy(&pMesh->m_triangles[pMesh->m_triangles.size() - counts[2]], pRead, counts[2]*CACHE_TRIANGLE_SIZE);
+			pRead += counts[2]*CACHE_TRIANGLE_SIZE;
+		}
+	}
+
+	delete [] pFileData;
+
+	m_numHits++;
+	return true;
+}
+
+bool QubicleMeshCache::SaveMeshes(unsigned long long contentHash, unsigned int mesherVersion, QubicleMatrixList& matrices)
+{
+	// Build the whole file in memory, so the checksum can be appended and it can be written with a single call
+	unsigned long long fileSize = CACHE_HEADER_SIZE + sizeof(unsigned long long);
+	for(unsigned int i = 0; i < matrices.size(); i++)
+	{
+		OpenGLTriangleMesh* pMesh = matrices[i]->m_pMesh;
+		if(pMesh == NULL)
+		{
+			return false;
+		}
+
+		fileSize += sizeof(unsigned int)*3;
+		fileSize += pMesh->m_vertices.size()*CACHE_VERTEX_SIZE + pMesh->m_textureCoordinates.size()*CACHE_TEXTURE_COORDINATE_SIZE + pMesh->m_triangles.size()*CACHE_TRIANGLE_SIZE;
+	}
+
+	unsigned char* pFileData = new unsigned char[(size_t)fileSize];
+	unsigned char* pWrite = pFileData;
+
+	unsigned int fileVersion = CACHE_FILE_VERSION;
+	unsigned int numMatrices = (unsigned int)matrices.size();
+	memcpy(pWrite, "QBMC", 4);
+	memcpy(pWrite + 4, &fileVersion, sizeof(unsigned int));
+	memcpy(pWrite + 8, &contentHash, sizeof(unsigned long long));
+	memcpy(pWrite + 16, &mesherVersion, sizeof(unsigned int));
+	memcpy(pWrite + 20, &numMatrices, sizeof(unsigned int));
+	pWrite += CACHE_HEADER_SIZE;
+
+	for(unsigned int i = 0; i < matrices.size(); i++)
+	{
+		OpenGLTriangleMesh* pMesh = matrices[i]->m_pMesh;
+
+		unsigned int counts[3] = { (unsigned int)pMesh->m_vertices.size(), (unsigned int)pMesh->m_textureCoordinates.size(), (unsigned int)pMesh->m_triangles.size() };
+		memcpy(pWrite, counts, sizeof(unsigned int)*3);
+		pWrite += sizeof(unsigned int)*3;
+
+		if(counts[0] > 0)
+		{
+			memcpy(pWrite, &pMesh->m_vertices[0], counts[0]*CACHE_VERTEX_SIZE);
+			pWrite += counts[0]*CACHE_VERTEX_SIZE;
+		}
+		if(counts[1] > 0)
+		{
+			memcpy(pWrite, &pMesh->m_textureCoordinates[0], counts[1]*CACHE_TEXTURE_COORDINATE_SIZE);
+			pWrite += counts[1]*CACHE_TEXTURE_COORDINATE_SIZE;
+		}
+		if(counts[2] > 0)
+		{
+			memcpy(pWrite, &pMesh->m_triangles[0], counts[2]*CACHE_TRIANGLE_SIZE);
+			pWrite += counts[2]*CACHE_TRIANGLE_SIZE;
+		}
+	}
+
+	unsigned long long checksum = HashData(pFileData, (unsigned int)(pWrite - pFileData));
+	memcpy(pWrite, &checksum, sizeof(unsigned long long));
+
+	// Write to a temporary file first, so a crash part way through can never leave a half written entry behind.
+	// Each save gets a temporary file of its own, two loading threads can be saving the same model at once.
+	string cacheFileName = GetCacheFileName(contentHash, mesherVersion);
+
+	char tempFileSuffix[32];
+	sprintf_s(tempFileSuffix, 32, ".%u.tmp", s_nextTempFileIndex++);
+	string tempFileName = cacheFileName + tempFileSuffix;
+
+	FILE* pCacheFile = NULL;
+	fopen_s(&pCacheFile, tempFileName.c_str(), "wb");
+
+	bool writeOk = false;
+	if(pCacheFile != NULL)
+	{
+		writeOk = fwrite(pFileData, 1, (size_t)fileSize, pCacheFile) == (size_t)fileSize;
+		writeOk = (fclose(pCacheFile) == 0) && writeOk;
+	}
+
+	delete [] pFileData;
+
+	if(writeOk)
+	{
+		remove(cacheFileName.c_str());
+		writeOk = rename(tempFileName.c_str(), cacheFileName.c_str()) == 0;
+	}
+
+	if(writeOk == false)
+	{
+		remove(tempFileName.c_str());
+	}
+
+	return writeOk;
+}
+
+// Statistics
+int QubicleMeshCache::GetNumHits()
+{
+	return m_numHits;
+}
+
+int QubicleMeshCache::GetNumMisses()
+{
+	return m_numMisses;
+}
+
+int QubicleMeshCache::GetNumRejected()
+{
+	return m_numRejected;
+}
+
+void QubicleMeshCache::ResetStatistics()
+{
+	m_numHits = 0;
+	m_numMisses = 0;
+	m_numRejected = 0;
+}
+
+void QubicleMeshCache::PrintStatistics()
+{
+	cout << "Qubicle mesh cache: " << m_numHits << " hits, " << m_numMisses << " misses (" << m_numRejected << " stale or corrupt)\n";
+}
+
+string QubicleMeshCache::GetCacheFileName(unsigned long long contentHash, unsigned int mesherVersion)
+{
+	char cacheFileName[64];
+	sprintf_s(cacheFileName, 64, "%016llx_%u.qbmesh", contentHash, mesherVersion);
+
+	return m_cacheDirectory + "/" + cacheFileName;
+}
@@ -0,0 +1,67 @@
+// ******************************************************************************
+//
+// Filename:	QubicleMeshCache.h
+// Project:		Game
+// Author:		Steven Ball
+//
+// Purpose:
+//   Persistent on-disk cache of the cooked vertex/index data for qubicle
+//   binary files, keyed by a hash of the .qb file contents and the mesher
+//   version, so that unchanged models don't need to be re-meshed every launch.
+//
+// Revision History:
+//   Initial Revision - 18/10/26
+//
+// Copyright (c) 2005-2015, Steven Ball
+//
+// ******************************************************************************
+
+#pragma once
+
+#include "QubicleBinary.h"
+
+#include <atomic>
+
+
+class QubicleMeshCache
+{
+public:
+	/* Public methods */
+	QubicleMeshCache(const char* cacheDirectory);
+	~QubicleMeshCache();
+
+	static unsigned long long HashData(const unsigned char* pData, unsigned int dataSize);
+
+	bool LoadMeshes(unsigned long long contentHash, unsigned int mesherVersion, QubicleMatrixList& matrices, Renderer* pRenderer);
+	bool SaveMeshes(unsigned long long contentHash, unsigned int mesherVersion, QubicleMatrixList& matrices);
+
+	// Statistics
+	int GetNumHits();
+	int GetNumMisses();
+	int GetNumRejected();
+	void ResetStatistics();
+	void PrintStatistics();
+
+protected:
+	/* Protected methods */
+
+private:
+	/* Private methods */
+	string GetCacheFileName(unsigned long long contentHash, unsigned int mesherVersion);
+
+public:
+	/* Public members */
+	static const unsigned int CACHE_FILE_VERSION = 1;
+
+protected:
+	/* Protected members */
+
+private:
+	/* Private members */
+	string m_cacheDirectory;
+
+	// Statistics, updated from the loading threads as well as the main thread
+	std::atomic<int> m_numHits;
+	std::atomic<int> m_numMisses;
+	std::atomic<int> m_numRejected;
+};
@@ -14,6 +14,7 @@
 // ******************************************************************************
 
 #include "VoxelCharacter.h"
+#include "../Renderer/RenderQueue.h"
 
 #include "../utils/Interpolator.h"
 #include "../utils/Random.h"
@@ -29,6 +30,11 @@ VoxelCharacter::VoxelCharacter(Renderer* pRenderer, QubicleBinaryManager* pQubic
 {
 	m_pRenderer = pRenderer;
 	m_pQubicleBinaryManager = pQubicleBinaryManager;
+	m_pPoseCache = NULL;
+
+	// Seeded from rand() so that characters differ from each other, but are still repeatable with srand()
+	m_pInterpolator = new Interpolator();
+	m_randomNumberGenerator.Seed((unsigned int)rand());
 
 	Reset();
 }
@@ -37,6 +43,8 @@ VoxelCharacter::~VoxelCharacter()
 {
 	UnloadCharacter();
 	Reset();
+
+	delete m_pInterpolator;
 }
 
 void VoxelCharacter::Reset()
@@ -54,6 +62,8 @@ void VoxelCharacter::Reset()
 
 	m_characterAlpha = 1.0f;
 
+	m_skinnedRendering = false;
+
 	m_lookRotationAngle = 0.0f;
 	m_zLookTranslate = 0.0f;
 
@@ -63,6 +73,7 @@ void VoxelCharacter::Reset()
 	{
 		m_pCharacterAnimator[i] = NULL;
 	}	
+	m_pCharacterAnimatorPaperdoll = NULL;
 
 	m_pRightWeapon = NULL;
 	m_pLeftWeapon = NULL;
@@ -74,9 +85,8 @@ void VoxelCharacter::Reset()
 	m_bBreathingAnimationStarted = false;
 	m_breathingBodyYOffset = 0.0f;
 	m_breathingHandsYOffset = 0.0f;
-	Interpolator::GetInstance()->RemoveFloatInterpolationByVariable(&m_breathingBodyYOffset);
-	Interpolator::GetInstance()->RemoveFloatInterpolationByVariable(&m_breathingHandsYOffset);
-	m_breathingAnimationInitialWaitTime = GetRandomNumber(0, 100, 2) * 0.01f;
+	m_pInterpolator->ClearInterpolators();
+	m_breathingAnimationInitialWaitTime = m_randomNumberGenerator.GetRandomNumber(0, 100, 2) * 0.01f;
 
 	// Facial expressions
 	m_numFacialExpressions = 0;
@@ -118,7 +128,7 @@ void VoxelCharacter::Reset()
 	m_bWinkAnimationEnabled = false;
 	m_faceEyesWinkTexture = -1;
 	m_wink = false;
-	m_winkWaitTimer = 4.0f + GetRandomNumber(-2, 2, 2);
+	m_winkWaitTimer = 4.0f + m_randomNumberGenerator.GetRandomNumber(-2, 2, 2);
 	m_winkStayTime = 0.15f;
 
 	// Talking animation
@@ -159,10 +169,12 @@ void VoxelCharacter::LoadVoxelCharacter(const char* characterType, const char *q
 	{
 		m_pCharacterAnimator[i] = new MS3DAnimator(m_pRenderer, m_pCharacterModel);
 		m_pCharacterAnimator[i]->LoadAnimations(animatorFilename);	
+		m_pCharacterAnimator[i]->SetPoseCache(m_pPoseCache);
 	}
 
 	m_pCharacterAnimatorPaperdoll = new MS3DAnimator(m_pRenderer, m_pCharacterModel);
 	m_pCharacterAnimatorPaperdoll->LoadAnimations(animatorFilename);	
+	m_pCharacterAnimatorPaperdoll->SetPoseCache(m_pPoseCache);
 	m_pCharacterAnimatorPaperdoll->PlayAnimation("BindPose");
 
 	m_pVoxelModel->SetupMatrixBones(m_pCharacterAnimator[0]);
@@ -212,10 +224,14 @@ void VoxelCharacter::UnloadCharacter()
 			delete m_pCharacterAnimator[i];
 			m_pCharacterAnimator[i] = NULL;
 		}
+		delete m_pCharacterAnimatorPaperdoll;
+		m_pCharacterAnimatorPaperdoll = NULL;
 
 		delete[] m_pFacialExpressions;
 		m_pFacialExpressions = NULL;
 		m_numFacialExpressions = 0;
+
+		m_vMatrixRenderTransforms.clear();
 	}
 
 	if(m_pRightWeapon != NULL)
@@ -376,6 +392,85 @@ void VoxelCharacter::SetupFacesBones()
 	m_legsBoneIndex = m_pCharacterAnimator[AnimationSections_FullBody]->GetModel()->GetBoneIndex("Legs");
 	m_rightFootBoneIndex = m_pCharacterAnimator[AnimationSections_FullBody]->GetModel()->GetBoneIndex("Right_Foot");
 	m_leftFootBoneIndex = m_pCharacterAnimator[AnimationSections_FullBody]->GetModel()->GetBoneIndex("Left_Foot");
+
+	SetupAnimationSectionMasks();
+}
+
+// Which section animator a bone is rendered with, matching QubicleBinary::RenderWithAnimator()
+AnimationSections VoxelCharacter::GetAnimationSectionForBone(int boneIndex)
+{
+	if(boneIndex == m_headBoneIndex || boneIndex == m_bodyBoneIndex)
+	{
+		return AnimationSections_Head_Body;
+	}
+	else if(boneIndex == m_leftShoulderBoneIndex || boneIndex == m_leftHandBoneIndex)
+	{
+		return AnimationSections_Left_Arm_Hand;
+	}
+	else if(boneIndex == m_rightShoulderBoneIndex || boneIndex == m_rightHandBoneIndex)
+	{
+		return AnimationSections_Right_Arm_Hand;
+	}
+	else if(boneIndex == m_legsBoneIndex || boneIndex == m_rightFootBoneIndex || boneIndex == m_leftFootBoneIndex)
+	{
+		return AnimationSections_Legs_Feet;
+	}
+
+	return AnimationSections_FullBody;
+}
+
+// Each section animator only has to evaluate the bones that are rendered with it, plus their parents. Any other bone
+// that gets asked for is still correct, the animator just evaluates its whole skeleton on demand for that frame.
+void VoxelCharacter::SetupAnimationSectionMasks()
+{
+	int numJoints = m_pCharacterModel->GetNumJoints();
+	if(numJoints == 0)
+	{
+		return;
+	}
+
+	bool* pSectionMasks[AnimationSections_NUMSECTIONS];
+	for(int i = 0; i < AnimationSections_NUMSECTIONS; i++)
+	{
+		pSectionMasks[i] = new bool[numJoints];
+		memset(pSectionMasks[i], 0, sizeof(bool)*numJoints);
+	}
+
+	// The section bones themselves, weapons attach to these as well
+	int sectionBones[9] = { m_headBoneIndex, m_bodyBoneIndex, m_leftShoulderBoneIndex, m_leftHandBoneIndex, m_rightShoulderBoneIndex, m_rightHandBoneIndex, m_legsBoneIndex, m_rightFootBoneIndex, m_leftFootBoneIndex };
+	for(int i = 0; i < 9; i++)
+	{
+		if(sectionBones[i] != -1)
+		{
+			pSectionMasks[GetAnimationSectionForBone(sectionBones[i])][sectionBones[i]] = true;
+		}
+	}
+
+	// The face is rendered with the head and body animator
+	if(m_eyesBone != -1)
+	{
+		pSectionMasks[AnimationSections_Head_Body][m_eyesBone] = true;
+	}
+	if(m_mouthBone != -1)
+	{
+		pSectionMasks[AnimationSections_Head_Body][m_mouthBone] = true;
+	}
+
+	// Any other bones that the model's matrices are attached to are rendered with the full body animator
+	for(int i = 0; i < m_pVoxelModel->GetNumMatrices(); i++)
+	{
+		int boneIndex = m_pVoxelModel->GetQubicleMatrix(i)->m_boneIndex;
+		if(boneIndex != -1)
+		{
+			pSectionMasks[GetAnimationSectionForBone(boneIndex)][boneIndex] = true;
+		}
+	}
+
+	for(int i = 0; i < AnimationSections_NUMSECTIONS; i++)
+	{
+		m_pCharacterAnimator[i]->SetJointMask(pSectionMasks[i]);
+		delete[] pSectionMasks[i];
+	}
 }
 
 void VoxelCharacter::ModifyEyesTextures(const char *charactersBaseFolder, const char* characterType, const char* eyeTextureFolder)
@@ -690,11 +785,40 @@ MS3DAnimator* VoxelCharacter::GetMS3DAnimator(AnimationSections section)
 	return m_pCharacterAnimator[section];
 }
 
+// The pose cache has to outlive this character
+void VoxelCharacter::SetPoseCache(MS3DPoseCache* pPoseCache)
+{
+	m_pPoseCache = pPoseCache;
+
+	for(int i = 0; i < AnimationSections_NUMSECTIONS; i++)
+	{
+		if(m_pCharacterAnimator[i] != NULL)
+		{
+			m_pCharacterAnimator[i]->SetPoseCache(m_pPoseCache);
+		}
+	}
+
+	if(m_pCharacterAnimatorPaperdoll != NULL)
+	{
+		m_pCharacterAnimatorPaperdoll->SetPoseCache(m_pPoseCache);
+	}
+}
+
 QubicleBinary* VoxelCharacter::GetQubicleModel()
 {
 	return m_pVoxelModel;
 }
 
+QubicleMatrixRenderTransform* VoxelCharacter::GetMatrixRenderTransforms(int numMatrices)
+{
+	if((int)m_vMatrixRenderTransforms.size() < numMatrices)
+	{
+		m_vMatrixRenderTransforms.resize(numMatrices);
+	}
+
+	return m_vMatrixRenderTransforms.empty() ? NULL : &m_vMatrixRenderTransforms[0];
+}
+
 Vector3d VoxelCharacter::GetBoneScale()
 {
 	return m_boneScale;
@@ -822,6 +946,16 @@ void VoxelCharacter::SetForceTransparency(bool force)
 	}
 }
 
+void VoxelCharacter::SetSkinnedRendering(bool skinned)
+{
+	m_skinnedRendering = skinned;
+}
+
+bool VoxelCharacter::IsSkinnedRendering()
+{
+	return m_skinnedRendering;
+}
+
 void VoxelCharacter::SetBreathingAnimationEnabled(bool enable)
 {
 	m_bBreathingAnimationEnabled = enable;
@@ -841,53 +975,42 @@ void VoxelCharacter::StartBreathAnimation()
 {
 	m_bBreathingAnimationStarted = true;
 
-	FloatInterpolation* lBodyYInterpolation1 = Interpolator::GetInstance()->CreateFloatInterpolation(&m_breathingBodyYOffset, 0.0f, 0.35f, 1.5f, 100.0f);
-	FloatInterpolation* lBodyYInterpolation2 = Interpolator::GetInstance()->CreateFloatInterpolation(&m_breathingBodyYOffset, 0.35f, 0.35f, 0.175f, 0.0f);
-	FloatInterpolation* lBodyYInterpolation3 = Interpolator::GetInstance()->CreateFloatInterpolation(&m_breathingBodyYOffset, 0.35f, 0.0f, 1.5f, -100.0f);
-	FloatInterpolation* lBodyYInterpolation4 = Interpolator::GetInstance()->CreateFloatInterpolation(&m_breathingBodyYOffset, 0.0f, 0.0f, 0.05f, 0.0f, NULL, _BreathAnimationFinished, this);
-	Interpolator::GetInstance()->LinkFloatInterpolation(lBodyYInterpolation1, lBodyYInterpolation2);
-	Interpolator::GetInstance()->LinkFloatInterpolation(lBodyYInterpolation2, lBodyYInterpolation3);
-	Interpolator::GetInstance()->LinkFloatInterpolation(lBodyYInterpolation3, lBodyYInterpolation4);
+	FloatInterpolation* lBodyYInterpolation1 = m_pInterpolator->CreateFloatInterpolation(&m_breathingBodyYOffset, 0.0f, 0.35f, 1.5f, 100.0f);
+	FloatInterpolation* lBodyYInterpolation2 = m_pInterpolator->CreateFloatInterpolation(&m_breathingBodyYOffset, 0.35f, 0.35f, 0.175f, 0.0f);
+	FloatInterpolation* lBodyYInterpolation3 = m_pInterpolator->CreateFloatInterpolation(&m_breathingBodyYOffset, 0.35f, 0.0f, 1.5f, -100.0f);
+	FloatInterpolation* lBodyYInterpolation4 = m_pInterpolator->CreateFloatInterpolation(&m_breathingBodyYOffset, 0.0f, 0.0f, 0.05f, 0.0f, NULL, _BreathAnimationFinished, this);
+	m_pInterpolator->LinkFloatInterpolation(lBodyYInterpolation1, lBodyYInterpolation2);
+	m_pInterpolator->LinkFloatInterpolation(lBodyYInterpolation2, lBodyYInterpolation3);
+	m_pInterpolator->LinkFloatInterpolation(lBodyYInterpolation3, lBodyYInterpolation4);
 
-	FloatInterpolation* lHandsYInterpolation1 = Interpolator::GetInstance()->CreateFloatInterpolation(&m_breathingHandsYOffset, 0.0f, 0.0f, 0.5f, 0.0f);
-	FloatInterpolation* lHandsYInterpolation2 = Interpolator::GetInstance()->CreateFloatInterpolation(&m_breathingHandsYOffset, 0.0f, 0.75f, 1.25f, 100.0f);
-	FloatInterpolation* lHandsYInterpolation3 = Interpolator::GetInstance()->CreateFloatInterpolation(&m_breathingHandsYOffset, 0.75f, 0.75f, 0.125f, 0.0f);
-	FloatInterpolation* lHandsYInterpolation4 = Interpolator::GetInstance()->CreateFloatInterpolation(&m_breathingHandsYOffset, 0.75f, 0.0f, 1.5f, -100.0f);
-	Interpolator::GetInstance()->LinkFloatInterpolation(lHandsYInterpolation1, lHandsYInterpolation2);
-	Interpolator::GetInstance()->LinkFloatInterpolation(lHandsYInterpolation2, lHandsYInterpolation3);
-	Interpolator::GetInstance()->LinkFloatInterpolation(lHandsYInterpolation3, lHandsYInterpolation4);
+	FloatInterpolation* lHandsYInterpolation1 = m_pInterpolator->CreateFloatInterpolation(&m_breathingHandsYOffset, 0.0f, 0.0f, 0.5f, 0.0f);
+	FloatInterpolation* lHandsYInterpolation2 = m_pInterpolator->CreateFloatInterpolation(&m_breathingHandsYOffset, 0.0f, 0.75f, 1.25f, 100.0f);
+	FloatInterpolation* lHandsYInterpolation3 = m_pInterpolator->CreateFloatInterpolation(&m_breathingHandsYOffset, 0.75f, 0.75f, 0.125f, 0.0f);
+	FloatInterpolation* lHandsYInterpolation4 = m_pInterpolator->CreateFloatInterpolation(&m_breathingHandsYOffset, 0.75f, 0.0f, 1.5f, -100.0f);
+	m_pInterpolator->LinkFloatInterpolation(lHandsYInterpolation1, lHandsYInterpolation2);
+	m_pInterpolator->LinkFloatInterpolation(lHandsYInterpolation2, lHandsYInterpolation3);
+	m_pInterpolator->LinkFloatInterpolation(lHandsYInterpolation3, lHandsYInterpolation4);
 
-	Interpolator::GetInstance()->AddFloatInterpolation(lBodyYInterpolation1);
-	Interpolator::GetInstance()->AddFloatInterpolation(lHandsYInterpolation1);
+	m_pInterpolator->AddFloatInterpolation(lBodyYInterpolation1);
+	m_pInterpolator->AddFloatInterpolation(lHandsYInterpolation1);
 }
 
 float VoxelCharacter::GetBreathingAnimationOffsetForBone(int boneIndex)
 {
-	if(strcmp(m_pCharacterAnimator[AnimationSections_FullBody]->GetModel()->GetNameFromBoneIndex(boneIndex), "Head") == 0)
+	// Compared by index, since this is asked for every matrix that is rendered
+	if(boneIndex == m_headBoneIndex)
 	{
 		return m_breathingBodyYOffset * 0.75f;
 	}
-	if(strcmp(m_pCharacterAnimator[AnimationSections_FullBody]->GetModel()->GetNameFromBoneIndex(boneIndex), "Body") == 0)
+	if(boneIndex == m_bodyBoneIndex)
 	{
 		return m_breathingBodyYOffset;
 	}
-	if(strcmp(m_pCharacterAnimator[AnimationSections_FullBody]->GetModel()->GetNameFromBoneIndex(boneIndex), "Legs") == 0)
+	if(boneIndex == m_legsBoneIndex)
 	{
 		return m_breathingBodyYOffset * 0.5f;
 	}
-	if(strcmp(m_pCharacterAnimator[AnimationSections_FullBody]->GetModel()->GetNameFromBoneIndex(boneIndex), "Right_Shoulder") == 0)
-	{
-		return m_breathingHandsYOffset;
-	}
-	if(strcmp(m_pCharacterAnimator[AnimationSections_FullBody]->GetModel()->GetNameFromBoneIndex(boneIndex), "Left_Shoulder") == 0)
-	{
-		return m_breathingHandsYOffset;
-	}
-	if(strcmp(m_pCharacterAnimator[AnimationSections_FullBody]->GetModel()->GetNameFromBoneIndex(boneIndex), "Right_Hand") == 0)
-	{
-		return m_breathingHandsYOffset;
-	}
-	if(strcmp(m_pCharacterAnimator[AnimationSections_FullBody]->GetModel()->GetNameFromBoneIndex(boneIndex), "Left_Hand") == 0)
+	if(boneIndex == m_rightShoulderBoneIndex || boneIndex == m_leftShoulderBoneIndex || boneIndex == m_rightHandBoneIndex || boneIndex == m_leftHandBoneIndex)
 	{
 		return m_breathingHandsYOffset;
 	}
@@ -941,7 +1064,7 @@ void VoxelCharacter::UpdateWinkAnimation(float dt)
 	m_winkWaitTimer -= dt;
 	if(m_winkWaitTimer <= 0.0f)
 	{
-		m_winkWaitTimer = 4.0f + GetRandomNumber(-2, 2, 2);
+		m_winkWaitTimer = 4.0f + m_randomNumberGenerator.GetRandomNumber(-2, 2, 2);
 		m_wink = false;
 
 		// Return eyes back to whatever they were before the wink
@@ -992,7 +1115,7 @@ void VoxelCharacter::UpdateTalkingAnimation(float dt)
 		if(m_randomMouthSelection)
 		{
 			// Random mouth selection
-			m_currentTalkingTexture = GetRandomNumber(0, m_numTalkingMouths-1);
+			m_currentTalkingTexture = m_randomNumberGenerator.GetRandomNumber(0, m_numTalkingMouths-1);
 		}
 		else
 		{
@@ -1009,15 +1132,15 @@ void VoxelCharacter::UpdateTalkingAnimation(float dt)
 		if(m_talkingPauseMouthCounter == m_talkingPauseMouthAmount)
 		{
 			m_talkingPauseMouthCounter = 0;
-			m_talkingPauseMouthAmount = 6 + GetRandomNumber(-2, 5);
+			m_talkingPauseMouthAmount = 6 + m_randomNumberGenerator.GetRandomNumber(-2, 5);
 
-			float randomTimeAddtion = GetRandomNumber(-25, 40, 2) * 0.01f;
+			float randomTimeAddtion = m_randomNumberGenerator.GetRandomNumber(-25, 40, 2) * 0.01f;
 			m_talkingPauseTimer = m_talkingPauseTime + randomTimeAddtion;
 		}
 
 		if(m_talkingPauseTimer > 0.0f)
 		{
-			if(GetRandomNumber(0, 100, 1) > 50)
+			if(m_randomNumberGenerator.GetRandomNumber(0, 100, 1) > 50)
 			{
 				// Revert back to the face pose mouth
 				m_faceMouthTexture = m_pFacialExpressions[m_currentFacialExpression].m_mouthTexture;
@@ -1031,7 +1154,7 @@ void VoxelCharacter::UpdateTalkingAnimation(float dt)
 		{
 			m_faceMouthTexture = m_pTalkingAnimations[m_currentTalkingTexture].m_talkingAnimationTexture;
 
-			float randomTimeAddtion = GetRandomNumber(-10, 50, 2) * 0.00225f;
+			float randomTimeAddtion = m_randomNumberGenerator.GetRandomNumber(-10, 50, 2) * 0.00225f;
 			m_talkingWaitTimer = m_talkingWaitTime + randomTimeAddtion;
 		}
 	}
@@ -1518,6 +1641,8 @@ void VoxelCharacter::Update(float dt, float animationSpeed[AnimationSections_NUM
 		}
 	}
 
+	m_pInterpolator->Update(dt);
+
 	// Facial animation
 	if(m_loadedFaces)
 	{
@@ -1537,7 +1662,7 @@ void VoxelCharacter::Update(float dt, float animationSpeed[AnimationSections_NUM
 	{
 		if(m_bRandomLookDirectionEnabled)
 		{
-			m_faceTargetDirection = Vector3d(GetRandomNumber(-1, 1, 2)*0.65f, GetRandomNumber(-1, 1, 2)*0.175f, GetRandomNumber(0, 3, 2)+0.35f);
+			m_faceTargetDirection = Vector3d(m_randomNumberGenerator.GetRandomNumber(-1, 1, 2)*0.65f, m_randomNumberGenerator.GetRandomNumber(-1, 1, 2)*0.175f, m_randomNumberGenerator.GetRandomNumber(0, 3, 2)+0.35f);
 			m_faceTargetDirection.Normalize();
 		}
 	}
@@ -1592,7 +1717,13 @@ void VoxelCharacter::Render(bool renderOutline, bool refelction, bool silhouette
 	{
 		m_pRenderer->PushMatrix();
 			m_pRenderer->ScaleWorldMatrix(m_characterScale, m_characterScale, m_characterScale);
-			m_pVoxelModel->RenderWithAnimator(m_pCharacterAnimator, this, renderOutline, refelction, silhouette, OutlineColour, subSelectionNamePicking);
+
+			// Nothing is drawn when the whole character is out of view, the matrices are only tested one by one when it is partly in view
+			int frustumResult = GetPoseFrustumResult();
+			if(frustumResult != Frustum::FRUSTUM_OUTSIDE)
+			{
+				m_pVoxelModel->RenderWithAnimator(m_pCharacterAnimator, this, renderOutline, refelction, silhouette, OutlineColour, subSelectionNamePicking, frustumResult == Frustum::FRUSTUM_INTERSECT);
+			}
 		m_pRenderer->PopMatrix();
 	}
 }
@@ -1634,7 +1765,11 @@ void VoxelCharacter::RenderFace()
 	{
 		m_pRenderer->PushMatrix();
 			m_pRenderer->ScaleWorldMatrix(m_characterScale, m_characterScale, m_characterScale);
-			m_pVoxelModel->RenderFace(m_pCharacterAnimator[AnimationSections_Head_Body], this, true);			
+
+			if(GetPoseFrustumResult() != Frustum::FRUSTUM_OUTSIDE)
+			{
+				m_pVoxelModel->RenderFace(m_pCharacterAnimator[AnimationSections_Head_Body], this, true);
+			}
 		m_pRenderer->PopMatrix();
 	}
 }
@@ -1684,9 +1819,6 @@ void VoxelCharacter::RenderFaceTextures(bool eyesTexture, bool wireframe, bool t
 		return;
 	}
 
-	float texture_w = 1.0f;
-	float texture_h = 1.0f;
-
 	float width = 1.0f;
 	float height = 1.0f;
 
@@ -1701,6 +1833,24 @@ void VoxelCharacter::RenderFaceTextures(bool eyesTexture, bool wireframe, bool t
 		height = m_mouthTextureHeight;
 	}
 
+	float alpha = transparency ? m_characterAlpha : 1.0f;
+
+	// Drawn later with the rest of the render queue
+	if(m_pRenderer->IsRecordingRenderQueue())
+	{
+		RenderPacket packet;
+		packet.m_transparent = transparency;
+		packet.m_materialID = m_pVoxelModel->GetMaterial();
+		packet.m_textureID = eyesTexture ? m_faceEyesTexture : m_faceMouthTexture;
+		packet.m_renderMode = wireframe ? RM_WIREFRAME : RM_TEXTURED;
+		packet.m_cullMode = CM_NOCULL;
+		packet.m_lineWidth = wireframe ? 1.0f : 0.0f;
+		packet.m_drawCallback = [this, width, height, alpha]() { RenderFaceQuad(width, height, alpha); };
+
+		m_pRenderer->SubmitRenderPacket(&packet, Vector3d(width*0.5f, height*0.5f, 0.0f));
+		return;
+	}
+
 	m_pRenderer->PushMatrix();
 		if(transparency)
 		{
@@ -1731,31 +1881,9 @@ void VoxelCharacter::RenderFaceTextures(bool eyesTexture, bool wireframe, bool t
 		}
 
 		m_pRenderer->SetCullMode(CM_NOCULL);
-		if(transparency)
-		{
-			m_pRenderer->ImmediateColourAlpha(1.0f, 1.0f, 1.0f, m_characterAlpha);
-		}
-		else
-		{
-			m_pRenderer->ImmediateColourAlpha(1.0f, 1.0f, 1.0f, 1.0f);
-		}
-		
 		m_pRenderer->EnableMaterial(m_pVoxelModel->GetMaterial());
 
-		m_pRenderer->EnableImmediateMode(IM_QUADS);
-			m_pRenderer->ImmediateNormal(0.0f, 0.0f, 1.0f);
-			m_pRenderer->ImmediateTextureCoordinate(0.0f, texture_h);
-			m_pRenderer->ImmediateVertex(0.0f, 0.0f, 0.0f);
-			m_pRenderer->ImmediateNormal(0.0f, 0.0f, 1.0f);
-			m_pRenderer->ImmediateTextureCoordinate(texture_w, texture_h);
-			m_pRenderer->ImmediateVertex(width, 0.0f, 0.0f);
-			m_pRenderer->ImmediateNormal(0.0f, 0.0f, 1.0f);
-			m_pRenderer->ImmediateTextureCoordinate(texture_w, 0.0f);
-			m_pRenderer->ImmediateVertex(width, height, 0.0f);
-			m_pRenderer->ImmediateNormal(0.0f, 0.0f, 1.0f);
-			m_pRenderer->ImmediateTextureCoordinate(0.0f, 0.0f);
-			m_pRenderer->ImmediateVertex(0.0f, height, 0.0f);
-		m_pRenderer->DisableImmediateMode();
+		RenderFaceQuad(width, height, alpha);
 		m_pRenderer->DisableTexture();
 
 		m_pRenderer->DisableTransparency();
@@ -1765,6 +1893,44 @@ void VoxelCharacter::RenderFaceTextures(bool eyesTexture, bool wireframe, bool t
 	m_pRenderer->PopMatrix();
 }
 
+// The character as posed against the view, in the space of the current model matrix
+int VoxelCharacter::GetPoseFrustumResult()
+{
+	if(m_pRenderer->IsFrustumCullingEnabled() == false)
+	{
+		return Frustum::FRUSTUM_INSIDE;
+	}
+
+	Vector3d boundingCentre;
+	float boundingRadius;
+	m_pVoxelModel->GetPoseBoundingSphere(m_pCharacterAnimator, this, &boundingCentre, &boundingRadius);
+
+	return m_pRenderer->ModelSphereInFrustum(boundingCentre, boundingRadius);
+}
+
+void VoxelCharacter::RenderFaceQuad(float width, float height, float alpha)
+{
+	float texture_w = 1.0f;
+	float texture_h = 1.0f;
+
+	m_pRenderer->ImmediateColourAlpha(1.0f, 1.0f, 1.0f, alpha);
+
+	m_pRenderer->EnableImmediateMode(IM_QUADS);
+		m_pRenderer->ImmediateNormal(0.0f, 0.0f, 1.0f);
+		m_pRenderer->ImmediateTextureCoordinate(0.0f, texture_h);
+		m_pRenderer->ImmediateVertex(0.0f, 0.0f, 0.0f);
+		m_pRenderer->ImmediateNormal(0.0f, 0.0f, 1.0f);
+		m_pRenderer->ImmediateTextureCoordinate(texture_w, texture_h);
+		m_pRenderer->ImmediateVertex(width, 0.0f, 0.0f);
+		m_pRenderer->ImmediateNormal(0.0f, 0.0f, 1.0f);
+		m_pRenderer->ImmediateTextureCoordinate(texture_w, 0.0f);
+		m_pRenderer->ImmediateVertex(width, height, 0.0f);
+		m_pRenderer->ImmediateNormal(0.0f, 0.0f, 1.0f);
+		m_pRenderer->ImmediateTextureCoordinate(0.0f, 0.0f);
+		m_pRenderer->ImmediateVertex(0.0f, height, 0.0f);
+	m_pRenderer->DisableImmediateMode();
+}
+
 void VoxelCharacter::RenderWeapons(bool renderOutline, bool refelction, bool silhouette, Colour OutlineColour)
 {
 	if(m_pLeftWeapon != NULL)
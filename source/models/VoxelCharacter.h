@@ -17,6 +17,7 @@
 
 #include "modelloader.h"
 #include "QubicleBinaryManager.h"
+#include "../utils/Random.h"
 
 
 // Facial expression
@@ -37,6 +38,7 @@ typedef struct TalkingAnimation
 } TalkingAnimation;
 
 class VoxelWeapon;
+class Interpolator;
 
 enum AnimationSections
 {
@@ -107,7 +109,10 @@ public:
 	int GetMatrixIndexForName(const char* matrixName);
 	MS3DModel* GetMS3DModel();
 	MS3DAnimator* GetMS3DAnimator(AnimationSections section);
+	AnimationSections GetAnimationSectionForBone(int boneIndex);
+	void SetPoseCache(MS3DPoseCache* pPoseCache);
 	QubicleBinary* GetQubicleModel();
+	QubicleMatrixRenderTransform* GetMatrixRenderTransforms(int numMatrices);
 	Vector3d GetBoneScale();
 	void SetBoneScale(float scale);
 
@@ -118,6 +123,8 @@ public:
 	void SetMeshAlpha(float alpha, bool force = false);
 	void SetMeshSingleColour(float r, float g, float b);
 	void SetForceTransparency(bool force);
+	void SetSkinnedRendering(bool skinned);  // One draw for the whole model, when the renderer supports it
+	bool IsSkinnedRendering();
 
 	// Breathing animation
 	void SetBreathingAnimationEnabled(bool enable);
@@ -238,6 +245,9 @@ protected:
 
 private:
 	/* Private methods */
+	void SetupAnimationSectionMasks();
+	void RenderFaceQuad(float width, float height, float alpha);
+	int GetPoseFrustumResult();
 
 public:
 	/* Public members */
@@ -250,6 +260,16 @@ private:
 	Renderer* m_pRenderer;
 	QubicleBinaryManager* m_pQubicleBinaryManager;
 
+	// Shared baked animations, optional
+	MS3DPoseCache* m_pPoseCache;
+
+	// Per character, so that characters can be updated on different threads
+	Interpolator* m_pInterpolator;
+	RandomNumberGenerator m_randomNumberGenerator;
+
+	// Cached render transforms for the matrices of the voxel model, see QubicleBinary::RenderWithAnimator()
+	vector<QubicleMatrixRenderTransform> m_vMatrixRenderTransforms;
+
 	// Loaded flags
 	bool m_loaded;
 	bool m_loadedFaces;
@@ -269,6 +289,9 @@ private:
 	// Character alpha
 	float m_characterAlpha;
 
+	// Skinned rendering
+	bool m_skinnedRendering;
+
 	// Bone scale
 	Vector3d m_boneScale;
 
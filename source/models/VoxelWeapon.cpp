@@ -14,6 +14,7 @@
 // ******************************************************************************
 
 #include "VoxelWeapon.h"
+#include "../Renderer/RenderQueue.h"
 
 #include <fstream>
 #include <ostream>
@@ -1529,8 +1530,6 @@ void VoxelWeapon::RenderWeaponTrails()
 {
 	for(int i = 0; i < m_numWeaponTrails; i++)
 	{
-		int trailCounter = 0;
-		int indexToUse1 = m_pWeaponTrails[i].m_trailNextAddIndex;
 		m_pRenderer->PushMatrix();
 			if(m_pWeaponTrails[i].m_followOrigin)
 			{
@@ -1539,53 +1538,84 @@ void VoxelWeapon::RenderWeaponTrails()
 				m_pRenderer->ScaleWorldMatrix(m_pWeaponTrails[i].m_parentScale, m_pWeaponTrails[i].m_parentScale, m_pWeaponTrails[i].m_parentScale);
 			}
 
-			m_pRenderer->EnableTransparency(BF_SRC_ALPHA, BF_ONE_MINUS_SRC_ALPHA);
-			//m_pRenderer->DisableDepthTest();
-			m_pRenderer->SetCullMode(CM_NOCULL);
-			m_pRenderer->SetRenderMode(RM_SOLID);
-			m_pRenderer->SetLineWidth(3.0f);
-
-			m_pRenderer->EnableImmediateMode(IM_QUADS);
-				while(trailCounter < m_pWeaponTrails[i].m_numTrailPoints-1)
+			// Drawn later with the rest of the render queue, depth sorted by the oldest point
+			if(m_pRenderer->IsRecordingRenderQueue())
+			{
+				RenderPacket packet;
+				packet.m_transparent = true;
+				packet.m_renderMode = RM_SOLID;
+				packet.m_cullMode = CM_NOCULL;
+				packet.m_lineWidth = 3.0f;
+				packet.m_drawCallback = [this, i]() { RenderWeaponTrail(i); };
+
+				Vector3d centre;
+				if(m_pWeaponTrails[i].m_numTrailPoints > 0)
 				{
-					int indexToUse2 = indexToUse1+1;
-					if(indexToUse2 >= m_pWeaponTrails[i].m_numTrailPoints)
-					{
-						indexToUse2 = 0;
-					}
+					WeaponTrailPoint* pTrailPoint = &m_pWeaponTrails[i].m_pTrailPoints[m_pWeaponTrails[i].m_trailNextAddIndex];
+					centre = (pTrailPoint->m_startPoint + pTrailPoint->m_endPoint) * 0.5f;
+				}
 
-					if(m_pWeaponTrails[i].m_pTrailPoints[indexToUse1].m_pointActive == true &&
-					   m_pWeaponTrails[i].m_pTrailPoints[indexToUse2].m_pointActive == true)
-					{
-						float alpha1 = (float)trailCounter / (float)m_pWeaponTrails[i].m_numTrailPoints;
-						float alpha2 = (float)(trailCounter-1) / (float)m_pWeaponTrails[i].m_numTrailPoints;
+				m_pRenderer->SubmitRenderPacket(&packet, centre);
+			}
+			else
+			{
+				m_pRenderer->EnableTransparency(BF_SRC_ALPHA, BF_ONE_MINUS_SRC_ALPHA);
+				//m_pRenderer->DisableDepthTest();
+				m_pRenderer->SetCullMode(CM_NOCULL);
+				m_pRenderer->SetRenderMode(RM_SOLID);
+				m_pRenderer->SetLineWidth(3.0f);
 
-						alpha1 += 0.2f;
-						alpha2 += 0.2f;
-						m_pRenderer->ImmediateColourAlpha(m_pWeaponTrails[i].m_trailColour.GetRed(), m_pWeaponTrails[i].m_trailColour.GetGreen(), m_pWeaponTrails[i].m_trailColour.GetBlue(), alpha2);						
-						m_pRenderer->ImmediateVertex(m_pWeaponTrails[i].m_pTrailPoints[indexToUse1].m_startPoint.x, m_pWeaponTrails[i].m_pTrailPoints[indexToUse1].m_startPoint.y, m_pWeaponTrails[i].m_pTrailPoints[indexToUse1].m_startPoint.z);
+				RenderWeaponTrail(i);
 
-						m_pRenderer->ImmediateColourAlpha(m_pWeaponTrails[i].m_trailColour.GetRed(), m_pWeaponTrails[i].m_trailColour.GetGreen(), m_pWeaponTrails[i].m_trailColour.GetBlue(), alpha2);
-						m_pRenderer->ImmediateVertex(m_pWeaponTrails[i].m_pTrailPoints[indexToUse1].m_endPoint.x, m_pWeaponTrails[i].m_pTrailPoints[indexToUse1].m_endPoint.y, m_pWeaponTrails[i].m_pTrailPoints[indexToUse1].m_endPoint.z);
+				m_pRenderer->DisableTransparency();
+				m_pRenderer->SetCullMode(CM_BACK);
+				m_pRenderer->EnableDepthTest(DT_LESS);
+			}
+		m_pRenderer->PopMatrix();
+	}
+}
 
-						m_pRenderer->ImmediateColourAlpha(m_pWeaponTrails[i].m_trailColour.GetRed(), m_pWeaponTrails[i].m_trailColour.GetGreen(), m_pWeaponTrails[i].m_trailColour.GetBlue(), alpha1);
-						m_pRenderer->ImmediateVertex(m_pWeaponTrails[i].m_pTrailPoints[indexToUse2].m_endPoint.x, m_pWeaponTrails[i].m_pTrailPoints[indexToUse2].m_endPoint.y, m_pWeaponTrails[i].m_pTrailPoints[indexToUse2].m_endPoint.z);
+void VoxelWeapon::RenderWeaponTrail(int index)
+{
+	int trailCounter = 0;
+	int indexToUse1 = m_pWeaponTrails[index].m_trailNextAddIndex;
 
-						m_pRenderer->ImmediateColourAlpha(m_pWeaponTrails[i].m_trailColour.GetRed(), m_pWeaponTrails[i].m_trailColour.GetGreen(), m_pWeaponTrails[i].m_trailColour.GetBlue(), alpha1);
-						m_pRenderer->ImmediateVertex(m_pWeaponTrails[i].m_pTrailPoints[indexToUse2].m_startPoint.x, m_pWeaponTrails[i].m_pTrailPoints[indexToUse2].m_startPoint.y, m_pWeaponTrails[i].m_pTrailPoints[indexToUse2].m_startPoint.z);
-					}
+	m_pRenderer->EnableImmediateMode(IM_QUADS);
+		while(trailCounter < m_pWeaponTrails[index].m_numTrailPoints-1)
+		{
+			int indexToUse2 = indexToUse1+1;
+			if(indexToUse2 >= m_pWeaponTrails[index].m_numTrailPoints)
+			{
+				indexToUse2 = 0;
+			}
 
-					indexToUse1++;
-					if(indexToUse1 >= m_pWeaponTrails[i].m_numTrailPoints)
-					{
-						indexToUse1 = 0;
-					}
-					trailCounter++;
-				}
-			m_pRenderer->DisableImmediateMode();
-			m_pRenderer->DisableTransparency();
-			m_pRenderer->SetCullMode(CM_BACK);
-			m_pRenderer->EnableDepthTest(DT_LESS);
-		m_pRenderer->PopMatrix();
-	}
+			if(m_pWeaponTrails[index].m_pTrailPoints[indexToUse1].m_pointActive == true &&
+			   m_pWeaponTrails[index].m_pTrailPoints[indexToUse2].m_pointActive == true)
+			{
+				float alpha1 = (float)trailCounter / (float)m_pWeaponTrails[index].m_numTrailPoints;
+				float alpha2 = (float)(trailCounter-1) / (float)m_pWeaponTrails[index].m_numTrailPoints;
+
+				alpha1 += 0.2f;
+				alpha2 += 0.2f;
+				m_pRenderer->ImmediateColourAlpha(m_pWeaponTrails[index].m_trailColour.GetRed(), m_pWeaponTrails[index].m_trailColour.GetGreen(), m_pWeaponTrails[index].m_trailColour.GetBlue(), alpha2);						
+				m_pRenderer->ImmediateVertex(m_pWeaponTrails[index].m_pTrailPoints[indexToUse1].m_startPoint.x, m_pWeaponTrails[index].m_pTrailPoints[indexToUse1].m_startPoint.y, m_pWeaponTrails[index].m_pTrailPoints[indexToUse1].m_startPoint.z);
+
+				m_pRenderer->ImmediateColourAlpha(m_pWeaponTrails[index].m_trailColour.GetRed(), m_pWeaponTrails[index].m_trailColour.GetGreen(), m_pWeaponTrails[index].m_trailColour.GetBlue(), alpha2);
+				m_pRenderer->ImmediateVertex(m_pWeaponTrails[index].m_pTrailPoints[indexToUse1].m_endPoint.x, m_pWeaponTrails[index].m_pTrailPoints[indexToUse1].m_endPoint.y, m_pWeaponTrails[index].m_pTrailPoints[indexToUse1].m_endPoint.z);
+
+				m_pRenderer->ImmediateColourAlpha(m_pWeaponTrails[index].m_trailColour.GetRed(), m_pWeaponTrails[index].m_trailColour.GetGreen(), m_pWeaponTrails[index].m_trailColour.GetBlue(), alpha1);
+				m_pRenderer->ImmediateVertex(m_pWeaponTrails[index].m_pTrailPoints[indexToUse2].m_endPoint.x, m_pWeaponTrails[index].m_pTrailPoints[indexToUse2].m_endPoint.y, m_pWeaponTrails[index].m_pTrailPoints[indexToUse2].m_endPoint.z);
+
+				m_pRenderer->ImmediateColourAlpha(m_pWeaponTrails[index].m_trailColour.GetRed(), m_pWeaponTrails[index].m_trailColour.GetGreen(), m_pWeaponTrails[index].m_trailColour.GetBlue(), alpha1);
+				m_pRenderer->ImmediateVertex(m_pWeaponTrails[index].m_pTrailPoints[indexToUse2].m_startPoint.x, m_pWeaponTrails[index].m_pTrailPoints[indexToUse2].m_startPoint.y, m_pWeaponTrails[index].m_pTrailPoints[indexToUse2].m_startPoint.z);
+			}
+
+			indexToUse1++;
+			if(indexToUse1 >= m_pWeaponTrails[index].m_numTrailPoints)
+			{
+				indexToUse1 = 0;
+			}
+			trailCounter++;
+		}
+	m_pRenderer->DisableImmediateMode();
 }
\ No newline at end of file
@@ -216,6 +216,7 @@ protected:
 
 private:
 	/* Private methods */
+	void RenderWeaponTrail(int index);
 
 public:
 	/* Public members */
@@ -3,6 +3,7 @@
 #include "OBJModel.h"
 #include "MS3DModel.h"
 #include "MS3DAnimator.h"
+#include "MS3DPoseCache.h"
 #include "QubicleBinary.h"
 #include "QubicleBinaryManager.h"
 #include "VoxelCharacter.h"
@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <Mmsystem.h>
 #include <algorithm>
+#include <set>
 
 #pragma comment (lib, "Winmm.lib")
 
@@ -42,127 +43,75 @@ void Interpolator::Destroy()
 {
 	if(c_instance)
 	{
-		ClearInterpolators();
-
 		delete c_instance;
+		c_instance = 0;
 	}
 }
 
 Interpolator::Interpolator()
 {
 	m_paused = false;
+	m_timeOld = -1.0;
+}
+
+Interpolator::~Interpolator()
+{
+	ClearInterpolators();
 }
 
 void Interpolator::ClearInterpolators()
 {
+	// A finished interpolation stays in the list until the next update, while the one chained after it is
+	// already in the create list. So gather everything up first, to only delete each interpolation once.
+
 	// Float
+	std::set<FloatInterpolation*> lFloatInterpolations;
 	for(unsigned int i = 0; i < m_vpFloatInterpolations.size(); i++)
 	{
-		FloatInterpolation* lpNext = m_vpFloatInterpolations[i]->m_pNextInterpolation;
-		while(lpNext != NULL)
+		FloatInterpolation* lpNext = m_vpFloatInterpolations[i];
+		while(lpNext != NULL && lFloatInterpolations.insert(lpNext).second)
 		{
-			FloatInterpolation* lpThisOne = lpNext;
 			lpNext = lpNext->m_pNextInterpolation;
-			
-			if(lpThisOne->m_variable != 0)
-			{
-				delete lpThisOne;
-				lpThisOne->m_variable = 0;
-				lpThisOne->m_pNextInterpolation = 0;
-				lpThisOne = 0;
-			}
-		}
-
-		if(m_vpFloatInterpolations[i]->m_variable != 0)
-		{
-			delete m_vpFloatInterpolations[i];
-			m_vpFloatInterpolations[i]->m_variable = 0;
-			m_vpFloatInterpolations[i]->m_pNextInterpolation = 0;
-			m_vpFloatInterpolations[i] = 0;
 		}
 	}
-	m_vpFloatInterpolations.clear();
-
 	for(unsigned int i = 0; i < m_vpCreateFloatInterpolations.size(); i++)
 	{
-		FloatInterpolation* lpNext = m_vpCreateFloatInterpolations[i]->m_pNextInterpolation;
-		while(lpNext != NULL)
+		FloatInterpolation* lpNext = m_vpCreateFloatInterpolations[i];
+		while(lpNext != NULL && lFloatInterpolations.insert(lpNext).second)
 		{
-			FloatInterpolation* lpThisOne = lpNext;
 			lpNext = lpNext->m_pNextInterpolation;
-
-			if(lpThisOne->m_variable != 0)
-			{
-				delete lpThisOne;
-				lpThisOne->m_variable = 0;
-				lpThisOne->m_pNextInterpolation = 0;
-				lpThisOne = 0;
-			}
-		}
-
-		if(m_vpCreateFloatInterpolations[i]->m_variable != 0)
-		{
-			delete m_vpCreateFloatInterpolations[i];
-			m_vpCreateFloatInterpolations[i]->m_variable = 0;
-			m_vpCreateFloatInterpolations[i]->m_pNextInterpolation = 0;
-			m_vpCreateFloatInterpolations[i] = 0;
 		}
 	}
+	for(std::set<FloatInterpolation*>::iterator iter = lFloatInterpolations.begin(); iter != lFloatInterpolations.end(); ++iter)
+	{
+		delete *iter;
+	}
+	m_vpFloatInterpolations.clear();
 	m_vpCreateFloatInterpolations.clear();
 
 	// Int
+	std::set<IntInterpolation*> lIntInterpolations;
 	for(unsigned int i = 0; i < m_vpIntInterpolations.size(); i++)
 	{
-		IntInterpolation* lpNext = m_vpIntInterpolations[i]->m_pNextInterpolation;
-		while(lpNext != NULL)
+		IntInterpolation* lpNext = m_vpIntInterpolations[i];
+		while(lpNext != NULL && lIntInterpolations.insert(lpNext).second)
 		{
-			IntInterpolation* lpThisOne = lpNext;
 			lpNext = lpNext->m_pNextInterpolation;
-
-			if(lpThisOne->m_variable != 0)
-			{
-				delete lpThisOne;
-				lpThisOne->m_variable = 0;
-				lpThisOne->m_pNextInterpolation = 0;
-				lpThisOne = 0;
-			}
-		}
-
-		if(m_vpIntInterpolations[i]->m_variable != 0)
-		{
-			delete m_vpIntInterpolations[i];
-			m_vpIntInterpolations[i]->m_variable = 0;
-			m_vpIntInterpolations[i]->m_pNextInterpolation = 0;
-			m_vpIntInterpolations[i] = 0;
 		}
 	}
-	m_vpIntInterpolations.clear();
-
 	for(unsigned int i = 0; i < m_vpCreateIntInterpolations.size(); i++)
 	{
-		IntInterpolation* lpNext = m_vpCreateIntInterpolations[i]->m_pNextInterpolation;
-		while(lpNext != NULL)
+		IntInterpolation* lpNext = m_vpCreateIntInterpolations[i];
+		while(lpNext != NULL && lIntInterpolations.insert(lpNext).second)
 		{
-			IntInterpolation* lpThisOne = lpNext;
 			lpNext = lpNext->m_pNextInterpolation;
-
-			if(lpThisOne->m_variable != 0)
-			{
-				delete lpThisOne;
-				lpThisOne->m_variable = 0;
-				lpThisOne->m_pNextInterpolation = 0;
-				lpThisOne = 0;
-			}
-		}
-
-		if(m_vpCreateIntInterpolations[i]->m_variable != 0)
-		{
-			delete m_vpCreateIntInterpolations[i];
-			m_vpCreateIntInterpolations[i]->m_variable = 0;
-			m_vpCreateIntInterpolations[i]->m_pNextInterpolation = 0;
-			m_vpCreateIntInterpolations[i] = 0;
 		}
 	}
+	for(std::set<IntInterpolation*>::iterator iter = lIntInterpolations.begin(); iter != lIntInterpolations.end(); ++iter)
+	{
+		delete *iter;
+	}
+	m_vpIntInterpolations.clear();
 	m_vpCreateIntInterpolations.clear();
 }
 
@@ -380,14 +329,21 @@ void Interpolator::Update()
 {
 	// Update the delta time
 	double timeNow = (double)timeGetTime() / 1000.0;
-	static double timeOld = timeNow - (1.0/50.0);
+	if(m_timeOld < 0.0)
+	{
+		m_timeOld = timeNow - (1.0/50.0);
+	}
 
-	double delta = timeNow - timeOld;
-	timeOld = timeNow;
+	double delta = timeNow - m_timeOld;
+	m_timeOld = timeNow;
 
+	Update((float)delta);
+}
 
-	UpdateFloatInterpolators((float)delta);
-	UpdateIntInterpolators((float)delta);	
+void Interpolator::Update(float dt)
+{
+	UpdateFloatInterpolators(dt);
+	UpdateIntInterpolators(dt);
 }
 
 void Interpolator::UpdateFloatInterpolators(float delta)
@@ -71,9 +71,13 @@ class Interpolator
 {
 public:
 	/* Public methods */
+	// The shared instance is for main thread work, objects that are updated on worker threads should own their own interpolator
 	static Interpolator* GetInstance();
 	void Destroy();
 
+	Interpolator();
+	~Interpolator();
+
 	void ClearInterpolators();
 
 	FloatInterpolation* CreateFloatInterpolation(float *val, float start, float end, float time, float easing, FloatInterpolation* aNext = NULL, FunctionCallback aCallback = NULL, void *aData = NULL);
@@ -92,12 +96,12 @@ public:
 	bool IsPaused();
 
 	void Update();
+	void Update(float dt);
 	void UpdateFloatInterpolators(float delta);
 	void UpdateIntInterpolators(float delta);
 
 protected:
 	/* Protected methods */
-	Interpolator();
 	Interpolator(const Interpolator&);
 	Interpolator &operator=(const Interpolator&);
 
@@ -130,4 +134,7 @@ private:
 
 	// Flag to control if we are paused or not
 	bool m_paused;
+
+	// Last time Update() was called without a delta time
+	double m_timeOld;
 };
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <stdlib.h>
 #include <time.h>
 #include <math.h>
 
@@ -50,4 +51,54 @@ inline float GetRandomNumber(int lower, int higher, int precision)
 	float lRand = (float)GetRandomNumber((int)(lower * lPrecisionPow), (int)(higher * lPrecisionPow));
 
 	return (lRand / lPrecisionPow);
-}
\ No newline at end of file
+}
+
+
+// A random number generator with its own seed, for objects that are updated on worker threads and
+// can't share rand()'s global state. Uses the same generator and range as the MSVC rand().
+class RandomNumberGenerator
+{
+public:
+	RandomNumberGenerator(unsigned int seed = 1)
+	{
+		Seed(seed);
+	}
+
+	void Seed(unsigned int seed)
+	{
+		m_state = seed;
+	}
+
+	// In the range [0, 32767]
+	int GetRandom()
+	{
+		m_state = m_state * 214013u + 2531011u;
+		return (int)((m_state >> 16) & 0x7fff);
+	}
+
+	// Get a random integer number in the range from lower to higher. INCLUSIVE
+	int GetRandomNumber(int lower, int higher)
+	{
+		if(lower > higher)
+		{
+			int temp = lower;
+			lower = higher;
+			higher = temp;
+		}
+		int diff = (higher+1) - lower;
+		return (GetRandom() % diff + lower);
+	}
+
+	// Get a random floating point number in the range from lower to higher. INCLUSIVE
+	// Precision defines how many significant numbers there are after the point
+	float GetRandomNumber(int lower, int higher, int precision)
+	{
+		float lPrecisionPow = pow(10.0f, precision);
+		float lRand = (float)GetRandomNumber((int)(lower * lPrecisionPow), (int)(higher * lPrecisionPow));
+
+		return (lRand / lPrecisionPow);
+	}
+
+private:
+	unsigned int m_state;
+};
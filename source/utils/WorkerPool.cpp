@@ -0,0 +1,198 @@
+// ******************************************************************************
+//
+// Filename:	WorkerPool.cpp
+// Project:		Utils
+// Author:		Steven Ball
+//
+// Purpose:
+//   A fixed pool of worker threads for fanning out independent per-object work,
+//   like updating a crowd of characters. ParallelFor() splits a range of
+//   indices into small batches that the workers and the calling thread pull
+//   from until the range is done, and only returns once every job is finished.
+//
+// Revision History:
+//   Initial Revision - 18/10/26
+//
+// Copyright (c) 2005-2015, Steven Ball
+//
+// ******************************************************************************
+
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+
+// The pools this thread is running jobs for, innermost first. Each RunBatches() links a scope in on its own stack.
+struct WorkerPoolScope
+{
+	WorkerPool* m_pPool;
+	WorkerPoolScope* m_pOuter;
+};
+
+static thread_local WorkerPoolScope* s_pWorkerPoolScope = NULL;
+
+// Whether a job of pPool is somewhere up this thread's stack, either on one of its workers or on its calling thread
+static bool IsRunningJobsFor(WorkerPool* pPool)
+{
+	for(WorkerPoolScope* pScope = s_pWorkerPoolScope; pScope != NULL; pScope = pScope->m_pOuter)
+	{
+		if(pScope->m_pPool == pPool)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+WorkerPool::WorkerPool(int numThreads)
+{
+	if(numThreads <= 0)
+	{
+		numThreads = (int)std::thread::hardware_concurrency();
+	}
+	m_numThreads = std::max(1, numThreads);
+
+	m_shutdown = false;
+	m_generation = 0;
+	m_pJob = NULL;
+	m_count = 0;
+	m_batchSize = 1;
+	m_nextIndex = 0;
+	m_numWorkersBusy = 0;
+
+	// The thread calling ParallelFor() does its share of the work, so it doesn't need a worker of its own
+	for(int i = 0; i < m_numThreads - 1; i++)
+	{
+		m_workerThreads.push_back(std::thread(&WorkerPool::WorkerThread, this));
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_workMutex);
+		m_shutdown = true;
+	}
+	m_workCondition.notify_all();
+
+	for(unsigned int i = 0; i < m_workerThreads.size(); i++)
+	{
+		m_workerThreads[i].join();
+	}
+	m_workerThreads.clear();
+}
+
+int WorkerPool::GetNumThreads()
+{
+	return m_numThreads;
+}
+
+void WorkerPool::ParallelFor(int count, const WorkerPoolJob& job, int batchSize)
+{
+	if(count <= 0)
+	{
+		return;
+	}
+
+	batchSize = std::max(1, batchSize);
+
+	// A job calling back into the pool runs the nested jobs itself. It is never offered the caller lock, this thread
+	// may already be holding it further up the stack.
+	bool nested = IsRunningJobsFor(this);
+
+	// Only one ParallelFor() can have the workers at a time. Another thread calling in runs its jobs on its own thread
+	// rather than waiting for the workers to come free.
+	std::unique_lock<std::mutex> callerLock(m_callerMutex, std::defer_lock);
+	if(nested == false)
+	{
+		callerLock.try_lock();
+	}
+
+	// Not worth waking the workers up for a single batch
+	if(callerLock.owns_lock() == false || m_workerThreads.empty() || count <= batchSize)
+	{
+		for(int i = 0; i < count; i++)
+		{
+			job(i);
+		}
+
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_workMutex);
+
+		m_pJob = &job;
+		m_count = count;
+		m_batchSize = batchSize;
+		m_nextIndex = 0;
+		m_numWorkersBusy = (int)m_workerThreads.size();
+		m_generation++;
+	}
+	m_workCondition.notify_all();
+
+	RunBatches();
+
+	// Every worker checks in for every generation, so nothing can still be running the job after this
+	std::unique_lock<std::mutex> lock(m_workMutex);
+	m_finishedCondition.wait(lock, [this]{ return m_numWorkersBusy == 0; });
+	m_pJob = NULL;
+}
+
+void WorkerPool::WorkerThread()
+{
+	// Not read from m_generation, a worker that is slow to start could miss the first ParallelFor() and never check in
+	unsigned int generation = 0;
+
+	while(true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_workMutex);
+			m_workCondition.wait(lock, [this, generation]{ return m_shutdown || m_generation != generation; });
+
+			if(m_shutdown)
+			{
+				return;
+			}
+
+			generation = m_generation;
+		}
+
+		RunBatches();
+
+		{
+			std::lock_guard<std::mutex> lock(m_workMutex);
+			m_numWorkersBusy--;
+			if(m_numWorkersBusy == 0)
+			{
+				m_finishedCondition.notify_one();
+			}
+		}
+	}
+}
+
+void WorkerPool::RunBatches()
+{
+	WorkerPoolScope scope;
+	scope.m_pPool = this;
+	scope.m_pOuter = s_pWorkerPoolScope;
+	s_pWorkerPoolScope = &scope;
+
+	while(true)
+	{
+		int start = m_nextIndex.fetch_add(m_batchSize);
+		if(start >= m_count)
+		{
+			break;
+		}
+
+		int end = std::min(start + m_batchSize, m_count);
+		for(int i = start; i < end; i++)
+		{
+			(*m_pJob)(i);
+		}
+	}
+
+	s_pWorkerPoolScope = scope.m_pOuter;
+}
@@ -0,0 +1,81 @@
+// ******************************************************************************
+//
+// Filename:	WorkerPool.h
+// Project:		Utils
+// Author:		Steven Ball
+//
+// Purpose:
+//   A fixed pool of worker threads for fanning out independent per-object work,
+//   like updating a crowd of characters. ParallelFor() splits a range of
+//   indices into small batches that the workers and the calling thread pull
+//   from until the range is done, and only returns once every job is finished.
+//
+// Revision History:
+//   Initial Revision - 18/10/26
+//
+// Copyright (c) 2005-2015, Steven Ball
+//
+// ******************************************************************************
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+typedef std::function<void(int index)> WorkerPoolJob;
+
+
+class WorkerPool
+{
+public:
+	/* Public methods */
+	// numThreads includes the calling thread, 0 uses all of the hardware threads
+	WorkerPool(int numThreads = 0);
+	~WorkerPool();
+
+	int GetNumThreads();
+
+	// Runs job(i) for every i in [0, count), each index exactly once. The jobs must not depend on each other.
+	// Safe to call from several threads at once, though only one call at a time gets the workers. A job calling back
+	// into the pool runs the nested jobs on its own thread.
+	void ParallelFor(int count, const WorkerPoolJob& job, int batchSize = 1);
+
+protected:
+	/* Protected methods */
+	WorkerPool(const WorkerPool&);
+	WorkerPool &operator=(const WorkerPool&);
+
+private:
+	/* Private methods */
+	void WorkerThread();
+	void RunBatches();
+
+public:
+	/* Public members */
+
+protected:
+	/* Protected members */
+
+private:
+	/* Private members */
+	int m_numThreads;
+	std::vector<std::thread> m_workerThreads;
+
+	std::mutex m_callerMutex;
+	std::mutex m_workMutex;
+	std::condition_variable m_workCondition;
+	std::condition_variable m_finishedCondition;
+	bool m_shutdown;
+
+	// The current ParallelFor(), the generation is bumped each time so the workers know there is new work
+	unsigned int m_generation;
+	const WorkerPoolJob* m_pJob;
+	int m_count;
+	int m_batchSize;
+	std::atomic<int> m_nextIndex;
+	int m_numWorkersBusy;
+};